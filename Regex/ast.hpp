@@ -5,10 +5,11 @@
 #include <ostream>
 #include <optional>
 #include <utility>
+#include <cstdint>
 
 using namespace std;
 
-enum class TypeKind { Int, Float, Bool, String, Char, Unknown };
+enum class TypeKind : uint8_t { Int, Float, Bool, String, Char, Unknown };
 
 struct Type {
     TypeKind kind = TypeKind::Unknown;
@@ -31,6 +32,7 @@ struct Type {
 };
 
 struct Node {
+    uint32_t nodeId = 0;  // dense, assigned in creation order by Parser
     virtual ~Node() = default;
     virtual void print(ostream& os, int indent = 0) const = 0;
 };
@@ -219,6 +221,7 @@ struct TopVarDecl : Decl {
 
 struct Program : Node {
     vector<DeclPtr> decls;
+    uint32_t nodeCount = 0;
     void print(ostream& os, int i = 0) const override {
         indent(os,i); os<<"Program\n";
         for (auto& d: decls) d->print(os, i+2);
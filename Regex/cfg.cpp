@@ -0,0 +1,227 @@
+#include "cfg.hpp"
+#include <algorithm>
+
+using namespace std;
+
+uint32_t CFG::blockOf(uint32_t instr) const {
+    return (uint32_t)(upper_bound(blockStart.begin(), blockStart.end() - 1, instr) - blockStart.begin()) - 1;
+}
+
+// Turns an edge list into CSR arrays; adjacency keeps insertion order.
+static void fillCSR(uint32_t nodes, const vector<pair<uint32_t, uint32_t>>& edges, bool reversed,
+                    vector<uint32_t>& offset, vector<uint32_t>& targets) {
+    offset.assign(nodes + 1, 0);
+    for (const auto& e : edges) offset[(reversed ? e.second : e.first) + 1]++;
+    for (uint32_t b = 0; b < nodes; ++b) offset[b + 1] += offset[b];
+    targets.resize(edges.size());
+    vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+    for (const auto& e : edges) {
+        if (reversed) targets[fill[e.second]++] = e.first;
+        else targets[fill[e.first]++] = e.second;
+    }
+}
+
+static void splitBlocks(const IRFunction& fn, CFG& cfg) {
+    const auto& code = fn.instructions;
+    cfg.blockStart.clear();
+    cfg.blockStart.push_back(0);
+    for (uint32_t i = 1; i < code.size(); ++i) {
+        bool leader = code[i].op == IROp::Label || isTerminator(code[i - 1].op);
+        if (leader) cfg.blockStart.push_back(i);
+    }
+    cfg.blockStart.push_back((uint32_t)code.size());
+}
+
+static void linkBlocks(const IRFunction& fn, CFG& cfg) {
+    const auto& code = fn.instructions;
+    uint32_t n = cfg.blockCount();
+
+    // Label ids are program-wide but each function uses a compact range.
+    uint32_t minLabel = UINT32_MAX, maxLabel = 0;
+    for (const auto& ins : code) {
+        if (ins.op != IROp::Label) continue;
+        minLabel = min(minLabel, ins.a.index());
+        maxLabel = max(maxLabel, ins.a.index());
+    }
+    cfg.labelBase = minLabel <= maxLabel ? minLabel : 0;
+    cfg.labelBlock.assign(minLabel <= maxLabel ? maxLabel - minLabel + 1 : 0, CFG::none);
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1] && code[i].op == IROp::Label; ++i) {
+            cfg.labelBlock[code[i].a.index() - minLabel] = b;
+        }
+    }
+    auto target = [&](Operand label) { return cfg.blockOfLabel(label); };
+
+    vector<pair<uint32_t, uint32_t>> edges;
+    edges.reserve(n + n / 2);
+    for (uint32_t b = 0; b < n; ++b) {
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        bool fallsThrough = b + 1 < n;
+        if (last > first) {
+            const IRInstr& term = code[last - 1];
+            if (term.op == IROp::Goto) {
+                edges.push_back({b, target(term.a)});
+                fallsThrough = false;
+            } else if (term.op == IROp::IfGoto) {
+                uint32_t taken = target(term.b);
+                edges.push_back({b, taken});
+                if (taken == b + 1) fallsThrough = false;
+            } else if (term.op == IROp::Return || term.op == IROp::ReturnVoid) {
+                fallsThrough = false;
+            }
+        }
+        if (fallsThrough) edges.push_back({b, b + 1});
+    }
+    fillCSR(n, edges, false, cfg.succOffset, cfg.succs);
+    fillCSR(n, edges, true, cfg.predOffset, cfg.preds);
+}
+
+static void computeRPO(CFG& cfg) {
+    uint32_t n = cfg.blockCount();
+    vector<uint32_t> postorder;
+    postorder.reserve(n);
+    vector<uint8_t> visited(n, 0);
+    vector<pair<uint32_t, uint32_t>> stack;  // block, next successor slot
+    stack.push_back({0, cfg.succOffset[0]});
+    visited[0] = 1;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.second < cfg.succOffset[top.first + 1]) {
+            uint32_t s = cfg.succs[top.second++];
+            if (!visited[s]) {
+                visited[s] = 1;
+                stack.push_back({s, cfg.succOffset[s]});
+            }
+        } else {
+            postorder.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    cfg.rpo.assign(postorder.rbegin(), postorder.rend());
+    cfg.rpoIndex.assign(n, CFG::none);
+    for (uint32_t i = 0; i < cfg.rpo.size(); ++i) cfg.rpoIndex[cfg.rpo[i]] = i;
+}
+
+// Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm".
+static void computeDominators(CFG& cfg) {
+    uint32_t n = cfg.blockCount();
+    cfg.idom.assign(n, CFG::none);
+    cfg.idom[0] = 0;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (cfg.rpoIndex[a] > cfg.rpoIndex[b]) a = cfg.idom[a];
+            while (cfg.rpoIndex[b] > cfg.rpoIndex[a]) b = cfg.idom[b];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 1; i < cfg.rpo.size(); ++i) {
+            uint32_t b = cfg.rpo[i];
+            uint32_t newIdom = CFG::none;
+            for (uint32_t p : cfg.predecessors(b)) {
+                if (cfg.idom[p] == CFG::none) continue;
+                newIdom = newIdom == CFG::none ? p : intersect(p, newIdom);
+            }
+            if (cfg.idom[b] != newIdom) {
+                cfg.idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    vector<pair<uint32_t, uint32_t>> treeEdges;
+    treeEdges.reserve(cfg.rpo.size());
+    for (uint32_t b : cfg.rpo) {
+        if (b != 0) treeEdges.push_back({cfg.idom[b], b});
+    }
+    fillCSR(n, treeEdges, false, cfg.domChildOffset, cfg.domChildren);
+
+    cfg.domPre.assign(n, CFG::none);
+    cfg.domPost.assign(n, CFG::none);
+    uint32_t preClock = 0, postClock = 0;
+    vector<pair<uint32_t, uint32_t>> stack;
+    stack.push_back({0, cfg.domChildOffset[0]});
+    cfg.domPre[0] = preClock++;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.second < cfg.domChildOffset[top.first + 1]) {
+            uint32_t c = cfg.domChildren[top.second++];
+            cfg.domPre[c] = preClock++;
+            stack.push_back({c, cfg.domChildOffset[c]});
+        } else {
+            cfg.domPost[top.first] = postClock++;
+            stack.pop_back();
+        }
+    }
+}
+
+CFG buildCFG(const IRFunction& fn) {
+    CFG cfg;
+    splitBlocks(fn, cfg);
+    linkBlocks(fn, cfg);
+    computeRPO(cfg);
+    computeDominators(cfg);
+    return cfg;
+}
+
+vector<NaturalLoop> findLoops(const CFG& cfg) {
+    vector<NaturalLoop> loops;
+    vector<uint32_t> mark(cfg.blockCount(), CFG::none);
+    vector<uint32_t> work;
+    for (uint32_t h : cfg.rpo) {
+        NaturalLoop loop;
+        loop.header = h;
+        for (uint32_t p : cfg.predecessors(h)) {
+            if (cfg.dominates(h, p)) loop.latches.push_back(p);
+        }
+        if (loop.latches.empty()) continue;
+        uint32_t id = (uint32_t)loops.size();
+        mark[h] = id;
+        loop.blocks.push_back(h);
+        for (uint32_t l : loop.latches) {
+            if (mark[l] != id) {
+                mark[l] = id;
+                loop.blocks.push_back(l);
+                work.push_back(l);
+            }
+        }
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t p : cfg.predecessors(b)) {
+                if (mark[p] == id || !cfg.reachable(p)) continue;
+                mark[p] = id;
+                loop.blocks.push_back(p);
+                work.push_back(p);
+            }
+        }
+        loops.push_back(move(loop));
+    }
+    stable_sort(loops.begin(), loops.end(),
+                [](const NaturalLoop& a, const NaturalLoop& b) { return a.blocks.size() < b.blocks.size(); });
+    return loops;
+}
+
+void printCFG(const IRProgram& ir, const IRFunction& fn, const CFG& cfg, ostream& os) {
+    os << "cfg " << fn.name << ": " << cfg.blockCount() << " blocks\n";
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        os << "  B" << b << " [" << cfg.blockStart[b] << ", " << cfg.blockStart[b + 1] << ")";
+        uint32_t first = cfg.blockStart[b];
+        if (first < cfg.blockStart[b + 1] && fn.instructions[first].op == IROp::Label) {
+            os << " ";
+            printOperand(ir, fn, fn.instructions[first].a, os);
+        }
+        if (!cfg.reachable(b)) {
+            os << " unreachable\n";
+            continue;
+        }
+        os << " idom ";
+        if (b == 0) os << "-";
+        else os << "B" << cfg.idom[b];
+        os << " succ";
+        for (uint32_t s : cfg.successors(b)) os << " B" << s;
+        os << "\n";
+    }
+}
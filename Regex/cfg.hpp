@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include "ir.hpp"
+
+using namespace std;
+
+// Basic blocks of one IRFunction. Block b covers instructions
+// [blockStart[b], blockStart[b + 1]); block 0 is the entry. Edges and the
+// dominator tree are stored CSR-style: the successors of b are
+// succs[succOffset[b] .. succOffset[b + 1]).
+struct CFG {
+    static constexpr uint32_t none = UINT32_MAX;
+
+    vector<uint32_t> blockStart;
+    vector<uint32_t> labelBlock;  // label id - labelBase -> block it starts
+    uint32_t labelBase = 0;
+    vector<uint32_t> succOffset, succs;
+    vector<uint32_t> predOffset, preds;
+
+    vector<uint32_t> rpo;       // reachable blocks in reverse postorder
+    vector<uint32_t> rpoIndex;  // block -> position in rpo, none if unreachable
+    vector<uint32_t> idom;      // immediate dominator; entry is its own, none if unreachable
+    vector<uint32_t> domChildOffset, domChildren;
+    vector<uint32_t> domPre, domPost;  // dominator-tree DFS numbering
+
+    uint32_t blockCount() const { return (uint32_t)blockStart.size() - 1; }
+    uint32_t blockOf(uint32_t instr) const;
+    uint32_t blockOfLabel(Operand label) const { return labelBlock[label.index() - labelBase]; }
+    bool reachable(uint32_t b) const { return rpoIndex[b] != none; }
+    bool dominates(uint32_t a, uint32_t b) const {
+        return reachable(a) && reachable(b) && domPre[a] <= domPre[b] && domPost[b] <= domPost[a];
+    }
+
+    struct Range {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        size_t size() const { return last - first; }
+    };
+    Range successors(uint32_t b) const { return {succs.data() + succOffset[b], succs.data() + succOffset[b + 1]}; }
+    Range predecessors(uint32_t b) const { return {preds.data() + predOffset[b], preds.data() + predOffset[b + 1]}; }
+    Range dominatorChildren(uint32_t b) const { return {domChildren.data() + domChildOffset[b], domChildren.data() + domChildOffset[b + 1]}; }
+};
+
+// For a function whose blocks all start with a label, as in SSA form: the
+// label of block b, and whether phis follow it.
+inline Operand blockLabel(const IRFunction& fn, const CFG& cfg, uint32_t b) {
+    return fn.instructions[cfg.blockStart[b]].a;
+}
+
+inline bool hasPhis(const IRFunction& fn, const CFG& cfg, uint32_t b) {
+    uint32_t i = cfg.blockStart[b] + 1;
+    return i < cfg.blockStart[b + 1] && fn.instructions[i].op == IROp::Phi;
+}
+
+// A natural loop: the header and every block that reaches a back edge into it
+// without passing through the header. Loops sharing a header are merged.
+struct NaturalLoop {
+    uint32_t header;
+    vector<uint32_t> blocks;   // header first
+    vector<uint32_t> latches;  // sources of the back edges
+};
+
+CFG buildCFG(const IRFunction& fn);
+// Loops of a reducible region, smallest first, so an inner loop comes
+// before any loop containing it.
+vector<NaturalLoop> findLoops(const CFG& cfg);
+void printCFG(const IRProgram& ir, const IRFunction& fn, const CFG& cfg, ostream& os);
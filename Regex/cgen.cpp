@@ -0,0 +1,472 @@
+#include "cgen.hpp"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include "x86.hpp"
+
+using namespace std;
+
+
+// Helpers every output file carries. An array is a block holding its length
+// and then its elements, each an rt_word; rt_elem grows the block on a store
+// and rt_load reads 0 past its end. Params are staged in rt_words too, so
+// their values are fixed when the Param runs, as in the VM.
+static const char* runtimeText = R"(#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define RT_THREADS 1
+#endif
+
+#define RT_MAX_LENGTH INT64_C(@MAX_LENGTH@)
+#define RT_MAX_DEPTH @MAX_DEPTH@
+
+typedef union { int64_t i; double f; const char* s; } rt_word;
+
+static uint32_t rt_depth;
+
+static inline void rt_fail(const char* what, const char* fn) {
+    fprintf(stderr, "Runtime error: %s in %s\n", what, fn);
+    exit(7);
+}
+
+static inline void rt_index(int64_t index, const char* fn) {
+    if (index < 0) fprintf(stderr, "Runtime error: negative array index %" PRId64 " in %s\n", index, fn);
+    else fprintf(stderr, "Runtime error: array index %" PRId64 " out of range in %s\n", index, fn);
+    exit(7);
+}
+
+static inline rt_word* rt_elem(rt_word** array, int64_t index, const char* fn) {
+    rt_word* block = *array;
+    int64_t length = block ? block[0].i : 0;
+    if (index < 0 || index >= RT_MAX_LENGTH) rt_index(index, fn);
+    if (index >= length) {
+        int64_t grown = length * 2 > index + 1 ? length * 2 : index + 1;
+        if (grown > RT_MAX_LENGTH) grown = RT_MAX_LENGTH;
+        block = (rt_word*)realloc(block, sizeof(rt_word) * (size_t)(grown + 1));
+        if (!block) rt_fail("out of memory", fn);
+        memset(block + 1 + length, 0, sizeof(rt_word) * (size_t)(grown - length));
+        block[0].i = grown;
+        *array = block;
+    }
+    return block + 1 + index;
+}
+
+static inline rt_word rt_load(const rt_word* block, int64_t index, const char* fn) {
+    rt_word zero;
+    if (index < 0 || index >= RT_MAX_LENGTH) rt_index(index, fn);
+    zero.i = 0;
+    return block && index < block[0].i ? block[1 + index] : zero;
+}
+
+static inline int64_t rt_div(int64_t a, int64_t b, const char* fn) {
+    if (b == 0) rt_fail("division by zero", fn);
+    return b == -1 ? (int64_t)(0 - (uint64_t)a) : a / b;
+}
+
+static inline int64_t rt_mod(int64_t a, int64_t b, const char* fn) {
+    if (b == 0) rt_fail("division by zero", fn);
+    return b == -1 ? 0 : a % b;
+}
+
+static inline int64_t rt_shr(int64_t a, int64_t b) {
+    int s = (int)(b & 63);
+    return a < 0 ? ~(~a >> s) : a >> s;
+}
+
+static inline int64_t rt_streq(const char* a, const char* b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+)";
+
+// A C identifier for an IR name, which may carry '.' or '$' from renaming.
+static string identifier(const string& name) {
+    string out = name;
+    for (char& c : out) {
+        if (!isalnum((unsigned char)c) && c != '_') c = '_';
+    }
+    return out;
+}
+
+static const char* cType(Type t) {
+    switch (t.kind) {
+        case TypeKind::Float: return "double";
+        case TypeKind::String: return "const char*";
+        default: return "int64_t";
+    }
+}
+
+// The rt_word member holding a value of type t.
+static const char* member(Type t) {
+    switch (t.kind) {
+        case TypeKind::Float: return "f";
+        case TypeKind::String: return "s";
+        default: return "i";
+    }
+}
+
+static string intLiteral(int64_t v) {
+    if (v == INT64_MIN) return "INT64_MIN";
+    if (v >= INT32_MIN && v <= INT32_MAX) return to_string(v);
+    return "INT64_C(" + to_string(v) + ")";
+}
+
+// A constant expression: hexadecimal, so the value survives exactly.
+static string floatLiteral(double v) {
+    if (isnan(v)) return signbit(v) ? "(-NAN)" : "NAN";
+    if (isinf(v)) return v < 0 ? "(-HUGE_VAL)" : "HUGE_VAL";
+    char text[64];
+    snprintf(text, sizeof text, "%a", v);
+    return v < 0 ? string("(") + text + ")" : text;
+}
+
+static string constant(const IRProgram& ir, uint32_t k) {
+    const IRConst& c = ir.constants[k];
+    if (c.type.kind == TypeKind::String) return "rt_str" + to_string(k);
+    if (isFloat(c.type)) return floatLiteral(c.floatValue);
+    return intLiteral(c.intValue);
+}
+
+static string functionName(const IRFunction& fn) {
+    return "fn_" + identifier(fn.name);
+}
+
+static string globalName(const IRGlobal& g) {
+    return "g_" + identifier(g.name);
+}
+
+namespace {
+
+// Per function: whether it returns a value and of which type, taken from
+// its Return instructions or, for one that never returns, from its callers.
+struct Signature {
+    bool returns = false;
+    Type type;
+};
+
+class FunctionEmitter {
+public:
+    FunctionEmitter(const IRProgram& ir, const vector<Signature>& signatures, uint32_t index, ostream& os)
+        : ir(ir), signatures(signatures), fn(ir.functions[index]), index(index), os(os) {}
+
+    void declare() {
+        os << "static " << returnType(index) << " " << functionName(fn) << "(";
+        for (uint32_t p = 0; p < fn.paramCount; ++p) os << (p ? ", " : "") << cType(fn.vars[p].type) << " " << var(p);
+        os << (fn.paramCount ? "" : "void") << ")";
+    }
+
+    void emit() {
+        if (fn.inSSA) throw runtime_error("cannot emit " + fn.name + " while it is in SSA form");
+        layOut();
+        declare();
+        os << " {\n";
+        for (uint32_t v = fn.paramCount; v < fn.vars.size(); ++v) {
+            if (arrays[v]) os << "    rt_word* " << var(v) << " = 0;\n";
+            else os << "    " << cType(fn.vars[v].type) << " " << var(v) << " = 0;\n";
+        }
+        for (uint32_t t = 0; t < fn.tempCount; ++t) {
+            if (usedTemps[t]) os << "    " << cType(temps[t]) << " t" << t << " = 0;\n";
+        }
+        for (uint32_t p = 0; p < argSlots; ++p) os << "    rt_word p" << p << ";\n";
+        if (hasArrays && signatures[index].returns) os << "    " << returnType(index) << " rt_result = 0;\n";
+        os << "    ++rt_depth;\n";
+        for (at = 0; at < fn.instructions.size(); ++at) instruction(fn.instructions[at]);
+        leave("0");
+        if (hasArrays) {
+            os << "rt_return:\n";
+            for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+                if (arrays[v]) os << "    free(" << var(v) << ");\n";
+            }
+            os << "    --rt_depth;\n"
+               << "    return" << (signatures[index].returns ? " rt_result" : "") << ";\n";
+        }
+        os << "}\n\n";
+    }
+
+private:
+    const IRProgram& ir;
+    const vector<Signature>& signatures;
+    const IRFunction& fn;
+    uint32_t index;
+    ostream& os;
+    vector<Type> temps;       // temp -> type of the instructions that write it
+    vector<uint8_t> usedTemps;  // temp -> named by some instruction
+    vector<uint8_t> arrays;   // local -> used as an array
+    bool hasArrays = false;
+    uint32_t argSlots = 0;    // most params pending at once
+    uint32_t pending = 0;     // params emitted but not yet consumed by a call
+    size_t at = 0;            // instruction being emitted
+
+    void layOut() {
+        temps.assign(fn.tempCount, Type::Int());
+        usedTemps.assign(fn.tempCount, 0);
+        arrays.assign(fn.vars.size(), 0);
+        uint32_t depth = 0;
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::Phi) throw runtime_error("cannot emit " + fn.name + " while it has phis");
+            if (writesDst(ins) && ins.dst.kind() == OperandKind::Temp) temps[ins.dst.index()] = ins.type;
+            for (Operand o : {ins.dst, ins.a, ins.b}) {
+                if (o.kind() == OperandKind::Temp) usedTemps[o.index()] = 1;
+            }
+            if (ins.op == IROp::IndexLoad) arrays[ins.a.index()] = 1;
+            if (ins.op == IROp::IndexStore) arrays[ins.dst.index()] = 1;
+            if (ins.op == IROp::Param) argSlots = max(argSlots, ++depth);
+            if (ins.op == IROp::Call) depth -= ins.b.index();
+        }
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+            if (!arrays[v]) continue;
+            if (v < fn.paramCount) throw runtime_error("array parameter in " + fn.name);
+            hasArrays = true;
+        }
+    }
+
+    string returnType(uint32_t f) const {
+        return signatures[f].returns ? cType(signatures[f].type) : "void";
+    }
+
+    string var(uint32_t v) const {
+        return "l" + to_string(v) + "_" + identifier(fn.vars[v].name);
+    }
+
+    string label(Operand l) const { return "L" + to_string(l.index()); }
+    string name() const { return quoted(fn.name); }
+
+    string value(Operand o) const {
+        switch (o.kind()) {
+            case OperandKind::Temp: return "t" + to_string(o.index());
+            case OperandKind::Local: return var(o.index());
+            case OperandKind::Global: return globalName(ir.globals[o.index()]);
+            case OperandKind::Const: return constant(ir, o.index());
+            default: throw runtime_error("unexpected operand in " + fn.name);
+        }
+    }
+
+    Type typeOf(Operand o) const {
+        switch (o.kind()) {
+            case OperandKind::Temp: return temps[o.index()];
+            case OperandKind::Local: return fn.vars[o.index()].type;
+            case OperandKind::Global: return ir.globals[o.index()].type;
+            case OperandKind::Const: return ir.constants[o.index()].type;
+            default: return Type::Int();
+        }
+    }
+
+    void assign(Operand dst, const string& expr) {
+        os << "    " << value(dst) << " = " << expr << ";\n";
+    }
+
+    // Leaves the function with result, or with nothing if it returns void.
+    void leave(const string& result) {
+        bool returns = signatures[index].returns;
+        if (hasArrays) {
+            if (returns) os << "    rt_result = " << result << ";\n";
+            os << "    goto rt_return;\n";
+            return;
+        }
+        os << "    --rt_depth;\n"
+           << "    return" << (returns ? " " + result : "") << ";\n";
+    }
+
+    string binary(const IRInstr& ins) const {
+        string a = value(ins.a), b = value(ins.b);
+        bool f = isFloat(ins.opType);
+        auto wrap = [&](const char* op) { return "(int64_t)((uint64_t)" + a + " " + op + " (uint64_t)" + b + ")"; };
+        switch (ins.op) {
+            case IROp::Add: return f ? a + " + " + b : wrap("+");
+            case IROp::Sub: return f ? a + " - " + b : wrap("-");
+            case IROp::Mul: return f ? a + " * " + b : wrap("*");
+            case IROp::Div: return f ? a + " / " + b : "rt_div(" + a + ", " + b + ", " + name() + ")";
+            case IROp::Mod: return f ? "fmod(" + a + ", " + b + ")" : "rt_mod(" + a + ", " + b + ", " + name() + ")";
+            case IROp::Shl: return "(int64_t)((uint64_t)" + a + " << (" + b + " & 63))";
+            case IROp::Shr: return "rt_shr(" + a + ", " + b + ")";
+            case IROp::BitAnd: case IROp::And: return a + " & " + b;  // bools are 0 or 1
+            case IROp::BitOr: case IROp::Or: return a + " | " + b;
+            case IROp::BitXor: return a + " ^ " + b;
+            default: break;
+        }
+        if (ins.opType.kind == TypeKind::String && (ins.op == IROp::Eq || ins.op == IROp::Neq)) {
+            return string(ins.op == IROp::Eq ? "" : "!") + "rt_streq(" + a + ", " + b + ")";
+        }
+        const char* op = "==";
+        switch (ins.op) {
+            case IROp::Neq: op = "!="; break;
+            case IROp::Lt: op = "<"; break;
+            case IROp::Le: op = "<="; break;
+            case IROp::Gt: op = ">"; break;
+            case IROp::Ge: op = ">="; break;
+            default: break;
+        }
+        return "(int64_t)(" + a + " " + op + " " + b + ")";
+    }
+
+    string unary(const IRInstr& ins) const {
+        string a = value(ins.a);
+        switch (ins.op) {
+            case IROp::Neg: return isFloat(ins.opType) ? "-" + a : "(int64_t)(0 - (uint64_t)" + a + ")";
+            case IROp::Pos: return a;
+            case IROp::Not: return "(int64_t)!" + a;
+            case IROp::BitNot: return "~" + a;
+            default: return "(double)" + a;
+        }
+    }
+
+    void call(const IRInstr& ins) {
+        uint32_t f = ins.a.index(), argc = ins.b.index();
+        const IRFunction& callee = ir.functions[f];
+        if (argc != callee.paramCount || argc > pending) throw runtime_error("bad call to " + callee.name + " in " + fn.name);
+        uint32_t first = pending - argc;
+        string expr = functionName(callee) + "(";
+        for (uint32_t i = 0; i < argc; ++i) {
+            expr += (i ? ", p" : "p") + to_string(first + i) + "." + member(callee.vars[i].type);
+        }
+        expr += ")";
+        pending = first;
+        // Leaving the depth before the call lets the C compiler turn it
+        // into a jump, and the depth stays where it was either way. The
+        // arguments are already staged, so the arrays can go first.
+        if (isTailCall(fn, at)) {
+            for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+                if (arrays[v]) os << "    free(" << var(v) << ");\n";
+            }
+            os << "    --rt_depth;\n";
+            if (ins.dst.isNone()) os << "    " << expr << ";\n    return;\n";
+            else os << "    return " << expr << ";\n";
+            return;
+        }
+        os << "    if (rt_depth >= RT_MAX_DEPTH) rt_fail(\"" << callStackOverflow << "\", " << name() << ");\n";
+        if (ins.dst.isNone()) os << "    " << expr << ";\n";
+        else assign(ins.dst, expr);
+    }
+
+    void instruction(const IRInstr& ins) {
+        if (isUnaryOp(ins.op)) {
+            assign(ins.dst, unary(ins));
+            return;
+        }
+        if (isBinaryOp(ins.op)) {
+            assign(ins.dst, binary(ins));
+            return;
+        }
+        switch (ins.op) {
+            case IROp::Copy:
+                assign(ins.dst, value(ins.a));
+                break;
+            case IROp::Label:
+                os << label(ins.a) << ":;\n";
+                break;
+            case IROp::Goto:
+                os << "    goto " << label(ins.a) << ";\n";
+                break;
+            case IROp::IfGoto:
+                os << "    if (" << value(ins.a) << ") goto " << label(ins.b) << ";\n";
+                break;
+            case IROp::Param:
+                os << "    p" << pending++ << "." << member(typeOf(ins.a)) << " = " << value(ins.a) << ";\n";
+                break;
+            case IROp::Call:
+                call(ins);
+                break;
+            case IROp::Return:
+                leave(value(ins.a));
+                break;
+            case IROp::ReturnVoid:
+                leave("0");
+                break;
+            case IROp::IndexLoad:
+                assign(ins.dst, "rt_load(" + value(ins.a) + ", " + value(ins.b) + ", " + name() + ")." + member(ins.type));
+                break;
+            case IROp::IndexStore:
+                os << "    rt_elem(&" << value(ins.dst) << ", " << value(ins.a) << ", " << name() << ")->"
+                   << member(typeOf(ins.b)) << " = " << value(ins.b) << ";\n";
+                break;
+            default:
+                throw runtime_error(string("cannot emit ") + irOpName(ins.op) + " in " + fn.name);
+        }
+    }
+};
+
+}  // namespace
+
+static vector<Signature> signatures(const IRProgram& ir) {
+    vector<Signature> out(ir.functions.size());
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        for (const auto& ins : ir.functions[f].instructions) {
+            if (ins.op == IROp::Return) out[f] = {true, ins.type};
+        }
+    }
+    for (const auto& fn : ir.functions) {
+        for (const auto& ins : fn.instructions) {
+            if (ins.op != IROp::Call || ins.dst.isNone()) continue;
+            Signature& s = out[ins.a.index()];
+            if (!s.returns) s = {true, ins.type};
+        }
+    }
+    return out;
+}
+
+static void emitMain(const IRProgram& ir, ostream& os) {
+    const IRFunction* entry = nullptr;
+    for (const auto& fn : ir.functions) {
+        if (fn.name == "main" && fn.paramCount == 0) entry = &fn;
+    }
+    os << "static void* rt_start(void* unused) {\n"
+       << "    (void)unused;\n";
+    if (entry) os << "    " << functionName(*entry) << "();\n";
+    os << "    return 0;\n"
+       << "}\n\n"
+       << "int main(void) {\n"
+       << "#ifdef RT_THREADS\n"
+       << "    pthread_attr_t attr;\n"
+       << "    pthread_t thread;\n"
+       << "    if (pthread_attr_init(&attr) == 0 && pthread_attr_setstacksize(&attr, (size_t)1 << 30) == 0 &&\n"
+       << "        pthread_create(&thread, &attr, rt_start, 0) == 0) {\n"
+       << "        pthread_join(thread, 0);\n"
+       << "    } else {\n"
+       << "        rt_start(0);\n"
+       << "    }\n"
+       << "#else\n"
+       << "    rt_start(0);\n"
+       << "#endif\n";
+    for (const auto& global : ir.globals) {
+        string value = globalName(global), format = global.name + " = ";
+        switch (global.type.kind) {
+            case TypeKind::Float: format += "%g"; break;
+            case TypeKind::Bool: format += "%s", value += " ? \"true\" : \"false\""; break;
+            case TypeKind::String: format += "%s", value += " ? " + value + " : \"\""; break;
+            case TypeKind::Char: format += "'%c'", value = "(char)" + value; break;
+            default: format += "%lld", value = "(long long)" + value; break;
+        }
+        os << "    printf(" << quoted(format + "\n") << ", " << value << ");\n";
+    }
+    os << "    return 0;\n"
+       << "}\n";
+}
+
+void emitC(const IRProgram& ir, ostream& os) {
+    string runtime = runtimeText;
+    runtime.replace(runtime.find("@MAX_LENGTH@"), 12, to_string(maxArrayLength));
+    runtime.replace(runtime.find("@MAX_DEPTH@"), 11, to_string(maxCallDepth));
+    os << runtime;
+
+    for (uint32_t k = 0; k < ir.constants.size(); ++k) {
+        if (ir.constants[k].type.kind == TypeKind::String) os << "static const char rt_str" << k << "[] = " << quoted(ir.constants[k].text) << ";\n";
+    }
+    for (const auto& g : ir.globals) {
+        os << "static " << cType(g.type) << " " << globalName(g) << " = " << (g.init.isNone() ? "0" : constant(ir, g.init.index())) << ";\n";
+    }
+    os << "\n";
+
+    vector<Signature> sigs = signatures(ir);
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        FunctionEmitter(ir, sigs, f, os).declare();
+        os << ";\n";
+    }
+    os << "\n";
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) FunctionEmitter(ir, sigs, f, os).emit();
+    emitMain(ir, os);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <ostream>
+#include "ir.hpp"
+
+using namespace std;
+
+// Portable C99 for an IRProgram that is not in SSA form, to be compiled
+// ahead of time by the host compiler. Each IRFunction becomes one static C
+// function whose locals and temporaries are typed C variables (int64_t for
+// int, bool and char, double for float, const char* for string, a growable
+// block for arrays); labels and gotos are kept as they are in the IR.
+//
+// Like emitX86, the output defines `main`, which runs the program's main on
+// a private 1 GiB stack where threads allow it and then prints the globals
+// the way VM::printGlobals does. Run-time errors print "Runtime error: ..."
+// to stderr and exit with 7, naming the function as emitX86's output does.
+// Build it with the C library and libm:
+//     cc -O2 out.c -o prog -lm -pthread
+// Throws runtime_error on IR it cannot express.
+void emitC(const IRProgram& ir, ostream& os);
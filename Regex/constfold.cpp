@@ -0,0 +1,442 @@
+#include "constfold.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+enum class Lattice : uint8_t { Top, Const, Bottom };
+
+struct Cell {
+    Lattice state = Lattice::Top;
+    uint32_t constant = 0;  // index into IRProgram::constants when state is Const
+};
+
+class ConstantPropagation {
+public:
+    ConstantPropagation(IRProgram& ir, IRFunction& fn);
+    bool run();
+
+private:
+    IRProgram& ir;
+    IRFunction& fn;
+    CFG cfg;
+    vector<uint32_t> instrBlock;
+    vector<uint8_t> ssaLocal;     // locals with exactly one definition
+    vector<Cell> cells;           // temps, then locals
+    vector<uint32_t> useOffset, users;  // value -> instructions reading it, CSR
+    vector<uint8_t> blockExecutable;
+    vector<uint8_t> edgeExecutable;     // parallel to cfg.succs
+    vector<pair<uint32_t, uint32_t>> flowWork;
+    vector<uint32_t> valueWork;
+
+    uint32_t valueId(Operand o) const;
+    uint32_t edgeSlot(uint32_t from, uint32_t to) const;
+    Cell cellOf(Operand o) const;
+    bool sameValue(uint32_t x, uint32_t y) const;
+    Cell meet(Cell x, Cell y) const;
+    void lower(Operand dst, Cell c);
+    void markEdge(uint32_t from, uint32_t to);
+    void enterBlock(uint32_t b);
+    void visit(uint32_t i);
+    void visitPhi(uint32_t i);
+    Cell foldUnary(const IRInstr& ins) const;
+    Cell foldBinary(const IRInstr& ins) const;
+    bool foldInt(IROp op, int64_t a, int64_t b, int64_t& out) const;
+    bool foldFloat(IROp op, double a, double b, double& out, bool& isBool) const;
+    Cell resultCell(Type type, int64_t i, double f) const;
+    void solve();
+    bool rewrite();
+};
+
+ConstantPropagation::ConstantPropagation(IRProgram& ir, IRFunction& fn) : ir(ir), fn(fn), cfg(buildCFG(fn)) {
+    const auto& code = fn.instructions;
+    uint32_t n = cfg.blockCount();
+    instrBlock.resize(code.size());
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) instrBlock[i] = b;
+    }
+    ssaLocal = ssaValueLocals(fn);
+    cells.resize(fn.tempCount + fn.vars.size());
+
+    useOffset.assign(cells.size() + 1, 0);
+    auto countUse = [&](Operand& o) {
+        uint32_t id = valueId(o);
+        if (id != CFG::none) useOffset[id + 1]++;
+    };
+    for (auto& ins : fn.instructions) {
+        if (ins.op == IROp::Phi) {
+            for (uint32_t k = 0; k < ins.b.index(); ++k) countUse(fn.phiArgs[ins.a.index() + k].value);
+        } else {
+            forEachUse(ins, countUse);
+        }
+    }
+    for (size_t v = 0; v < cells.size(); ++v) useOffset[v + 1] += useOffset[v];
+    users.resize(useOffset.back());
+    vector<uint32_t> fill(useOffset.begin(), useOffset.end() - 1);
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        auto addUse = [&](Operand& o) {
+            uint32_t id = valueId(o);
+            if (id != CFG::none) users[fill[id]++] = i;
+        };
+        IRInstr ins = code[i];
+        if (ins.op == IROp::Phi) {
+            for (uint32_t k = 0; k < ins.b.index(); ++k) addUse(fn.phiArgs[ins.a.index() + k].value);
+        } else {
+            forEachUse(ins, addUse);
+        }
+    }
+    blockExecutable.assign(n, 0);
+    edgeExecutable.assign(cfg.succs.size(), 0);
+}
+
+uint32_t ConstantPropagation::valueId(Operand o) const {
+    if (o.kind() == OperandKind::Temp) return o.index();
+    if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return fn.tempCount + o.index();
+    return CFG::none;
+}
+
+uint32_t ConstantPropagation::edgeSlot(uint32_t from, uint32_t to) const {
+    for (uint32_t k = cfg.succOffset[from]; k < cfg.succOffset[from + 1]; ++k) {
+        if (cfg.succs[k] == to) return k;
+    }
+    return CFG::none;
+}
+
+Cell ConstantPropagation::cellOf(Operand o) const {
+    if (o.kind() == OperandKind::Const) return {Lattice::Const, o.index()};
+    uint32_t id = valueId(o);
+    if (id == CFG::none) return {Lattice::Bottom, 0};
+    return cells[id];
+}
+
+bool ConstantPropagation::sameValue(uint32_t x, uint32_t y) const {
+    if (x == y) return true;
+    const IRConst& a = ir.constants[x];
+    const IRConst& b = ir.constants[y];
+    if (a.type.kind != b.type.kind) return false;
+    if (a.type.kind == TypeKind::Float) return a.floatValue == b.floatValue && signbit(a.floatValue) == signbit(b.floatValue);
+    if (a.type.kind == TypeKind::String) return a.text == b.text;
+    return a.intValue == b.intValue;
+}
+
+Cell ConstantPropagation::meet(Cell x, Cell y) const {
+    if (x.state == Lattice::Top) return y;
+    if (y.state == Lattice::Top) return x;
+    if (x.state == Lattice::Bottom || y.state == Lattice::Bottom) return {Lattice::Bottom, 0};
+    if (sameValue(x.constant, y.constant)) return x;
+    return {Lattice::Bottom, 0};
+}
+
+void ConstantPropagation::lower(Operand dst, Cell c) {
+    uint32_t id = valueId(dst);
+    if (id == CFG::none || c.state == Lattice::Top) return;
+    Cell& old = cells[id];
+    if (old.state == Lattice::Bottom) return;
+    if (old.state == Lattice::Const) {
+        if (c.state == Lattice::Const && sameValue(old.constant, c.constant)) return;
+        c = {Lattice::Bottom, 0};
+    }
+    old = c;
+    valueWork.push_back(id);
+}
+
+void ConstantPropagation::markEdge(uint32_t from, uint32_t to) {
+    uint32_t slot = edgeSlot(from, to);
+    if (slot == CFG::none || edgeExecutable[slot]) return;
+    edgeExecutable[slot] = 1;
+    flowWork.push_back({from, to});
+}
+
+void ConstantPropagation::enterBlock(uint32_t b) {
+    blockExecutable[b] = 1;
+    uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+    for (uint32_t i = first; i < last; ++i) visit(i);
+    if (last == first || !isTerminator(fn.instructions[last - 1].op)) {
+        for (uint32_t s : cfg.successors(b)) markEdge(b, s);
+    }
+}
+
+void ConstantPropagation::visitPhi(uint32_t i) {
+    const IRInstr& ins = fn.instructions[i];
+    uint32_t b = instrBlock[i];
+    Cell result;
+    for (uint32_t k = 0; k < ins.b.index() && result.state != Lattice::Bottom; ++k) {
+        const PhiArg& arg = fn.phiArgs[ins.a.index() + k];
+        uint32_t slot = edgeSlot(cfg.blockOfLabel(arg.label), b);
+        if (slot == CFG::none || !edgeExecutable[slot]) continue;
+        result = meet(result, cellOf(arg.value));
+    }
+    lower(ins.dst, result);
+}
+
+void ConstantPropagation::visit(uint32_t i) {
+    const IRInstr& ins = fn.instructions[i];
+    uint32_t b = instrBlock[i];
+    switch (ins.op) {
+        case IROp::Phi:
+            visitPhi(i);
+            break;
+        case IROp::Copy:
+            lower(ins.dst, cellOf(ins.a));
+            break;
+        case IROp::Call:
+        case IROp::IndexLoad:
+            if (!ins.dst.isNone()) lower(ins.dst, {Lattice::Bottom, 0});
+            break;
+        case IROp::Goto:
+            markEdge(b, cfg.blockOfLabel(ins.a));
+            break;
+        case IROp::IfGoto: {
+            Cell cond = cellOf(ins.a);
+            if (cond.state == Lattice::Const) {
+                if (ir.constants[cond.constant].intValue != 0) markEdge(b, cfg.blockOfLabel(ins.b));
+                else markEdge(b, b + 1);
+            } else if (cond.state == Lattice::Bottom) {
+                for (uint32_t s : cfg.successors(b)) markEdge(b, s);
+            }
+            break;
+        }
+        default:
+            if (isUnaryOp(ins.op)) lower(ins.dst, foldUnary(ins));
+            else if (isBinaryOp(ins.op)) lower(ins.dst, foldBinary(ins));
+            break;
+    }
+}
+
+// Folded values are interned only for the types the printer can spell back.
+Cell ConstantPropagation::resultCell(Type type, int64_t i, double f) const {
+    Operand c;
+    switch (type.kind) {
+        case TypeKind::Int: c = ir.intConstant(type, i); break;
+        case TypeKind::Bool: c = ir.intConstant(type, i != 0); break;
+        case TypeKind::Float:
+            if (!isfinite(f)) return {Lattice::Bottom, 0};
+            c = ir.floatConstant(f);
+            break;
+        default: return {Lattice::Bottom, 0};
+    }
+    return {Lattice::Const, c.index()};
+}
+
+Cell ConstantPropagation::foldUnary(const IRInstr& ins) const {
+    Cell x = cellOf(ins.a);
+    if (x.state != Lattice::Const) return x;
+    const IRConst& a = ir.constants[x.constant];
+    bool isFloat = a.type.kind == TypeKind::Float;
+    switch (ins.op) {
+        case IROp::Neg:
+            if (isFloat) return resultCell(ins.type, 0, -a.floatValue);
+            return resultCell(ins.type, (int64_t)(0 - (uint64_t)a.intValue), 0);
+        case IROp::Pos:
+            return x;
+        case IROp::Not:
+            return resultCell(ins.type, a.intValue == 0, 0);
+        case IROp::BitNot:
+            return resultCell(ins.type, ~a.intValue, 0);
+        case IROp::IntToFloat:
+            return resultCell(ins.type, 0, (double)a.intValue);
+        default:
+            return {Lattice::Bottom, 0};
+    }
+}
+
+bool ConstantPropagation::foldInt(IROp op, int64_t a, int64_t b, int64_t& out) const {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    switch (op) {
+        case IROp::Add: out = (int64_t)(ua + ub); return true;
+        case IROp::Sub: out = (int64_t)(ua - ub); return true;
+        case IROp::Mul: out = (int64_t)(ua * ub); return true;
+        case IROp::Div:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            out = a / b;
+            return true;
+        case IROp::Mod:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            out = a % b;
+            return true;
+        case IROp::Shl:
+            if (b < 0 || b > 63) return false;
+            out = (int64_t)(ua << b);
+            return true;
+        case IROp::Shr:
+            if (b < 0 || b > 63) return false;
+            out = a >> b;
+            return true;
+        case IROp::BitAnd: out = a & b; return true;
+        case IROp::BitOr: out = a | b; return true;
+        case IROp::BitXor: out = a ^ b; return true;
+        case IROp::And: out = a != 0 && b != 0; return true;
+        case IROp::Or: out = a != 0 || b != 0; return true;
+        case IROp::Eq: out = a == b; return true;
+        case IROp::Neq: out = a != b; return true;
+        case IROp::Lt: out = a < b; return true;
+        case IROp::Le: out = a <= b; return true;
+        case IROp::Gt: out = a > b; return true;
+        case IROp::Ge: out = a >= b; return true;
+        default: return false;
+    }
+}
+
+bool ConstantPropagation::foldFloat(IROp op, double a, double b, double& out, bool& isBool) const {
+    isBool = true;
+    switch (op) {
+        case IROp::Eq: out = a == b; return true;
+        case IROp::Neq: out = a != b; return true;
+        case IROp::Lt: out = a < b; return true;
+        case IROp::Le: out = a <= b; return true;
+        case IROp::Gt: out = a > b; return true;
+        case IROp::Ge: out = a >= b; return true;
+        default: break;
+    }
+    isBool = false;
+    switch (op) {
+        case IROp::Add: out = a + b; return true;
+        case IROp::Sub: out = a - b; return true;
+        case IROp::Mul: out = a * b; return true;
+        case IROp::Div: out = a / b; return true;
+        case IROp::Mod: out = fmod(a, b); return true;
+        default: return false;
+    }
+}
+
+Cell ConstantPropagation::foldBinary(const IRInstr& ins) const {
+    Cell x = cellOf(ins.a), y = cellOf(ins.b);
+    // A constant false (true) decides And (Or) whatever the other side is.
+    if (ins.op == IROp::And || ins.op == IROp::Or) {
+        bool absorbing = ins.op == IROp::Or;
+        for (Cell c : {x, y}) {
+            if (c.state == Lattice::Const && (ir.constants[c.constant].intValue != 0) == absorbing) {
+                return resultCell(ins.type, absorbing, 0);
+            }
+        }
+    }
+    if (x.state == Lattice::Bottom || y.state == Lattice::Bottom) return {Lattice::Bottom, 0};
+    if (x.state == Lattice::Top || y.state == Lattice::Top) return {Lattice::Top, 0};
+    const IRConst& a = ir.constants[x.constant];
+    const IRConst& b = ir.constants[y.constant];
+    if (ins.opType.kind == TypeKind::String || a.type.kind == TypeKind::String || b.type.kind == TypeKind::String) {
+        return {Lattice::Bottom, 0};
+    }
+    if (ins.opType.kind == TypeKind::Float) {
+        double out;
+        bool isBool;
+        if (!foldFloat(ins.op, a.floatValue, b.floatValue, out, isBool)) return {Lattice::Bottom, 0};
+        if (isBool) return resultCell(ins.type, out != 0, 0);
+        return resultCell(ins.type, 0, out);
+    }
+    int64_t out;
+    if (!foldInt(ins.op, a.intValue, b.intValue, out)) return {Lattice::Bottom, 0};
+    return resultCell(ins.type, out, 0);
+}
+
+void ConstantPropagation::solve() {
+    enterBlock(0);
+    while (!flowWork.empty() || !valueWork.empty()) {
+        while (!flowWork.empty()) {
+            auto edge = flowWork.back();
+            flowWork.pop_back();
+            uint32_t b = edge.second;
+            if (!blockExecutable[b]) {
+                enterBlock(b);
+                continue;
+            }
+            // Another edge into a visited block can only change its phis.
+            for (uint32_t i = cfg.blockStart[b] + 1; i < cfg.blockStart[b + 1] && fn.instructions[i].op == IROp::Phi; ++i) {
+                visitPhi(i);
+            }
+        }
+        while (!valueWork.empty()) {
+            uint32_t v = valueWork.back();
+            valueWork.pop_back();
+            for (uint32_t k = useOffset[v]; k < useOffset[v + 1]; ++k) {
+                if (blockExecutable[instrBlock[users[k]]]) visit(users[k]);
+            }
+        }
+    }
+}
+
+bool ConstantPropagation::rewrite() {
+    const auto& code = fn.instructions;
+    bool changed = false;
+    vector<IRInstr> out;
+    vector<PhiArg> phiArgs;
+    out.reserve(code.size());
+    phiArgs.reserve(fn.phiArgs.size());
+    auto substitute = [&](Operand& o) {
+        Cell c = cellOf(o);
+        if (c.state == Lattice::Const && o.kind() != OperandKind::Const) {
+            o = Operand::constant(c.constant);
+            changed = true;
+        }
+    };
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        if (!blockExecutable[b]) {
+            changed = true;
+            continue;
+        }
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            IRInstr ins = code[i];
+            if (writesDst(ins) && ins.op != IROp::Call && cellOf(ins.dst).state == Lattice::Const) {
+                changed = true;
+                continue;
+            }
+            if (ins.op == IROp::Phi) {
+                uint32_t first = (uint32_t)phiArgs.size();
+                for (uint32_t k = 0; k < ins.b.index(); ++k) {
+                    PhiArg arg = fn.phiArgs[ins.a.index() + k];
+                    uint32_t slot = edgeSlot(cfg.blockOfLabel(arg.label), b);
+                    if (slot == CFG::none || !edgeExecutable[slot]) {
+                        changed = true;
+                        continue;
+                    }
+                    substitute(arg.value);
+                    phiArgs.push_back(arg);
+                }
+                uint32_t count = (uint32_t)phiArgs.size() - first;
+                if (count == 1) {
+                    // Every phi of this block lost the same edges, so they all
+                    // turn into copies and none is left behind a copy.
+                    ins.op = IROp::Copy;
+                    ins.a = phiArgs.back().value;
+                    ins.b = Operand::none();
+                    phiArgs.pop_back();
+                } else {
+                    ins.a = Operand::imm(first);
+                    ins.b = Operand::imm(count);
+                }
+                out.push_back(ins);
+                continue;
+            }
+            forEachUse(ins, substitute);
+            if (ins.op == IROp::IfGoto && ins.a.kind() == OperandKind::Const) {
+                changed = true;
+                if (ir.constants[ins.a.index()].intValue == 0) continue;
+                ins.op = IROp::Goto;
+                ins.a = ins.b;
+                ins.b = Operand::none();
+            }
+            out.push_back(ins);
+        }
+    }
+    fn.instructions.swap(out);
+    fn.phiArgs.swap(phiArgs);
+    return changed;
+}
+
+bool ConstantPropagation::run() {
+    if (fn.instructions.empty()) return false;
+    solve();
+    return rewrite();
+}
+
+}  // namespace
+
+bool propagateConstants(IRProgram& ir, IRFunction& fn) {
+    if (!fn.inSSA) return false;
+    ConstantPropagation pass(ir, fn);
+    return pass.run();
+}
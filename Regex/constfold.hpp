@@ -0,0 +1,13 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Sparse conditional constant propagation (Wegman & Zadeck) over a function
+// in SSA form. Values proven constant are substituted into their uses and
+// their definitions dropped; branches on constant conditions become jumps or
+// fall-throughs and the blocks no executable edge reaches are removed.
+// Integer arithmetic wraps at 64 bits. Division or modulo by zero, INT64_MIN
+// divided by -1, shifts outside [0, 63] and floating results that are not
+// finite are left for run time. Returns true if fn changed.
+bool propagateConstants(IRProgram& ir, IRFunction& fn);
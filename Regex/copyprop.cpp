@@ -0,0 +1,146 @@
+#include "copyprop.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+
+using namespace std;
+
+bool propagateCopies(IRProgram&, IRFunction& fn) {
+    if (!fn.inSSA) return false;
+    auto& code = fn.instructions;
+    vector<uint8_t> ssaLocal = ssaValueLocals(fn);
+    vector<uint8_t> assigned(fn.vars.size(), 0), arrayBase(fn.vars.size(), 0);
+    for (const auto& ins : code) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) assigned[ins.dst.index()] = 1;
+        if (ins.op == IROp::IndexStore && ins.dst.kind() == OperandKind::Local) arrayBase[ins.dst.index()] = 1;
+        if (ins.op == IROp::IndexLoad && ins.a.kind() == OperandKind::Local) arrayBase[ins.a.index()] = 1;
+    }
+    auto valueId = [&](Operand o) -> uint32_t {
+        if (o.kind() == OperandKind::Temp) return o.index();
+        if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return fn.tempCount + o.index();
+        return CFG::none;
+    };
+    auto stable = [&](Operand o) {
+        switch (o.kind()) {
+            case OperandKind::Const: case OperandKind::Temp: return true;
+            case OperandKind::Local: return ssaLocal[o.index()] || (!assigned[o.index()] && !arrayBase[o.index()]);
+            default: return false;
+        }
+    };
+
+    vector<Operand> replacement(fn.tempCount + fn.vars.size(), Operand::none());
+    auto resolve = [&](Operand o) {
+        for (uint32_t id = valueId(o); id != CFG::none && !replacement[id].isNone(); id = valueId(o)) {
+            o = replacement[id];
+        }
+        return o;
+    };
+
+    // Removing one trivial phi can make another trivial, so repeat until
+    // nothing new is found.
+    bool found = true, changed = false;
+    while (found) {
+        found = false;
+        for (const auto& ins : code) {
+            uint32_t id = writesDst(ins) ? valueId(ins.dst) : CFG::none;
+            if (id == CFG::none || !replacement[id].isNone()) continue;
+            Operand source = Operand::none();
+            if (ins.op == IROp::Copy) {
+                source = resolve(ins.a);
+            } else if (ins.op == IROp::Phi) {
+                for (uint32_t k = 0; k < ins.b.index(); ++k) {
+                    Operand arg = resolve(fn.phiArgs[ins.a.index() + k].value);
+                    if (arg == ins.dst || arg == source) continue;
+                    if (!source.isNone()) {
+                        source = Operand::none();
+                        break;
+                    }
+                    source = arg;
+                }
+            }
+            if (source.isNone() || source == ins.dst || !stable(source)) continue;
+            replacement[id] = source;
+            found = changed = true;
+        }
+    }
+    if (!changed) return false;
+
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (auto ins : code) {
+        uint32_t id = writesDst(ins) ? valueId(ins.dst) : CFG::none;
+        if (id != CFG::none && !replacement[id].isNone()) continue;
+        if (ins.op == IROp::Phi) {
+            for (uint32_t k = 0; k < ins.b.index(); ++k) {
+                Operand& value = fn.phiArgs[ins.a.index() + k].value;
+                value = resolve(value);
+            }
+        } else {
+            forEachUse(ins, [&](Operand& o) { o = resolve(o); });
+        }
+        out.push_back(ins);
+    }
+    code.swap(out);
+    return true;
+}
+
+static bool endsBlock(IROp op) {
+    return op == IROp::Label || op == IROp::Goto || op == IROp::IfGoto || op == IROp::Return || op == IROp::ReturnVoid;
+}
+
+// How far back from a copy the defining instruction is looked for; generated
+// code keeps the two adjacent or nearly so.
+static const uint32_t coalesceWindow = 32;
+
+bool coalesceTemps(IRFunction& fn) {
+    if (fn.inSSA) return false;
+    auto& code = fn.instructions;
+    vector<uint32_t> defs(fn.tempCount, 0), uses(fn.tempCount, 0);
+    for (auto& ins : code) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Temp) defs[ins.dst.index()]++;
+        forEachUse(ins, [&](Operand& o) {
+            if (o.kind() == OperandKind::Temp) uses[o.index()]++;
+        });
+    }
+
+    vector<uint8_t> removed(code.size(), 0);
+    bool changed = false;
+    uint32_t blockStart = 0;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (endsBlock(code[i].op)) {
+            blockStart = i + 1;
+            continue;
+        }
+        IRInstr& copy = code[i];
+        if (copy.op != IROp::Copy || copy.a.kind() != OperandKind::Temp) continue;
+        uint32_t t = copy.a.index();
+        if (defs[t] != 1 || uses[t] != 1) continue;
+        Operand target = copy.dst;
+        uint32_t low = i - blockStart > coalesceWindow ? i - coalesceWindow : blockStart;
+        uint32_t d = i;
+        bool clobbered = false;
+        while (d > low && !clobbered) {
+            --d;
+            if (removed[d]) continue;
+            const IRInstr& ins = code[d];
+            if (writesDst(ins) && ins.dst == copy.a) break;
+            bool touches = ins.dst == target;  // a write, or an IndexStore base
+            IRInstr probe = ins;
+            forEachUse(probe, [&](Operand& o) { touches |= o == target; });
+            // A callee may read or write any global.
+            clobbered = touches || (ins.op == IROp::Call && target.kind() == OperandKind::Global);
+        }
+        IRInstr& def = code[d];
+        if (clobbered || d == i || !writesDst(def) || def.dst != copy.a || def.type.kind != copy.type.kind) continue;
+        def.dst = target;
+        removed[i] = 1;
+        changed = true;
+    }
+    if (!changed) return false;
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (!removed[i]) out.push_back(code[i]);
+    }
+    code.swap(out);
+    return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Copy propagation over a function in SSA form. A copy "x = y" (and a phi
+// whose arguments are all y or x itself) makes x another name for y, as long
+// as y cannot change: a constant, a temp, an SSA local or a scalar local that
+// is never assigned. Uses of x are rewritten to y and the copy is removed.
+// Returns true if fn changed.
+bool propagateCopies(IRProgram& ir, IRFunction& fn);
+
+// Out of SSA: folds "%t = <expr>; ...; v = %t" into "v = <expr>" when the
+// temp has no other use and v is not touched in between. Returns true if fn
+// changed.
+bool coalesceTemps(IRFunction& fn);
@@ -0,0 +1,257 @@
+#include "dce.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include <algorithm>
+
+using namespace std;
+
+bool eliminateDeadCode(IRProgram& ir, IRFunction& fn) {
+    if (!fn.inSSA) return false;
+    const auto& code = fn.instructions;
+    vector<uint8_t> ssaLocal = ssaValueLocals(fn);
+    auto valueId = [&](Operand o) -> uint32_t {
+        if (o.kind() == OperandKind::Temp) return o.index();
+        if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return fn.tempCount + o.index();
+        return CFG::none;
+    };
+
+    vector<uint32_t> defOf(fn.tempCount + fn.vars.size(), CFG::none);
+    vector<uint8_t> live(code.size(), 0);
+    vector<uint32_t> work;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const IRInstr& ins = code[i];
+        uint32_t id = writesDst(ins) ? valueId(ins.dst) : CFG::none;
+        if (id != CFG::none) defOf[id] = i;
+        if (hasSideEffects(ir, ins) || (writesDst(ins) && id == CFG::none)) {
+            live[i] = 1;
+            work.push_back(i);
+        }
+    }
+    auto markDef = [&](Operand& o) {
+        uint32_t id = valueId(o);
+        if (id == CFG::none || defOf[id] == CFG::none || live[defOf[id]]) return;
+        live[defOf[id]] = 1;
+        work.push_back(defOf[id]);
+    };
+    while (!work.empty()) {
+        IRInstr ins = code[work.back()];
+        work.pop_back();
+        if (ins.op == IROp::Phi) {
+            for (uint32_t k = 0; k < ins.b.index(); ++k) markDef(fn.phiArgs[ins.a.index() + k].value);
+        } else {
+            forEachUse(ins, markDef);
+        }
+    }
+
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (live[i]) out.push_back(code[i]);
+    }
+    if (out.size() == code.size()) return false;
+    fn.instructions.swap(out);
+    return true;
+}
+
+// Rewrites the phis of fn keeping only the arguments keep(label) accepts,
+// with labels passed through rename. A phi left with one argument becomes a
+// copy; all phis of a block lose the same edges, so copies never precede phis.
+template <class Keep, class Rename>
+static void rebuildPhis(IRFunction& fn, Keep keep, Rename rename) {
+    vector<PhiArg> phiArgs;
+    phiArgs.reserve(fn.phiArgs.size());
+    for (auto& ins : fn.instructions) {
+        if (ins.op != IROp::Phi) continue;
+        uint32_t first = (uint32_t)phiArgs.size();
+        for (uint32_t k = 0; k < ins.b.index(); ++k) {
+            PhiArg arg = fn.phiArgs[ins.a.index() + k];
+            if (!keep(arg.label)) continue;
+            arg.label = rename(arg.label);
+            phiArgs.push_back(arg);
+        }
+        uint32_t count = (uint32_t)phiArgs.size() - first;
+        if (count == 1) {
+            ins.op = IROp::Copy;
+            ins.a = phiArgs.back().value;
+            ins.b = Operand::none();
+            phiArgs.pop_back();
+        } else {
+            ins.a = Operand::imm(first);
+            ins.b = Operand::imm(count);
+        }
+    }
+    fn.phiArgs.swap(phiArgs);
+}
+
+static bool removeUnreachableBlocks(IRFunction& fn) {
+    CFG cfg = buildCFG(fn);
+    if (cfg.rpo.size() == cfg.blockCount()) return false;
+    vector<IRInstr> out;
+    out.reserve(fn.instructions.size());
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        if (!cfg.reachable(b)) continue;
+        out.insert(out.end(), fn.instructions.begin() + cfg.blockStart[b], fn.instructions.begin() + cfg.blockStart[b + 1]);
+    }
+    fn.instructions.swap(out);
+    rebuildPhis(fn, [&](Operand label) { return cfg.reachable(cfg.blockOfLabel(label)); },
+                [](Operand label) { return label; });
+    return true;
+}
+
+// A block that is just "label: goto M" can be jumped over when M has no phis
+// (the jumping block would need arguments of its own there).
+static bool threadJumps(IRFunction& fn) {
+    CFG cfg = buildCFG(fn);
+    auto& code = fn.instructions;
+    auto forwardsTo = [&](uint32_t b) -> uint32_t {
+        uint32_t first = cfg.blockStart[b];
+        if (cfg.blockStart[b + 1] - first != 2 || code[first + 1].op != IROp::Goto) return CFG::none;
+        uint32_t m = cfg.blockOfLabel(code[first + 1].a);
+        return m == b || hasPhis(fn, cfg, m) ? CFG::none : m;
+    };
+    bool changed = false;
+    for (auto& ins : code) {
+        Operand* target = ins.op == IROp::Goto ? &ins.a : ins.op == IROp::IfGoto ? &ins.b : nullptr;
+        if (!target) continue;
+        uint32_t b = cfg.blockOfLabel(*target);
+        // Bounded so a cycle of empty blocks cannot hang the walk.
+        for (int hops = 0; hops < 8; ++hops) {
+            uint32_t m = forwardsTo(b);
+            if (m == CFG::none) break;
+            b = m;
+        }
+        if (blockLabel(fn, cfg, b) != *target) {
+            *target = blockLabel(fn, cfg, b);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool removeJumpsToNext(IRFunction& fn) {
+    CFG cfg = buildCFG(fn);
+    const auto& code = fn.instructions;
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    bool changed = false;
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        out.insert(out.end(), code.begin() + first, code.begin() + last);
+        const IRInstr& term = code[last - 1];
+        if (b + 1 == cfg.blockCount()) continue;
+        Operand next = blockLabel(fn, cfg, b + 1);
+        if ((term.op == IROp::Goto && term.a == next) || (term.op == IROp::IfGoto && term.b == next)) {
+            out.pop_back();
+            changed = true;
+        }
+    }
+    if (changed) fn.instructions.swap(out);
+    return changed;
+}
+
+static bool mergeStraightLineBlocks(IRFunction& fn) {
+    CFG cfg = buildCFG(fn);
+    const auto& code = fn.instructions;
+    vector<uint32_t> into(cfg.blockCount());  // block -> block it was merged into
+    vector<Operand> labels(cfg.blockCount());
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) labels[b] = blockLabel(fn, cfg, b);
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    bool changed = false;
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        into[b] = b;
+        if (b > 0 && cfg.predecessors(b).size() == 1 && *cfg.predecessors(b).begin() == b - 1 &&
+            cfg.successors(b - 1).size() == 1 && !isTerminator(code[cfg.blockStart[b] - 1].op)) {
+            into[b] = into[b - 1];
+            first++;  // drop the label; the block's phis have one argument and become copies below
+            changed = true;
+        }
+        out.insert(out.end(), code.begin() + first, code.begin() + last);
+    }
+    if (!changed) return false;
+    fn.instructions.swap(out);
+    rebuildPhis(fn, [](Operand) { return true; },
+                [&](Operand label) { return labels[into[cfg.blockOfLabel(label)]]; });
+    return true;
+}
+
+bool simplifyControlFlow(IRProgram&, IRFunction& fn) {
+    if (!fn.inSSA || fn.instructions.empty()) return false;
+    bool changed = removeUnreachableBlocks(fn);
+    changed |= threadJumps(fn);
+    changed |= removeUnreachableBlocks(fn);
+    changed |= removeJumpsToNext(fn);
+    changed |= mergeStraightLineBlocks(fn);
+    return changed;
+}
+
+void tidyFunction(IRFunction& fn) {
+    if (fn.inSSA) return;
+    auto& code = fn.instructions;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        vector<uint8_t> referenced;
+        auto reference = [&](Operand label) {
+            if (referenced.size() <= label.index()) referenced.resize(label.index() + 1, 0);
+            referenced[label.index()] = 1;
+        };
+        for (const auto& ins : code) {
+            if (ins.op == IROp::Goto) reference(ins.a);
+            else if (ins.op == IROp::IfGoto) reference(ins.b);
+        }
+        vector<IRInstr> out;
+        out.reserve(code.size());
+        bool afterJump = false;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const IRInstr& ins = code[i];
+            if (ins.op == IROp::Label) {
+                if (ins.a.index() >= referenced.size() || !referenced[ins.a.index()]) {
+                    changed = true;
+                    continue;
+                }
+                afterJump = false;
+            } else if (afterJump) {
+                changed = true;  // no label in between, so nothing reaches it
+                continue;
+            }
+            if (ins.op == IROp::Goto || ins.op == IROp::IfGoto) {
+                Operand target = ins.op == IROp::Goto ? ins.a : ins.b;
+                uint32_t j = i + 1;
+                while (j < code.size() && code[j].op == IROp::Label && code[j].a != target) ++j;
+                if (j < code.size() && code[j].op == IROp::Label) {
+                    changed = true;
+                    continue;
+                }
+            }
+            afterJump = ins.op == IROp::Goto || ins.op == IROp::Return || ins.op == IROp::ReturnVoid;
+            out.push_back(ins);
+        }
+        code.swap(out);
+    }
+
+    vector<uint32_t> slot(fn.vars.size(), CFG::none);
+    for (uint32_t v = 0; v < fn.paramCount; ++v) slot[v] = 0;
+    for (const auto& ins : code) {
+        for (Operand o : {ins.dst, ins.a, ins.b}) {
+            if (o.kind() == OperandKind::Local) slot[o.index()] = 0;
+        }
+    }
+    vector<IRVar> vars;
+    for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+        if (slot[v] == CFG::none) continue;
+        slot[v] = (uint32_t)vars.size();
+        vars.push_back(move(fn.vars[v]));
+    }
+    if (vars.size() == fn.vars.size()) {
+        fn.vars.swap(vars);
+        return;
+    }
+    for (auto& ins : code) {
+        for (Operand* o : {&ins.dst, &ins.a, &ins.b}) {
+            if (o->kind() == OperandKind::Local) *o = Operand::local(slot[o->index()]);
+        }
+    }
+    fn.vars.swap(vars);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Mark-and-sweep over a function in SSA form. Instructions with side effects
+// (see hasSideEffects) and writes to locals that are not SSA values are live;
+// so is every definition a live instruction reads. Everything else, phis
+// included, is removed. Returns true if fn changed.
+bool eliminateDeadCode(IRProgram& ir, IRFunction& fn);
+
+// Control-flow cleanup on a function in SSA form: removes unreachable blocks,
+// retargets jumps to blocks that only jump on, drops jumps to the next block
+// and merges a block into its only predecessor when that predecessor falls
+// straight into it. Returns true if fn changed.
+bool simplifyControlFlow(IRProgram& ir, IRFunction& fn);
+
+// Out of SSA: drops jumps to the next instruction, labels nothing jumps to
+// and locals nothing references (params are kept), renumbering the rest.
+void tidyFunction(IRFunction& fn);
@@ -0,0 +1,164 @@
+#include "gvn.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+struct ValueKey {
+    IROp op;
+    TypeKind type;
+    TypeKind opType;
+    uint32_t a, b;
+    uint32_t memory;  // load generation, 0 for pure operations
+
+    bool operator==(const ValueKey& o) const {
+        return op == o.op && type == o.type && opType == o.opType && a == o.a && b == o.b && memory == o.memory;
+    }
+};
+
+struct ValueKeyHash {
+    size_t operator()(const ValueKey& k) const {
+        uint64_t h = ((uint64_t)k.op << 16) ^ ((uint64_t)k.type << 8) ^ (uint64_t)k.opType;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.a;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.b;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.memory;
+        return (size_t)(h ^ (h >> 29));
+    }
+};
+
+bool isCommutative(IROp op) {
+    switch (op) {
+        case IROp::Add: case IROp::Mul: case IROp::BitAnd: case IROp::BitOr: case IROp::BitXor:
+        case IROp::And: case IROp::Or: case IROp::Eq: case IROp::Neq:
+            return true;
+        default:
+            return false;
+    }
+}
+
+}  // namespace
+
+static bool numberValues(IRFunction& fn, bool global) {
+    if (!fn.inSSA || fn.instructions.empty()) return false;
+    auto& code = fn.instructions;
+    CFG cfg = buildCFG(fn);
+    vector<uint8_t> ssaLocal = ssaValueLocals(fn);
+    auto valueId = [&](Operand o) -> uint32_t {
+        if (o.kind() == OperandKind::Temp) return o.index();
+        if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return fn.tempCount + o.index();
+        return CFG::none;
+    };
+    // Globals and locals assigned more than once can change between two
+    // evaluations, so operations reading them are not numbered.
+    vector<uint8_t> assigned(fn.vars.size(), 0);
+    for (const auto& ins : code) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) assigned[ins.dst.index()] = 1;
+    }
+    auto stable = [&](Operand o) {
+        switch (o.kind()) {
+            case OperandKind::None: case OperandKind::Const: case OperandKind::Temp: return true;
+            case OperandKind::Local: return ssaLocal[o.index()] || !assigned[o.index()];
+            default: return false;
+        }
+    };
+    vector<Operand> replacement(fn.tempCount + fn.vars.size(), Operand::none());
+    auto resolve = [&](Operand o) {
+        uint32_t id = valueId(o);
+        return id != CFG::none && !replacement[id].isNone() ? replacement[id] : o;
+    };
+
+    unordered_map<ValueKey, Operand, ValueKeyHash> table;
+    vector<ValueKey> undo;  // keys added, popped when leaving a dominator subtree
+    vector<uint32_t> blockMemory(cfg.blockCount(), 0);
+    uint32_t nextMemory = 1;
+    bool changed = false;
+
+    auto visitBlock = [&](uint32_t b) {
+        uint32_t memory = nextMemory++;
+        auto preds = cfg.predecessors(b);
+        if (global && b != 0 && preds.size() == 1 && *preds.begin() == cfg.idom[b]) memory = blockMemory[cfg.idom[b]];
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            IRInstr& ins = code[i];
+            if (ins.op == IROp::Phi) continue;
+            forEachUse(ins, [&](Operand& o) { o = resolve(o); });
+            if (ins.op == IROp::IndexStore || ins.op == IROp::Call) {
+                memory = nextMemory++;
+                continue;
+            }
+            bool numbered = isUnaryOp(ins.op) || isBinaryOp(ins.op) || ins.op == IROp::IndexLoad;
+            if (!numbered || valueId(ins.dst) == CFG::none) continue;
+            if (ins.op != IROp::IndexLoad && (!stable(ins.a) || !stable(ins.b))) continue;
+            if (ins.op == IROp::IndexLoad && !stable(ins.b)) continue;
+            ValueKey key{ins.op, ins.type.kind, ins.opType.kind, ins.a.bits, ins.b.bits,
+                         ins.op == IROp::IndexLoad ? memory : 0};
+            if (isCommutative(ins.op) && key.a > key.b) swap(key.a, key.b);
+            auto found = table.find(key);
+            if (found != table.end()) {
+                replacement[valueId(ins.dst)] = found->second;
+                changed = true;
+                continue;
+            }
+            table.emplace(key, ins.dst);
+            undo.push_back(key);
+        }
+        blockMemory[b] = memory;
+    };
+
+    if (global) {
+        // Iterative dominator-tree walk; each frame remembers how much of the
+        // undo log belongs to its parent.
+        vector<pair<uint32_t, size_t>> stack;  // block, undo size on entry
+        vector<uint32_t> nextChild(cfg.blockCount());
+        stack.push_back({0, 0});
+        nextChild[0] = cfg.domChildOffset[0];
+        visitBlock(0);
+        while (!stack.empty()) {
+            uint32_t b = stack.back().first;
+            if (nextChild[b] < cfg.domChildOffset[b + 1]) {
+                uint32_t c = cfg.domChildren[nextChild[b]++];
+                stack.push_back({c, undo.size()});
+                nextChild[c] = cfg.domChildOffset[c];
+                visitBlock(c);
+                continue;
+            }
+            for (size_t mark = stack.back().second; undo.size() > mark; undo.pop_back()) table.erase(undo.back());
+            stack.pop_back();
+        }
+    } else {
+        for (uint32_t b : cfg.rpo) {
+            visitBlock(b);
+            table.clear();
+            undo.clear();
+        }
+    }
+    if (!changed) return false;
+
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (auto ins : code) {
+        uint32_t id = writesDst(ins) ? valueId(ins.dst) : CFG::none;
+        if (id != CFG::none && !replacement[id].isNone()) continue;
+        if (ins.op == IROp::Phi) {
+            for (uint32_t k = 0; k < ins.b.index(); ++k) {
+                Operand& value = fn.phiArgs[ins.a.index() + k].value;
+                value = resolve(value);
+            }
+        } else {
+            forEachUse(ins, [&](Operand& o) { o = resolve(o); });
+        }
+        out.push_back(ins);
+    }
+    code.swap(out);
+    return true;
+}
+
+bool numberValuesLocal(IRProgram&, IRFunction& fn) {
+    return numberValues(fn, false);
+}
+
+bool numberValuesGlobal(IRProgram&, IRFunction& fn) {
+    return numberValues(fn, true);
+}
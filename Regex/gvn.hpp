@@ -0,0 +1,17 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Hash-based value numbering over a function in SSA form. An unary, binary
+// or IndexLoad instruction computing the same operation on the same operands
+// as an earlier one is removed and its uses read the earlier result.
+// Commutative operands are ordered, so a*b matches b*a.
+//
+// numberValuesLocal matches within a basic block. numberValuesGlobal scopes
+// the table along the dominator tree, so any dominating computation is
+// reused. Loads are kept conservative: an IndexStore or Call ends every
+// earlier load, and a load only carries into a block entered solely from its
+// immediate dominator. Both return true if fn changed.
+bool numberValuesLocal(IRProgram& ir, IRFunction& fn);
+bool numberValuesGlobal(IRProgram& ir, IRFunction& fn);
@@ -0,0 +1,317 @@
+#include "inline.hpp"
+#include "cfg.hpp"
+#include "opt.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+bool CallGraph::recursive(uint32_t f) const {
+    return sccs[sccOf[f]].size() > 1 || find(callees[f].begin(), callees[f].end(), f) != callees[f].end();
+}
+
+// Tarjan's algorithm, with an explicit stack; it finishes a component only
+// after every component it reaches, which puts callees first.
+CallGraph buildCallGraph(const IRProgram& ir) {
+    const uint32_t none = UINT32_MAX;
+    uint32_t n = (uint32_t)ir.functions.size();
+    CallGraph g;
+    g.callees.resize(n);
+    vector<uint32_t> seen(n, none);
+    for (uint32_t f = 0; f < n; ++f) {
+        for (const auto& ins : ir.functions[f].instructions) {
+            if (ins.op != IROp::Call) continue;
+            uint32_t callee = ins.a.index();
+            if (seen[callee] == f) continue;
+            seen[callee] = f;
+            g.callees[f].push_back(callee);
+        }
+    }
+
+    vector<uint32_t> order(n, none), low(n, 0), stack;
+    vector<uint8_t> onStack(n, 0);
+    g.sccOf.assign(n, none);
+    uint32_t counter = 0;
+    struct Frame {
+        uint32_t f, next;
+    };
+    vector<Frame> frames;
+    auto visit = [&](uint32_t f) {
+        order[f] = low[f] = counter++;
+        stack.push_back(f);
+        onStack[f] = 1;
+        frames.push_back({f, 0});
+    };
+    for (uint32_t root = 0; root < n; ++root) {
+        if (order[root] != none) continue;
+        visit(root);
+        while (!frames.empty()) {
+            uint32_t f = frames.back().f;
+            if (frames.back().next < g.callees[f].size()) {
+                uint32_t c = g.callees[f][frames.back().next++];
+                if (order[c] == none) visit(c);
+                else if (onStack[c]) low[f] = min(low[f], order[c]);
+                continue;
+            }
+            frames.pop_back();
+            if (!frames.empty()) low[frames.back().f] = min(low[frames.back().f], low[f]);
+            if (low[f] != order[f]) continue;
+            vector<uint32_t> scc;
+            uint32_t m;
+            do {
+                m = stack.back();
+                stack.pop_back();
+                onStack[m] = 0;
+                g.sccOf[m] = (uint32_t)g.sccs.size();
+                scc.push_back(m);
+            } while (m != f);
+            g.sccs.push_back(move(scc));
+        }
+    }
+    return g;
+}
+
+namespace {
+
+// What the inliner needs to know about a callee whose body is final.
+struct CalleeInfo {
+    bool inlinable = false;
+    size_t size = 0;
+    bool returnsWithoutValue = false;  // has a ReturnVoid or can run off its end
+    vector<uint8_t> needsReset;        // local -> may be read before it is written
+    bool stringReset = false;          // a string local needs resetting; there is no null constant
+};
+
+CalleeInfo describe(const IRFunction& fn) {
+    CalleeInfo info;
+    info.size = countInstructions(fn);
+    if (fn.inSSA) return info;
+    for (const auto& ins : fn.instructions) {
+        if (ins.op == IROp::IndexLoad || ins.op == IROp::IndexStore) return info;
+        if (ins.op == IROp::ReturnVoid) info.returnsWithoutValue = true;
+    }
+    IROp last = fn.instructions.empty() ? IROp::Label : fn.instructions.back().op;
+    if (last != IROp::Return && last != IROp::ReturnVoid && last != IROp::Goto) info.returnsWithoutValue = true;
+    info.needsReset = localsReadBeforeWrite(fn);
+    for (uint32_t v = fn.paramCount; v < fn.vars.size(); ++v) {
+        if (info.needsReset[v] && fn.vars[v].type.kind == TypeKind::String) info.stringReset = true;
+    }
+    info.inlinable = true;
+    return info;
+}
+
+class Inliner {
+public:
+    Inliner(IRProgram& ir, const InlineOptions& options, InlineReport& report)
+        : ir(ir), options(options), report(report), graph(buildCallGraph(ir)), infos(ir.functions.size()),
+          described(ir.functions.size(), 0) {}
+
+    void run() {
+        for (const auto& scc : graph.sccs) {
+            for (uint32_t f : scc) inlineInto(f);
+        }
+    }
+
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    IRProgram& ir;
+    const InlineOptions& options;
+    InlineReport& report;
+    CallGraph graph;
+    vector<CalleeInfo> infos;
+    vector<uint8_t> described;
+
+    // One call being inlined: where the callee's locals and temporaries
+    // start in the caller, and its labels renamed so far.
+    struct Site {
+        uint32_t caller = 0, callee = 0;
+        bool inLoop = false;
+        uint32_t varBase = 0, tempBase = 0;
+        unordered_map<uint32_t, uint32_t> labels;
+        string resultName;  // for a result local, if one is needed
+    };
+
+    // Callees come from components finished earlier, so their bodies no
+    // longer change by the time anyone asks.
+    const CalleeInfo& info(uint32_t f) {
+        if (!described[f]) {
+            infos[f] = describe(ir.functions[f]);
+            described[f] = 1;
+        }
+        return infos[f];
+    }
+
+    Operand zero(Type t) {
+        return t.kind == TypeKind::Float ? ir.floatConstant(0) : ir.intConstant(t, 0);
+    }
+
+    Operand rename(Site& site, Operand o) {
+        switch (o.kind()) {
+            case OperandKind::Temp: return Operand::temp(site.tempBase + o.index());
+            case OperandKind::Local: return Operand::local(site.varBase + o.index());
+            case OperandKind::Label: {
+                auto it = site.labels.find(o.index());
+                if (it == site.labels.end()) {
+                    ir.labelBases.push_back(ir.labelBases[o.index()]);
+                    it = site.labels.emplace(o.index(), (uint32_t)ir.labelBases.size() - 1).first;
+                }
+                return Operand::label(it->second);
+            }
+            default: return o;
+        }
+    }
+
+    void inlineInto(uint32_t f) {
+        IRFunction& fn = ir.functions[f];
+        if (fn.inSSA) return;
+        const vector<IRInstr>& code = fn.instructions;
+
+        CFG cfg = buildCFG(fn);
+        vector<uint8_t> loopBlock(cfg.blockCount(), 0);
+        for (const auto& loop : findLoops(cfg)) {
+            for (uint32_t b : loop.blocks) loopBlock[b] = 1;
+        }
+        // The call each Param feeds.
+        vector<uint32_t> owner(code.size(), none), pending;
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            if (code[i].op == IROp::Param) pending.push_back(i);
+            if (code[i].op != IROp::Call) continue;
+            uint32_t argc = code[i].b.index();
+            if (argc > pending.size()) return;
+            for (size_t k = pending.size() - argc; k < pending.size(); ++k) owner[pending[k]] = i;
+            pending.resize(pending.size() - argc);
+        }
+
+        // Calls inside loops get the first claim on the caller's budget.
+        size_t size = countInstructions(fn);
+        unordered_map<uint32_t, Site> sites;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (uint32_t i = 0; i < code.size(); ++i) {
+                const IRInstr& ins = code[i];
+                bool inLoop = loopBlock[cfg.blockOf(i)];
+                if (ins.op != IROp::Call || inLoop != (pass == 0)) continue;
+                uint32_t g = ins.a.index();
+                if (graph.sccOf[g] == graph.sccOf[f]) continue;
+                const CalleeInfo& callee = info(g);
+                if (!callee.inlinable || ins.b.index() != ir.functions[g].paramCount) continue;
+                if (inLoop && callee.stringReset) continue;
+                if (!ins.dst.isNone() && callee.returnsWithoutValue && ins.type.kind == TypeKind::String) continue;
+                size_t removed = ins.b.index() + 2;
+                size_t growth = callee.size > removed ? callee.size - removed : 0;
+                if (growth > (inLoop ? 2 * options.maxGrowth : options.maxGrowth)) continue;
+                if (size + growth > options.maxCallerSize) continue;
+                size += growth;
+                Site& site = sites[i];
+                site.caller = f;
+                site.callee = g;
+                site.inLoop = inLoop;
+            }
+        }
+        if (sites.empty()) return;
+
+        unordered_set<string> names;
+        for (const auto& v : fn.vars) names.insert(v.name);
+        vector<uint32_t> calls;
+        for (auto& entry : sites) calls.push_back(entry.first);
+        sort(calls.begin(), calls.end());
+        for (uint32_t i : calls) {
+            Site& site = sites[i];
+            const IRFunction& callee = ir.functions[site.callee];
+            site.varBase = (uint32_t)fn.vars.size();
+            site.tempBase = fn.tempCount;
+            fn.tempCount += callee.tempCount;
+            for (const auto& v : callee.vars) {
+                string name = callee.name + "." + v.name;
+                for (int n = 1; names.count(name); ++n) name = callee.name + "." + v.name + "." + to_string(n);
+                names.insert(name);
+                fn.vars.push_back(IRVar{name, v.type});
+            }
+            site.resultName = callee.name + ".result";
+            for (int n = 1; names.count(site.resultName); ++n) site.resultName = callee.name + ".result." + to_string(n);
+            names.insert(site.resultName);
+            report.sites.push_back({fn.name, callee.name, info(site.callee).size, site.inLoop});
+        }
+
+        vector<IRInstr> out;
+        out.reserve(code.size());
+        vector<uint32_t> argIndex(code.size(), 0);
+        for (uint32_t i = 0; i < code.size(); ++i) {
+            const IRInstr& ins = code[i];
+            auto it = sites.find(owner[i] == none ? i : owner[i]);
+            if (it == sites.end()) {
+                out.push_back(ins);
+                continue;
+            }
+            Site& site = it->second;
+            const IRFunction& callee = ir.functions[site.callee];
+            if (ins.op == IROp::Param) {
+                uint32_t p = argIndex[owner[i]]++;
+                out.push_back(makeInstr(IROp::Copy, callee.vars[p].type, Operand::local(site.varBase + p), ins.a));
+                continue;
+            }
+            emitBody(site, ins, out);
+        }
+        fn.instructions.swap(out);
+    }
+
+    // The callee's body in place of call. Temporaries have one definition
+    // each, so with several ways out the result goes through a local.
+    void emitBody(Site& site, const IRInstr& call, vector<IRInstr>& out) {
+        IRFunction& fn = ir.functions[site.caller];
+        const IRFunction& callee = ir.functions[site.callee];
+        const CalleeInfo& calleeInfo = info(site.callee);
+        if (site.inLoop) {
+            for (uint32_t v = callee.paramCount; v < callee.vars.size(); ++v) {
+                if (calleeInfo.needsReset[v]) {
+                    out.push_back(makeInstr(IROp::Copy, callee.vars[v].type, Operand::local(site.varBase + v), zero(callee.vars[v].type)));
+                }
+            }
+        }
+        IROp lastOp = callee.instructions.empty() ? IROp::Label : callee.instructions.back().op;
+        bool fallsOff = lastOp != IROp::Return && lastOp != IROp::ReturnVoid && lastOp != IROp::Goto;
+        size_t exits = fallsOff;
+        for (const auto& ins : callee.instructions) exits += ins.op == IROp::Return || ins.op == IROp::ReturnVoid;
+        Operand result = call.dst;
+        if (!call.dst.isNone() && exits > 1) {
+            result = Operand::local((uint32_t)fn.vars.size());
+            fn.vars.push_back(IRVar{site.resultName, call.type});
+        }
+        Operand end;
+        for (size_t k = 0; k < callee.instructions.size(); ++k) {
+            IRInstr ins = callee.instructions[k];
+            bool last = k + 1 == callee.instructions.size();
+            if (ins.op == IROp::Return || ins.op == IROp::ReturnVoid) {
+                if (!result.isNone()) {
+                    Operand value = ins.op == IROp::Return ? rename(site, ins.a) : zero(call.type);
+                    out.push_back(makeInstr(IROp::Copy, call.type, result, value));
+                }
+                if (last) continue;
+                if (end.isNone()) {
+                    ir.labelBases.push_back("inline_end");
+                    end = Operand::label((uint32_t)ir.labelBases.size() - 1);
+                }
+                out.push_back(makeInstr(IROp::Goto, Type::Unknown(), Operand::none(), end));
+                continue;
+            }
+            ins.dst = rename(site, ins.dst);
+            ins.a = rename(site, ins.a);
+            ins.b = rename(site, ins.b);
+            out.push_back(ins);
+        }
+        if (!result.isNone() && fallsOff) out.push_back(makeInstr(IROp::Copy, call.type, result, zero(call.type)));
+        if (!end.isNone()) out.push_back(makeInstr(IROp::Label, Type::Unknown(), Operand::none(), end));
+        if (result != call.dst) out.push_back(makeInstr(IROp::Copy, call.type, call.dst, result));
+    }
+};
+
+}  // namespace
+
+InlineReport inlineCalls(IRProgram& ir, const InlineOptions& options) {
+    InlineReport report;
+    report.sizeBefore = countInstructions(ir);
+    Inliner(ir, options, report).run();
+    report.sizeAfter = countInstructions(ir);
+    return report;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ir.hpp"
+
+using namespace std;
+
+// Who calls whom. callees[f] lists the distinct functions f calls. sccs
+// holds the strongly connected components callees first, so a function
+// comes after everything it calls unless they call each other.
+struct CallGraph {
+    vector<vector<uint32_t>> callees;
+    vector<vector<uint32_t>> sccs;
+    vector<uint32_t> sccOf;  // function -> index into sccs
+
+    // True if f can reach itself through calls.
+    bool recursive(uint32_t f) const;
+};
+
+CallGraph buildCallGraph(const IRProgram& ir);
+
+// Cost model. Inlining a call removes its Params, the Call and the Return,
+// and adds the callee's body; a call is inlined when that grows the caller
+// by at most maxGrowth instructions, or twice that for a call inside a
+// loop, and the caller stays within maxCallerSize.
+struct InlineOptions {
+    size_t maxGrowth = 16;
+    size_t maxCallerSize = 4000;
+};
+
+struct InlinedCall {
+    string caller, callee;
+    size_t calleeSize = 0;
+    bool inLoop = false;
+};
+
+struct InlineReport {
+    vector<InlinedCall> sites;
+    size_t sizeBefore = 0, sizeAfter = 0;  // countInstructions over the program
+};
+
+// Inlines calls into their callers over a program that is not in SSA form,
+// one strongly connected component at a time, callees first, so a callee
+// has already absorbed its own small callees. Calls between functions of
+// the same component (recursion) are kept. The callee's locals and
+// temporaries become new ones in the caller and its labels are renamed;
+// each argument is copied into its parameter where its Param was, and each
+// Return becomes a copy into the call's result and a jump past the body.
+// Callees with arrays are not inlined. An inlined call no longer counts
+// towards the call depth limit, and run-time errors in its body name the
+// caller. Functions stay in the program even when no call is left.
+InlineReport inlineCalls(IRProgram& ir, const InlineOptions& options = {});
@@ -1,25 +1,64 @@
 #include "ir.hpp"
+#include <sstream>
 
 using namespace std;
 
+Operand IRProgram::constant(Type type, const string& text, int64_t intValue, double floatValue) {
+    string key = (char)type.kind + text;
+    auto it = constantIndex.find(key);
+    if (it != constantIndex.end()) return Operand::constant(it->second);
+    uint32_t index = (uint32_t)constants.size();
+    IRConst c;
+    c.type = type;
+    c.text = text;
+    c.intValue = intValue;
+    c.floatValue = floatValue;
+    constants.push_back(move(c));
+    constantIndex.emplace(move(key), index);
+    return Operand::constant(index);
+}
+
+Operand IRProgram::intConstant(Type type, int64_t value) {
+    string text;
+    if (type.kind == TypeKind::Bool) text = value ? "true" : "false";
+    else if (type.kind == TypeKind::Char) text = "'" + string(1, (char)value) + "'";
+    else text = to_string(value);
+    return constant(type, text, value, (double)value);
+}
+
+Operand IRProgram::floatConstant(double value) {
+    ostringstream os;
+    os.precision(17);
+    os << value;
+    string text = os.str();
+    if (text.find_first_of(".en") == string::npos) text += ".0";
+    bool fitsInt = value > -9.2e18 && value < 9.2e18;
+    return constant(Type::Float(), text, fitsInt ? (int64_t)value : 0, value);
+}
+
 IRGenerator::IRGenerator(const ScopeAnalyzer& s, const TypeChecker& t)
     : scope(s),
       types(t),
-      currentFunction(nullptr),
-      tempCounter(0),
-      labelCounter(0) {}
+      currentFunction(nullptr) {}
 
 IRProgram IRGenerator::generate(const Program& program) {
-    irProgram.globals.clear();
-    irProgram.functions.clear();
+    irProgram = IRProgram();
     diagnostics.clear();
     currentFunction = nullptr;
-    tempCounter = 0;
-    labelCounter = 0;
+    globalIndex.clear();
+    functionIndex.clear();
+    for (const auto& d : program.decls) {
+        if (auto* tv = dynamic_cast<const TopVarDecl*>(d.get())) {
+            globalIndex.emplace(tv->decl->name, (uint32_t)globalIndex.size());
+        } else if (auto* fn = dynamic_cast<const FunctionDecl*>(d.get())) {
+            functionIndex.emplace(fn->name, (uint32_t)functionIndex.size());
+        }
+    }
+    irProgram.functions.reserve(functionIndex.size());
     for (const auto& d : program.decls) {
         generateTopLevelDecl(d.get());
     }
-    return irProgram;
+    return move(irProgram);
 }
 
 const vector<IRGenDiagnostic>& IRGenerator::getDiagnostics() const {
@@ -34,20 +73,96 @@ void IRGenerator::report(IRGenError kind, const Node* where, const string& messa
     diagnostics.push_back(IRGenDiagnostic{kind, message, where});
 }
 
-string IRGenerator::createTemp() {
-    string name = "%t" + to_string(tempCounter++);
-    return name;
+Operand IRGenerator::createTemp() {
+    return Operand::temp(currentFunction->tempCount++);
 }
 
-string IRGenerator::createLabel(const string& base) {
-    string name = base + "_" + to_string(labelCounter++);
-    return name;
+Operand IRGenerator::createLabel(const char* base) {
+    irProgram.labelBases.push_back(base);
+    return Operand::label((uint32_t)irProgram.labelBases.size() - 1);
 }
 
-void IRGenerator::emit(const IRInstr& instr) {
+void IRGenerator::emit(IROp op, Type type, Operand dst, Operand a, Operand b, Type opType) {
     if (currentFunction) {
-        currentFunction->instructions.push_back(instr);
+        IRInstr ins;
+        ins.op = op;
+        ins.type = type;
+        ins.opType = opType;
+        ins.dst = dst;
+        ins.a = a;
+        ins.b = b;
+        currentFunction->instructions.push_back(ins);
+    }
+}
+
+// The constant for a literal expression, or None if e is not a literal.
+Operand IRGenerator::literalConstant(const Expr* e) {
+    if (auto* il = dynamic_cast<const IntLit*>(e)) {
+        return irProgram.constant(Type::Int(), il->raw, il->v, (double)il->v);
     }
+    if (auto* fl = dynamic_cast<const FloatLit*>(e)) {
+        return irProgram.constant(Type::Float(), fl->raw, (int64_t)fl->v, fl->v);
+    }
+    if (auto* bl = dynamic_cast<const BoolLit*>(e)) {
+        return irProgram.constant(Type::Bool(), bl->v ? "true" : "false", bl->v ? 1 : 0, 0);
+    }
+    if (auto* sl = dynamic_cast<const StringLit*>(e)) {
+        return irProgram.constant(Type::String(), "\"" + sl->v + "\"", 0, 0);
+    }
+    if (auto* cl = dynamic_cast<const CharLit*>(e)) {
+        return irProgram.constant(Type::Char(), "'" + cl->v + "'", cl->v.empty() ? 0 : (unsigned char)cl->v[0], 0);
+    }
+    return Operand::none();
+}
+
+// Locals keep their source name unless it is already taken by a parameter,
+// a global or an outer local in the same function; then they get name.N.
+uint32_t IRGenerator::declareLocal(const VarDeclStmt* s) {
+    string name = s->name;
+    if (globalIndex.count(name) || functionNames.count(name)) {
+        int& n = nextSuffix[s->name];
+        do {
+            name = s->name + "." + to_string(++n);
+        } while (globalIndex.count(name) || functionNames.count(name));
+    }
+    functionNames.insert(name);
+    uint32_t slot = (uint32_t)currentFunction->vars.size();
+    if (const Symbol* sym = scope.getDeclaredSymbol(s)) localSlots[sym] = slot;
+    currentFunction->vars.push_back(IRVar{name, s->type});
+    return slot;
+}
+
+// A local the generator needs for a value computed on several paths. The
+// name gets a suffix like a shadowed local, so it cannot clash with one.
+uint32_t IRGenerator::declareHidden(const char* base, Type type) {
+    string name;
+    int& n = nextSuffix[base];
+    do {
+        name = string(base) + "." + to_string(++n);
+    } while (globalIndex.count(name) || functionNames.count(name));
+    functionNames.insert(name);
+    uint32_t slot = (uint32_t)currentFunction->vars.size();
+    currentFunction->vars.push_back(IRVar{name, type});
+    return slot;
+}
+
+// Parameters have no declaring node, so anything not found among the
+// function's locals is a parameter or else a global.
+Operand IRGenerator::variable(const Ident* id) const {
+    auto it = localSlots.find(scope.getResolvedSymbolForIdent(id));
+    if (it != localSlots.end()) return Operand::local(it->second);
+    auto p = paramSlots.find(id->name);
+    if (p != paramSlots.end()) return Operand::local(p->second);
+    auto g = globalIndex.find(id->name);
+    if (g != globalIndex.end()) return Operand::global(g->second);
+    return Operand::none();
+}
+
+Operand IRGenerator::convert(Operand value, Type from, Type to) {
+    if (from.kind != TypeKind::Int || to.kind != TypeKind::Float) return value;
+    Operand t = createTemp();
+    emit(IROp::IntToFloat, to, t, value, Operand::none(), from);
+    return t;
 }
 
 void IRGenerator::generateTopLevelDecl(const Decl* decl) {
@@ -65,26 +180,10 @@ void IRGenerator::generateTopVar(const TopVarDecl* tv) {
     IRGlobal g;
     g.name = s->name;
     g.type = s->type;
-    g.hasInit = false;
-    g.initValue = "";
     if (s->init) {
         const Expr* e = s->init->get();
-        if (auto* il = dynamic_cast<const IntLit*>(e)) {
-            g.hasInit = true;
-            g.initValue = il->raw;
-        } else if (auto* fl = dynamic_cast<const FloatLit*>(e)) {
-            g.hasInit = true;
-            g.initValue = fl->raw;
-        } else if (auto* bl = dynamic_cast<const BoolLit*>(e)) {
-            g.hasInit = true;
-            g.initValue = bl->v ? "true" : "false";
-        } else if (auto* sl = dynamic_cast<const StringLit*>(e)) {
-            g.hasInit = true;
-            g.initValue = "\"" + sl->v + "\"";
-        } else if (auto* cl = dynamic_cast<const CharLit*>(e)) {
-            g.hasInit = true;
-            g.initValue = "'" + cl->v + "'";
-        } else {
+        g.init = literalConstant(e);
+        if (g.init.isNone()) {
             report(IRGenError::UnsupportedExpression, e, "non-literal global initializer is not supported");
         }
     }
@@ -95,13 +194,18 @@ void IRGenerator::generateFunction(const FunctionDecl* fn) {
     irProgram.functions.emplace_back();
     IRFunction& f = irProgram.functions.back();
     f.name = fn->name;
-    f.params.clear();
+    functionNames.clear();
+    nextSuffix.clear();
+    localSlots.clear();
+    paramSlots.clear();
     for (const auto& p : fn->params) {
-        f.params.push_back(p.name);
+        paramSlots[p.name] = (uint32_t)f.vars.size();
+        f.vars.push_back(IRVar{p.name, p.type});
+        functionNames.insert(p.name);
     }
+    f.paramCount = (uint32_t)f.vars.size();
     IRFunction* saved = currentFunction;
     currentFunction = &f;
-    tempCounter = 0;
     generateBlock(fn->body.get());
     currentFunction = saved;
 }
@@ -144,88 +248,64 @@ void IRGenerator::generateStatement(const Stmt* stmt) {
     report(IRGenError::UnsupportedStatement, stmt, "unsupported statement");
 }
 
+// Jumps to trueLabel or falseLabel on the value of e. && and || branch
+// after their left operand instead of evaluating both, and ! swaps the
+// targets, so no boolean is materialized for them.
+void IRGenerator::generateCondition(const Expr* e, Operand trueLabel, Operand falseLabel) {
+    if (auto* b = dynamic_cast<const BinaryExpr*>(e)) {
+        if (b->op == BinaryOp::And || b->op == BinaryOp::Or) {
+            bool isAnd = b->op == BinaryOp::And;
+            Operand rhsLabel = createLabel(isAnd ? "and_rhs" : "or_rhs");
+            if (isAnd) generateCondition(b->lhs.get(), rhsLabel, falseLabel);
+            else generateCondition(b->lhs.get(), trueLabel, rhsLabel);
+            emit(IROp::Label, Type::Unknown(), Operand::none(), rhsLabel);
+            generateCondition(b->rhs.get(), trueLabel, falseLabel);
+            return;
+        }
+    }
+    if (auto* u = dynamic_cast<const UnaryExpr*>(e)) {
+        if (u->op == UnaryOp::Not) {
+            generateCondition(u->rhs.get(), falseLabel, trueLabel);
+            return;
+        }
+    }
+    Operand cond = generateExpr(e);
+    emit(IROp::IfGoto, Type::Bool(), Operand::none(), cond, trueLabel);
+    emit(IROp::Goto, Type::Unknown(), Operand::none(), falseLabel);
+}
+
 void IRGenerator::generateIf(const IfStmt* s) {
-    string condTemp = generateExpr(s->cond.get());
-    string thenLabel = createLabel("if_then");
-    string elseLabel = s->elseS ? createLabel("if_else") : createLabel("if_end");
-    string endLabel = s->elseS ? createLabel("if_end") : elseLabel;
-
-    IRInstr ifg;
-    ifg.kind = IRInstrKind::IfGoto;
-    ifg.src1 = condTemp;
-    ifg.info = thenLabel;
-    emit(ifg);
-
-    IRInstr g;
-    g.kind = IRInstrKind::Goto;
-    g.info = elseLabel;
-    emit(g);
-
-    IRInstr lt;
-    lt.kind = IRInstrKind::Label;
-    lt.info = thenLabel;
-    emit(lt);
+    Operand thenLabel = createLabel("if_then");
+    Operand elseLabel = s->elseS ? createLabel("if_else") : createLabel("if_end");
+    Operand endLabel = s->elseS ? createLabel("if_end") : elseLabel;
+
+    generateCondition(s->cond.get(), thenLabel, elseLabel);
+    emit(IROp::Label, Type::Unknown(), Operand::none(), thenLabel);
     generateStatement(s->thenS.get());
 
     if (s->elseS) {
-        IRInstr g2;
-        g2.kind = IRInstrKind::Goto;
-        g2.info = endLabel;
-        emit(g2);
-        IRInstr le;
-        le.kind = IRInstrKind::Label;
-        le.info = elseLabel;
-        emit(le);
+        emit(IROp::Goto, Type::Unknown(), Operand::none(), endLabel);
+        emit(IROp::Label, Type::Unknown(), Operand::none(), elseLabel);
         generateStatement(s->elseS->get());
-        IRInstr lend;
-        lend.kind = IRInstrKind::Label;
-        lend.info = endLabel;
-        emit(lend);
+        emit(IROp::Label, Type::Unknown(), Operand::none(), endLabel);
     } else {
-        IRInstr lend;
-        lend.kind = IRInstrKind::Label;
-        lend.info = elseLabel;
-        emit(lend);
+        emit(IROp::Label, Type::Unknown(), Operand::none(), elseLabel);
     }
 }
 
 void IRGenerator::generateWhile(const WhileStmt* s) {
-    string condLabel = createLabel("while_cond");
-    string bodyLabel = createLabel("while_body");
-    string endLabel = createLabel("while_end");
-
-    IRInstr lc;
-    lc.kind = IRInstrKind::Label;
-    lc.info = condLabel;
-    emit(lc);
-
-    string condTemp = generateExpr(s->cond.get());
-    IRInstr ifg;
-    ifg.kind = IRInstrKind::IfGoto;
-    ifg.src1 = condTemp;
-    ifg.info = bodyLabel;
-    emit(ifg);
-
-    IRInstr gEnd;
-    gEnd.kind = IRInstrKind::Goto;
-    gEnd.info = endLabel;
-    emit(gEnd);
-
-    IRInstr lb;
-    lb.kind = IRInstrKind::Label;
-    lb.info = bodyLabel;
-    emit(lb);
-    generateStatement(s->body.get());
+    Operand condLabel = createLabel("while_cond");
+    Operand bodyLabel = createLabel("while_body");
+    Operand endLabel = createLabel("while_end");
 
-    IRInstr gBack;
-    gBack.kind = IRInstrKind::Goto;
-    gBack.info = condLabel;
-    emit(gBack);
+    emit(IROp::Label, Type::Unknown(), Operand::none(), condLabel);
+    generateCondition(s->cond.get(), bodyLabel, endLabel);
 
-    IRInstr le;
-    le.kind = IRInstrKind::Label;
-    le.info = endLabel;
-    emit(le);
+    emit(IROp::Label, Type::Unknown(), Operand::none(), bodyLabel);
+    generateStatement(s->body.get());
+    emit(IROp::Goto, Type::Unknown(), Operand::none(), condLabel);
+
+    emit(IROp::Label, Type::Unknown(), Operand::none(), endLabel);
 }
 
 void IRGenerator::generateFor(const ForStmt* s) {
@@ -233,65 +313,34 @@ void IRGenerator::generateFor(const ForStmt* s) {
         generateStatement(s->init->get());
     }
 
-    string condLabel = createLabel("for_cond");
-    string bodyLabel = createLabel("for_body");
-    string endLabel = createLabel("for_end");
-
-    IRInstr lc;
-    lc.kind = IRInstrKind::Label;
-    lc.info = condLabel;
-    emit(lc);
+    Operand condLabel = createLabel("for_cond");
+    Operand bodyLabel = createLabel("for_body");
+    Operand endLabel = createLabel("for_end");
 
+    emit(IROp::Label, Type::Unknown(), Operand::none(), condLabel);
     if (s->cond) {
-        string condTemp = generateExpr(s->cond->get());
-        IRInstr ifg;
-        ifg.kind = IRInstrKind::IfGoto;
-        ifg.src1 = condTemp;
-        ifg.info = bodyLabel;
-        emit(ifg);
-        IRInstr gEnd;
-        gEnd.kind = IRInstrKind::Goto;
-        gEnd.info = endLabel;
-        emit(gEnd);
+        generateCondition(s->cond->get(), bodyLabel, endLabel);
     } else {
-        IRInstr gBody;
-        gBody.kind = IRInstrKind::Goto;
-        gBody.info = bodyLabel;
-        emit(gBody);
+        emit(IROp::Goto, Type::Unknown(), Operand::none(), bodyLabel);
     }
 
-    IRInstr lb;
-    lb.kind = IRInstrKind::Label;
-    lb.info = bodyLabel;
-    emit(lb);
+    emit(IROp::Label, Type::Unknown(), Operand::none(), bodyLabel);
     generateStatement(s->body.get());
 
     if (s->incr) {
         generateExpr(s->incr->get());
     }
+    emit(IROp::Goto, Type::Unknown(), Operand::none(), condLabel);
 
-    IRInstr gBack;
-    gBack.kind = IRInstrKind::Goto;
-    gBack.info = condLabel;
-    emit(gBack);
-
-    IRInstr le;
-    le.kind = IRInstrKind::Label;
-    le.info = endLabel;
-    emit(le);
+    emit(IROp::Label, Type::Unknown(), Operand::none(), endLabel);
 }
 
 void IRGenerator::generateReturn(const ReturnStmt* s) {
     if (s->expr) {
-        string temp = generateExpr(s->expr->get());
-        IRInstr r;
-        r.kind = IRInstrKind::Return;
-        r.src1 = temp;
-        emit(r);
+        Operand value = generateExpr(s->expr->get());
+        emit(IROp::Return, types.getExpressionType(s->expr->get()), Operand::none(), value);
     } else {
-        IRInstr r;
-        r.kind = IRInstrKind::ReturnVoid;
-        emit(r);
+        emit(IROp::ReturnVoid, Type::Unknown());
     }
 }
 
@@ -301,63 +350,22 @@ void IRGenerator::generateExprStmt(const ExprStmt* s) {
 
 void IRGenerator::generateVarDeclStmt(const VarDeclStmt* s) {
     if (s->init) {
-        string temp = generateExpr(s->init->get());
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = s->name;
-        a.src1 = temp;
-        emit(a);
+        Operand value = generateExpr(s->init->get());
+        emit(IROp::Copy, s->type, Operand::local(declareLocal(s)), value);
+    } else {
+        declareLocal(s);
     }
 }
 
-string IRGenerator::generateExpr(const Expr* expr) {
+Operand IRGenerator::generateExpr(const Expr* expr) {
     if (!expr) {
         report(IRGenError::UnsupportedExpression, nullptr, "empty expression");
-        return "";
-    }
-    if (auto* il = dynamic_cast<const IntLit*>(expr)) {
-        string t = createTemp();
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = t;
-        a.src1 = il->raw;
-        emit(a);
-        return t;
+        return Operand::none();
     }
-    if (auto* fl = dynamic_cast<const FloatLit*>(expr)) {
-        string t = createTemp();
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = t;
-        a.src1 = fl->raw;
-        emit(a);
-        return t;
-    }
-    if (auto* sl = dynamic_cast<const StringLit*>(expr)) {
-        string t = createTemp();
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = t;
-        a.src1 = "\"" + sl->v + "\"";
-        emit(a);
-        return t;
-    }
-    if (auto* cl = dynamic_cast<const CharLit*>(expr)) {
-        string t = createTemp();
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = t;
-        a.src1 = "'" + cl->v + "'";
-        emit(a);
-        return t;
-    }
-    if (auto* bl = dynamic_cast<const BoolLit*>(expr)) {
-        string t = createTemp();
-        IRInstr a;
-        a.kind = IRInstrKind::Assign;
-        a.dst = t;
-        a.src1 = bl->v ? "true" : "false";
-        emit(a);
+    Operand c = literalConstant(expr);
+    if (!c.isNone()) {
+        Operand t = createTemp();
+        emit(IROp::Copy, irProgram.constants[c.index()].type, t, c);
         return t;
     }
     if (auto* id = dynamic_cast<const Ident*>(expr)) {
@@ -369,215 +377,383 @@ string IRGenerator::generateExpr(const Expr* expr) {
     if (auto* b = dynamic_cast<const BinaryExpr*>(expr)) {
         return generateBinary(b);
     }
-    if (auto* c = dynamic_cast<const CallExpr*>(expr)) {
-        return generateCall(c);
+    if (auto* call = dynamic_cast<const CallExpr*>(expr)) {
+        return generateCall(call);
     }
     if (auto* x = dynamic_cast<const IndexExpr*>(expr)) {
         return generateIndex(x);
     }
     report(IRGenError::UnsupportedExpression, expr, "unsupported expression");
-    return "";
-}
-
-string IRGenerator::generateIdentifier(const Ident* id) {
-    return id->name;
-}
-
-string IRGenerator::generateUnary(const UnaryExpr* e) {
-    string rhs = generateExpr(e->rhs.get());
-    string dst = createTemp();
-    string op;
-    if (e->op == UnaryOp::Not) op = "!";
-    else if (e->op == UnaryOp::BitNot) op = "~";
-    else if (e->op == UnaryOp::Neg) op = "-";
-    else if (e->op == UnaryOp::Pos) op = "+";
-    IRInstr u;
-    u.kind = IRInstrKind::Unary;
-    u.dst = dst;
-    u.src1 = rhs;
-    u.info = op;
-    emit(u);
+    return Operand::none();
+}
+
+Operand IRGenerator::generateIdentifier(const Ident* id) {
+    return variable(id);
+}
+
+Operand IRGenerator::generateUnary(const UnaryExpr* e) {
+    Operand rhs = generateExpr(e->rhs.get());
+    Operand dst = createTemp();
+    IROp op = IROp::Pos;
+    if (e->op == UnaryOp::Not) op = IROp::Not;
+    else if (e->op == UnaryOp::BitNot) op = IROp::BitNot;
+    else if (e->op == UnaryOp::Neg) op = IROp::Neg;
+    emit(op, types.getExpressionType(e), dst, rhs, Operand::none(), types.getExpressionType(e->rhs.get()));
     return dst;
 }
 
-string IRGenerator::opStringForBinary(BinaryOp op) const {
+IROp IRGenerator::opForBinary(BinaryOp op) const {
+    switch (op) {
+        case BinaryOp::Or: return IROp::Or;
+        case BinaryOp::And: return IROp::And;
+        case BinaryOp::BitOr: return IROp::BitOr;
+        case BinaryOp::BitXor: return IROp::BitXor;
+        case BinaryOp::BitAnd: return IROp::BitAnd;
+        case BinaryOp::Eq: return IROp::Eq;
+        case BinaryOp::Neq: return IROp::Neq;
+        case BinaryOp::Lt: return IROp::Lt;
+        case BinaryOp::Le: return IROp::Le;
+        case BinaryOp::Gt: return IROp::Gt;
+        case BinaryOp::Ge: return IROp::Ge;
+        case BinaryOp::Shl: return IROp::Shl;
+        case BinaryOp::Shr: return IROp::Shr;
+        case BinaryOp::Add: return IROp::Add;
+        case BinaryOp::Sub: return IROp::Sub;
+        case BinaryOp::Mul: return IROp::Mul;
+        case BinaryOp::Div: return IROp::Div;
+        case BinaryOp::Mod: return IROp::Mod;
+        case BinaryOp::Assign: return IROp::Copy;
+    }
+    return IROp::Copy;
+}
+
+// Arithmetic and relational operators accept int/float mixes; the int side
+// is widened before the operation.
+static bool promotesToFloat(BinaryOp op) {
     switch (op) {
-        case BinaryOp::Or: return "||";
-        case BinaryOp::And: return "&&";
-        case BinaryOp::BitOr: return "|";
-        case BinaryOp::BitXor: return "^";
-        case BinaryOp::BitAnd: return "&";
-        case BinaryOp::Eq: return "==";
-        case BinaryOp::Neq: return "!=";
-        case BinaryOp::Lt: return "<";
-        case BinaryOp::Le: return "<=";
-        case BinaryOp::Gt: return ">";
-        case BinaryOp::Ge: return ">=";
-        case BinaryOp::Shl: return "<<";
-        case BinaryOp::Shr: return ">>";
-        case BinaryOp::Add: return "+";
-        case BinaryOp::Sub: return "-";
-        case BinaryOp::Mul: return "*";
-        case BinaryOp::Div: return "/";
-        case BinaryOp::Mod: return "%";
-        case BinaryOp::Assign: return "=";
+        case BinaryOp::Lt: case BinaryOp::Le: case BinaryOp::Gt: case BinaryOp::Ge:
+        case BinaryOp::Add: case BinaryOp::Sub: case BinaryOp::Mul: case BinaryOp::Div: case BinaryOp::Mod:
+            return true;
+        default:
+            return false;
     }
-    return "?";
 }
 
-string IRGenerator::generateBinary(const BinaryExpr* e) {
+Operand IRGenerator::generateBinary(const BinaryExpr* e) {
     if (e->op == BinaryOp::Assign) {
         if (auto* id = dynamic_cast<const Ident*>(e->lhs.get())) {
-            string rhs = generateExpr(e->rhs.get());
-            IRInstr a;
-            a.kind = IRInstrKind::Assign;
-            a.dst = id->name;
-            a.src1 = rhs;
-            emit(a);
-            return id->name;
+            Operand rhs = generateExpr(e->rhs.get());
+            Operand dst = variable(id);
+            emit(IROp::Copy, types.getExpressionType(id), dst, rhs);
+            return dst;
         } else if (auto* idx = dynamic_cast<const IndexExpr*>(e->lhs.get())) {
-            string base = generateExpr(idx->base.get());
-            string index = generateExpr(idx->index.get());
-            string rhs = generateExpr(e->rhs.get());
-            IRInstr st;
-            st.kind = IRInstrKind::IndexStore;
-            st.dst = base;
-            st.src1 = index;
-            st.src2 = rhs;
-            emit(st);
+            Operand base = generateExpr(idx->base.get());
+            Operand index = generateExpr(idx->index.get());
+            Operand rhs = generateExpr(e->rhs.get());
+            emit(IROp::IndexStore, types.getExpressionType(idx), base, index, rhs, types.getExpressionType(idx->index.get()));
             return rhs;
         } else {
             report(IRGenError::InvalidAssignmentTarget, e->lhs.get(), "invalid assignment target");
-            string rhs = generateExpr(e->rhs.get());
-            return rhs;
+            return generateExpr(e->rhs.get());
         }
     }
-    string left = generateExpr(e->lhs.get());
-    string right = generateExpr(e->rhs.get());
-    string dst = createTemp();
-    string op = opStringForBinary(e->op);
-    IRInstr b;
-    b.kind = IRInstrKind::Binary;
-    b.dst = dst;
-    b.src1 = left;
-    b.src2 = right;
-    b.info = op;
-    emit(b);
+    if (e->op == BinaryOp::And || e->op == BinaryOp::Or) return generateLogical(e);
+    Operand left = generateExpr(e->lhs.get());
+    Operand right = generateExpr(e->rhs.get());
+    Type leftType = types.getExpressionType(e->lhs.get());
+    Type rightType = types.getExpressionType(e->rhs.get());
+    Type opType = leftType;
+    if (promotesToFloat(e->op) && rightType.kind == TypeKind::Float) opType = rightType;
+    left = convert(left, leftType, opType);
+    right = convert(right, rightType, opType);
+    Operand dst = createTemp();
+    emit(opForBinary(e->op), types.getExpressionType(e), dst, left, right, opType);
     return dst;
 }
 
-string IRGenerator::generateCall(const CallExpr* e) {
+// a && b as a value: v = a; if v goto rhs; goto end; rhs: v = b; end.
+// For a || b the left value decides when it is true: v = a; if v goto end.
+Operand IRGenerator::generateLogical(const BinaryExpr* e) {
+    bool isAnd = e->op == BinaryOp::And;
+    Operand result = Operand::local(declareHidden(isAnd ? "and" : "or", Type::Bool()));
+    Operand rhsLabel = isAnd ? createLabel("and_rhs") : Operand::none();
+    Operand endLabel = createLabel(isAnd ? "and_end" : "or_end");
+    emit(IROp::Copy, Type::Bool(), result, generateExpr(e->lhs.get()));
+    if (isAnd) {
+        emit(IROp::IfGoto, Type::Bool(), Operand::none(), result, rhsLabel);
+        emit(IROp::Goto, Type::Unknown(), Operand::none(), endLabel);
+        emit(IROp::Label, Type::Unknown(), Operand::none(), rhsLabel);
+    } else {
+        emit(IROp::IfGoto, Type::Bool(), Operand::none(), result, endLabel);
+    }
+    emit(IROp::Copy, Type::Bool(), result, generateExpr(e->rhs.get()));
+    emit(IROp::Label, Type::Unknown(), Operand::none(), endLabel);
+    return result;
+}
+
+Operand IRGenerator::generateCall(const CallExpr* e) {
     for (const auto& arg : e->args) {
-        string t = generateExpr(arg.get());
-        IRInstr p;
-        p.kind = IRInstrKind::Param;
-        p.src1 = t;
-        emit(p);
+        Operand value = generateExpr(arg.get());
+        emit(IROp::Param, types.getExpressionType(arg.get()), Operand::none(), value);
     }
 
-    string funcName;
-    if (auto* id = dynamic_cast<const Ident*>(e->callee.get())) {
-        funcName = id->name;
-    } else {
-        funcName = "<call>";
+    auto* id = dynamic_cast<const Ident*>(e->callee.get());
+    auto fnIt = id ? functionIndex.find(id->name) : functionIndex.end();
+    if (fnIt == functionIndex.end()) {
+        report(IRGenError::UnsupportedExpression, e, "callee is not a named function");
+        return Operand::none();
     }
 
     const Symbol* fnSym = scope.getResolvedSymbolForCall(e);
-    bool hasReturn = false;
+    Operand func = Operand::func(fnIt->second);
+    Operand argc = Operand::imm((uint32_t)e->args.size());
     if (fnSym && fnSym->functionSig && fnSym->functionSig->returnType) {
-        hasReturn = true;
+        Operand dst = createTemp();
+        emit(IROp::Call, *fnSym->functionSig->returnType, dst, func, argc);
+        return dst;
     }
+    emit(IROp::Call, Type::Unknown(), Operand::none(), func, argc);
+    return Operand::none();
+}
 
-    IRInstr c;
-    c.kind = IRInstrKind::Call;
-    c.info = funcName;
-    c.src1 = to_string(e->args.size());
-
-    if (hasReturn) {
-        string dst = createTemp();
-        c.dst = dst;
-        emit(c);
-        return dst;
-    } else {
-        c.dst = "";
-        emit(c);
-        return "";
-    }
-}
-
-string IRGenerator::generateIndex(const IndexExpr* e) {
-    string base = generateExpr(e->base.get());
-    string index = generateExpr(e->index.get());
-    string dst = createTemp();
-    IRInstr i;
-    i.kind = IRInstrKind::IndexLoad;
-    i.dst = dst;
-    i.src1 = base;
-    i.src2 = index;
-    emit(i);
+Operand IRGenerator::generateIndex(const IndexExpr* e) {
+    Operand base = generateExpr(e->base.get());
+    Operand index = generateExpr(e->index.get());
+    Operand dst = createTemp();
+    emit(IROp::IndexLoad, types.getExpressionType(e), dst, base, index, types.getExpressionType(e->index.get()));
     return dst;
 }
 
+bool hasSideEffects(const IRProgram& ir, const IRInstr& ins) {
+    switch (ins.op) {
+        case IROp::Label: case IROp::Goto: case IROp::IfGoto:
+        case IROp::Param: case IROp::Call: case IROp::Return: case IROp::ReturnVoid:
+        case IROp::IndexStore:
+            return true;
+        case IROp::Div: case IROp::Mod:
+            if (ins.opType.kind != TypeKind::Float) {
+                if (ins.b.kind() != OperandKind::Const) return true;
+                int64_t divisor = ir.constants[ins.b.index()].intValue;
+                if (divisor == 0 || divisor == -1) return true;
+            }
+            break;
+        case IROp::IndexLoad:
+            if (ins.b.kind() != OperandKind::Const || ir.constants[ins.b.index()].intValue < 0) return true;
+            break;
+        default:
+            break;
+    }
+    return ins.dst.kind() == OperandKind::Global;
+}
+
+bool isTailCall(const IRFunction& fn, size_t i) {
+    const auto& code = fn.instructions;
+    if (i >= code.size() || code[i].op != IROp::Call) return false;
+    const IRInstr& call = code[i];
+    if (i + 1 == code.size()) return call.dst.isNone();
+    const IRInstr& next = code[i + 1];
+    if (call.dst.isNone()) return next.op == IROp::ReturnVoid;
+    return next.op == IROp::Return && next.a == call.dst && call.dst.kind() != OperandKind::Global;
+}
+
+vector<uint8_t> localsReadBeforeWrite(const IRFunction& fn) {
+    vector<uint8_t> written(fn.vars.size(), 0), read(fn.vars.size(), 0), mentioned(fn.vars.size(), 0);
+    fill(written.begin(), written.begin() + fn.paramCount, 1);
+    bool prefix = true;
+    for (const auto& ins : fn.instructions) {
+        if (ins.op == IROp::Label) prefix = false;
+        for (Operand o : {ins.dst, ins.a, ins.b}) {
+            if (o.kind() == OperandKind::Local) mentioned[o.index()] = 1;
+        }
+        if (!prefix) continue;
+        forEachUse(ins, [&](Operand o) {
+            if (o.kind() == OperandKind::Local && !written[o.index()]) read[o.index()] = 1;
+        });
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) written[ins.dst.index()] = 1;
+        if (ins.op == IROp::Goto || ins.op == IROp::IfGoto || ins.op == IROp::Return || ins.op == IROp::ReturnVoid) prefix = false;
+    }
+    for (uint32_t v = fn.paramCount; v < fn.vars.size(); ++v) read[v] = read[v] || (mentioned[v] && !written[v]);
+    return read;
+}
+
+const char* irOpName(IROp op) {
+    switch (op) {
+        case IROp::Copy: return "=";
+        case IROp::Neg: return "-";
+        case IROp::Pos: return "+";
+        case IROp::Not: return "!";
+        case IROp::BitNot: return "~";
+        case IROp::IntToFloat: return "itof";
+        case IROp::Add: return "+";
+        case IROp::Sub: return "-";
+        case IROp::Mul: return "*";
+        case IROp::Div: return "/";
+        case IROp::Mod: return "%";
+        case IROp::Shl: return "<<";
+        case IROp::Shr: return ">>";
+        case IROp::BitAnd: return "&";
+        case IROp::BitOr: return "|";
+        case IROp::BitXor: return "^";
+        case IROp::And: return "&&";
+        case IROp::Or: return "||";
+        case IROp::Eq: return "==";
+        case IROp::Neq: return "!=";
+        case IROp::Lt: return "<";
+        case IROp::Le: return "<=";
+        case IROp::Gt: return ">";
+        case IROp::Ge: return ">=";
+        case IROp::Label: return "label";
+        case IROp::Goto: return "goto";
+        case IROp::IfGoto: return "if";
+        case IROp::Param: return "param";
+        case IROp::Call: return "call";
+        case IROp::Return: return "return";
+        case IROp::ReturnVoid: return "return";
+        case IROp::IndexLoad: return "load";
+        case IROp::IndexStore: return "store";
+        case IROp::Phi: return "phi";
+    }
+    return "?";
+}
+
+void printOperand(const IRProgram& ir, const IRFunction& fn, Operand o, ostream& os) {
+    switch (o.kind()) {
+        case OperandKind::None: os << "_"; break;
+        case OperandKind::Temp: os << "%t" << o.index(); break;
+        case OperandKind::Local: os << fn.vars[o.index()].name; break;
+        case OperandKind::Global: os << ir.globals[o.index()].name; break;
+        case OperandKind::Const: os << ir.constants[o.index()].text; break;
+        case OperandKind::Label: os << ir.labelName(o.index()); break;
+        case OperandKind::Func: os << ir.functions[o.index()].name; break;
+        case OperandKind::Imm: os << o.index(); break;
+    }
+}
+
+static void printVar(const IRVar& v, ostream& os) {
+    os << v.type.str() << " " << v.name;
+}
+
+static void printDst(const IRProgram& ir, const IRFunction& fn, const IRInstr& ins, ostream& os) {
+    printOperand(ir, fn, ins.dst, os);
+    os << ":" << ins.type.str() << " = ";
+}
+
+// Operators whose operand type differs from the result type say so, e.g. "<.float".
+static void printOp(const IRInstr& ins, ostream& os) {
+    os << irOpName(ins.op);
+    if (ins.opType.kind != ins.type.kind) os << "." << ins.opType.str();
+}
+
+void printIRInstr(const IRProgram& ir, const IRFunction& fn, const IRInstr& ins, ostream& os) {
+    auto operand = [&](Operand o) { printOperand(ir, fn, o, os); };
+    switch (ins.op) {
+        case IROp::Label:
+            operand(ins.a);
+            os << ":";
+            break;
+        case IROp::Goto:
+            os << "goto ";
+            operand(ins.a);
+            break;
+        case IROp::IfGoto:
+            os << "if ";
+            operand(ins.a);
+            os << " goto ";
+            operand(ins.b);
+            break;
+        case IROp::Copy:
+            printDst(ir, fn, ins, os);
+            operand(ins.a);
+            break;
+        case IROp::IntToFloat:
+            printDst(ir, fn, ins, os);
+            os << "itof ";
+            operand(ins.a);
+            break;
+        case IROp::Param:
+            os << "param ";
+            operand(ins.a);
+            break;
+        case IROp::Call:
+            if (!ins.dst.isNone()) printDst(ir, fn, ins, os);
+            os << "call ";
+            operand(ins.a);
+            os << ", ";
+            operand(ins.b);
+            break;
+        case IROp::Return:
+            os << "return ";
+            operand(ins.a);
+            break;
+        case IROp::ReturnVoid:
+            os << "return";
+            break;
+        case IROp::IndexLoad:
+            printDst(ir, fn, ins, os);
+            operand(ins.a);
+            os << "[";
+            operand(ins.b);
+            os << "]";
+            break;
+        case IROp::Phi:
+            printDst(ir, fn, ins, os);
+            os << "phi";
+            for (uint32_t i = 0; i < ins.b.index(); ++i) {
+                const PhiArg& arg = fn.phiArgs[ins.a.index() + i];
+                os << (i ? ", [" : " [");
+                operand(arg.label);
+                os << ": ";
+                operand(arg.value);
+                os << "]";
+            }
+            break;
+        case IROp::IndexStore:
+            operand(ins.dst);
+            os << "[";
+            operand(ins.a);
+            os << "] = ";
+            operand(ins.b);
+            break;
+        default:
+            printDst(ir, fn, ins, os);
+            if (isUnaryOp(ins.op)) {
+                printOp(ins, os);
+                operand(ins.a);
+            } else {
+                operand(ins.a);
+                os << " ";
+                printOp(ins, os);
+                os << " ";
+                operand(ins.b);
+            }
+            break;
+    }
+}
+
 void printIRProgram(const IRProgram& ir, ostream& os) {
     for (const auto& g : ir.globals) {
         os << "global " << g.type.str() << " " << g.name;
-        if (g.hasInit) {
-            os << " = " << g.initValue;
+        if (!g.init.isNone()) {
+            os << " = " << ir.constants[g.init.index()].text;
         }
         os << "\n";
     }
     if (!ir.globals.empty()) os << "\n";
     for (const auto& fn : ir.functions) {
         os << "function " << fn.name << "(";
-        for (size_t i = 0; i < fn.params.size(); ++i) {
-            os << fn.params[i];
-            if (i + 1 < fn.params.size()) os << ", ";
+        for (uint32_t i = 0; i < fn.paramCount; ++i) {
+            printVar(fn.vars[i], os);
+            if (i + 1 < fn.paramCount) os << ", ";
         }
         os << ")\n";
+        for (size_t i = fn.paramCount; i < fn.vars.size(); ++i) {
+            os << "  local ";
+            printVar(fn.vars[i], os);
+            os << "\n";
+        }
         for (const auto& ins : fn.instructions) {
             os << "  ";
-            switch (ins.kind) {
-                case IRInstrKind::Label:
-                    os << ins.info << ":";
-                    break;
-                case IRInstrKind::Goto:
-                    os << "goto " << ins.info;
-                    break;
-                case IRInstrKind::IfGoto:
-                    os << "if " << ins.src1 << " goto " << ins.info;
-                    break;
-                case IRInstrKind::Assign:
-                    os << ins.dst << " = " << ins.src1;
-                    break;
-                case IRInstrKind::Unary:
-                    os << ins.dst << " = " << ins.info << ins.src1;
-                    break;
-                case IRInstrKind::Binary:
-                    os << ins.dst << " = " << ins.src1 << " " << ins.info << " " << ins.src2;
-                    break;
-                case IRInstrKind::Param:
-                    os << "param " << ins.src1;
-                    break;
-                case IRInstrKind::Call:
-                    if (!ins.dst.empty()) {
-                        os << ins.dst << " = call " << ins.info << ", " << ins.src1;
-                    } else {
-                        os << "call " << ins.info << ", " << ins.src1;
-                    }
-                    break;
-                case IRInstrKind::Return:
-                    os << "return " << ins.src1;
-                    break;
-                case IRInstrKind::ReturnVoid:
-                    os << "return";
-                    break;
-                case IRInstrKind::IndexLoad:
-                    os << ins.dst << " = " << ins.src1 << "[" << ins.src2 << "]";
-                    break;
-                case IRInstrKind::IndexStore:
-                    os << ins.dst << "[" << ins.src1 << "] = " << ins.src2;
-                    break;
-            }
+            printIRInstr(ir, fn, ins, os);
             os << "\n";
         }
         os << "end\n\n";
@@ -2,14 +2,23 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
 #include "typechk.hpp"
 
 using namespace std;
 
-enum class IRInstrKind {
-    Assign,
-    Unary,
-    Binary,
+enum class IROp : uint8_t {
+    Copy,
+    // unary
+    Neg, Pos, Not, BitNot, IntToFloat,
+    // binary
+    Add, Sub, Mul, Div, Mod,
+    Shl, Shr, BitAnd, BitOr, BitXor,
+    And, Or,
+    Eq, Neq, Lt, Le, Gt, Ge,
+    // control and memory
     Label,
     Goto,
     IfGoto,
@@ -18,35 +27,178 @@ enum class IRInstrKind {
     Return,
     ReturnVoid,
     IndexLoad,
-    IndexStore
+    IndexStore,
+    Phi
 };
 
+enum class OperandKind : uint8_t {
+    None,
+    Temp,    // function-local temporary id
+    Local,   // slot in IRFunction::vars (params first)
+    Global,  // index into IRProgram::globals
+    Const,   // index into IRProgram::constants
+    Label,   // index into IRProgram::labelBases
+    Func,    // index into IRProgram::functions
+    Imm      // small unsigned immediate (call argument count, phi argument range)
+};
+
+// A tagged 32-bit operand: kind in the top 3 bits, index in the rest.
+struct Operand {
+    uint32_t bits = 0;
+
+    static constexpr uint32_t indexMask = (1u << 29) - 1;
+    static Operand make(OperandKind k, uint32_t index) { return Operand{((uint32_t)k << 29) | (index & indexMask)}; }
+    static Operand none() { return Operand{}; }
+    static Operand temp(uint32_t id) { return make(OperandKind::Temp, id); }
+    static Operand local(uint32_t slot) { return make(OperandKind::Local, slot); }
+    static Operand global(uint32_t index) { return make(OperandKind::Global, index); }
+    static Operand constant(uint32_t index) { return make(OperandKind::Const, index); }
+    static Operand label(uint32_t id) { return make(OperandKind::Label, id); }
+    static Operand func(uint32_t index) { return make(OperandKind::Func, index); }
+    static Operand imm(uint32_t value) { return make(OperandKind::Imm, value); }
+
+    OperandKind kind() const { return (OperandKind)(bits >> 29); }
+    uint32_t index() const { return bits & indexMask; }
+    bool isNone() const { return bits == 0; }
+    bool operator==(const Operand& o) const { return bits == o.bits; }
+    bool operator!=(const Operand& o) const { return bits != o.bits; }
+};
+
+// Fixed 16-byte record. type is the type of dst (or of the value consumed by
+// Param/Return/IfGoto/IndexStore); opType is the type Unary/Binary operate on.
+// Operand roles by op:
+//   Copy/unary      dst = op a
+//   binary          dst = a op b
+//   Label/Goto      a = label
+//   IfGoto          if a goto b(label)
+//   Param/Return    a = value
+//   Call            dst = call a(func), b(imm argc); dst is None for void calls
+//   IndexLoad       dst = a[b]
+//   IndexStore      dst[a] = b  (dst is the array, read not written)
+//   Phi             dst = phi of IRFunction::phiArgs[a, a + b) (both Imm)
 struct IRInstr {
-    IRInstrKind kind;
-    string dst;
-    string src1;
-    string src2;
-    string info;
+    IROp op;
+    Type type;
+    Type opType;
+    uint8_t reserved = 0;
+    Operand dst;
+    Operand a;
+    Operand b;
+};
+static_assert(sizeof(IRInstr) == 16, "IRInstr must stay a 16-byte record");
+
+// Values of this type pass in float registers in the native backends.
+inline bool isFloat(Type t) { return t.kind == TypeKind::Float; }
+inline bool isUnaryOp(IROp op) { return op >= IROp::Neg && op <= IROp::IntToFloat; }
+inline bool isBinaryOp(IROp op) { return op >= IROp::Add && op <= IROp::Ge; }
+inline bool isTerminator(IROp op) {
+    return op == IROp::Goto || op == IROp::IfGoto || op == IROp::Return || op == IROp::ReturnVoid;
+}
+inline bool writesDst(const IRInstr& ins) {
+    return ins.op != IROp::IndexStore && !ins.dst.isNone();
+}
+inline bool readsA(IROp op) {
+    return op == IROp::Copy || isUnaryOp(op) || isBinaryOp(op) || op == IROp::IfGoto || op == IROp::Param ||
+           op == IROp::Return || op == IROp::IndexLoad || op == IROp::IndexStore;
+}
+inline bool readsB(IROp op) {
+    return isBinaryOp(op) || op == IROp::IndexLoad || op == IROp::IndexStore;
+}
+
+// Calls f(Operand&) on every operand ins reads. Phi arguments live in
+// IRFunction::phiArgs and are not visited.
+template <class Instr, class F>
+void forEachUse(Instr& ins, F f) {
+    if (ins.op == IROp::IndexStore) f(ins.dst);
+    if (readsA(ins.op)) f(ins.a);
+    if (readsB(ins.op)) f(ins.b);
+}
+
+// Run-time limits every engine enforces (IRExecutor, the VM, the JIT and
+// the assembly and C backends), so they all stop on the same programs. A
+// call made with maxCallDepth frames live, the entry's included, fails with
+// callStackOverflow followed by " in " and the caller's name.
+constexpr uint32_t maxCallDepth = 100000;
+constexpr const char* callStackOverflow = "call stack overflow";
+constexpr int64_t maxArrayLength = int64_t(1) << 24;
+
+struct IRProgram;
+
+// True if ins does more than compute dst: control flow, calls, stores to
+// memory or globals, or a possible run-time error (integer division by a
+// divisor that may be 0 or -1, an index that may be negative).
+bool hasSideEffects(const IRProgram& ir, const IRInstr& ins);
+
+struct IRVar {
+    string name;
+    Type type;
+};
+
+// Incoming value of a phi along the edge from the block labelled label.
+struct PhiArg {
+    Operand label;
+    Operand value;
 };
 
 struct IRFunction {
     string name;
-    vector<string> params;
+    vector<IRVar> vars;  // params are vars[0, paramCount)
+    uint32_t paramCount = 0;
+    uint32_t tempCount = 0;
     vector<IRInstr> instructions;
+    vector<PhiArg> phiArgs;
+    bool inSSA = false;
+};
+
+struct IRConst {
+    Type type;
+    string text;  // source spelling, used by the printer
+    int64_t intValue = 0;
+    double floatValue = 0;
 };
 
 struct IRGlobal {
     string name;
     Type type;
-    bool hasInit;
-    string initValue;
+    Operand init;  // Const operand, or None
 };
 
 struct IRProgram {
     vector<IRGlobal> globals;
     vector<IRFunction> functions;
+    vector<IRConst> constants;    // interned per program
+    vector<const char*> labelBases;  // label id -> "if_then", "while_cond", ...
+    unordered_map<string, uint32_t> constantIndex;  // type tag + spelling -> constants index
+
+    string labelName(uint32_t id) const { return string(labelBases[id]) + "_" + to_string(id); }
+    Operand constant(Type type, const string& text, int64_t intValue, double floatValue);
+    Operand intConstant(Type type, int64_t value);  // int, bool or char
+    Operand floatConstant(double value);
 };
 
+// True if instruction i of fn is a Call followed straight away by a Return
+// of its result ("t = call f, n; return t"), or a void Call by a
+// ReturnVoid or the end of fn, so the callee can take over fn's frame.
+bool isTailCall(const IRFunction& fn, size_t i);
+
+// Locals past the parameters that a run of fn may read before it writes
+// them, and so must read as zero. Only the instructions before the first
+// label or branch are followed; any local not written there counts.
+vector<uint8_t> localsReadBeforeWrite(const IRFunction& fn);
+
+// An instruction for a pass to insert; opType is left Unknown, as copies,
+// labels and jumps have no operand type.
+inline IRInstr makeInstr(IROp op, Type type, Operand dst, Operand a, Operand b = Operand::none()) {
+    IRInstr ins;
+    ins.op = op;
+    ins.type = type;
+    ins.opType = Type::Unknown();
+    ins.dst = dst;
+    ins.a = a;
+    ins.b = b;
+    return ins;
+}
+
 enum class IRGenError {
     UnsupportedExpression,
     UnsupportedStatement,
@@ -72,13 +224,22 @@ private:
     IRProgram irProgram;
     vector<IRGenDiagnostic> diagnostics;
     IRFunction* currentFunction;
-    int tempCounter;
-    int labelCounter;
+    unordered_map<string, uint32_t> globalIndex;
+    unordered_map<string, uint32_t> functionIndex;
+    unordered_set<string> functionNames;  // IR names taken in the current function
+    unordered_map<string, int> nextSuffix;
+    unordered_map<const Symbol*, uint32_t> localSlots;
+    unordered_map<string, uint32_t> paramSlots;
 
     void report(IRGenError kind, const Node* where, const string& message);
-    string createTemp();
-    string createLabel(const string& base);
-    void emit(const IRInstr& instr);
+    Operand createTemp();
+    Operand createLabel(const char* base);
+    void emit(IROp op, Type type, Operand dst = Operand::none(), Operand a = Operand::none(), Operand b = Operand::none(), Type opType = Type::Unknown());
+    Operand literalConstant(const Expr* e);
+    uint32_t declareLocal(const VarDeclStmt* s);
+    uint32_t declareHidden(const char* base, Type type);
+    Operand variable(const Ident* id) const;
+    Operand convert(Operand value, Type from, Type to);
 
     void generateTopLevelDecl(const Decl* decl);
     void generateFunction(const FunctionDecl* fn);
@@ -92,15 +253,20 @@ private:
     void generateReturn(const ReturnStmt* s);
     void generateExprStmt(const ExprStmt* s);
     void generateVarDeclStmt(const VarDeclStmt* s);
+    void generateCondition(const Expr* e, Operand trueLabel, Operand falseLabel);
 
-    string generateExpr(const Expr* expr);
-    string generateUnary(const UnaryExpr* e);
-    string generateBinary(const BinaryExpr* e);
-    string generateCall(const CallExpr* e);
-    string generateIndex(const IndexExpr* e);
-    string generateIdentifier(const Ident* id);
+    Operand generateExpr(const Expr* expr);
+    Operand generateUnary(const UnaryExpr* e);
+    Operand generateBinary(const BinaryExpr* e);
+    Operand generateLogical(const BinaryExpr* e);
+    Operand generateCall(const CallExpr* e);
+    Operand generateIndex(const IndexExpr* e);
+    Operand generateIdentifier(const Ident* id);
 
-    string opStringForBinary(BinaryOp op) const;
+    IROp opForBinary(BinaryOp op) const;
 };
 
+const char* irOpName(IROp op);
+void printOperand(const IRProgram& ir, const IRFunction& fn, Operand o, ostream& os);
+void printIRInstr(const IRProgram& ir, const IRFunction& fn, const IRInstr& ins, ostream& os);
 void printIRProgram(const IRProgram& ir, ostream& os);
@@ -0,0 +1,269 @@
+#include "irexec.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+struct IRExecutor::Frame {
+    uint32_t function = 0;
+    uint32_t pc = 0;
+    Operand previous, current;  // labels, for phis
+    Operand dst;                // where the caller takes the result
+    Slot result{0};
+    vector<Slot> locals, temps, pending;
+    unordered_map<uint32_t, vector<Slot>> arrays;  // local slot -> elements
+};
+
+IRExecutor::IRExecutor(const IRProgram& program) : ir(program), perOp((size_t)IROp::Phi + 1, 0) {
+    for (const auto& fn : ir.functions) {
+        vector<uint32_t> pcs(ir.labelBases.size(), UINT32_MAX);
+        for (uint32_t i = 0; i < fn.instructions.size(); ++i) {
+            if (fn.instructions[i].op == IROp::Label) pcs[fn.instructions[i].a.index()] = i;
+        }
+        labelPc.push_back(move(pcs));
+    }
+    for (const auto& g : ir.globals) {
+        Slot v{0};
+        if (!g.init.isNone()) v = read(Frame(), g.init);
+        globals.push_back(v);
+    }
+}
+
+bool IRExecutor::run(const string& entry) {
+    errorMessage.clear();
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        if (ir.functions[f].name != entry) continue;
+        try {
+            call(f);
+            return true;
+        } catch (const runtime_error& e) {
+            errorMessage = e.what();
+            return false;
+        }
+    }
+    errorMessage = "no function named " + entry;
+    return false;
+}
+
+IRExecutor::Slot IRExecutor::read(const Frame& frame, Operand o) const {
+    Slot v{0};
+    switch (o.kind()) {
+        case OperandKind::Temp: return frame.temps[o.index()];
+        case OperandKind::Local: return frame.locals[o.index()];
+        case OperandKind::Global: return globals[o.index()];
+        case OperandKind::Const: {
+            const IRConst& c = ir.constants[o.index()];
+            if (c.type.kind == TypeKind::Float) v.f = c.floatValue;
+            else if (c.type.kind == TypeKind::String) v.i = o.index();
+            else v.i = c.intValue;
+            return v;
+        }
+        case OperandKind::Imm: v.i = o.index(); return v;
+        default: return v;
+    }
+}
+
+void IRExecutor::write(Frame& frame, Operand o, Slot v) {
+    switch (o.kind()) {
+        case OperandKind::Temp: frame.temps[o.index()] = v; break;
+        case OperandKind::Local: frame.locals[o.index()] = v; break;
+        case OperandKind::Global: globals[o.index()] = v; break;
+        default: break;
+    }
+}
+
+vector<IRExecutor::Slot>& IRExecutor::element(Frame& frame, Operand base, int64_t index, const IRFunction& fn) {
+    if (index < 0) throw runtime_error("negative array index " + to_string(index) + " in " + fn.name);
+    if (index >= maxArrayLength) throw runtime_error("array index " + to_string(index) + " out of range in " + fn.name);
+    auto& elements = frame.arrays[base.index()];
+    if ((uint64_t)index >= elements.size()) elements.resize((size_t)index + 1, Slot{0});
+    return elements;
+}
+
+IRExecutor::Slot IRExecutor::evaluate(const IRInstr& ins, Slot a, Slot b, const IRFunction& fn) const {
+    Slot r{0};
+    TypeKind kind = ins.opType.kind;
+    if (ins.op == IROp::IntToFloat) {
+        r.f = (double)a.i;
+        return r;
+    }
+    if (kind == TypeKind::Float) {
+        switch (ins.op) {
+            case IROp::Neg: r.f = -a.f; break;
+            case IROp::Pos: r.f = a.f; break;
+            case IROp::Add: r.f = a.f + b.f; break;
+            case IROp::Sub: r.f = a.f - b.f; break;
+            case IROp::Mul: r.f = a.f * b.f; break;
+            case IROp::Div: r.f = a.f / b.f; break;
+            case IROp::Mod: r.f = fmod(a.f, b.f); break;
+            case IROp::Eq: r.i = a.f == b.f; break;
+            case IROp::Neq: r.i = a.f != b.f; break;
+            case IROp::Lt: r.i = a.f < b.f; break;
+            case IROp::Le: r.i = a.f <= b.f; break;
+            case IROp::Gt: r.i = a.f > b.f; break;
+            case IROp::Ge: r.i = a.f >= b.f; break;
+            default: break;
+        }
+        return r;
+    }
+    if (kind == TypeKind::String) {
+        bool same = ir.constants[a.i].text == ir.constants[b.i].text;
+        r.i = ins.op == IROp::Eq ? same : !same;
+        return r;
+    }
+    uint64_t x = (uint64_t)a.i, y = (uint64_t)b.i;
+    switch (ins.op) {
+        case IROp::Neg: r.i = (int64_t)(0 - x); break;
+        case IROp::Pos: r.i = a.i; break;
+        case IROp::Not: r.i = !a.i; break;
+        case IROp::BitNot: r.i = ~a.i; break;
+        case IROp::Add: r.i = (int64_t)(x + y); break;
+        case IROp::Sub: r.i = (int64_t)(x - y); break;
+        case IROp::Mul: r.i = (int64_t)(x * y); break;
+        case IROp::Div:
+        case IROp::Mod:
+            if (b.i == 0) throw runtime_error("division by zero in " + fn.name);
+            if (b.i == -1) r.i = ins.op == IROp::Div ? (int64_t)(0 - x) : 0;
+            else r.i = ins.op == IROp::Div ? a.i / b.i : a.i % b.i;
+            break;
+        case IROp::Shl: r.i = (int64_t)(x << (y & 63)); break;
+        case IROp::Shr: r.i = a.i >> (y & 63); break;
+        case IROp::BitAnd: r.i = a.i & b.i; break;
+        case IROp::BitOr: r.i = a.i | b.i; break;
+        case IROp::BitXor: r.i = a.i ^ b.i; break;
+        case IROp::And: r.i = a.i && b.i; break;
+        case IROp::Or: r.i = a.i || b.i; break;
+        case IROp::Eq: r.i = a.i == b.i; break;
+        case IROp::Neq: r.i = a.i != b.i; break;
+        case IROp::Lt: r.i = a.i < b.i; break;
+        case IROp::Le: r.i = a.i <= b.i; break;
+        case IROp::Gt: r.i = a.i > b.i; break;
+        case IROp::Ge: r.i = a.i >= b.i; break;
+        default: break;
+    }
+    return r;
+}
+
+// Frames live on an explicit stack rather than the host's, so a recursion
+// as deep as the other engines allow costs heap, not native stack.
+IRExecutor::Slot IRExecutor::call(uint32_t entry) {
+    vector<Frame> frames;
+    auto enter = [&](uint32_t f, Operand dst, vector<Slot> args) {
+        const IRFunction& fn = ir.functions[f];
+        Frame frame;
+        frame.function = f;
+        frame.dst = dst;
+        frame.locals.assign(fn.vars.size(), Slot{0});
+        frame.temps.assign(fn.tempCount, Slot{0});
+        for (uint32_t i = 0; i < fn.paramCount && i < args.size(); ++i) frame.locals[i] = args[i];
+        frames.push_back(move(frame));
+    };
+    enter(entry, Operand::none(), {});
+    vector<Slot> incoming;
+    for (;;) {
+        Frame& frame = frames.back();
+        const IRFunction& fn = ir.functions[frame.function];
+        const auto& code = fn.instructions;
+        if (frame.pc >= code.size()) {
+            Frame done = move(frame);
+            frames.pop_back();
+            if (frames.empty()) return done.result;
+            if (!done.dst.isNone()) write(frames.back(), done.dst, done.result);
+            continue;
+        }
+        const auto& pcs = labelPc[frame.function];
+        const IRInstr& ins = code[frame.pc++];
+        if (ins.op == IROp::Label) {
+            frame.previous = frame.current;
+            frame.current = ins.a;
+            continue;
+        }
+        if (++total > stepLimit) throw runtime_error("step limit of " + to_string(stepLimit) + " instructions exceeded");
+        perOp[(size_t)ins.op]++;
+        switch (ins.op) {
+            case IROp::Goto:
+                frame.pc = pcs[ins.a.index()];
+                break;
+            case IROp::IfGoto:
+                if (read(frame, ins.a).i) frame.pc = pcs[ins.b.index()];
+                break;
+            case IROp::Param:
+                frame.pending.push_back(read(frame, ins.a));
+                break;
+            case IROp::Call: {
+                uint32_t argc = ins.b.index();
+                vector<Slot> args(frame.pending.end() - argc, frame.pending.end());
+                Operand dst = ins.dst;
+                if (isTailCall(fn, frame.pc - 1)) {
+                    // The callee takes over the frame, as the VM's TailCall does.
+                    dst = frame.dst;
+                    frames.pop_back();
+                } else {
+                    if (frames.size() >= maxCallDepth) throw runtime_error(string(callStackOverflow) + " in " + fn.name);
+                    frame.pending.resize(frame.pending.size() - argc);
+                }
+                enter(ins.a.index(), dst, move(args));  // frame is gone from here on
+                break;
+            }
+            case IROp::Return:
+                frame.result = read(frame, ins.a);
+                frame.pc = (uint32_t)code.size();
+                break;
+            case IROp::ReturnVoid:
+                frame.pc = (uint32_t)code.size();
+                break;
+            case IROp::IndexLoad: {
+                int64_t index = read(frame, ins.b).i;
+                write(frame, ins.dst, element(frame, ins.a, index, fn)[index]);
+                break;
+            }
+            case IROp::IndexStore: {
+                int64_t index = read(frame, ins.a).i;
+                element(frame, ins.dst, index, fn)[index] = read(frame, ins.b);
+                break;
+            }
+            case IROp::Phi: {
+                // The phis at the top of a block read their arguments together.
+                uint32_t first = frame.pc - 1;
+                incoming.clear();
+                for (uint32_t i = first; i < code.size() && code[i].op == IROp::Phi; ++i) {
+                    const IRInstr& phi = code[i];
+                    for (uint32_t k = 0; k < phi.b.index(); ++k) {
+                        const PhiArg& arg = fn.phiArgs[phi.a.index() + k];
+                        if (arg.label == frame.previous) incoming.push_back(read(frame, arg.value));
+                    }
+                    if (incoming.size() != i - first + 1) throw runtime_error("phi without an argument for its incoming edge in " + fn.name);
+                }
+                for (uint32_t k = 0; k < incoming.size(); ++k) write(frame, code[first + k].dst, incoming[k]);
+                total += incoming.size() - 1;
+                perOp[(size_t)IROp::Phi] += incoming.size() - 1;
+                frame.pc = first + (uint32_t)incoming.size();
+                break;
+            }
+            case IROp::Copy:
+                write(frame, ins.dst, read(frame, ins.a));
+                break;
+            default:
+                write(frame, ins.dst, evaluate(ins, read(frame, ins.a), read(frame, ins.b), fn));
+                break;
+        }
+    }
+}
+
+void IRExecutor::printGlobals(ostream& os) const {
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        const IRGlobal& global = ir.globals[g];
+        os << global.name << " = ";
+        switch (global.type.kind) {
+            case TypeKind::Float: os << globals[g].f; break;
+            case TypeKind::String:
+                if ((uint64_t)globals[g].i < ir.constants.size()) os << ir.constants[globals[g].i].text;
+                break;
+            case TypeKind::Bool: os << (globals[g].i ? "true" : "false"); break;
+            case TypeKind::Char: os << "'" << (char)globals[g].i << "'"; break;
+            default: os << globals[g].i; break;
+        }
+        os << "\n";
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include "ir.hpp"
+
+using namespace std;
+
+// Runs an IRProgram directly and counts what it executes. It is the
+// reference semantics the optimizer is measured (and checked) against, not
+// a fast engine: every value is an 8-byte slot, int arithmetic wraps, local
+// arrays grow on demand, and integer division by zero, a negative index or
+// a call past maxCallDepth stops the run with the error the VM would give.
+// A tail call (isTailCall) replaces its caller's frame, as in the VM.
+class IRExecutor {
+public:
+    explicit IRExecutor(const IRProgram& ir);
+
+    // Runs entry with no arguments. Returns false on a run-time error or once
+    // more than stepLimit instructions have run.
+    bool run(const string& entry = "main");
+    void setStepLimit(uint64_t limit) { stepLimit = limit; }
+
+    const string& error() const { return errorMessage; }
+    uint64_t executed() const { return total; }  // labels excluded
+    uint64_t executed(IROp op) const { return perOp[(size_t)op]; }
+    void printGlobals(ostream& os) const;
+
+private:
+    union Slot {
+        int64_t i;
+        double f;  // strings hold their constant index in i
+    };
+    struct Frame;
+
+    const IRProgram& ir;
+    vector<vector<uint32_t>> labelPc;  // function -> label id -> instruction
+    vector<Slot> globals;
+    uint64_t total = 0, stepLimit = UINT64_MAX;
+    vector<uint64_t> perOp;
+    string errorMessage;
+
+    Slot call(uint32_t entry);
+    Slot read(const Frame& frame, Operand o) const;
+    void write(Frame& frame, Operand o, Slot v);
+    vector<Slot>& element(Frame& frame, Operand base, int64_t index, const IRFunction& fn);
+    Slot evaluate(const IRInstr& ins, Slot a, Slot b, const IRFunction& fn) const;
+};
@@ -0,0 +1,324 @@
+#include "ivopt.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include <unordered_map>
+#include <climits>
+
+using namespace std;
+
+namespace {
+
+// i = phi(init from the preheader, next from the latch), next = i +/- step.
+struct BasicIV {
+    uint32_t phi;   // code index of the phi
+    uint32_t next;  // code index of the instruction defining the latch value
+    Operand dst, init, step;
+    bool sub;
+};
+
+}  // namespace
+
+static bool isInt(Type t) { return t.kind == TypeKind::Int; }
+
+static bool checkedAdd(int64_t a, int64_t b, int64_t& out) {
+    if (b > 0 ? a > INT64_MAX - b : a < INT64_MIN - b) return false;
+    out = a + b;
+    return true;
+}
+
+static bool checkedMul(int64_t a, int64_t b, int64_t& out) {
+    if (a != 0 && b != 0) {
+        if (a == -1 || b == -1) {
+            if (a == INT64_MIN || b == INT64_MIN) return false;
+        } else if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+                         : (b > 0 ? a < INT64_MIN / b : b < INT64_MAX / a)) {
+            return false;
+        }
+    }
+    out = a * b;
+    return true;
+}
+
+static IROp mirrored(IROp op) {
+    switch (op) {
+        case IROp::Lt: return IROp::Gt;
+        case IROp::Le: return IROp::Ge;
+        case IROp::Gt: return IROp::Lt;
+        case IROp::Ge: return IROp::Le;
+        default: return op;
+    }
+}
+
+bool reduceInductionVariables(IRProgram& ir, IRFunction& fn) {
+    if (!fn.inSSA || fn.instructions.empty()) return false;
+    CFG cfg = buildCFG(fn);
+    vector<NaturalLoop> loops = findLoops(cfg);
+    if (loops.empty()) return false;
+
+    vector<IRInstr> code = fn.instructions;  // new instructions are appended
+    const uint32_t original = (uint32_t)code.size();
+    const uint32_t temps = fn.tempCount;
+    uint32_t n = cfg.blockCount();
+    vector<uint8_t> ssaLocal = ssaValueLocals(fn);
+    vector<uint8_t> assigned(fn.vars.size(), 0);
+    for (const auto& ins : code) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) assigned[ins.dst.index()] = 1;
+    }
+    auto valueId = [&](Operand o) -> uint32_t {
+        if (o.kind() == OperandKind::Temp) return o.index() < temps ? o.index() : CFG::none;
+        if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return temps + o.index();
+        return CFG::none;
+    };
+    vector<uint32_t> defOf(temps + fn.vars.size(), CFG::none), uses(temps + fn.vars.size(), 0);
+    vector<vector<uint32_t>> blockCode(n);
+    vector<uint32_t> blockOf(original);
+    auto countUse = [&](Operand& o) {
+        uint32_t id = valueId(o);
+        if (id != CFG::none) uses[id]++;
+    };
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            blockCode[b].push_back(i);
+            blockOf[i] = b;
+            uint32_t id = writesDst(code[i]) ? valueId(code[i].dst) : CFG::none;
+            if (id != CFG::none) defOf[id] = i;
+            forEachUse(code[i], countUse);
+        }
+    }
+    for (auto& arg : fn.phiArgs) countUse(arg.value);
+
+    unordered_map<uint32_t, Operand> rename;  // operand bits -> replacement
+    auto newTemp = [&]() { return Operand::temp(fn.tempCount++); };
+    auto emitBefore = [&](uint32_t b, IRInstr ins) {
+        auto& list = blockCode[b];
+        auto at = !list.empty() && isTerminator(code[list.back()].op) ? list.end() - 1 : list.end();
+        list.insert(at, (uint32_t)code.size());
+        code.push_back(ins);
+    };
+    auto binary = [](IROp op, Operand dst, Operand a, Operand b) {
+        IRInstr ins;
+        ins.op = op;
+        ins.type = Type::Int();
+        ins.opType = Type::Int();
+        ins.dst = dst;
+        ins.a = a;
+        ins.b = b;
+        return ins;
+    };
+    auto intValue = [&](Operand o, int64_t& v) {
+        if (o.kind() != OperandKind::Const || !isInt(ir.constants[o.index()].type)) return false;
+        v = ir.constants[o.index()].intValue;
+        return true;
+    };
+
+    vector<uint32_t> inLoop(n, CFG::none);
+    bool changed = false;
+    for (uint32_t k = 0; k < loops.size(); ++k) {
+        const NaturalLoop& loop = loops[k];
+        for (uint32_t b : loop.blocks) inLoop[b] = k;
+        uint32_t h = loop.header, ph = CFG::none, entries = 0;
+        for (uint32_t p : cfg.predecessors(h)) {
+            if (inLoop[p] != k) {
+                ph = p;
+                entries++;
+            }
+        }
+        if (entries != 1 || cfg.successors(ph).size() != 1 || loop.latches.size() != 1) continue;
+        uint32_t latch = loop.latches[0];
+        Operand phLabel = code[cfg.blockStart[ph]].a, latchLabel = code[cfg.blockStart[latch]].a;
+
+        auto invariant = [&](Operand o) {
+            if (o.kind() == OperandKind::Const) return true;
+            uint32_t id = valueId(o);
+            if (id == CFG::none) return o.kind() == OperandKind::Local && !assigned[o.index()];
+            return defOf[id] != CFG::none && inLoop[blockOf[defOf[id]]] != k;
+        };
+
+        vector<BasicIV> ivs;
+        for (uint32_t i = cfg.blockStart[h] + 1; i < cfg.blockStart[h + 1] && code[i].op == IROp::Phi; ++i) {
+            const IRInstr& phi = code[i];
+            if (!isInt(phi.type) || phi.b.index() != 2 || valueId(phi.dst) == CFG::none) continue;
+            BasicIV iv{i, CFG::none, phi.dst, Operand::none(), Operand::none(), false};
+            Operand next = Operand::none();
+            for (uint32_t a = 0; a < 2; ++a) {
+                const PhiArg& arg = fn.phiArgs[phi.a.index() + a];
+                if (arg.label == phLabel) iv.init = arg.value;
+                else if (arg.label == latchLabel) next = arg.value;
+            }
+            uint32_t id = valueId(next);
+            if (iv.init.isNone() || id == CFG::none || defOf[id] == CFG::none) continue;
+            const IRInstr& step = code[defOf[id]];
+            if (inLoop[blockOf[defOf[id]]] != k || !isInt(step.opType)) continue;
+            if (step.op == IROp::Add && step.b == phi.dst) iv.step = step.a;
+            else if ((step.op == IROp::Add || step.op == IROp::Sub) && step.a == phi.dst) iv.step = step.b;
+            if (iv.step.isNone() || !invariant(iv.step)) continue;
+            iv.next = defOf[id];
+            iv.sub = step.op == IROp::Sub;
+            ivs.push_back(iv);
+        }
+        if (ivs.empty()) continue;
+
+        // Two variables counting in lockstep: uses of the second become uses
+        // of the first and DCE drops its phi. Its step stays, now computed
+        // from the first; it may be used where the first's step is not
+        // available yet.
+        bool merged = false;
+        for (uint32_t x = 0; x < ivs.size(); ++x) {
+            for (uint32_t y = 0; y < x; ++y) {
+                if (ivs[x].init != ivs[y].init || ivs[x].step != ivs[y].step || ivs[x].sub != ivs[y].sub) continue;
+                if (rename.count(ivs[y].dst.bits)) continue;
+                rename[ivs[x].dst.bits] = ivs[y].dst;
+                merged = true;
+                break;
+            }
+        }
+        if (merged) {
+            changed = true;
+            continue;
+        }
+
+        // i * s and i << c become variables of their own, stepped by step * s.
+        struct Candidate {
+            Operand dst, scale;
+            uint32_t iv;
+        };
+        vector<Candidate> candidates;
+        bool reducedAny = false;
+        for (uint32_t b : loop.blocks) {
+            auto& list = blockCode[b];
+            size_t kept = 0;
+            for (uint32_t i : list) {
+                const IRInstr& ins = code[i];
+                Candidate c{ins.dst, Operand::none(), CFG::none};
+                if (i < original && valueId(ins.dst) != CFG::none && isInt(ins.type) && isInt(ins.opType) && (ins.op == IROp::Mul || ins.op == IROp::Shl)) {
+                    for (uint32_t v = 0; v < ivs.size() && c.scale.isNone(); ++v) {
+                        int64_t shift;
+                        if (ins.op == IROp::Mul && ins.a == ivs[v].dst && invariant(ins.b)) c.scale = ins.b;
+                        else if (ins.op == IROp::Mul && ins.b == ivs[v].dst && invariant(ins.a)) c.scale = ins.a;
+                        else if (ins.op == IROp::Shl && ins.a == ivs[v].dst && intValue(ins.b, shift) && shift >= 0 && shift < 64)
+                            c.scale = ir.intConstant(Type::Int(), (int64_t)((uint64_t)1 << shift));
+                        c.iv = v;
+                    }
+                }
+                int64_t one;
+                if (c.scale.isNone()) list[kept++] = i;
+                else if (intValue(c.scale, one) && one == 1) rename[c.dst.bits] = ivs[c.iv].dst;
+                else candidates.push_back(c);
+                reducedAny |= !c.scale.isNone();
+            }
+            list.resize(kept);
+        }
+        unordered_map<uint64_t, Operand> reduced;  // (iv, scale) -> new variable
+        for (const Candidate& c : candidates) {
+            const BasicIV& iv = ivs[c.iv];
+            uint64_t key = (uint64_t)iv.dst.bits << 32 | c.scale.bits;
+            auto it = reduced.find(key);
+            if (it == reduced.end()) {
+                int64_t x = 0, y = 0;
+                Operand start, stride, value = newTemp(), next = newTemp();
+                bool initConst = intValue(iv.init, x), scaleConst = intValue(c.scale, y);
+                if (initConst && (x == 0 || scaleConst)) {
+                    start = ir.intConstant(Type::Int(), (int64_t)((uint64_t)x * (uint64_t)y));
+                } else {
+                    start = newTemp();
+                    emitBefore(ph, binary(IROp::Mul, start, iv.init, c.scale));
+                }
+                bool stepConst = intValue(iv.step, x);
+                if (stepConst && x == 1) {
+                    stride = c.scale;
+                } else if (stepConst && scaleConst) {
+                    stride = ir.intConstant(Type::Int(), (int64_t)((uint64_t)x * (uint64_t)y));
+                } else {
+                    stride = newTemp();
+                    emitBefore(ph, binary(IROp::Mul, stride, iv.step, c.scale));
+                }
+                IRInstr phi = binary(IROp::Phi, value, Operand::imm((uint32_t)fn.phiArgs.size()), Operand::imm(2));
+                phi.opType = Type::Unknown();
+                fn.phiArgs.push_back({phLabel, start});
+                fn.phiArgs.push_back({latchLabel, next});
+                blockCode[h].insert(blockCode[h].begin() + 1, (uint32_t)code.size());
+                code.push_back(phi);
+                emitBefore(latch, binary(iv.sub ? IROp::Sub : IROp::Add, next, value, stride));
+                it = reduced.emplace(key, value).first;
+            }
+            rename[c.dst.bits] = it->second;
+        }
+        if (reducedAny) {
+            changed = true;
+            continue;  // use counts are stale until the next round
+        }
+
+        // Linear-function test replacement: when i only feeds its own step and
+        // the header's exit test "i < n", test a variable j = i * s instead.
+        // All constants, so the range i takes can be checked for overflow.
+        const IRInstr& term = code[cfg.blockStart[h + 1] - 1];
+        if (term.op != IROp::IfGoto || cfg.successors(h).size() != 2) continue;
+        uint32_t taken = cfg.blockOfLabel(term.b), other = CFG::none;
+        for (uint32_t s : cfg.successors(h)) {
+            if (s != taken) other = s;
+        }
+        uint32_t condId = valueId(term.a);
+        if (inLoop[taken] != k || inLoop[other] == k || condId == CFG::none || defOf[condId] == CFG::none) continue;
+        uint32_t test = defOf[condId];
+        if (blockOf[test] != h) continue;
+        IRInstr& cmp = code[test];
+        for (const BasicIV& iv : ivs) {
+            bool left = cmp.a == iv.dst;
+            if (!isInt(cmp.opType) || (!left && cmp.b != iv.dst)) continue;
+            int64_t init, step, bound;
+            if (uses[valueId(iv.dst)] != 2 || uses[valueId(code[iv.next].dst)] != 1) continue;
+            if (!intValue(iv.init, init) || !intValue(iv.step, step) || !intValue(left ? cmp.b : cmp.a, bound)) continue;
+            if (iv.sub) {
+                if (step == INT64_MIN) continue;
+                step = -step;
+            }
+            // Values i takes at the header: from init while the test holds,
+            // plus the one that fails it.
+            IROp rel = left ? cmp.op : mirrored(cmp.op);
+            int64_t lo = init, hi = init, last;
+            if (step > 0 && (rel == IROp::Lt || rel == IROp::Le)) {
+                if (!checkedAdd(bound, rel == IROp::Lt ? step - 1 : step, last)) continue;
+                hi = max(hi, last);
+            } else if (step < 0 && (rel == IROp::Gt || rel == IROp::Ge)) {
+                if (!checkedAdd(bound, rel == IROp::Gt ? step + 1 : step, last)) continue;
+                lo = min(lo, last);
+            } else {
+                continue;
+            }
+            for (const BasicIV& j : ivs) {
+                int64_t otherInit, otherStep, scale, scaled;
+                if (&j == &iv || !intValue(j.init, otherInit) || !intValue(j.step, otherStep)) continue;
+                if (j.sub) {
+                    if (otherStep == INT64_MIN) continue;
+                    otherStep = -otherStep;
+                }
+                if (otherStep % step != 0 || (scale = otherStep / step) <= 0) continue;
+                if (!checkedMul(init, scale, scaled) || scaled != otherInit) continue;
+                int64_t scaledBound;
+                if (!checkedMul(lo, scale, scaled) || !checkedMul(hi, scale, scaled) || !checkedMul(bound, scale, scaledBound)) continue;
+                (left ? cmp.a : cmp.b) = j.dst;
+                (left ? cmp.b : cmp.a) = ir.intConstant(Type::Int(), scaledBound);
+                changed = true;
+                break;
+            }
+            break;
+        }
+    }
+    if (!changed) return false;
+
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    auto resolve = [&](Operand& o) {
+        for (auto it = rename.find(o.bits); it != rename.end(); it = rename.find(o.bits)) o = it->second;
+    };
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i : blockCode[b]) {
+            IRInstr ins = code[i];
+            forEachUse(ins, resolve);
+            out.push_back(ins);
+        }
+    }
+    for (auto& arg : fn.phiArgs) resolve(arg.value);
+    fn.instructions.swap(out);
+    return true;
+}
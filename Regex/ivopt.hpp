@@ -0,0 +1,16 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Induction-variable optimization over a function in SSA form, for loops
+// with a preheader and a single latch.
+//
+// A basic induction variable is a header phi "i = phi(init, i +/- step)"
+// with a loop-invariant step. Two with the same init and step are merged.
+// A product "i * s" or shift "i << k" by an invariant becomes a new
+// induction variable stepped by an addition in the latch. When the header's
+// exit test "i < n" (constant n) is then the only other use of i, the test
+// is rewritten against the reduced variable and i dies; this is done only
+// when no value in the loop's range can overflow. Returns true if fn changed.
+bool reduceInductionVariables(IRProgram& ir, IRFunction& fn);
@@ -0,0 +1,1167 @@
+#include "jit.hpp"
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <sys/mman.h>
+#include "regalloc.hpp"
+
+using namespace std;
+
+static const size_t stackBytes = size_t(1) << 30;
+static const size_t pageBytes = 4096;
+
+enum : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+static const uint8_t intArgRegs[] = {RDI, RSI, RDX, RCX, R8, R9};
+
+// Condition codes, as in jcc and setcc.
+enum : uint8_t { CondAE = 3, CondE = 4, CondNE = 5, CondA = 7, CondP = 10, CondNP = 11, CondL = 12, CondGE = 13, CondLE = 14, CondG = 15 };
+
+// Group-1 arithmetic: the /digit of 81 and (8 * op + 3) for "op r64, r/m64".
+enum AluOp : uint8_t { Add = 0, Or = 1, And = 4, Sub = 5, Xor = 6, Cmp = 7 };
+
+enum FaultKind : uint32_t { DivisionByZero, StackOverflow };
+
+// Argument registers as JIT::invoke fills them for the trampoline.
+struct ArgumentRegisters {
+    int64_t ints[6];
+    double floats[8];
+};
+
+struct JITRuntime {
+    static thread_local JIT* active;
+
+    // Records the error and unwinds to JIT::enter. Nothing with a destructor
+    // may be alive in this frame at the longjmp.
+    [[noreturn]] static void fail(uint32_t function, const char* what, const int64_t* index = nullptr, const char* after = "") {
+        JIT& jit = *active;
+        jit.errorMessage = what;
+        if (index) jit.errorMessage += to_string(*index) + after;
+        jit.errorMessage += " in " + jit.ir.functions[function].name;
+        longjmp(jit.fault, 1);
+    }
+
+    // Address of element index of the array whose block is in *slot, growing
+    // the block (a length word, then the elements) as needed.
+    static int64_t* element(int64_t** slot, int64_t index, uint32_t function) {
+        if (index < 0) fail(function, "negative array index ", &index);
+        if (index >= maxArrayLength) fail(function, "array index ", &index, " out of range");
+        int64_t* block = *slot;
+        int64_t length = block ? block[0] : 0;
+        if (index >= length) {
+            int64_t grown = min(max(index + 1, 2 * length), maxArrayLength);
+            int64_t* bigger = (int64_t*)realloc(block, 8 * (grown + 1));
+            if (!bigger) fail(function, "out of memory");
+            active->arrays.erase(block);
+            active->arrays.insert(bigger);
+            memset(bigger + 1 + length, 0, 8 * (grown - length));
+            bigger[0] = grown;
+            *slot = block = bigger;
+        }
+        return block + 1 + index;
+    }
+
+    static void release(int64_t* block) {
+        if (!block) return;
+        active->arrays.erase(block);
+        free(block);
+    }
+
+    static int64_t stringEqual(const char* a, const char* b) {
+        return strcmp(a ? a : "", b ? b : "") == 0;
+    }
+
+    [[noreturn]] static void fault(uint32_t kind, uint32_t function) {
+        fail(function, kind == DivisionByZero ? "division by zero" : callStackOverflow);
+    }
+};
+
+thread_local JIT* JITRuntime::active = nullptr;
+
+namespace {
+
+// Operand of a ModRM-encoded instruction: a register, [base + disp], or a
+// word of the JIT's data area, addressed relative to rip.
+struct Place {
+    enum Kind : uint8_t { Register, Memory, Data } kind;
+    uint8_t reg;
+    int32_t disp;
+
+    static Place r(uint8_t reg) { return {Register, reg, 0}; }
+    static Place at(uint8_t base, int32_t disp) { return {Memory, base, disp}; }
+    static Place word(uint32_t index) { return {Data, 0, (int32_t)index}; }
+};
+
+class Assembler {
+public:
+    vector<uint8_t> bytes;
+
+    struct Fixup {
+        size_t at;
+        uint32_t label;
+    };
+    struct DataFixup {
+        size_t at, end;  // disp32 offset and the end of its instruction
+        uint32_t word;
+    };
+    vector<size_t> labels;
+    vector<Fixup> fixups;
+    vector<DataFixup> dataFixups;
+
+    uint32_t newLabel() {
+        labels.push_back(SIZE_MAX);
+        return (uint32_t)labels.size() - 1;
+    }
+    void bind(uint32_t label) { labels[label] = bytes.size(); }
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+    void u32(uint32_t v) {
+        for (int k = 0; k < 4; ++k) byte((uint8_t)(v >> (8 * k)));
+    }
+    void u64(uint64_t v) {
+        for (int k = 0; k < 8; ++k) byte((uint8_t)(v >> (8 * k)));
+    }
+
+    // [prefix] [REX] opcode ModRM [SIB] [disp]; immBytes of immediate must
+    // follow, for rip-relative displacements.
+    void encode(uint8_t prefix, bool w, initializer_list<uint8_t> opcode, uint8_t reg, Place rm, int immBytes = 0) {
+        if (prefix) byte(prefix);
+        uint8_t base = rm.kind == Place::Data ? 0 : rm.reg;
+        uint8_t rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+        if (rex != 0x40) byte(rex);
+        for (uint8_t b : opcode) byte(b);
+        uint8_t r = (uint8_t)((reg & 7) << 3);
+        switch (rm.kind) {
+            case Place::Register:
+                byte(0xC0 | r | (base & 7));
+                return;
+            case Place::Data:
+                byte(0x05 | r);
+                dataFixups.push_back({bytes.size(), bytes.size() + 4 + immBytes, (uint32_t)rm.disp});
+                u32(0);
+                return;
+            case Place::Memory: {
+                bool short8 = rm.disp >= -128 && rm.disp <= 127;
+                uint8_t mod = rm.disp == 0 && (base & 7) != RBP ? 0x00 : short8 ? 0x40 : 0x80;
+                byte(mod | r | (base & 7));
+                if ((base & 7) == RSP) byte(0x24);
+                if (mod == 0x40) byte((uint8_t)rm.disp);
+                else if (mod == 0x80) u32((uint32_t)rm.disp);
+                return;
+            }
+        }
+    }
+
+    void mov(uint8_t dst, Place src) { encode(0, true, {0x8B}, dst, src); }
+    void mov(Place dst, uint8_t src) { encode(0, true, {0x89}, src, dst); }
+    void movRegs(uint8_t dst, uint8_t src) {
+        if (dst != src) mov(dst, Place::r(src));
+    }
+    void movImm(uint8_t dst, int64_t v) {
+        if (v >= INT32_MIN && v <= INT32_MAX) {
+            encode(0, true, {0xC7}, 0, Place::r(dst));
+            u32((uint32_t)v);
+        } else {
+            byte(0x48 | (dst & 8 ? 1 : 0));
+            byte(0xB8 | (dst & 7));
+            u64((uint64_t)v);
+        }
+    }
+    void lea(uint8_t dst, Place src) { encode(0, true, {0x8D}, dst, src); }
+    void alu(AluOp op, uint8_t dst, Place src) { encode(0, true, {(uint8_t)(8 * op + 3)}, dst, src); }
+    void aluImm(AluOp op, Place dst, int32_t imm) {
+        encode(0, true, {0x81}, op, dst, 4);
+        u32((uint32_t)imm);
+    }
+    void imul(uint8_t dst, Place src) { encode(0, true, {0x0F, 0xAF}, dst, src); }
+    void imulImm(uint8_t dst, Place src, int32_t imm) {
+        encode(0, true, {0x69}, dst, src, 4);
+        u32((uint32_t)imm);
+    }
+    void test(Place a, uint8_t b) { encode(0, true, {0x85}, b, a); }
+    void group3(uint8_t digit, Place p) { encode(0, true, {0xF7}, digit, p); }  // 2 not, 3 neg, 7 idiv
+    void shiftCl(uint8_t digit, uint8_t reg) { encode(0, true, {0xD3}, digit, Place::r(reg)); }  // 4 shl, 7 sar
+    void cqo() {
+        byte(0x48);
+        byte(0x99);
+    }
+    void setcc(uint8_t cond, uint8_t reg8) { encode(0, false, {0x0F, (uint8_t)(0x90 + cond)}, 0, Place::r(reg8)); }
+    void movzxAl() { encode(0, false, {0x0F, 0xB6}, RAX, Place::r(RAX)); }
+    void btc63(uint8_t reg) {
+        encode(0, true, {0x0F, 0xBA}, 7, Place::r(reg), 1);
+        byte(63);
+    }
+
+    void sse(uint8_t prefix, uint8_t op, uint8_t xmm, Place rm) { encode(prefix, false, {0x0F, op}, xmm, rm); }
+    void movsdLoad(uint8_t xmm, Place src) { sse(0xF2, 0x10, xmm, src); }
+    void movsdStore(Place dst, uint8_t xmm) { sse(0xF2, 0x11, xmm, dst); }
+    void movapd(uint8_t dst, uint8_t src) {
+        if (dst != src) sse(0x66, 0x28, dst, Place::r(src));
+    }
+    void movqToXmm(uint8_t xmm, uint8_t gp) { encode(0x66, true, {0x0F, 0x6E}, xmm, Place::r(gp)); }
+    void movqFromXmm(uint8_t gp, uint8_t xmm) { encode(0x66, true, {0x0F, 0x7E}, xmm, Place::r(gp)); }
+    void cvtsi2sd(uint8_t xmm, uint8_t gp) { encode(0xF2, true, {0x0F, 0x2A}, xmm, Place::r(gp)); }
+
+    void push(Place p) { encode(0, false, {0xFF}, 6, p); }
+    void depth(uint8_t digit, uint32_t word) { encode(0, false, {0xFF}, digit, Place::word(word)); }  // 0 inc, 1 dec
+    void cmpDepth(uint32_t word, int32_t imm) {
+        encode(0, false, {0x81}, Cmp, Place::word(word), 4);
+        u32((uint32_t)imm);
+    }
+    void repStosq() {
+        byte(0xF3);
+        byte(0x48);
+        byte(0xAB);
+    }
+
+    void jmp(uint32_t label) { rel32({0xE9}, label); }
+    void jcc(uint8_t cond, uint32_t label) { rel32({0x0F, (uint8_t)(0x80 + cond)}, label); }
+    void call(uint32_t label) { rel32({0xE8}, label); }
+    void callAbsolute(const void* target) {
+        movImm(RAX, (int64_t)(intptr_t)target);
+        encode(0, false, {0xFF}, 2, Place::r(RAX));
+    }
+
+    // Fills in jumps; data words are patched once the code has its address.
+    void link() {
+        for (const auto& f : fixups) {
+            int64_t rel = (int64_t)labels[f.label] - (int64_t)(f.at + 4);
+            memcpy(&bytes[f.at], &rel, 4);
+        }
+    }
+
+private:
+    void rel32(initializer_list<uint8_t> opcode, uint32_t label) {
+        for (uint8_t b : opcode) byte(b);
+        fixups.push_back({bytes.size(), label});
+        u32(0);
+    }
+};
+
+// Layout of JIT::data, in 8-byte words.
+struct DataLayout {
+    uint32_t depth;       // after the globals
+    uint32_t firstConst;  // word of constant k is firstConst + k (floats only)
+    uint32_t words;
+};
+
+// Machine code for one function. Mirrors FunctionEmitter in x86.cpp.
+class FunctionCompiler {
+public:
+    FunctionCompiler(const IRProgram& ir, uint32_t index, Assembler& as, const vector<uint32_t>& entryLabels,
+                     const DataLayout& layout, const vector<const char*>& constantText, uint32_t argumentWords)
+        : ir(ir), fn(ir.functions[index]), index(index), as(as), entryLabels(entryLabels), layout(layout),
+          constantText(constantText), argumentWords(argumentWords) {}
+
+    // (IR label, assembler label) of each loop entry compile emits.
+    vector<pair<uint32_t, uint32_t>> loops;
+
+    // With loopEntries, also emits an entry at each loop header (a label
+    // some later jump goes back to) for on-stack replacement.
+    void compile(X86Registers registers, bool loopEntries = false) {
+        if (fn.inSSA) throw runtime_error("cannot compile " + fn.name + " while it is in SSA form");
+        if (registers == X86Registers::LinearScan) {
+            allocation = allocateRegisters(fn);
+            alloc = &allocation;
+        }
+        retLabel = as.newLabel();
+        divzeroLabel = as.newLabel();
+        overflowLabel = as.newLabel();
+        layOutFrame();
+        prologue();
+        if (alloc) resolve(CFG::none, 0);
+        for (at = 0; at < fn.instructions.size(); ++at) {
+            const IRInstr& ins = fn.instructions[at];
+            instruction(ins);
+            if (!alloc) continue;
+            uint32_t b = block();
+            bool jumps = ins.op == IROp::Goto || ins.op == IROp::IfGoto || ins.op == IROp::Return || ins.op == IROp::ReturnVoid;
+            if (!jumps && at + 1 == alloc->cfg.blockStart[b + 1] && b + 1 < alloc->cfg.blockCount()) resolve(b, b + 1);
+        }
+        as.alu(Xor, RAX, Place::r(RAX));
+        epilogue();
+        if (!loopEntries) return;
+        vector<uint8_t> seen(ir.labelBases.size(), 0);
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::Label) seen[ins.a.index()] = 1;
+            Operand target = ins.op == IROp::Goto ? ins.a : ins.op == IROp::IfGoto ? ins.b : Operand::none();
+            if (target.isNone() || !seen[target.index()]) continue;
+            seen[target.index()] = 0;
+            loops.push_back({target.index(), as.newLabel()});
+            loopEntry(target, loops.back().second);
+        }
+    }
+
+private:
+    const IRProgram& ir;
+    const IRFunction& fn;
+    uint32_t index;
+    Assembler& as;
+    const vector<uint32_t>& entryLabels;
+    const DataLayout& layout;
+    const vector<const char*>& constantText;
+    uint32_t argumentWords;  // see stackArgumentWords
+    uint32_t argBase = 0, stashSlot = 0, saveBase = 0, frameBytes = 0;
+    vector<uint32_t> arrays;
+    uint32_t pending = 0;
+    RegisterAllocation allocation;
+    const RegisterAllocation* alloc = nullptr;
+    uint32_t at = 0;
+    uint32_t retLabel = 0, divzeroLabel = 0, overflowLabel = 0;
+    unordered_map<uint32_t, uint32_t> irLabels;  // IR label id -> assembler label
+
+    struct EdgeStub {
+        uint32_t label, target, from, to;
+    };
+    vector<EdgeStub> stubs;
+
+    uint32_t label(Operand l) {
+        auto it = irLabels.find(l.index());
+        if (it != irLabels.end()) return it->second;
+        uint32_t id = as.newLabel();
+        irLabels[l.index()] = id;
+        return id;
+    }
+
+    Place slot(uint32_t k) const { return Place::at(RBP, -8 * (int32_t)(k + 1)); }
+
+    Place home(Operand o) const {
+        switch (o.kind()) {
+            case OperandKind::Local: return slot(o.index());
+            case OperandKind::Temp: return slot((uint32_t)fn.vars.size() + o.index());
+            case OperandKind::Global: return Place::word(o.index());
+            default: throw runtime_error("operand has no home in " + fn.name);
+        }
+    }
+
+    uint32_t block() const { return alloc->cfg.blockOf(at); }
+
+    int regOf(Operand o) const {
+        if (!alloc) return RegisterAllocation::memory;
+        if (o.kind() == OperandKind::Local) return alloc->location(o.index(), at);
+        if (o.kind() == OperandKind::Temp) return alloc->location((uint32_t)fn.vars.size() + o.index(), at);
+        return RegisterAllocation::memory;
+    }
+
+    void move(const SpillMove& m) {
+        int reg = m.to == RegisterAllocation::memory ? m.from : m.to;
+        uint8_t hw = (uint8_t)registerEncoding(reg);
+        if (m.to == RegisterAllocation::memory) {
+            if (isFloatRegister(reg)) as.movsdStore(slot(m.value), hw);
+            else as.mov(slot(m.value), hw);
+        } else {
+            if (isFloatRegister(reg)) as.movsdLoad(hw, slot(m.value));
+            else as.mov(hw, slot(m.value));
+        }
+    }
+
+    void resolve(uint32_t from, uint32_t to) {
+        for (const auto& m : alloc->edgeMoves(from, to)) move(m);
+    }
+
+    uint32_t jumpTarget(Operand l) {
+        if (!alloc) return label(l);
+        uint32_t from = block(), to = alloc->cfg.blockOfLabel(l);
+        if (alloc->edgeMoves(from, to).empty()) return label(l);
+        stubs.push_back({as.newLabel(), label(l), from, to});
+        return stubs.back().label;
+    }
+
+    void load(Operand o, uint8_t reg) {
+        switch (o.kind()) {
+            case OperandKind::Const: {
+                const IRConst& c = ir.constants[o.index()];
+                if (c.type.kind == TypeKind::String) {
+                    as.movImm(reg, (int64_t)(intptr_t)constantText[o.index()]);
+                    return;
+                }
+                int64_t v;
+                if (isFloat(c.type)) memcpy(&v, &c.floatValue, sizeof v);
+                else v = c.intValue;
+                as.movImm(reg, v);
+                return;
+            }
+            case OperandKind::Imm:
+                as.movImm(reg, o.index());
+                return;
+            default: {
+                int r = regOf(o);
+                if (r == RegisterAllocation::memory) as.mov(reg, home(o));
+                else if (isFloatRegister(r)) as.movqFromXmm(reg, (uint8_t)registerEncoding(r));
+                else as.movRegs(reg, (uint8_t)registerEncoding(r));
+                return;
+            }
+        }
+    }
+
+    void store(Operand o, uint8_t reg) {
+        int r = regOf(o);
+        if (r == RegisterAllocation::memory) as.mov(home(o), reg);
+        else if (isFloatRegister(r)) as.movqToXmm((uint8_t)registerEncoding(r), reg);
+        else as.movRegs((uint8_t)registerEncoding(r), reg);
+    }
+
+    // o as an integer source: a register or memory, else loaded into rcx.
+    // immediate is set instead when o is a constant that fits 32 bits.
+    Place source(Operand o, bool& immediate, int32_t& value) {
+        immediate = false;
+        if (o.kind() == OperandKind::Const) {
+            const IRConst& c = ir.constants[o.index()];
+            if (c.type.kind != TypeKind::String && !isFloat(c.type) && c.intValue >= INT32_MIN && c.intValue <= INT32_MAX) {
+                immediate = true;
+                value = (int32_t)c.intValue;
+                return Place::r(RCX);
+            }
+        } else {
+            int r = regOf(o);
+            if (r == RegisterAllocation::memory) return home(o);
+            if (!isFloatRegister(r)) return Place::r((uint8_t)registerEncoding(r));
+        }
+        load(o, RCX);
+        return Place::r(RCX);
+    }
+
+    void loadFloat(Operand o, uint8_t xmm) {
+        if (o.kind() == OperandKind::Const && isFloat(ir.constants[o.index()].type)) {
+            as.movsdLoad(xmm, Place::word(layout.firstConst + o.index()));
+            return;
+        }
+        if (o.kind() == OperandKind::Const || o.kind() == OperandKind::Imm) {
+            load(o, RAX);
+            as.movqToXmm(xmm, RAX);
+            return;
+        }
+        int r = regOf(o);
+        if (r == RegisterAllocation::memory) as.movsdLoad(xmm, home(o));
+        else if (!isFloatRegister(r)) as.movqToXmm(xmm, (uint8_t)registerEncoding(r));
+        else as.movapd(xmm, (uint8_t)registerEncoding(r));
+    }
+
+    Place floatSource(Operand o) {
+        if (o.kind() == OperandKind::Const && isFloat(ir.constants[o.index()].type)) return Place::word(layout.firstConst + o.index());
+        if (o.kind() != OperandKind::Const) {
+            int r = regOf(o);
+            if (r == RegisterAllocation::memory) return home(o);
+            if (isFloatRegister(r)) return Place::r((uint8_t)registerEncoding(r));
+        }
+        loadFloat(o, 1);
+        return Place::r(1);
+    }
+
+    void storeFloat(Operand o, uint8_t xmm) {
+        int r = regOf(o);
+        if (r == RegisterAllocation::memory) as.movsdStore(home(o), xmm);
+        else if (!isFloatRegister(r)) as.movqFromXmm((uint8_t)registerEncoding(r), xmm);
+        else as.movapd((uint8_t)registerEncoding(r), xmm);
+    }
+
+    void layOutFrame() {
+        vector<uint8_t> isArray(fn.vars.size(), 0);
+        uint32_t depth = 0, maxDepth = 0;
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::IndexLoad) isArray[ins.a.index()] = 1;
+            if (ins.op == IROp::IndexStore) isArray[ins.dst.index()] = 1;
+            if (ins.op == IROp::Param) maxDepth = max(maxDepth, ++depth);
+            if (ins.op == IROp::Call) depth -= min(depth, ins.b.index());
+        }
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+            if (isArray[v]) arrays.push_back(v);
+        }
+        argBase = (uint32_t)fn.vars.size() + fn.tempCount;
+        stashSlot = argBase + maxDepth;
+        saveBase = stashSlot + 1;
+        uint32_t saved = alloc ? (uint32_t)__builtin_popcount(alloc->calleeSaved) : 0;
+        frameBytes = (8 * (saveBase + saved) + 15) / 16 * 16;
+    }
+
+    void saveRegisters(bool save) {
+        if (!alloc) return;
+        uint32_t k = saveBase;
+        for (int r = 0; r < firstCallerSaved; ++r) {
+            if (!(alloc->calleeSaved >> r & 1)) continue;
+            if (save) as.mov(slot(k++), (uint8_t)registerEncoding(r));
+            else as.mov((uint8_t)registerEncoding(r), slot(k++));
+        }
+    }
+
+    void prologue() {
+        as.bind(entryLabels[index]);
+        as.byte(0x55);  // push rbp
+        as.mov(Place::r(RBP), RSP);
+        as.aluImm(Sub, Place::r(RSP), (int32_t)frameBytes);
+        as.depth(0, layout.depth);
+        saveRegisters(true);
+        uint32_t ints = 0, floats = 0, stacked = 0;
+        for (uint32_t p = 0; p < fn.paramCount; ++p) {
+            if (isFloat(fn.vars[p].type) && floats < 8) {
+                as.movsdStore(slot(p), (uint8_t)floats++);
+            } else if (!isFloat(fn.vars[p].type) && ints < 6) {
+                as.mov(slot(p), intArgRegs[ints++]);
+            } else {
+                as.mov(RAX, Place::at(RBP, 16 + 8 * (int32_t)stacked++));
+                as.mov(slot(p), RAX);
+            }
+        }
+        uint32_t zeroed = stashSlot + 1 - fn.paramCount;
+        if (zeroed) {
+            as.lea(RDI, slot(stashSlot));
+            as.movImm(RCX, zeroed);
+            as.alu(Xor, RAX, Place::r(RAX));
+            as.repStosq();
+        }
+    }
+
+    // Builds the frame like prologue, but takes every local and temp from
+    // the words at rdi, then enters the loop through the moves a jump from
+    // the function entry would make.
+    void loopEntry(Operand header, uint32_t entry) {
+        as.bind(entry);
+        as.byte(0x55);  // push rbp
+        as.mov(Place::r(RBP), RSP);
+        as.aluImm(Sub, Place::r(RSP), (int32_t)frameBytes);
+        as.depth(0, layout.depth);
+        saveRegisters(true);
+        for (uint32_t v = 0; v < argBase; ++v) {
+            as.mov(RAX, Place::at(RDI, 8 * (int32_t)v));
+            as.mov(slot(v), RAX);
+        }
+        if (alloc) resolve(CFG::none, alloc->cfg.blockOfLabel(header));
+        as.jmp(label(header));
+    }
+
+    void fail(FaultKind kind) {
+        as.movImm(RDI, kind);
+        as.movImm(RSI, index);
+        as.callAbsolute((const void*)&JITRuntime::fault);
+    }
+
+    void epilogue() {
+        as.bind(retLabel);
+        if (!arrays.empty()) {
+            as.mov(slot(stashSlot), RAX);
+            for (uint32_t v : arrays) {
+                as.mov(RDI, slot(v));
+                as.callAbsolute((const void*)&JITRuntime::release);
+            }
+            as.mov(RAX, slot(stashSlot));
+        }
+        saveRegisters(false);
+        as.depth(1, layout.depth);
+        as.movqToXmm(0, RAX);
+        as.byte(0xC9);  // leave
+        as.byte(0xC3);  // ret
+        as.bind(divzeroLabel);
+        fail(DivisionByZero);
+        as.bind(overflowLabel);
+        fail(StackOverflow);
+        for (const auto& stub : stubs) {
+            as.bind(stub.label);
+            resolve(stub.from, stub.to);
+            as.jmp(stub.target);
+        }
+    }
+
+    void call(const IRInstr& ins) {
+        const IRFunction& callee = ir.functions[ins.a.index()];
+        uint32_t argc = ins.b.index();
+        uint32_t first = pending - argc;
+        pending = first;
+        vector<uint32_t> stacked;
+        uint32_t ints = 0, floats = 0;
+        vector<pair<uint32_t, int>> inRegs;  // slot, int register or -(xmm + 1)
+        for (uint32_t i = 0; i < argc; ++i) {
+            bool f = i < callee.paramCount && isFloat(callee.vars[i].type);
+            if (f && floats < 8) inRegs.push_back({argBase + first + i, -(int)++floats});
+            else if (!f && ints < 6) inRegs.push_back({argBase + first + i, intArgRegs[ints++]});
+            else stacked.push_back(argBase + first + i);
+        }
+        // Tail call, as in emitX86: free the arrays, pass stacked arguments
+        // in our incoming slots, unwind, then jump to the callee.
+        if (isTailCall(fn, at)) {
+            for (uint32_t v : arrays) {
+                as.mov(RDI, slot(v));
+                as.callAbsolute((const void*)&JITRuntime::release);
+            }
+            for (size_t k = 0; k < stacked.size(); ++k) {
+                as.mov(RAX, slot(stacked[k]));
+                as.mov(Place::at(RBP, 16 + 8 * (int32_t)k), RAX);
+            }
+            for (const auto& r : inRegs) {
+                if (r.second < 0) as.movsdLoad((uint8_t)(-r.second - 1), slot(r.first));
+                else as.mov((uint8_t)r.second, slot(r.first));
+            }
+            saveRegisters(false);
+            as.depth(1, layout.depth);
+            as.byte(0xC9);  // leave
+            as.jmp(entryLabels[ins.a.index()]);
+            return;
+        }
+        as.cmpDepth(layout.depth, (int32_t)maxCallDepth);
+        as.jcc(CondAE, overflowLabel);
+        if (argumentWords > stacked.size()) as.aluImm(Sub, Place::r(RSP), 8 * (int32_t)(argumentWords - stacked.size()));
+        for (size_t k = stacked.size(); k-- > 0;) as.push(slot(stacked[k]));
+        for (const auto& r : inRegs) {
+            if (r.second < 0) as.movsdLoad((uint8_t)(-r.second - 1), slot(r.first));
+            else as.mov((uint8_t)r.second, slot(r.first));
+        }
+        as.call(entryLabels[ins.a.index()]);
+        if (argumentWords) as.aluImm(Add, Place::r(RSP), 8 * (int32_t)argumentWords);
+        if (ins.dst.isNone()) return;
+        if (isFloat(ins.type)) storeFloat(ins.dst, 0);
+        else store(ins.dst, RAX);
+    }
+
+    void element(Operand array, Operand index) {
+        as.lea(RDI, home(array));
+        load(index, RSI);
+        as.movImm(RDX, this->index);
+        as.callAbsolute((const void*)&JITRuntime::element);
+    }
+
+    void floatBinary(const IRInstr& ins) {
+        uint8_t arithmetic = 0;
+        switch (ins.op) {
+            case IROp::Add: arithmetic = 0x58; break;
+            case IROp::Mul: arithmetic = 0x59; break;
+            case IROp::Sub: arithmetic = 0x5C; break;
+            case IROp::Div: arithmetic = 0x5E; break;
+            case IROp::Mod:
+                loadFloat(ins.a, 0);
+                loadFloat(ins.b, 1);
+                as.callAbsolute((const void*)static_cast<double (*)(double, double)>(&fmod));
+                storeFloat(ins.dst, 0);
+                return;
+            default: break;
+        }
+        if (arithmetic) {
+            int d = regOf(ins.dst);
+            bool direct = d != RegisterAllocation::memory && isFloatRegister(d) && regOf(ins.b) != d;
+            uint8_t acc = direct ? (uint8_t)registerEncoding(d) : 0;
+            loadFloat(ins.a, acc);
+            Place b = floatSource(ins.b);
+            as.sse(0xF2, arithmetic, acc, b);
+            storeFloat(ins.dst, acc);
+            return;
+        }
+        bool swapped = ins.op == IROp::Lt || ins.op == IROp::Le;
+        loadFloat(swapped ? ins.b : ins.a, 0);
+        Place other = floatSource(swapped ? ins.a : ins.b);
+        as.sse(0x66, 0x2E, 0, other);  // ucomisd
+        switch (ins.op) {
+            case IROp::Eq:
+                as.setcc(CondE, RAX);
+                as.setcc(CondNP, RCX);
+                as.byte(0x20);  // and al, cl
+                as.byte(0xC8);
+                break;
+            case IROp::Neq:
+                as.setcc(CondNE, RAX);
+                as.setcc(CondP, RCX);
+                as.byte(0x08);  // or al, cl
+                as.byte(0xC8);
+                break;
+            case IROp::Lt: case IROp::Gt: as.setcc(CondA, RAX); break;
+            case IROp::Le: case IROp::Ge: as.setcc(CondAE, RAX); break;
+            default: throw runtime_error(string("no float form of ") + irOpName(ins.op));
+        }
+        as.movzxAl();
+        store(ins.dst, RAX);
+    }
+
+    void intBinary(const IRInstr& ins) {
+        static const uint8_t setcc[] = {CondE, CondNE, CondL, CondLE, CondG, CondGE};
+        bool arithmetic = true;
+        AluOp op = Add;
+        switch (ins.op) {
+            case IROp::Add: op = Add; break;
+            case IROp::Sub: op = Sub; break;
+            case IROp::Mul: break;
+            case IROp::BitAnd: case IROp::And: op = And; break;
+            case IROp::BitOr: case IROp::Or: op = Or; break;
+            case IROp::BitXor: op = Xor; break;
+            default: arithmetic = false; break;
+        }
+        bool immediate;
+        int32_t value;
+        if (arithmetic) {
+            int d = regOf(ins.dst);
+            bool direct = d != RegisterAllocation::memory && !isFloatRegister(d) && regOf(ins.b) != d;
+            uint8_t acc = direct ? (uint8_t)registerEncoding(d) : (uint8_t)RAX;
+            load(ins.a, acc);
+            Place b = source(ins.b, immediate, value);
+            if (ins.op == IROp::Mul) {
+                if (immediate) as.imulImm(acc, Place::r(acc), value);
+                else as.imul(acc, b);
+            } else {
+                if (immediate) as.aluImm(op, Place::r(acc), value);
+                else as.alu(op, acc, b);
+            }
+            store(ins.dst, acc);
+            return;
+        }
+        load(ins.a, RAX);
+        switch (ins.op) {
+            case IROp::Div:
+            case IROp::Mod: {
+                load(ins.b, RCX);
+                // idiv faults on INT64_MIN / -1, which wraps here.
+                uint32_t general = as.newLabel(), done = as.newLabel();
+                as.test(Place::r(RCX), RCX);
+                as.jcc(CondE, divzeroLabel);
+                as.aluImm(Cmp, Place::r(RCX), -1);
+                as.jcc(CondNE, general);
+                if (ins.op == IROp::Div) as.group3(3, Place::r(RAX));
+                else as.alu(Xor, RAX, Place::r(RAX));
+                as.jmp(done);
+                as.bind(general);
+                as.cqo();
+                as.group3(7, Place::r(RCX));
+                if (ins.op == IROp::Mod) as.movRegs(RAX, RDX);
+                as.bind(done);
+                break;
+            }
+            case IROp::Shl:
+            case IROp::Shr:
+                load(ins.b, RCX);
+                as.shiftCl(ins.op == IROp::Shl ? 4 : 7, RAX);
+                break;
+            default: {
+                Place b = source(ins.b, immediate, value);
+                if (immediate) as.aluImm(Cmp, Place::r(RAX), value);
+                else as.alu(Cmp, RAX, b);
+                as.setcc(setcc[(size_t)ins.op - (size_t)IROp::Eq], RAX);
+                as.movzxAl();
+                break;
+            }
+        }
+        store(ins.dst, RAX);
+    }
+
+    void copy(const IRInstr& ins) {
+        int d = regOf(ins.dst), a = regOf(ins.a);
+        if (d != RegisterAllocation::memory && isFloatRegister(d)) {
+            loadFloat(ins.a, (uint8_t)registerEncoding(d));
+        } else if (d != RegisterAllocation::memory) {
+            load(ins.a, (uint8_t)registerEncoding(d));
+        } else if (a != RegisterAllocation::memory && isFloatRegister(a)) {
+            storeFloat(ins.dst, (uint8_t)registerEncoding(a));
+        } else {
+            load(ins.a, RAX);
+            store(ins.dst, RAX);
+        }
+    }
+
+    void instruction(const IRInstr& ins) {
+        switch (ins.op) {
+            case IROp::Label:
+                as.bind(label(ins.a));
+                return;
+            case IROp::Goto:
+                if (alloc) resolve(block(), alloc->cfg.blockOfLabel(ins.a));
+                as.jmp(label(ins.a));
+                return;
+            case IROp::IfGoto: {
+                int r = regOf(ins.a);
+                if (r != RegisterAllocation::memory) {
+                    uint8_t hw = (uint8_t)registerEncoding(r);
+                    as.test(Place::r(hw), hw);
+                } else if (ins.a.kind() == OperandKind::Const) {
+                    load(ins.a, RAX);
+                    as.test(Place::r(RAX), RAX);
+                } else {
+                    as.encode(0, true, {0x83}, Cmp, home(ins.a), 1);  // cmp qword, 0
+                    as.byte(0);
+                }
+                as.jcc(CondNE, jumpTarget(ins.b));
+                uint32_t b = alloc ? block() : 0;
+                if (alloc && b + 1 < alloc->cfg.blockCount()) resolve(b, b + 1);
+                return;
+            }
+            case IROp::Copy:
+            case IROp::Pos:
+                copy(ins);
+                return;
+            case IROp::Neg:
+                load(ins.a, RAX);
+                if (isFloat(ins.opType)) as.btc63(RAX);
+                else as.group3(3, Place::r(RAX));
+                store(ins.dst, RAX);
+                return;
+            case IROp::Not:
+                load(ins.a, RAX);
+                as.test(Place::r(RAX), RAX);
+                as.setcc(CondE, RAX);
+                as.movzxAl();
+                store(ins.dst, RAX);
+                return;
+            case IROp::BitNot:
+                load(ins.a, RAX);
+                as.group3(2, Place::r(RAX));
+                store(ins.dst, RAX);
+                return;
+            case IROp::IntToFloat:
+                load(ins.a, RAX);
+                as.cvtsi2sd(0, RAX);
+                storeFloat(ins.dst, 0);
+                return;
+            case IROp::Param: {
+                int r = regOf(ins.a);
+                Place target = slot(argBase + pending++);
+                if (r == RegisterAllocation::memory) {
+                    load(ins.a, RAX);
+                    as.mov(target, RAX);
+                } else if (isFloatRegister(r)) {
+                    as.movsdStore(target, (uint8_t)registerEncoding(r));
+                } else {
+                    as.mov(target, (uint8_t)registerEncoding(r));
+                }
+                return;
+            }
+            case IROp::Call:
+                call(ins);
+                return;
+            case IROp::Return:
+                load(ins.a, RAX);
+                as.jmp(retLabel);
+                return;
+            case IROp::ReturnVoid:
+                as.alu(Xor, RAX, Place::r(RAX));
+                as.jmp(retLabel);
+                return;
+            case IROp::IndexLoad: {
+                element(ins.a, ins.b);
+                int d = regOf(ins.dst);
+                if (d == RegisterAllocation::memory) {
+                    as.mov(RAX, Place::at(RAX, 0));
+                    store(ins.dst, RAX);
+                } else if (isFloatRegister(d)) {
+                    as.movsdLoad((uint8_t)registerEncoding(d), Place::at(RAX, 0));
+                } else {
+                    as.mov((uint8_t)registerEncoding(d), Place::at(RAX, 0));
+                }
+                return;
+            }
+            case IROp::IndexStore: {
+                element(ins.dst, ins.a);
+                int r = regOf(ins.b);
+                if (r != RegisterAllocation::memory && !isFloatRegister(r)) {
+                    as.mov(Place::at(RAX, 0), (uint8_t)registerEncoding(r));
+                } else {
+                    load(ins.b, RCX);
+                    as.mov(Place::at(RAX, 0), RCX);
+                }
+                return;
+            }
+            case IROp::Phi:
+                throw runtime_error("phi outside SSA form in " + fn.name);
+            default:
+                break;
+        }
+        if (!isBinaryOp(ins.op)) throw runtime_error(string("cannot compile ") + irOpName(ins.op));
+        if (ins.opType.kind == TypeKind::String) {
+            load(ins.a, RDI);
+            load(ins.b, RSI);
+            as.callAbsolute((const void*)&JITRuntime::stringEqual);
+            if (ins.op == IROp::Neq) {
+                as.encode(0, false, {0x83}, Xor, Place::r(RAX), 1);  // xor eax, 1
+                as.byte(1);
+            }
+            store(ins.dst, RAX);
+        } else if (isFloat(ins.opType)) {
+            floatBinary(ins);
+        } else {
+            intBinary(ins);
+        }
+    }
+};
+
+// enter(registers, target, sp): switches to sp, loads the argument
+// registers, calls target and returns its rax on the caller's stack.
+static void emitTrampoline(Assembler& as) {
+    as.byte(0x55);  // push rbp
+    as.mov(Place::r(RBP), RSP);
+    as.mov(Place::r(RSP), RDX);
+    as.movRegs(R11, RSI);
+    as.movRegs(R10, RDI);
+    for (uint8_t k = 0; k < 8; ++k) as.movsdLoad(k, Place::at(R10, (int32_t)offsetof(ArgumentRegisters, floats) + 8 * k));
+    for (uint8_t k = 0; k < 6; ++k) as.mov(intArgRegs[k], Place::at(R10, 8 * k));
+    as.encode(0, false, {0xFF}, 2, Place::r(R11));  // call r11
+    as.byte(0xC9);  // leave
+    as.byte(0xC3);  // ret
+}
+
+}  // namespace
+
+JIT::JIT(const IRProgram& ir, X86Registers registers) : ir(ir) {
+    compile(vector<uint8_t>(ir.functions.size(), 1), registers, false);
+}
+
+JIT::JIT(const IRProgram& ir, const vector<uint32_t>& roots, X86Registers registers) : ir(ir) {
+    vector<uint8_t> selected(ir.functions.size(), 0);
+    vector<uint32_t> work;
+    for (uint32_t f : roots) {
+        if (selected[f]) continue;
+        selected[f] = 1;
+        work.push_back(f);
+    }
+    while (!work.empty()) {
+        const IRFunction& fn = ir.functions[work.back()];
+        work.pop_back();
+        for (const auto& ins : fn.instructions) {
+            if (ins.op != IROp::Call || selected[ins.a.index()]) continue;
+            selected[ins.a.index()] = 1;
+            work.push_back(ins.a.index());
+        }
+    }
+    compile(selected, registers, true);
+}
+
+void JIT::compile(const vector<uint8_t>& selected, X86Registers registers, bool loopEntries) {
+    DataLayout layout;
+    layout.depth = (uint32_t)ir.globals.size();
+    layout.firstConst = layout.depth + 1;
+    layout.words = layout.firstConst + (uint32_t)ir.constants.size();
+
+    argumentWords = stackArgumentWords(ir);
+    constantText.assign(ir.constants.size(), nullptr);
+    for (uint32_t k = 0; k < ir.constants.size(); ++k) {
+        if (ir.constants[k].type.kind != TypeKind::String) continue;
+        strings.push_back(ir.constants[k].text);
+        constantText[k] = strings.back().c_str();
+    }
+
+    Assembler as;
+    vector<uint32_t> entryLabels;
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        entryLabels.push_back(as.newLabel());
+        if (selected[f]) functionIndex[ir.functions[f].name] = f;
+    }
+    returnsString.assign(ir.functions.size(), 0);
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        for (const auto& ins : ir.functions[f].instructions) {
+            if (ins.op == IROp::Return && ins.type.kind == TypeKind::String) returnsString[f] = 1;
+        }
+    }
+    vector<pair<uint64_t, uint32_t>> loopLabels;
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        if (!selected[f]) continue;
+        FunctionCompiler compiler(ir, f, as, entryLabels, layout, constantText, argumentWords);
+        compiler.compile(registers, loopEntries);
+        for (const auto& loop : compiler.loops) loopLabels.push_back({(uint64_t)f << 32 | loop.first, loop.second});
+    }
+    trampoline = as.bytes.size();
+    emitTrampoline(as);
+    as.link();
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) entries.push_back(selected[f] ? as.labels[entryLabels[f]] : SIZE_MAX);
+    for (const auto& loop : loopLabels) this->loops[loop.first] = as.labels[loop.second];
+
+    size_t dataBytes = (8 * layout.words + pageBytes - 1) / pageBytes * pageBytes;
+    codeSize = as.bytes.size();
+    regionBytes = dataBytes + (codeSize + pageBytes - 1) / pageBytes * pageBytes;
+    void* mapped = mmap(nullptr, regionBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) throw runtime_error("cannot map memory for compiled code");
+    region = (uint8_t*)mapped;
+    data = (int64_t*)region;
+    code = region + dataBytes;
+    for (const auto& f : as.dataFixups) {
+        int64_t rel = (int64_t)(8 * f.word) - (int64_t)(dataBytes + f.end);
+        int32_t disp = (int32_t)rel;
+        memcpy(&as.bytes[f.at], &disp, 4);
+    }
+    memcpy(code, as.bytes.data(), codeSize);
+    if (mprotect(code, regionBytes - dataBytes, PROT_READ | PROT_EXEC) != 0) {
+        munmap(region, regionBytes);
+        throw runtime_error("cannot make compiled code executable");
+    }
+    for (uint32_t k = 0; k < ir.constants.size(); ++k) {
+        if (isFloat(ir.constants[k].type)) memcpy(&data[layout.firstConst + k], &ir.constants[k].floatValue, 8);
+    }
+    initializeGlobals();
+}
+
+JIT::~JIT() {
+    for (int64_t* block : arrays) free(block);
+    if (region) munmap(region, regionBytes);
+    if (stack) munmap(stack, stackBytes);
+}
+
+void JIT::initializeGlobals() {
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        const IRGlobal& global = ir.globals[g];
+        data[g] = 0;
+        if (global.init.isNone()) continue;
+        const IRConst& c = ir.constants[global.init.index()];
+        if (c.type.kind == TypeKind::String) data[g] = (int64_t)(intptr_t)constantText[global.init.index()];
+        else if (isFloat(c.type)) memcpy(&data[g], &c.floatValue, 8);
+        else data[g] = c.intValue;
+    }
+    data[ir.globals.size()] = 0;
+}
+
+bool JIT::enter(size_t entry, const void* registers, uint8_t* sp, uint64_t& result) {
+    using Trampoline = uint64_t (*)(const void*, const void*, void*);
+    JIT* outer = JITRuntime::active;
+    JITRuntime::active = this;
+    if (setjmp(fault)) {
+        JITRuntime::active = outer;
+        data[ir.globals.size()] = 0;
+        for (int64_t* block : arrays) free(block);
+        arrays.clear();
+        return false;
+    }
+    result = ((Trampoline)(code + trampoline))(registers, code + entry, sp);
+    JITRuntime::active = outer;
+    return true;
+}
+
+void JIT::mapStack() {
+    void* mapped = mmap(nullptr, stackBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped == MAP_FAILED) throw runtime_error("cannot map a stack for compiled code");
+    stack = (uint8_t*)mapped;
+}
+
+// Compiled code holds strings as their source spelling, quotes and escapes
+// included, as the constants are; host strings are plain text.
+static string spell(const char* text) {
+    string out = "\"";
+    for (const char* c = text ? text : ""; *c; ++c) {
+        switch (*c) {
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\v': out += "\\v"; break;
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            default: out += *c; break;
+        }
+    }
+    return out + "\"";
+}
+
+static string unspell(const char* spelling) {
+    string out;
+    size_t n = strlen(spelling);
+    for (size_t i = 1; i + 1 < n; ++i) {
+        char c = spelling[i];
+        if (c == '\\' && i + 2 < n) {
+            switch (c = spelling[++i]) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'v': c = '\v'; break;
+                default: break;
+            }
+        }
+        out += c;
+    }
+    return out;
+}
+
+uint64_t JIT::invoke(const string& name, const JITArg* args, size_t count) {
+    auto it = functionIndex.find(name);
+    if (it == functionIndex.end()) throw runtime_error("no function named " + name);
+    const IRFunction& fn = ir.functions[it->second];
+    if (count != fn.paramCount) {
+        throw runtime_error(name + " takes " + to_string(fn.paramCount) + " arguments, not " + to_string(count));
+    }
+    vector<int64_t> words(count);
+    for (uint32_t p = 0; p < count; ++p) {
+        const JITArg& arg = args[p];
+        if (isFloat(fn.vars[p].type)) {
+            double f = arg.isFloat ? arg.f : (double)arg.i;
+            memcpy(&words[p], &f, 8);
+        } else if (fn.vars[p].type.kind == TypeKind::String) {
+            // Kept for the JIT's lifetime: a global may hold on to it.
+            const string& spelling = *hostStrings.insert(spell((const char*)(intptr_t)arg.i)).first;
+            words[p] = (int64_t)(intptr_t)spelling.c_str();
+        } else {
+            words[p] = arg.isFloat ? (int64_t)arg.f : arg.i;
+        }
+    }
+    uint64_t result = callFunction(it->second, words.data(), 0);
+    if (!returnsString[it->second] || !result) return result;
+    resultText = unspell((const char*)(intptr_t)result);
+    return (uint64_t)(intptr_t)resultText.c_str();
+}
+
+uint64_t JIT::callFunction(uint32_t function, const int64_t* args, uint32_t depth) {
+    if (!stack) mapStack();
+    const IRFunction& fn = ir.functions[function];
+    // Parameter p goes in a register when inRegister[p], else on the stack.
+    uint32_t ints = 0, floats = 0;
+    auto inRegister = [&](uint32_t p) {
+        bool f = isFloat(fn.vars[p].type);
+        return f ? floats++ < 8 : ints++ < 6;
+    };
+    // The stacked ones go in the argumentWords every entry reserves.
+    uint8_t* sp = stack + stackBytes - 8 * argumentWords;
+    ArgumentRegisters registers = {};
+    int64_t* next = (int64_t*)sp;
+    for (uint32_t p = 0; p < fn.paramCount; ++p) {
+        uint32_t slot = isFloat(fn.vars[p].type) ? floats : ints;
+        if (!inRegister(p)) *next++ = args[p];
+        else if (isFloat(fn.vars[p].type)) memcpy(&registers.floats[slot], &args[p], 8);
+        else registers.ints[slot] = args[p];
+    }
+    data[ir.globals.size()] = depth;
+    uint64_t result = 0;
+    if (!enter(entries[function], &registers, sp, result)) throw runtime_error(errorMessage);
+    return result;
+}
+
+uint64_t JIT::enterLoop(uint32_t function, uint32_t label, const int64_t* frame, uint32_t depth) {
+    auto it = loops.find((uint64_t)function << 32 | label);
+    if (it == loops.end()) throw runtime_error("no loop entry at " + ir.labelName(label) + " in " + ir.functions[function].name);
+    if (!stack) mapStack();
+    ArgumentRegisters registers = {};
+    registers.ints[0] = (int64_t)(intptr_t)frame;
+    data[ir.globals.size()] = depth;
+    uint64_t result = 0;
+    if (!enter(it->second, &registers, stack + stackBytes - 8 * argumentWords, result)) throw runtime_error(errorMessage);
+    return result;
+}
+
+int64_t* JIT::newArray(const void* elements, size_t length) {
+    int64_t* block = (int64_t*)malloc(8 * (length + 1));
+    if (!block) throw runtime_error("out of memory");
+    block[0] = (int64_t)length;
+    memcpy(block + 1, elements, 8 * length);
+    arrays.insert(block);
+    return block;
+}
+
+bool JIT::run(const string& entry) {
+    errorMessage.clear();
+    initializeGlobals();
+    try {
+        invoke(entry, nullptr, 0);
+    } catch (const runtime_error& e) {
+        errorMessage = e.what();
+        return false;
+    }
+    return true;
+}
+
+void JIT::printGlobals(ostream& os) const {
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        const IRGlobal& global = ir.globals[g];
+        os << global.name << " = ";
+        int64_t v = data[g];
+        switch (global.type.kind) {
+            case TypeKind::Float: {
+                double f;
+                memcpy(&f, &v, sizeof f);
+                os << f;
+                break;
+            }
+            case TypeKind::String: os << (v ? (const char*)(intptr_t)v : ""); break;
+            case TypeKind::Bool: os << (v ? "true" : "false"); break;
+            case TypeKind::Char: os << "'" << (char)v << "'"; break;
+            default: os << v; break;
+        }
+        os << "\n";
+    }
+}
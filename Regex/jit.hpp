@@ -0,0 +1,121 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+#include <csetjmp>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include "ir.hpp"
+#include "x86.hpp"
+
+using namespace std;
+
+// An argument to JIT::call, converted to the parameter's type on entry.
+struct JITArg {
+    bool isFloat;
+    int64_t i;
+    double f;
+
+    template <class T, class = enable_if_t<is_arithmetic<T>::value>>
+    JITArg(T v) : isFloat(is_floating_point<T>::value), i(is_floating_point<T>::value ? 0 : (int64_t)v), f((double)v) {}
+    JITArg(const char* s) : isFloat(false), i((int64_t)(intptr_t)s), f(0) {}
+};
+
+// Compiles an IRProgram that is not in SSA form straight to x86-64 machine
+// code in mmap'd memory: no assembler, no linker. Code generation follows
+// emitX86 (same frame layout, calling convention and register allocation),
+// but the run-time helpers are C++ functions, and errors come back to the
+// caller instead of exiting. Semantics and error messages match the VM.
+// Functions run on a private 1 GiB stack. The IRProgram must outlive the JIT.
+class JIT {
+public:
+    explicit JIT(const IRProgram& ir, X86Registers registers = X86Registers::LinearScan);
+    // Compiles only roots and the functions they call, directly or not,
+    // with loop entries for on-stack replacement (see enterLoop).
+    JIT(const IRProgram& ir, const vector<uint32_t>& roots, X86Registers registers = X86Registers::LinearScan);
+    ~JIT();
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    // Calls function name; T is void, bool, char, an integer type, double or
+    // const char* (strings). Strings go in and come back as plain text, not
+    // source spelling; a string result lasts until the next call. Throws
+    // runtime_error for an unknown name, a wrong argument count or a
+    // run-time error in the program.
+    template <class T = void, class... Args>
+    T call(const string& name, Args... args) {
+        JITArg list[] = {JITArg(args)..., JITArg(0)};
+        uint64_t bits = invoke(name, list, sizeof...(Args));
+        if constexpr (is_void<T>::value) {
+            (void)bits;
+        } else if constexpr (is_floating_point<T>::value) {
+            double f;
+            memcpy(&f, &bits, sizeof f);
+            return (T)f;
+        } else if constexpr (is_pointer<T>::value) {
+            return reinterpret_cast<T>(bits);
+        } else if constexpr (is_same<T, bool>::value) {
+            return bits != 0;
+        } else {
+            return (T)(int64_t)bits;
+        }
+    }
+
+    // Resets the globals and runs entry; false on a run-time error.
+    bool run(const string& entry = "main");
+    const string& error() const { return errorMessage; }
+    void printGlobals(ostream& os) const;
+
+    size_t codeBytes() const { return codeSize; }
+    bool compiled(uint32_t function) const { return entries[function] != SIZE_MAX; }
+
+    // For another runtime handing calls to the JIT (see tier.hpp). args
+    // holds one raw word per parameter, of the parameter's type (strings as
+    // const char*); the result comes back as raw bits. depth is the caller's
+    // call depth, which counts toward the limit. The globals are the first
+    // words of globalWords(), in the same representation.
+    uint64_t callFunction(uint32_t function, const int64_t* args, uint32_t depth);
+    int64_t* globalWords() { return data; }
+
+    // On-stack replacement: runs the rest of function from the loop header
+    // with IR label id label. frame holds one word per local and then per
+    // temp, arrays as blocks from newArray. Only the roots constructor emits
+    // loop entries; hasLoopEntry says where.
+    bool hasLoopEntry(uint32_t function, uint32_t label) const { return loops.count((uint64_t)function << 32 | label) != 0; }
+    uint64_t enterLoop(uint32_t function, uint32_t label, const int64_t* frame, uint32_t depth);
+    int64_t* newArray(const void* elements, size_t length);
+
+private:
+    friend struct JITRuntime;
+
+    const IRProgram& ir;
+    uint8_t* region = nullptr;  // data pages, then code pages
+    size_t regionBytes = 0;
+    int64_t* data = nullptr;    // globals, the call depth, float constants
+    uint8_t* code = nullptr;
+    size_t codeSize = 0;
+    vector<size_t> entries;     // function -> offset in code
+    unordered_map<uint64_t, size_t> loops;  // function << 32 | IR label -> offset of its loop entry
+    size_t trampoline = 0;
+    uint32_t argumentWords = 0;  // stackArgumentWords(ir), reserved below every entry
+    unordered_map<string, uint32_t> functionIndex;
+    deque<string> strings;                // string constants
+    vector<const char*> constantText;     // constant -> its text, for strings
+    vector<uint8_t> returnsString;        // function -> returns a string
+    unordered_set<string> hostStrings;    // string arguments given to call, spelled
+    string resultText;                    // the last string call returned, unspelled
+    uint8_t* stack = nullptr;             // mapped on the first call
+    unordered_set<int64_t*> arrays;       // live array blocks
+    string errorMessage;
+    jmp_buf fault;
+
+    void compile(const vector<uint8_t>& selected, X86Registers registers, bool loopEntries);
+    void mapStack();
+    uint64_t invoke(const string& name, const JITArg* args, size_t count);
+    bool enter(size_t entry, const void* registers, uint8_t* sp, uint64_t& result);
+    void initializeGlobals();
+};
@@ -58,7 +58,7 @@ static string unescapeChar(const string& raw) {
 
 using svmatch = match_results<string_view::const_iterator>;
 inline static bool regex_search_sv(string_view sv, const regex& re, svmatch& m) {
-    return regex_search(sv.begin(), sv.end(), m, re);
+    return regex_search(sv.begin(), sv.end(), m, re, regex_constants::match_continuous);
 }
 
 static pair<int,int> lineColOf(const string& text, size_t pos) {
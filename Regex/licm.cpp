@@ -0,0 +1,208 @@
+#include "licm.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include <algorithm>
+
+using namespace std;
+
+static IRInstr jumpTo(IROp op, Operand label) {
+    IRInstr ins;
+    ins.op = op;
+    ins.a = label;
+    return ins;
+}
+
+// Gives every loop header whose outside predecessors are not a single block
+// falling or jumping only into it a fresh preheader, placed right before the
+// header. Phi arguments from outside move to the preheader, merged by a new
+// phi there when there are several.
+static bool insertPreheaders(IRProgram& ir, IRFunction& fn) {
+    CFG cfg = buildCFG(fn);
+    vector<NaturalLoop> loops = findLoops(cfg);
+    uint32_t n = cfg.blockCount();
+    vector<Operand> preheader(n, Operand::none());
+    bool any = false;
+    for (const auto& loop : loops) {
+        uint32_t h = loop.header;
+        uint32_t outside = 0, last = CFG::none;
+        for (uint32_t p : cfg.predecessors(h)) {
+            if (!cfg.dominates(h, p)) {
+                outside++;
+                last = p;
+            }
+        }
+        if (outside == 1 && cfg.successors(last).size() == 1) continue;
+        if (!preheader[h].isNone()) continue;
+        ir.labelBases.push_back("preheader");
+        preheader[h] = Operand::label((uint32_t)ir.labelBases.size() - 1);
+        any = true;
+    }
+    if (!any) return false;
+
+    const auto& code = fn.instructions;
+    vector<IRInstr> out;
+    out.reserve(code.size() + 4 * loops.size());
+    auto isOutside = [&](uint32_t h, uint32_t p) { return !cfg.dominates(h, p); };
+    for (uint32_t b = 0; b < n; ++b) {
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        Operand label = blockLabel(fn, cfg, b);
+        Operand ph = preheader[b];
+        Operand latchBridge = Operand::none();
+        vector<Operand> merged;  // preheader phi per header phi, when several edges enter
+        if (!ph.isNone()) {
+            // A latch falling into the header must now jump over the preheader.
+            if (b > 0 && !isOutside(b, b - 1) && !isTerminator(code[first - 1].op)) {
+                out.push_back(jumpTo(IROp::Goto, label));
+            } else if (b > 0 && !isOutside(b, b - 1) && code[first - 1].op == IROp::IfGoto) {
+                ir.labelBases.push_back("latch");
+                latchBridge = Operand::label((uint32_t)ir.labelBases.size() - 1);
+                if (out.back().b == label) out.back().b = latchBridge;  // both edges now pass the bridge
+                out.push_back(jumpTo(IROp::Label, latchBridge));
+                out.push_back(jumpTo(IROp::Goto, label));
+            }
+            out.push_back(jumpTo(IROp::Label, ph));
+            size_t outsideCount = 0;
+            for (uint32_t p : cfg.predecessors(b)) outsideCount += isOutside(b, p);
+            for (uint32_t i = first + 1; i < last && code[i].op == IROp::Phi && outsideCount > 1; ++i) {
+                IRInstr merge = code[i];
+                merge.dst = Operand::temp(fn.tempCount++);
+                uint32_t start = (uint32_t)fn.phiArgs.size();
+                for (uint32_t k = 0; k < code[i].b.index(); ++k) {
+                    PhiArg arg = fn.phiArgs[code[i].a.index() + k];
+                    if (isOutside(b, cfg.blockOfLabel(arg.label))) fn.phiArgs.push_back(arg);
+                }
+                merge.a = Operand::imm(start);
+                merge.b = Operand::imm((uint32_t)fn.phiArgs.size() - start);
+                out.push_back(merge);
+                merged.push_back(merge.dst);
+            }
+        }
+        for (uint32_t i = first; i < last; ++i) {
+            IRInstr ins = code[i];
+            Operand* target = ins.op == IROp::Goto ? &ins.a : ins.op == IROp::IfGoto ? &ins.b : nullptr;
+            if (target) {
+                uint32_t t = cfg.blockOfLabel(*target);
+                if (!preheader[t].isNone() && isOutside(t, b)) *target = preheader[t];
+            }
+            if (ins.op == IROp::Phi && !ph.isNone()) {
+                // Outside arguments collapse into one coming from the preheader.
+                uint32_t start = (uint32_t)fn.phiArgs.size();
+                Operand fromOutside = Operand::none();
+                for (uint32_t k = 0; k < ins.b.index(); ++k) {
+                    PhiArg arg = fn.phiArgs[ins.a.index() + k];
+                    if (isOutside(b, cfg.blockOfLabel(arg.label))) {
+                        fromOutside = arg.value;
+                        continue;
+                    }
+                    if (!latchBridge.isNone() && arg.label == blockLabel(fn, cfg, b - 1)) arg.label = latchBridge;
+                    fn.phiArgs.push_back(arg);
+                }
+                if (!merged.empty()) fromOutside = merged[i - first - 1];
+                fn.phiArgs.push_back({ph, fromOutside});
+                ins.a = Operand::imm(start);
+                ins.b = Operand::imm((uint32_t)fn.phiArgs.size() - start);
+            }
+            out.push_back(ins);
+        }
+    }
+    fn.instructions.swap(out);
+    return true;
+}
+
+bool hoistLoopInvariants(IRProgram& ir, IRFunction& fn) {
+    if (!fn.inSSA || fn.instructions.empty()) return false;
+    bool changed = insertPreheaders(ir, fn);
+    CFG cfg = buildCFG(fn);
+    vector<NaturalLoop> loops = findLoops(cfg);
+    if (loops.empty()) return changed;
+
+    const auto& code = fn.instructions;
+    uint32_t n = cfg.blockCount();
+    vector<uint8_t> ssaLocal = ssaValueLocals(fn);
+    vector<uint8_t> assigned(fn.vars.size(), 0);
+    for (const auto& ins : code) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) assigned[ins.dst.index()] = 1;
+    }
+    auto valueId = [&](Operand o) -> uint32_t {
+        if (o.kind() == OperandKind::Temp) return o.index();
+        if (o.kind() == OperandKind::Local && ssaLocal[o.index()]) return fn.tempCount + o.index();
+        return CFG::none;
+    };
+    vector<uint32_t> defBlock(fn.tempCount + fn.vars.size(), CFG::none);
+    vector<vector<uint32_t>> blockCode(n);
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            blockCode[b].push_back(i);
+            uint32_t id = writesDst(code[i]) ? valueId(code[i].dst) : CFG::none;
+            if (id != CFG::none) defBlock[id] = b;
+        }
+    }
+
+    vector<uint32_t> inLoop(n, CFG::none), globalWritten(ir.globals.size(), CFG::none);
+    bool hoisted = false;
+    for (uint32_t k = 0; k < loops.size(); ++k) {
+        NaturalLoop& loop = loops[k];
+        bool hasCall = false;
+        for (uint32_t b : loop.blocks) {
+            inLoop[b] = k;
+            for (uint32_t i : blockCode[b]) {
+                hasCall |= code[i].op == IROp::Call;
+                if (code[i].dst.kind() == OperandKind::Global) globalWritten[code[i].dst.index()] = k;
+            }
+        }
+        uint32_t ph = CFG::none, entries = 0;
+        for (uint32_t p : cfg.predecessors(loop.header)) {
+            if (inLoop[p] != k) {
+                ph = p;
+                entries++;
+            }
+        }
+        if (entries != 1 || cfg.successors(ph).size() != 1) continue;
+
+        auto invariant = [&](Operand o) {
+            switch (o.kind()) {
+                case OperandKind::None: case OperandKind::Const: return true;
+                case OperandKind::Global: return !hasCall && globalWritten[o.index()] != k;
+                case OperandKind::Temp: case OperandKind::Local: {
+                    uint32_t id = valueId(o);
+                    if (id == CFG::none) return o.kind() == OperandKind::Local && !assigned[o.index()];
+                    return defBlock[id] != CFG::none && inLoop[defBlock[id]] != k;
+                }
+                default: return false;
+            }
+        };
+        sort(loop.blocks.begin(), loop.blocks.end(), [&](uint32_t a, uint32_t b) { return cfg.rpoIndex[a] < cfg.rpoIndex[b]; });
+        vector<uint32_t> moved;
+        for (uint32_t b : loop.blocks) {
+            auto& list = blockCode[b];
+            size_t kept = 0;
+            for (uint32_t i : list) {
+                IRInstr ins = code[i];
+                bool movable = (ins.op == IROp::Copy || isUnaryOp(ins.op) || isBinaryOp(ins.op)) &&
+                               !hasSideEffects(ir, ins) && valueId(ins.dst) != CFG::none;
+                if (movable) forEachUse(ins, [&](Operand& o) { movable = movable && invariant(o); });
+                if (!movable) {
+                    list[kept++] = i;
+                    continue;
+                }
+                moved.push_back(i);
+                defBlock[valueId(ins.dst)] = ph;
+            }
+            list.resize(kept);
+        }
+        if (moved.empty()) continue;
+        auto& target = blockCode[ph];
+        auto at = !target.empty() && isTerminator(code[target.back()].op) ? target.end() - 1 : target.end();
+        target.insert(at, moved.begin(), moved.end());
+        hoisted = true;
+    }
+    if (!hoisted) return changed;
+
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i : blockCode[b]) out.push_back(code[i]);
+    }
+    fn.instructions.swap(out);
+    return true;
+}
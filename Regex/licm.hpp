@@ -0,0 +1,14 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Loop-invariant code motion over a function in SSA form. Every natural loop
+// gets a preheader: a block outside the loop whose only successor is the
+// header, created when the header has several outside predecessors or the
+// single one branches elsewhere too. Copies, unary and binary instructions
+// that cannot fail and whose operands are defined outside the loop (or are
+// themselves hoisted) move to the end of the preheader. Globals count as
+// invariant in loops without calls or writes to them. Inner loops go first,
+// so an expression can climb several levels. Returns true if fn changed.
+bool hoistLoopInvariants(IRProgram& ir, IRFunction& fn);
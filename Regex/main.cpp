@@ -4,6 +4,10 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <thread>
 #include "token.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
@@ -11,6 +15,15 @@
 #include "scope.hpp"
 #include "typechk.hpp"
 #include "ir.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include "opt.hpp"
+#include "vm.hpp"
+#include "superinstr.hpp"
+#include "x86.hpp"
+#include "cgen.hpp"
+#include "jit.hpp"
+#include "tier.hpp"
 
 using namespace std;
 
@@ -70,15 +83,104 @@ static const char* irgen_error_name(IRGenError e){
     }
 }
 
-int main(){
-    ifstream fin("input.fn", ios::in | ios::binary);
+// "compare-jump,arg-pair" -> the bit set formSuperinstructions takes; false
+// on a name that is not a fusion.
+static bool parse_fusions(const string& list, uint32_t& mask){
+    stringstream names(list);
+    string name;
+    while (getline(names, name, ',')){
+        uint32_t f = 0;
+        while (f < fusionCount && name != fusionName((Fusion)f)) ++f;
+        if (f == fusionCount) return false;
+        mask |= 1u << f;
+    }
+    return mask != 0;
+}
+
+static bool parse_dispatch(const string& name, Dispatch& dispatch){
+    for (Dispatch d : {Dispatch::Switch, Dispatch::Threaded, Dispatch::Handlers}){
+        if (name == dispatchName(d)){
+            dispatch = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv){
+    string inputPath = "input.fn";
+    bool fused = false;
+    bool dumpCFG = false;
+    bool dumpSSA = false;
+    bool dumpBytecode = false;
+    bool runProgram = false;
+    bool profileFusions = false;
+    uint32_t fusions = 0;
+    Dispatch dispatch = Dispatch::Threaded;
+    bool jitProgram = false;
+    bool tieredProgram = false;
+    string asmPath;
+    string cPath;
+    bool spillAll = false;
+    unsigned parallelThreads = 0;
+    int optLevel = 0;
+    for (int a = 1; a < argc; ++a){
+        string arg = argv[a];
+        if (arg == "--fused") fused = true;
+        else if (arg == "--cfg") dumpCFG = true;
+        else if (arg == "--ssa") dumpSSA = true;
+        else if (arg == "--bytecode") dumpBytecode = true;
+        else if (arg == "--run") runProgram = true;
+        else if (arg == "--super") profileFusions = true;
+        else if (arg.rfind("--super=", 0) == 0){
+            if (!parse_fusions(arg.substr(8), fusions)){
+                cerr << "Error: '" << arg << "' needs fusions from compare-jump, compare-skip, add-immediate, load-index-add, arg-pair.\n";
+                return 2;
+            }
+        }
+        else if (arg.rfind("--dispatch=", 0) == 0){
+            if (!parse_dispatch(arg.substr(11), dispatch)){
+                cerr << "Error: '" << arg << "' needs switch, threaded or handlers.\n";
+                return 2;
+            }
+        }
+        else if (arg == "--jit") jitProgram = true;
+        else if (arg == "--tiered") tieredProgram = true;
+        else if (arg.rfind("--asm=", 0) == 0 && arg.size() > 6) asmPath = arg.substr(6);
+        else if (arg.rfind("--c=", 0) == 0 && arg.size() > 4) cPath = arg.substr(4);
+        else if (arg == "--spill-all") spillAll = true;
+        else if (arg == "--parallel") parallelThreads = max(1u, thread::hardware_concurrency());
+        else if (arg.rfind("--parallel=", 0) == 0){
+            int n = atoi(arg.c_str() + 11);
+            if (n <= 0){
+                cerr << "Error: '" << arg << "' needs a positive thread count.\n";
+                return 2;
+            }
+            parallelThreads = (unsigned)n;
+        }
+        else if (arg == "-O") optLevel = maxOptLevel;
+        else if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && isdigit((unsigned char)arg[2])){
+            optLevel = min(arg[2] - '0', maxOptLevel);
+        }
+        else if (arg.rfind("-", 0) == 0){
+            cerr << "Error: unknown option '" << arg << "'.\n";
+            return 2;
+        }
+        else inputPath = arg;
+    }
+    if (fused && parallelThreads){
+        cerr << "Error: --fused and --parallel cannot be combined.\n";
+        return 2;
+    }
+
+    ifstream fin(inputPath, ios::in | ios::binary);
     if (!fin){
-        cerr << "Error: could not open 'input.fn' in the current folder.\n";
+        cerr << "Error: could not open '" << inputPath << "'.\n";
         return 2;
     }
     string src((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
     if (src.empty()){
-        cerr << "Error: 'input.fn' is empty.\n";
+        cerr << "Error: '" << inputPath << "' is empty.\n";
         return 3;
     }
 
@@ -101,11 +203,14 @@ int main(){
         }
         fout << "]\n";
 
+        ScopeAnalyzer sa;
+        TypeChecker tc(sa);
         Parser p(tokens, src);
+        if (fused) p.enableFusedAnalysis(sa, tc);
         auto prog = p.parse();
 
-        ScopeAnalyzer sa;
-        sa.analyzeProgram(*prog);
+        if (parallelThreads) sa.analyzeProgramParallel(*prog, parallelThreads);
+        else if (!fused) sa.analyzeProgram(*prog);
 
         if (sa.hasErrors()) {
             cerr << "Scope analysis reported errors:\n";
@@ -117,8 +222,8 @@ int main(){
             return 4;
         }
 
-        TypeChecker tc(sa);
-        tc.analyzeProgram(*prog);
+        if (parallelThreads) tc.analyzeProgramParallel(*prog, parallelThreads);
+        else if (!fused) tc.analyzeProgram(*prog);
 
         if (tc.hasErrors()) {
             cerr << "Type checking reported errors:\n";
@@ -145,6 +250,99 @@ int main(){
         prog->print(cout);
         cout << "\n\n[TAC]\n";
         printIRProgram(ir, cout);
+        if (optLevel > 0) {
+            size_t before = countInstructions(ir);
+            optimizeProgram(ir, optLevel);
+            cout << "[Optimized -O" << optLevel << ": " << before << " -> " << countInstructions(ir) << " instructions]\n";
+            printIRProgram(ir, cout);
+        }
+        if (dumpCFG) {
+            cout << "[CFG]\n";
+            for (const auto& fn : ir.functions) printCFG(ir, fn, buildCFG(fn), cout);
+        }
+        if (dumpSSA) {
+            for (auto& fn : ir.functions) constructSSA(ir, fn);
+            cout << "[SSA]\n";
+            printIRProgram(ir, cout);
+            for (auto& fn : ir.functions) destructSSA(ir, fn);
+            cout << "[Out of SSA]\n";
+            printIRProgram(ir, cout);
+        }
+        if (!asmPath.empty()) {
+            ofstream asmOut(asmPath, ios::out | ios::trunc);
+            if (!asmOut){
+                cerr << "Error: could not write '" << asmPath << "'.\n";
+                return 2;
+            }
+            emitX86(ir, asmOut, spillAll ? X86Registers::AllSpill : X86Registers::LinearScan);
+            cout << "[Assembly written to " << asmPath << "]\n";
+        }
+        if (!cPath.empty()) {
+            ofstream cOut(cPath, ios::out | ios::trunc);
+            if (!cOut){
+                cerr << "Error: could not write '" << cPath << "'.\n";
+                return 2;
+            }
+            emitC(ir, cOut);
+            cout << "[C written to " << cPath << "]\n";
+        }
+        if (dumpBytecode || runProgram) {
+            BytecodeProgram bytecode = compileBytecode(ir);
+            if (profileFusions) {
+                // Picks the fusions this program's own run supports, as
+                // main_bench super does for a corpus.
+                NGramProfile profile;
+                VM vm(bytecode);
+                vm.setProfiling(true);
+                vm.run();
+                vm.addProfile(profile);
+                fusions |= selectFusions(profile);
+            }
+            if (fusions) {
+                size_t formed = formSuperinstructions(bytecode, fusions);
+                cout << "[Superinstructions: " << formed << " formed]\n";
+            }
+            if (dumpBytecode) {
+                cout << "[Bytecode]\n";
+                printBytecode(bytecode, cout);
+            }
+            // Every engine names the function an error's instruction ended up
+            // in. At -O2 that is the caller for an error in an inlined body
+            // ("division by zero in main", not "in div"), and a call stack
+            // overflow comes later, since inlined calls take no frame.
+            if (runProgram) {
+                VM vm(bytecode, dispatch);
+                bool ok = vm.run();
+                cout << "[Run: " << vm.executed() << " instructions]\n";
+                vm.printGlobals(cout);
+                if (!ok) {
+                    cerr << "Runtime error: " << vm.error() << "\n";
+                    return 7;
+                }
+            }
+        }
+        if (tieredProgram) {
+            BytecodeProgram bytecode = compileBytecode(ir);
+            TieredVM tiered(ir, bytecode);
+            bool ok = tiered.run();
+            cout << "[Tiered: " << tiered.interpreted() << " instructions interpreted, "
+                 << tiered.promoted().size() << " functions compiled]\n";
+            tiered.printGlobals(cout);
+            if (!ok) {
+                cerr << "Runtime error: " << tiered.error() << "\n";
+                return 7;
+            }
+        }
+        if (jitProgram) {
+            JIT jit(ir, spillAll ? X86Registers::AllSpill : X86Registers::LinearScan);
+            bool ok = jit.run();
+            cout << "[JIT: " << jit.codeBytes() << " bytes of code]\n";
+            jit.printGlobals(cout);
+            if (!ok) {
+                cerr << "Runtime error: " << jit.error() << "\n";
+                return 7;
+            }
+        }
     }
     catch (const ParseException& ex){
         cerr << "Parse error [" << parse_error_name(ex.kind) << "]: " << ex.what() << "\n";
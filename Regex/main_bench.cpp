@@ -0,0 +1,1129 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "token.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "scope.hpp"
+#include "typechk.hpp"
+#include "ir.hpp"
+#include "cfg.hpp"
+#include "ssa.hpp"
+#include "opt.hpp"
+#include "irexec.hpp"
+#include "vm.hpp"
+#include "superinstr.hpp"
+#include "x86.hpp"
+#include "cgen.hpp"
+#include "regalloc.hpp"
+#include "jit.hpp"
+#include "tier.hpp"
+#include "inline.hpp"
+#include "tailcall.hpp"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start){
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+static string synthesizeProgram(int functions, int stmtsPerFunction){
+    ostringstream os;
+    os << "int total = 0;\nfloat scale = 1.5;\n";
+    for (int f = 0; f < functions; ++f){
+        os << "fn work" << f << "(int n, float w) {\n";
+        os << "    int acc = 0;\n    float facc = 0.0;\n";
+        for (int s = 0; s < stmtsPerFunction; ++s){
+            switch (s % 4){
+                case 0:
+                    os << "    acc = acc + n * " << s << " - (acc >> 1);\n";
+                    break;
+                case 1:
+                    os << "    if (acc > " << s << " && facc < 100.0) { facc = facc + w * scale; } else { acc = acc ^ " << s << "; }\n";
+                    break;
+                case 2:
+                    os << "    for (int i = 0; i < n; i = i + 1) { int t" << s << " = i * " << s << " + acc; acc = acc + t" << s << " % 7; }\n";
+                    break;
+                default:
+                    os << "    while (acc > 1000) { acc = acc / 2; total = total + 1; }\n";
+                    break;
+            }
+        }
+        if (f > 0) os << "    work" << (f - 1) << "(acc, facc);\n";
+        os << "    return;\n}\n";
+    }
+    return os.str();
+}
+
+static string readFile(const string& path){
+    ifstream fin(path, ios::in | ios::binary);
+    return string((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+}
+
+struct FrontEndResult {
+    vector<string> scopeDiags;
+    vector<string> typeDiags;
+};
+
+static FrontEndResult runFrontEnd(const vector<Token>& tokens, bool fused){
+    ScopeAnalyzer sa;
+    TypeChecker tc(sa);
+    Parser p(tokens);
+    if (fused) p.enableFusedAnalysis(sa, tc);
+    auto prog = p.parse();
+    if (!fused){
+        sa.analyzeProgram(*prog);
+        tc.analyzeProgram(*prog);
+    }
+    FrontEndResult r;
+    for (const auto& d : sa.getDiagnostics()) r.scopeDiags.push_back(d.name + ": " + d.message);
+    for (const auto& d : tc.getDiagnostics()) r.typeDiags.push_back(d.message);
+    return r;
+}
+
+static FrontEndResult runAnalysis(const Program& prog, unsigned threads){
+    ScopeAnalyzer sa;
+    TypeChecker tc(sa);
+    if (threads == 0){
+        sa.analyzeProgram(prog);
+        tc.analyzeProgram(prog);
+    } else {
+        sa.analyzeProgramParallel(prog, threads);
+        tc.analyzeProgramParallel(prog, threads);
+    }
+    FrontEndResult r;
+    for (const auto& d : sa.getDiagnostics()) r.scopeDiags.push_back(d.name + ": " + d.message);
+    for (const auto& d : tc.getDiagnostics()) r.typeDiags.push_back(d.message);
+    return r;
+}
+
+static int benchParallel(const string& src, int iterations){
+    vector<Token> tokens = Lexer(src).tokenize();
+    Parser p(tokens);
+    auto prog = p.parse();
+    FrontEndResult sequential = runAnalysis(*prog, 0);
+    const unsigned threadCounts[] = {0, 1, 2, 4, 8};
+    cout << "functions:   " << prog->decls.size() << " decls, hardware threads " << thread::hardware_concurrency() << "\n";
+    double baseline = 0;
+    for (unsigned threads : threadCounts){
+        FrontEndResult r = runAnalysis(*prog, threads);
+        if (r.scopeDiags != sequential.scopeDiags || r.typeDiags != sequential.typeDiags){
+            cerr << "parallel analysis with " << threads << " threads differs from the sequential pass\n";
+            return 1;
+        }
+        double best = 1e300;
+        for (int it = 0; it < iterations; ++it){
+            auto start = Clock::now();
+            runAnalysis(*prog, threads);
+            best = min(best, elapsedMs(start));
+        }
+        if (threads == 0){
+            baseline = best;
+            cout << "sequential:  " << best << " ms\n";
+        } else {
+            cout << "threads " << threads << ":   " << best << " ms (x" << baseline / best << ")\n";
+        }
+    }
+    cout << "diagnostics: " << sequential.scopeDiags.size() << " scope, " << sequential.typeDiags.size() << " type (identical)\n";
+    return 0;
+}
+
+static int benchIR(const string& src, int iterations){
+    vector<Token> tokens = Lexer(src).tokenize();
+    Parser p(tokens);
+    auto prog = p.parse();
+    ScopeAnalyzer sa;
+    TypeChecker tc(sa);
+    sa.analyzeProgram(*prog);
+    tc.analyzeProgram(*prog);
+    IRProgram ir;
+    double best = 1e300;
+    for (int it = 0; it < iterations; ++it){
+        IRGenerator gen(sa, tc);
+        auto start = Clock::now();
+        ir = gen.generate(*prog);
+        best = min(best, elapsedMs(start));
+        if (gen.hasErrors()){
+            cerr << "IR generation reported errors\n";
+            return 1;
+        }
+    }
+    size_t count = 0, bytes = 0;
+    for (const auto& f : ir.functions){
+        count += f.instructions.size();
+        bytes += f.instructions.capacity() * sizeof(IRInstr);
+    }
+    size_t poolBytes = ir.constants.capacity() * sizeof(IRConst) + ir.labelBases.capacity() * sizeof(const char*);
+    for (const auto& c : ir.constants) poolBytes += c.text.capacity() > 15 ? c.text.capacity() + 1 : 0;
+    cout << "instructions: " << count << " in " << ir.functions.size() << " functions\n";
+    cout << "instr memory: " << bytes << " bytes (" << (double)bytes / count << " per instruction)\n";
+    cout << "pools:        " << ir.constants.size() << " constants, " << ir.labelBases.size() << " labels, " << poolBytes << " bytes\n";
+    cout << "generate:     " << best << " ms\n";
+    return 0;
+}
+
+static IRProgram lowerToIR(const string& src){
+    vector<Token> tokens = Lexer(src).tokenize();
+    Parser p(tokens);
+    auto prog = p.parse();
+    ScopeAnalyzer sa;
+    TypeChecker tc(sa);
+    sa.analyzeProgram(*prog);
+    tc.analyzeProgram(*prog);
+    IRGenerator gen(sa, tc);
+    return gen.generate(*prog);
+}
+
+// lowerToIR on one of several files: one that does not lex, parse or lower
+// is reported and skipped, and counts as a failure, instead of ending the run.
+static bool lowerFile(const string& path, IRProgram& ir){
+    try {
+        ir = lowerToIR(readFile(path));
+        return true;
+    }
+    catch (const exception& ex){
+        cerr << path << ": " << ex.what() << "\n";
+        return false;
+    }
+}
+
+// Builds CFGs for one function at growing sizes; near-linear construction
+// keeps ns/instruction flat as the function grows.
+static int benchCFG(const string& path, int iterations){
+    vector<int> sizes = {8000, 17000, 34000, 69000};  // ~1M instructions at the top
+    if (path != "-") sizes = {0};
+    for (int stmts : sizes){
+        IRProgram ir = lowerToIR(stmts ? synthesizeProgram(1, stmts) : readFile(path));
+        const IRFunction* largest = nullptr;
+        for (const auto& f : ir.functions){
+            if (!largest || f.instructions.size() > largest->instructions.size()) largest = &f;
+        }
+        if (!largest) continue;
+        double best = 1e300;
+        CFG cfg;
+        for (int it = 0; it < iterations; ++it){
+            auto start = Clock::now();
+            cfg = buildCFG(*largest);
+            best = min(best, elapsedMs(start));
+        }
+        size_t n = largest->instructions.size();
+        cout << n << " instrs, " << cfg.blockCount() << " blocks, " << cfg.succs.size() << " edges: "
+             << best << " ms (" << best * 1e6 / n << " ns/instr)\n";
+    }
+    return 0;
+}
+
+static int benchSSA(const string& src, int iterations){
+    IRProgram ir = lowerToIR(src);
+    size_t instrs = 0;
+    for (const auto& f : ir.functions) instrs += f.instructions.size();
+    double best[2] = {1e300, 1e300};
+    size_t phis = 0, ssaInstrs = 0;
+    for (int it = 0; it < iterations; ++it){
+        IRProgram work = ir;
+        auto start = Clock::now();
+        for (auto& f : work.functions) constructSSA(work, f);
+        best[0] = min(best[0], elapsedMs(start));
+        phis = ssaInstrs = 0;
+        for (const auto& f : work.functions){
+            ssaInstrs += f.instructions.size();
+            for (const auto& ins : f.instructions) phis += ins.op == IROp::Phi;
+        }
+        start = Clock::now();
+        for (auto& f : work.functions) destructSSA(work, f);
+        best[1] = min(best[1], elapsedMs(start));
+    }
+    cout << "instructions: " << instrs << " (" << ssaInstrs << " in SSA, " << phis << " phis)\n";
+    cout << "into SSA:     " << best[0] << " ms\n";
+    cout << "out of SSA:   " << best[1] << " ms\n";
+    return 0;
+}
+
+// Instructions inside natural loops, each counted once however deep.
+static size_t countLoopInstructions(const IRProgram& ir){
+    size_t n = 0;
+    for (const auto& fn : ir.functions){
+        if (fn.instructions.empty()) continue;
+        CFG cfg = buildCFG(fn);
+        vector<uint8_t> inLoop(cfg.blockCount(), 0);
+        for (const auto& loop : findLoops(cfg)){
+            for (uint32_t b : loop.blocks) inLoop[b] = 1;
+        }
+        for (uint32_t b = 0; b < cfg.blockCount(); ++b){
+            if (!inLoop[b]) continue;
+            for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) n += fn.instructions[i].op != IROp::Label;
+        }
+    }
+    return n;
+}
+
+// Instruction counts before and after each optimization level, per file and
+// over the whole corpus (see bench/*.fn). "in loops" counts the part that
+// runs once per iteration.
+static int benchOpt(const vector<string>& paths, int iterations){
+    vector<size_t> totals(maxOptLevel + 1, 0), loopTotals(maxOptLevel + 1, 0);
+    int failures = 0;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (path == "-") ir = lowerToIR(synthesizeProgram(200, 40));
+        else if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        cout << path << " (all/in loops):";
+        for (int level = 0; level <= maxOptLevel; ++level){
+            double best = 1e300;
+            size_t count = 0, inLoops = 0;
+            for (int it = 0; it < iterations; ++it){
+                IRProgram work = ir;
+                auto start = Clock::now();
+                optimizeProgram(work, level);
+                best = min(best, elapsedMs(start));
+                count = countInstructions(work);
+                inLoops = countLoopInstructions(work);
+            }
+            totals[level] += count;
+            loopTotals[level] += inLoops;
+            cout << " -O" << level << " " << count << "/" << inLoops;
+            if (level > 0) cout << " (" << best << " ms)";
+        }
+        cout << "\n";
+    }
+    for (int level = 1; level <= maxOptLevel; ++level){
+        double reduction = totals[0] ? 100.0 * ((double)totals[0] - (double)totals[level]) / (double)totals[0] : 0;
+        cout << "total -O" << level << ": " << totals[0] << " -> " << totals[level]
+             << " instructions (" << reduction << "% fewer), in loops " << loopTotals[0] << " -> " << loopTotals[level] << "\n";
+    }
+    return failures ? 1 : 0;
+}
+
+// Instructions and multiplications executed by each program at -O0, at -O2
+// without induction-variable optimization and at full -O2. The three runs
+// must end with the same globals (or the same run-time error).
+static int benchInductionVariables(const vector<string>& paths){
+    struct Config { const char* name; int level; vector<string> disabled; };
+    const Config configs[] = {{"-O0", 0, {}}, {"-O2 no ivopt", 2, {"ivopt"}}, {"-O2", 2, {}}};
+    uint64_t totals[3] = {0, 0, 0};
+    int failures = 0;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        cout << path << ":";
+        string expected;
+        for (int c = 0; c < 3; ++c){
+            IRProgram work = ir;
+            optimizeProgram(work, configs[c].level, configs[c].disabled);
+            IRExecutor exec(work);
+            ostringstream outcome;  // a run-time error is an outcome too
+            if (exec.run()) exec.printGlobals(outcome);
+            else outcome << "error: " << exec.error() << "\n";
+            if (c == 0) expected = outcome.str();
+            else if (outcome.str() != expected){
+                cerr << "\n" << path << " " << configs[c].name << ": result differs from -O0\n";
+                return 1;
+            }
+            totals[c] += exec.executed();
+            cout << " " << configs[c].name << " " << exec.executed() << " (" << exec.executed(IROp::Mul) << " mul)";
+        }
+        cout << "\n";
+    }
+    double saved = totals[1] ? 100.0 * ((double)totals[1] - (double)totals[2]) / (double)totals[1] : 0;
+    cout << "executed: -O0 " << totals[0] << ", -O2 no ivopt " << totals[1] << ", -O2 " << totals[2]
+         << " (" << saved << "% fewer from ivopt)\n";
+    return failures ? 1 : 0;
+}
+
+static string vmResult(const IRProgram& work, double* ms = nullptr, uint64_t* executed = nullptr){
+    BytecodeProgram bytecode = compileBytecode(work);
+    VM vm(bytecode);
+    auto start = Clock::now();
+    bool ok = vm.run();
+    if (ms) *ms = elapsedMs(start);
+    if (executed) *executed = vm.executed();
+    ostringstream result;
+    if (ok) vm.printGlobals(result);
+    else result << "Runtime error: " << vm.error() << "\n";
+    return result.str();
+}
+
+struct PassTotals {
+    size_t size[2] = {0, 0};  // -O2 instructions
+    uint64_t executed[2] = {0, 0};
+    double ms[2] = {0, 0};
+};
+
+// Runs ir at -O2 on the VM without and then with pass, best of iterations
+// each, printing a line per run and adding to totals. Returns false, after
+// printing both results, if the runs end differently. With ignoreCaller an
+// error is compared only up to " in ", since one raised in an inlined body
+// names its caller.
+static bool comparePass(const IRProgram& ir, const string& pass, int iterations, bool ignoreCaller, PassTotals& totals){
+    auto outcome = [&](const string& result){
+        return ignoreCaller && result.rfind("Runtime error:", 0) == 0 ? result.substr(0, result.rfind(" in ")) : result;
+    };
+    string results[2];
+    for (int k = 0; k < 2; ++k){
+        IRProgram work = ir;
+        optimizeProgram(work, maxOptLevel, k ? vector<string>{} : vector<string>{pass});
+        double best = 1e300, ms = 0;
+        uint64_t executed = 0;
+        for (int it = 0; it < iterations; ++it){
+            results[k] = vmResult(work, &ms, &executed);
+            best = min(best, ms);
+        }
+        totals.size[k] += countInstructions(work);
+        totals.executed[k] += executed;
+        totals.ms[k] += best;
+        cout << "  -O2" << (k ? "" : " no " + pass) << ": " << countInstructions(work) << " instructions, "
+             << executed << " executed, " << best << " ms\n";
+    }
+    if (outcome(results[0]) == outcome(results[1])) return true;
+    cout << "  MISMATCH\n  without:\n" << results[0] << "  with:\n" << results[1];
+    return false;
+}
+
+// The call sites the inliner takes at -O2 and what that does to code size,
+// then VM instructions executed and run time (best of iterations) at -O2
+// without and with inlining. Both runs must end with the same globals or
+// fail the same way; an error raised in an inlined body names its caller,
+// so only the message up to " in " is compared.
+static int benchInline(const vector<string>& paths, int iterations){
+    int failures = 0;
+    size_t sizes[2] = {0, 0};
+    PassTotals totals;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        IRProgram inlined = ir;
+        InlineReport report = inlineCalls(inlined);
+        CallGraph graph = buildCallGraph(ir);
+        cout << path << ": " << report.sites.size() << " calls inlined, " << report.sizeBefore << " -> "
+             << report.sizeAfter << " instructions (" << showpos << (long long)report.sizeAfter - (long long)report.sizeBefore
+             << noshowpos << ")\n";
+        map<string, pair<int, int>> pairs;  // "caller <- callee (size)" -> sites, in loops
+        for (const auto& site : report.sites){
+            auto& n = pairs[site.caller + " <- " + site.callee + " (" + to_string(site.calleeSize) + ")"];
+            n.first++;
+            n.second += site.inLoop;
+        }
+        for (const auto& p : pairs) cout << "  " << p.first << ": " << p.second.first << " sites, " << p.second.second << " in loops\n";
+        for (uint32_t f = 0; f < ir.functions.size(); ++f){
+            if (graph.recursive(f)) cout << "  " << ir.functions[f].name << " is recursive\n";
+        }
+        sizes[0] += report.sizeBefore;
+        sizes[1] += report.sizeAfter;
+        if (!comparePass(ir, "inline", iterations, true, totals)) failures++;
+    }
+    cout << failures << " mismatches; inlining " << sizes[0] << " -> " << sizes[1] << " instructions, -O2 "
+         << totals.size[0] << " -> " << totals.size[1] << ", executed " << totals.executed[0] << " -> " << totals.executed[1] << ", "
+         << totals.ms[0] << " -> " << totals.ms[1] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// Tail calls in each program, how many of them are self calls the IR pass
+// turns into loops, then VM instructions executed and run time (best of
+// iterations) at -O2 without and with that pass. The remaining tail calls
+// reuse the caller's frame in the VM either way. Both runs must end with
+// the same globals or fail the same way.
+static int benchTailCall(const vector<string>& paths, int iterations){
+    int failures = 0;
+    size_t eliminated = 0;
+    PassTotals totals;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        size_t tail = 0, self = 0;
+        for (uint32_t f = 0; f < ir.functions.size(); ++f){
+            const IRFunction& fn = ir.functions[f];
+            for (size_t i = 0; i < fn.instructions.size(); ++i){
+                if (!isTailCall(fn, i)) continue;
+                tail++;
+                self += fn.instructions[i].a.index() == f;
+            }
+        }
+        auto selfCalls = [](const IRProgram& program){
+            size_t n = 0;
+            for (uint32_t f = 0; f < program.functions.size(); ++f){
+                for (const auto& ins : program.functions[f].instructions) n += ins.op == IROp::Call && ins.a.index() == f;
+            }
+            return n;
+        };
+        IRProgram looped = ir;
+        for (auto& fn : looped.functions) eliminateTailRecursion(looped, fn);
+        eliminated += selfCalls(ir) - selfCalls(looped);
+        cout << path << ": " << tail << " tail calls, " << self << " to the caller itself\n";
+        if (!comparePass(ir, "tailcall", iterations, false, totals)) failures++;
+    }
+    cout << failures << " mismatches; " << eliminated << " self calls turned into loops, executed " << totals.executed[0] << " -> "
+         << totals.executed[1] << ", " << totals.ms[0] << " -> " << totals.ms[1] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// Nanoseconds per executed bytecode instruction for each VM dispatch mode,
+// best of `iterations` runs of the -O2 bytecode. All modes must finish
+// with the same globals.
+static int benchDispatch(const vector<string>& paths, int iterations){
+    const Dispatch modes[] = {Dispatch::Switch, Dispatch::Threaded, Dispatch::Handlers};
+    if (!VM::hasComputedGoto()) cout << "(no computed goto: threaded runs the switch loop)\n";
+    double totalNs[3] = {0, 0, 0};
+    uint64_t totalExecuted = 0;
+    int failures = 0;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        optimizeProgram(ir, maxOptLevel);
+        BytecodeProgram bytecode = compileBytecode(ir);
+        cout << path << ":";
+        string expected;
+        uint64_t executed = 0;
+        for (int m = 0; m < 3; ++m){
+            double best = 1e300;
+            for (int it = 0; it < iterations; ++it){
+                VM vm(bytecode, modes[m]);
+                auto start = Clock::now();
+                bool ok = vm.run();
+                best = min(best, elapsedMs(start));
+                ostringstream outcome;
+                if (ok) vm.printGlobals(outcome);
+                else outcome << "error: " << vm.error() << "\n";
+                if (m == 0 && it == 0) expected = outcome.str();
+                else if (outcome.str() != expected){
+                    cerr << "\n" << path << " " << dispatchName(modes[m]) << ": result differs from switch dispatch\n";
+                    return 1;
+                }
+                executed = vm.executed();
+            }
+            double ns = executed ? best * 1e6 / (double)executed : 0;
+            totalNs[m] += best * 1e6;
+            cout << " " << dispatchName(modes[m]) << " " << ns << " ns";
+        }
+        totalExecuted += executed;
+        cout << " (" << executed << " instructions)\n";
+    }
+    for (int m = 0; m < 3; ++m){
+        cout << dispatchName(modes[m]) << ": " << (totalExecuted ? totalNs[m] / (double)totalExecuted : 0) << " ns/instruction\n";
+    }
+    return failures ? 1 : 0;
+}
+
+static void printTopGrams(const char* title, const unordered_map<uint32_t, uint64_t>& grams, int n, uint64_t total){
+    vector<pair<uint64_t, uint32_t>> ranked;
+    for (const auto& g : grams) ranked.push_back({g.second, g.first});
+    sort(ranked.rbegin(), ranked.rend());
+    cout << title << ":\n";
+    for (int i = 0; i < n && i < (int)ranked.size(); ++i){
+        uint32_t key = ranked[i].second;
+        cout << "  ";
+        if (key > 0xffff) cout << opCodeName((OpCode)(key >> 16)) << " ";
+        cout << opCodeName((OpCode)((key >> 8) & 0xff)) << " " << opCodeName((OpCode)(key & 0xff))
+             << "  " << 100.0 * (double)ranked[i].first / (double)total << "%\n";
+    }
+}
+
+// Profiles the -O2 bytecode of every file, picks the superinstructions the
+// profile supports and compares executed instructions and run time with and
+// without them (threaded dispatch, best of `iterations`). The corpus is both
+// the training and the measured set.
+static int benchSuperinstructions(const vector<string>& paths, int iterations){
+    vector<BytecodeProgram> programs;
+    programs.reserve(paths.size());  // strings in registers point into each program
+    vector<string> names;            // the paths that lowered, one per program
+    NGramProfile profile;
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)) continue;
+        optimizeProgram(ir, maxOptLevel);
+        names.push_back(path);
+        programs.push_back(compileBytecode(ir));
+        VM vm(programs.back());
+        vm.setProfiling(true);
+        vm.run();
+        vm.addProfile(profile);
+    }
+    if (!profile.total){
+        cerr << "nothing executed\n";
+        return 1;
+    }
+    cout << "profiled " << profile.total << " instructions\n";
+    printTopGrams("top bigrams", profile.bigrams, 8, profile.total);
+    printTopGrams("top trigrams", profile.trigrams, 5, profile.total);
+    uint32_t mask = selectFusions(profile);
+    cout << "fusions:\n";
+    for (uint32_t f = 0; f < fusionCount; ++f){
+        cout << "  " << fusionName((Fusion)f) << " " << 100.0 * (double)fusionWeight(profile, (Fusion)f) / (double)profile.total
+             << "%" << ((mask >> f) & 1 ? " (selected)" : "") << "\n";
+    }
+    uint64_t executed[2] = {0, 0};
+    double ms[2] = {0, 0};
+    for (size_t p = 0; p < programs.size(); ++p){
+        BytecodeProgram fused = programs[p];
+        size_t formed = formSuperinstructions(fused, mask);
+        const BytecodeProgram* variants[2] = {&programs[p], &fused};
+        cout << names[p] << ": " << formed << " formed";
+        string expected;
+        for (int v = 0; v < 2; ++v){
+            double best = 1e300;
+            for (int it = 0; it < iterations; ++it){
+                VM vm(*variants[v]);
+                auto start = Clock::now();
+                bool ok = vm.run();
+                best = min(best, elapsedMs(start));
+                ostringstream outcome;
+                if (ok) vm.printGlobals(outcome);
+                else outcome << "error: " << vm.error() << "\n";
+                if (v == 0 && it == 0) expected = outcome.str();
+                else if (outcome.str() != expected){
+                    cerr << "\n" << names[p] << ": superinstructions change the result\n";
+                    return 1;
+                }
+                if (it == 0) executed[v] += vm.executed();
+                if (it == 0) cout << (v ? " -> " : ", executed ") << vm.executed();
+            }
+            ms[v] += best;
+        }
+        cout << "\n";
+    }
+    cout << "executed " << executed[0] << " -> " << executed[1] << " instructions, "
+         << ms[0] << " -> " << ms[1] << " ms\n";
+    return names.size() == paths.size() ? 0 : 1;
+}
+
+static string nativeCompiler(){
+    const char* cc = getenv("CC");
+    return cc && *cc ? cc : "cc";
+}
+
+// Emits work as assembly into dir/prog.s and links dir/prog.
+static bool buildNative(const IRProgram& work, X86Registers registers, const string& dir){
+    {
+        ofstream out(dir + "/prog.s");
+        emitX86(work, out, registers);
+    }
+    string build = nativeCompiler() + " -o " + dir + "/prog " + dir + "/prog.s -lm";
+    return system(build.c_str()) == 0;
+}
+
+// Runs dir/prog; output is its globals, or its error when it exits with 7.
+static int runNative(const string& dir, string& output, double& ms){
+    string run = dir + "/prog > " + dir + "/out.txt 2> " + dir + "/err.txt";
+    auto start = Clock::now();
+    int status = system(run.c_str());
+    ms = elapsedMs(start);
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    output = readFile(dir + (code == 0 ? "/out.txt" : "/err.txt"));
+    return code;
+}
+
+static bool makeTempDir(string& dir){
+    char dirTemplate[] = "/tmp/main_bench_native.XXXXXX";
+    if (!mkdtemp(dirTemplate)){
+        cerr << "cannot create a temporary directory\n";
+        return false;
+    }
+    dir = dirTemplate;
+    return true;
+}
+
+// Emits work as C into dir/prog.c and builds dir/prog with cc -O2.
+static bool buildC(const IRProgram& work, const string& dir){
+    {
+        ofstream out(dir + "/prog.c");
+        emitC(work, out);
+    }
+    string build = nativeCompiler() + " -O2 -o " + dir + "/prog " + dir + "/prog.c -lm -pthread";
+    return system(build.c_str()) == 0;
+}
+
+static void removeTempDir(const string& dir){
+    for (const char* file : {"/prog.s", "/prog.c", "/prog", "/out.txt", "/err.txt"}) remove((dir + file).c_str());
+    rmdir(dir.c_str());
+}
+
+// Builds every file at -O0 and -O2 with the x86-64 backend and the system
+// C compiler ($CC, default cc), runs it and checks its globals (or its
+// run-time error) against the VM. Reports VM and native run times; the
+// native time includes process start-up.
+static int benchNative(const vector<string>& paths){
+    string dir;
+    if (!makeTempDir(dir)) return 1;
+    int failures = 0;
+    double totals[2] = {0, 0};
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        for (int level : {0, maxOptLevel}){
+            IRProgram work = ir;
+            optimizeProgram(work, level);
+            double vmMs = 0;
+            string expected = vmResult(work, &vmMs);
+            if (!buildNative(work, X86Registers::LinearScan, dir)){
+                cerr << path << " -O" << level << ": assembling failed\n";
+                failures++;
+                continue;
+            }
+            string got;
+            double nativeMs = 0;
+            int code = runNative(dir, got, nativeMs);
+            bool same = (code == 0 || code == 7) && got == expected;
+            totals[0] += vmMs;
+            totals[1] += nativeMs;
+            cout << path << " -O" << level << ": " << (same ? "ok" : "MISMATCH")
+                 << ", vm " << vmMs << " ms, native " << nativeMs << " ms\n";
+            if (!same){
+                failures++;
+                cout << "  expected:\n" << expected << "  got (exit " << code << "):\n" << got;
+            }
+        }
+    }
+    removeTempDir(dir);
+    cout << failures << " mismatches; vm " << totals[0] << " ms, native " << totals[1] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// Builds every file at -O0 and -O2 with the C backend and cc -O2, and with
+// the x86-64 backend, runs both and checks them against the VM. Reports the
+// C compile time and the VM and native run times (process start-up
+// included).
+static int benchC(const vector<string>& paths){
+    string dir;
+    if (!makeTempDir(dir)) return 1;
+    int failures = 0;
+    double totals[4] = {0, 0, 0, 0};
+    for (const auto& path : paths){
+        IRProgram ir;
+        if (!lowerFile(path, ir)){
+            failures++;
+            continue;
+        }
+        for (int level : {0, maxOptLevel}){
+            IRProgram work = ir;
+            optimizeProgram(work, level);
+            double vmMs = 0;
+            string expected = vmResult(work, &vmMs);
+            double ms[3] = {0, 0, 0};  // cc, C run, assembly run
+            bool same = true;
+            for (int k = 0; k < 2; ++k){
+                auto start = Clock::now();
+                if (!(k == 0 ? buildC(work, dir) : buildNative(work, X86Registers::LinearScan, dir))){
+                    cerr << path << " -O" << level << ": " << (k == 0 ? "cc" : "assembling") << " failed\n";
+                    same = false;
+                    continue;
+                }
+                if (k == 0) ms[0] = elapsedMs(start);
+                string got;
+                int code = runNative(dir, got, ms[k + 1]);
+                if ((code != 0 && code != 7) || got != expected){
+                    same = false;
+                    cout << path << " -O" << level << " " << (k == 0 ? "C" : "assembly")
+                         << ": expected:\n" << expected << "  got (exit " << code << "):\n" << got;
+                }
+            }
+            totals[0] += vmMs;
+            totals[1] += ms[0];
+            totals[2] += ms[1];
+            totals[3] += ms[2];
+            cout << path << " -O" << level << ": " << (same ? "ok" : "MISMATCH") << ", cc " << ms[0]
+                 << " ms, vm " << vmMs << " ms, C " << ms[1] << " ms, assembly " << ms[2] << " ms\n";
+            if (!same) failures++;
+        }
+    }
+    removeTempDir(dir);
+    cout << failures << " mismatches; cc " << totals[1] << " ms, vm " << totals[0] << " ms, C " << totals[2]
+         << " ms, assembly " << totals[3] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// Linear-scan allocation at -O2: per function, how many values live in
+// registers, how many were spilled or split and the spill moves that puts on
+// CFG edges. Then runs the native build with and without allocation (best
+// of iterations, process start-up included) and checks both against the VM.
+static int benchRegisterAllocation(const vector<string>& paths, int iterations){
+    string dir;
+    if (!makeTempDir(dir)) return 1;
+    int failures = 0;
+    double totals[2] = {0, 0};
+    for (const auto& path : paths){
+        IRProgram work;
+        if (!lowerFile(path, work)){
+            failures++;
+            continue;
+        }
+        optimizeProgram(work, maxOptLevel);
+        cout << path << "\n";
+        for (const auto& fn : work.functions){
+            RegisterAllocation ra = allocateRegisters(fn);
+            cout << "  " << fn.name << ": " << ra.intervals << " intervals, " << ra.intervals - ra.spilled
+                 << " in registers, " << ra.spilled << " spilled, " << ra.splits << " splits, "
+                 << ra.stores << " stores, " << ra.reloads << " reloads, "
+                 << __builtin_popcount(ra.calleeSaved) << " callee-saved\n";
+        }
+        string expected = vmResult(work);
+        double best[2] = {1e300, 1e300};
+        for (X86Registers registers : {X86Registers::AllSpill, X86Registers::LinearScan}){
+            int k = registers == X86Registers::LinearScan;
+            if (!buildNative(work, registers, dir)){
+                cerr << path << ": assembling failed\n";
+                failures++;
+                continue;
+            }
+            for (int it = 0; it < iterations; ++it){
+                string got;
+                double ms = 0;
+                int code = runNative(dir, got, ms);
+                if ((code != 0 && code != 7) || got != expected){
+                    cout << "  " << (k ? "linear scan" : "all spill") << ": MISMATCH (exit " << code << ")\n" << got;
+                    failures++;
+                    break;
+                }
+                best[k] = min(best[k], ms);
+            }
+        }
+        totals[0] += best[0];
+        totals[1] += best[1];
+        cout << "  all spill " << best[0] << " ms, linear scan " << best[1] << " ms\n";
+    }
+    removeTempDir(dir);
+    cout << failures << " mismatches; all spill " << totals[0] << " ms, linear scan " << totals[1] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// Calls into a small JIT-compiled program from the host with each kind of
+// argument and result, strings included; false if any call comes back wrong.
+static bool checkJITHostCalls(){
+    IRProgram work = lowerToIR(
+        "fn string pick(int n) { if (n < 0) { return \"neg\"; } return \"pos\"; }\n"
+        "fn bool ishello(string s) { return s == \"hello\"; }\n"
+        "fn string echo(string s) { return s; }\n"
+        "fn float scale(float x, int k) { return x * 2.0 + k; }\n"
+        "fn main() { }\n");
+    JIT jit(work);
+    bool ok = true;
+    auto expect = [&](bool good, const char* what){
+        if (!good) cout << "host call " << what << " came back wrong\n";
+        ok = ok && good;
+    };
+    expect(string(jit.call<const char*>("pick", -1)) == "neg", "pick(-1)");
+    expect(string(jit.call<const char*>("pick", 3)) == "pos", "pick(3)");
+    expect(jit.call<bool>("ishello", "hello"), "ishello(\"hello\")");
+    expect(!jit.call<bool>("ishello", "hell"), "ishello(\"hell\")");
+    expect(string(jit.call<const char*>("echo", "say \"hi\"\n")) == "say \"hi\"\n", "echo");
+    expect(jit.call<double>("scale", 1.5, 2) == 5.0, "scale(1.5, 2)");
+    return ok;
+}
+
+// JIT compile latency per function (best of iterations, with and without
+// register allocation) and the machine code size, then -O2 run times of the
+// JIT against the VM and the IR interpreter. All three must agree on the
+// globals or the run-time error. checkJITHostCalls runs first and counts
+// as a mismatch if it fails.
+static int benchJIT(const vector<string>& paths, int iterations){
+    int failures = !checkJITHostCalls();
+    size_t totalFunctions = 0;
+    double compileUs[2] = {0, 0};
+    double totals[3] = {0, 0, 0};
+    for (const auto& path : paths){
+        IRProgram work;
+        if (!lowerFile(path, work)){
+            failures++;
+            continue;
+        }
+        optimizeProgram(work, maxOptLevel);
+        size_t functions = work.functions.size();
+        cout << path << ": " << functions << " functions\n";
+        double best[2] = {1e300, 1e300};
+        size_t bytes[2] = {0, 0};
+        for (X86Registers registers : {X86Registers::AllSpill, X86Registers::LinearScan}){
+            int k = registers == X86Registers::LinearScan;
+            for (int it = 0; it < iterations; ++it){
+                auto start = Clock::now();
+                JIT jit(work, registers);
+                best[k] = min(best[k], elapsedMs(start));
+                bytes[k] = jit.codeBytes();
+            }
+        }
+        for (int k = 0; k < 2; ++k){
+            double us = functions ? best[k] * 1e3 / (double)functions : 0;
+            compileUs[k] += best[k] * 1e3;
+            cout << "  compile " << (k ? "linear scan " : "all spill ") << us << " us/function, "
+                 << bytes[k] << " bytes\n";
+        }
+        totalFunctions += functions;
+
+        double ms[3] = {0, 0, 0};
+        string expected = vmResult(work, &ms[0]);
+        IRExecutor exec(work);
+        auto start = Clock::now();
+        bool ok = exec.run();
+        ms[1] = elapsedMs(start);
+        ostringstream interpreted;
+        if (ok) exec.printGlobals(interpreted);
+        else interpreted << "Runtime error: " << exec.error() << "\n";
+        JIT jit(work);
+        start = Clock::now();
+        ok = jit.run();
+        ms[2] = elapsedMs(start);
+        ostringstream compiled;
+        if (ok) jit.printGlobals(compiled);
+        else compiled << "Runtime error: " << jit.error() << "\n";
+        bool same = compiled.str() == expected && interpreted.str() == expected;
+        for (int m = 0; m < 3; ++m) totals[m] += ms[m];
+        cout << "  " << (same ? "ok" : "MISMATCH") << ": vm " << ms[0] << " ms, interpreter " << ms[1]
+             << " ms, jit " << ms[2] << " ms\n";
+        if (!same){
+            failures++;
+            cout << "  expected:\n" << expected << "  jit:\n" << compiled.str()
+                 << "  interpreter:\n" << interpreted.str();
+        }
+    }
+    double n = totalFunctions ? (double)totalFunctions : 1;
+    cout << failures << " mismatches; compile " << compileUs[0] / n << " us/function all spill, "
+         << compileUs[1] / n << " linear scan; vm " << totals[0] << " ms, interpreter " << totals[1]
+         << " ms, jit " << totals[2] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+// End-to-end -O2 run times (best of iterations, compilation included) of the
+// VM, the tiered VM and the JIT, which compiles everything up front. All must
+// agree on the globals or the run-time error. Also reports what the tiered
+// VM compiled and how it got into the compiled code.
+static int benchTiered(const vector<string>& paths, int iterations){
+    int failures = 0;
+    double totals[3] = {0, 0, 0};
+    for (const auto& path : paths){
+        IRProgram work;
+        if (!lowerFile(path, work)){
+            failures++;
+            continue;
+        }
+        optimizeProgram(work, maxOptLevel);
+        double best[3] = {1e300, 1e300, 1e300};
+        string outcomes[3];
+        vector<string> promoted;
+        uint64_t calls = 0, loops = 0;
+        double compileMs = 0;
+        for (int it = 0; it < iterations; ++it){
+            for (int m = 0; m < 3; ++m){
+                ostringstream outcome;
+                auto start = Clock::now();
+                if (m == 0){
+                    BytecodeProgram bytecode = compileBytecode(work);
+                    VM vm(bytecode);
+                    bool ok = vm.run();
+                    best[m] = min(best[m], elapsedMs(start));
+                    if (ok) vm.printGlobals(outcome);
+                    else outcome << "Runtime error: " << vm.error() << "\n";
+                } else if (m == 1){
+                    BytecodeProgram bytecode = compileBytecode(work);
+                    TieredVM tiered(work, bytecode);
+                    bool ok = tiered.run();
+                    best[m] = min(best[m], elapsedMs(start));
+                    if (ok) tiered.printGlobals(outcome);
+                    else outcome << "Runtime error: " << tiered.error() << "\n";
+                    promoted = tiered.promoted();
+                    calls = tiered.compiledCalls();
+                    loops = tiered.loopEntries();
+                    compileMs = tiered.compileMs();
+                } else {
+                    JIT jit(work);
+                    bool ok = jit.run();
+                    best[m] = min(best[m], elapsedMs(start));
+                    if (ok) jit.printGlobals(outcome);
+                    else outcome << "Runtime error: " << jit.error() << "\n";
+                }
+                outcomes[m] = outcome.str();
+            }
+        }
+        // Promotion in the timed runs depends on when the worker finishes, so
+        // also compile every function on its first entry, on this thread.
+        ostringstream eager;
+        {
+            BytecodeProgram bytecode = compileBytecode(work);
+            TieredVM tiered(work, bytecode, 1, false);
+            if (tiered.run()) tiered.printGlobals(eager);
+            else eager << "Runtime error: " << tiered.error() << "\n";
+        }
+        bool same = outcomes[1] == outcomes[0] && outcomes[2] == outcomes[0] && eager.str() == outcomes[0];
+        for (int m = 0; m < 3; ++m) totals[m] += best[m];
+        cout << path << ": " << (same ? "ok" : "MISMATCH") << ", vm " << best[0] << " ms, tiered " << best[1]
+             << " ms, jit " << best[2] << " ms\n  compiled";
+        for (const auto& name : promoted) cout << " " << name;
+        if (promoted.empty()) cout << " nothing";
+        cout << " (" << compileMs << " ms), " << calls << " calls and " << loops << " loops entered\n";
+        if (!same){
+            failures++;
+            cout << "  vm:\n" << outcomes[0] << "  tiered:\n" << outcomes[1] << "  tiered, eager:\n" << eager.str()
+                 << "  jit:\n" << outcomes[2];
+        }
+    }
+    cout << failures << " mismatches; vm " << totals[0] << " ms, tiered " << totals[1] << " ms, jit "
+         << totals[2] << " ms\n";
+    return failures ? 1 : 0;
+}
+
+static int benchFused(const string& src, int iterations){
+    vector<Token> tokens = Lexer(src).tokenize();
+    FrontEndResult multi = runFrontEnd(tokens, false);
+    FrontEndResult fused = runFrontEnd(tokens, true);
+    if (multi.scopeDiags != fused.scopeDiags || multi.typeDiags != fused.typeDiags){
+        cerr << "fused front end diagnostics differ from the multi-pass pipeline\n";
+        return 1;
+    }
+    double best[2] = {1e300, 1e300};
+    for (int it = 0; it < iterations; ++it){
+        for (int mode = 0; mode < 2; ++mode){
+            auto start = Clock::now();
+            runFrontEnd(tokens, mode == 1);
+            double ms = elapsedMs(start);
+            if (ms < best[mode]) best[mode] = ms;
+        }
+    }
+    cout << "tokens:     " << tokens.size() << "\n";
+    cout << "diagnostics: " << multi.scopeDiags.size() << " scope, " << multi.typeDiags.size() << " type (identical)\n";
+    cout << "multi-pass: " << best[0] << " ms\n";
+    cout << "fused:      " << best[1] << " ms\n";
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if (argc < 2){
+        cerr << "usage: main_bench fused|parallel|ir|cfg|ssa [file.fn|-] [iterations]\n"
+             << "       main_bench opt [file.fn|-]...\n"
+             << "       main_bench iv file.fn...\n"
+             << "       main_bench dispatch file.fn...\n"
+             << "       main_bench inline file.fn...\n"
+             << "       main_bench tailcall file.fn...\n"
+             << "       main_bench super file.fn...\n"
+             << "       main_bench native file.fn...\n"
+             << "       main_bench cgen file.fn...\n"
+             << "       main_bench regalloc file.fn...\n"
+             << "       main_bench jit file.fn...\n"
+             << "       main_bench tier file.fn...\n";
+        return 2;
+    }
+    string mode = argv[1];
+    if (mode == "opt"){
+        vector<string> paths(argv + 2, argv + argc);
+        if (paths.empty()) paths.push_back("-");
+        return benchOpt(paths, 5);
+    }
+    if (mode == "iv"){
+        if (argc < 3){
+            cerr << "usage: main_bench iv file.fn...\n";
+            return 2;
+        }
+        return benchInductionVariables(vector<string>(argv + 2, argv + argc));
+    }
+    if (mode == "dispatch"){
+        if (argc < 3){
+            cerr << "usage: main_bench dispatch file.fn...\n";
+            return 2;
+        }
+        return benchDispatch(vector<string>(argv + 2, argv + argc), 5);
+    }
+    if (mode == "inline"){
+        if (argc < 3){
+            cerr << "usage: main_bench inline file.fn...\n";
+            return 2;
+        }
+        return benchInline(vector<string>(argv + 2, argv + argc), 5);
+    }
+    if (mode == "tailcall"){
+        if (argc < 3){
+            cerr << "usage: main_bench tailcall file.fn...\n";
+            return 2;
+        }
+        return benchTailCall(vector<string>(argv + 2, argv + argc), 5);
+    }
+    if (mode == "super"){
+        if (argc < 3){
+            cerr << "usage: main_bench super file.fn...\n";
+            return 2;
+        }
+        return benchSuperinstructions(vector<string>(argv + 2, argv + argc), 5);
+    }
+    if (mode == "native"){
+        if (argc < 3){
+            cerr << "usage: main_bench native file.fn...\n";
+            return 2;
+        }
+        return benchNative(vector<string>(argv + 2, argv + argc));
+    }
+    if (mode == "cgen"){
+        if (argc < 3){
+            cerr << "usage: main_bench cgen file.fn...\n";
+            return 2;
+        }
+        return benchC(vector<string>(argv + 2, argv + argc));
+    }
+    if (mode == "regalloc"){
+        if (argc < 3){
+            cerr << "usage: main_bench regalloc file.fn...\n";
+            return 2;
+        }
+        return benchRegisterAllocation(vector<string>(argv + 2, argv + argc), 5);
+    }
+    if (mode == "jit"){
+        if (argc < 3){
+            cerr << "usage: main_bench jit file.fn...\n";
+            return 2;
+        }
+        return benchJIT(vector<string>(argv + 2, argv + argc), 20);
+    }
+    if (mode == "tier"){
+        if (argc < 3){
+            cerr << "usage: main_bench tier file.fn...\n";
+            return 2;
+        }
+        return benchTiered(vector<string>(argv + 2, argv + argc), 5);
+    }
+    string path = argc > 2 ? argv[2] : "-";
+    int iterations = argc > 3 ? atoi(argv[3]) : 10;
+    if (mode == "cfg") return benchCFG(path, iterations);
+    string src;
+    if (path != "-") src = readFile(path);
+    else if (mode == "ir" || mode == "ssa") src = synthesizeProgram(4, 5000);  // few, very large functions
+    else src = synthesizeProgram(200, 40);
+    if (src.empty()){
+        cerr << "Error: no input program.\n";
+        return 3;
+    }
+    try {
+        if (mode == "fused") return benchFused(src, iterations);
+        if (mode == "parallel") return benchParallel(src, iterations);
+        if (mode == "ir") return benchIR(src, iterations);
+        if (mode == "ssa") return benchSSA(src, iterations);
+    }
+    catch (const exception& ex){
+        cerr << "error: " << ex.what() << "\n";
+        return 1;
+    }
+    cerr << "unknown benchmark '" << mode << "'\n";
+    return 2;
+}
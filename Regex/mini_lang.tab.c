@@ -1,8 +1,8 @@
-/* A Bison parser, made by GNU Bison 3.7.4.  */
+/* A Bison parser, made by GNU Bison 3.8.2.  */
 
 /* Bison implementation for Yacc-like parsers in C
 
-   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2020 Free Software Foundation,
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
    Inc.
 
    This program is free software: you can redistribute it and/or modify
@@ -16,7 +16,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* As a special exception, you may create a larger work that contains
    part or all of the Bison parser skeleton and distribute that work
@@ -46,10 +46,10 @@
    USER NAME SPACE" below.  */
 
 /* Identify Bison output, and Bison version.  */
-#define YYBISON 30704
+#define YYBISON 30802
 
 /* Bison version string.  */
-#define YYBISON_VERSION "3.7.4"
+#define YYBISON_VERSION "3.8.2"
 
 /* Skeleton name.  */
 #define YYSKELETON_NAME "yacc.c"
@@ -237,6 +237,18 @@ typedef int_least16_t yytype_int16;
 typedef short yytype_int16;
 #endif
 
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
 #if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
 typedef __UINT_LEAST8_TYPE__ yytype_uint8;
 #elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
@@ -334,17 +346,23 @@ typedef int yy_state_fast_t;
 
 /* Suppress unused-variable warnings by "using" E.  */
 #if ! defined lint || defined __GNUC__
-# define YYUSE(E) ((void) (E))
+# define YY_USE(E) ((void) (E))
 #else
-# define YYUSE(E) /* empty */
+# define YY_USE(E) /* empty */
 #endif
 
-#if defined __GNUC__ && ! defined __ICC && 407 <= __GNUC__ * 100 + __GNUC_MINOR__
 /* Suppress an incorrect diagnostic about yylval being uninitialized.  */
-# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                            \
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
     _Pragma ("GCC diagnostic push")                                     \
     _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
     _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
 # define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
     _Pragma ("GCC diagnostic pop")
 #else
@@ -503,16 +521,16 @@ union yyalloc
 /* YYFINAL -- State number of the termination state.  */
 #define YYFINAL  3
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   178
+#define YYLAST   165
 
 /* YYNTOKENS -- Number of terminals.  */
 #define YYNTOKENS  51
 /* YYNNTS -- Number of nonterminals.  */
 #define YYNNTS  40
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  97
+#define YYNRULES  98
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  156
+#define YYNSTATES  162
 
 /* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   305
@@ -563,19 +581,19 @@ static const yytype_int8 yytranslate[] =
 };
 
 #if YYDEBUG
-  /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,    46,    46,    50,    51,    55,    56,    61,    65,    66,
-      70,    71,    75,    80,    81,    82,    83,    84,    89,    93,
-      94,    98,    99,   103,   104,   105,   106,   107,   108,   109,
-     113,   114,   118,   119,   120,   124,   125,   129,   130,   134,
-     135,   140,   144,   145,   149,   150,   154,   158,   159,   164,
-     168,   169,   173,   174,   178,   179,   183,   184,   188,   189,
-     193,   194,   198,   199,   200,   204,   205,   206,   207,   208,
-     212,   213,   214,   218,   219,   220,   224,   225,   226,   227,
-     231,   232,   233,   234,   235,   239,   240,   241,   245,   246,
-     250,   251,   255,   256,   257,   258,   259,   260
+       0,    46,    46,    50,    51,    55,    56,    61,    62,    66,
+      67,    71,    72,    76,    81,    82,    83,    84,    85,    90,
+      94,    95,    99,   100,   104,   105,   106,   107,   108,   109,
+     110,   114,   115,   119,   120,   121,   125,   126,   130,   131,
+     135,   136,   141,   145,   146,   150,   151,   155,   159,   160,
+     165,   169,   170,   174,   175,   179,   180,   184,   185,   189,
+     190,   194,   195,   199,   200,   201,   205,   206,   207,   208,
+     209,   213,   214,   215,   219,   220,   221,   225,   226,   227,
+     228,   232,   233,   234,   235,   236,   240,   241,   242,   246,
+     247,   251,   252,   256,   257,   258,   259,   260,   261
 };
 #endif
 
@@ -617,21 +635,7 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#ifdef YYPRINT
-/* YYTOKNUM[NUM] -- (External) token number corresponding to the
-   (internal) symbol number NUM (which must be that of a token).  */
-static const yytype_int16 yytoknum[] =
-{
-       0,   256,   257,   258,   259,   260,   261,   262,   263,   264,
-     265,   266,   267,   268,   269,   270,   271,   272,   273,   274,
-     275,   276,   277,   278,   279,   280,   281,   282,   283,   284,
-     285,   286,   287,   288,   289,   290,   291,   292,   293,   294,
-     295,   296,   297,   298,   299,   300,   301,   302,   303,   304,
-     305
-};
-#endif
-
-#define YYPACT_NINF (-71)
+#define YYPACT_NINF (-47)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
@@ -641,166 +645,167 @@ static const yytype_int16 yytoknum[] =
 #define yytable_value_is_error(Yyn) \
   0
 
-  /* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
-     STATE-NUM.  */
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
 static const yytype_int16 yypact[] =
 {
-     -71,    42,    26,   -71,     7,   -71,   -71,   -71,   -71,   -71,
-     -71,   -71,    16,    30,    33,    38,   -71,    15,    73,    65,
-      38,   -71,    58,    64,   -71,    74,    73,    73,    73,    73,
-      73,   -71,   -71,   -71,   -71,   -71,    72,   -71,   -71,     8,
-      99,    82,    83,    84,     5,    67,    68,    66,    46,   -71,
-      28,   -71,    73,   -71,   -71,    86,    15,   -71,   -71,   -71,
-     -71,   -71,    89,   -71,    73,    73,    73,    73,    73,    73,
-      73,    73,    73,    73,    73,    73,    73,    73,    73,    73,
-      73,    73,    73,    73,    73,   -71,     6,   -71,   -71,   -71,
-      99,   -71,    82,    83,    84,     5,    67,    67,    68,    68,
-      68,    68,    66,    66,    46,    46,   -71,   -71,   -71,   -71,
-      90,    87,    91,    73,    94,    95,    98,   -71,    96,     6,
-     -71,    93,    97,   -71,    73,   -71,   100,    73,    35,    73,
-     -71,   -71,   -71,   -71,   -71,   -71,   101,   102,   -71,   -71,
-     104,     6,    73,     6,   130,   103,   -71,   -71,     6,   -71,
-      73,   -71,   105,   -71,     6,   -71
+     -47,    45,    12,   -47,    -2,   -47,   -47,   -47,   -47,   -47,
+     -47,   -47,   -19,    18,    27,    17,    33,   -47,    84,    70,
+      44,    58,    33,   -47,    71,    41,   -47,    64,    84,    44,
+      44,    44,    44,    44,   -47,   -47,   -47,   -47,   -47,    76,
+     -47,   -47,     4,   117,   100,   101,   104,     0,    25,     7,
+       5,    95,   -47,   -21,   -47,    44,   -47,   -47,   102,    84,
+     -47,   105,   -47,   -47,   -47,   -47,   106,   -47,    44,    44,
+      44,    44,    44,    44,    44,    44,    44,    44,    44,    44,
+      44,    44,    44,    44,    44,    44,    44,    44,    44,   -47,
+      29,   -47,   -47,   102,   -47,   117,   -47,   100,   101,   104,
+       0,    25,    25,     7,     7,     7,     7,     5,     5,    95,
+      95,   -47,   -47,   -47,   -47,   107,    96,    98,    44,   109,
+     110,   111,   -47,   112,    29,   -47,   113,   114,   -47,   -47,
+      44,   -47,   115,    44,    74,    44,   -47,   -47,   -47,   -47,
+     -47,   -47,   116,   118,   -47,   -47,   122,    29,    44,    29,
+     134,   119,   -47,   -47,    29,   -47,    44,   -47,   123,   -47,
+      29,   -47
 };
 
-  /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
-     Performed when YYTABLE does not specify something else to do.  Zero
-     means the default is an error.  */
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       3,     0,     2,     1,     0,    13,    14,    15,    16,    17,
-       4,     5,     0,     0,     0,    42,     6,     8,    39,    47,
-      43,    44,     0,     9,    10,     0,     0,     0,     0,     0,
-       0,    92,    93,    94,    95,    96,     0,    40,    49,    50,
-      52,    54,    56,    58,    60,    62,    65,    70,    73,    76,
-      84,    85,     0,    41,    45,     0,     0,    12,    80,    83,
-      82,    81,     0,    46,     0,     0,     0,     0,     0,     0,
+       3,     0,     2,     1,     0,    14,    15,    16,    17,    18,
+       4,     5,     0,     0,     0,     0,    43,     6,     9,     0,
+      40,    48,    44,    45,     0,    10,    11,     0,     9,     0,
+       0,     0,     0,     0,    93,    94,    95,    96,    97,     0,
+      41,    50,    51,    53,    55,    57,    59,    61,    63,    66,
+      71,    74,    77,    85,    86,     0,    42,    46,     0,     0,
+      13,     0,    81,    84,    83,    82,     0,    47,     0,     0,
        0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
-       0,     0,     0,    88,     0,    48,    19,     7,    11,    97,
-      53,    51,    55,    57,    59,    61,    63,    64,    67,    69,
-      66,    68,    71,    72,    74,    75,    77,    78,    79,    90,
-       0,    89,     0,    39,     0,     0,     0,    23,     0,    20,
-      21,     0,     0,    86,     0,    87,     0,     0,    32,     0,
-      18,    22,    28,    29,    91,    27,     0,     0,    33,    34,
-       0,     0,    35,     0,    30,     0,    36,    25,     0,    24,
-      37,    31,     0,    38,     0,    26
+       0,     0,     0,     0,     0,     0,     0,    89,     0,    49,
+      20,     7,    12,     0,    98,    54,    52,    56,    58,    60,
+      62,    64,    65,    68,    70,    67,    69,    72,    73,    75,
+      76,    78,    79,    80,    91,     0,    90,     0,    40,     0,
+       0,     0,    24,     0,    21,    22,     0,     0,     8,    87,
+       0,    88,     0,     0,    33,     0,    19,    23,    29,    30,
+      92,    28,     0,     0,    34,    35,     0,     0,    36,     0,
+      31,     0,    37,    26,     0,    25,    38,    32,     0,    39,
+       0,    27
 };
 
-  /* YYPGOTO[NTERM-NUM].  */
-static const yytype_int8 yypgoto[] =
+/* YYPGOTO[NTERM-NUM].  */
+static const yytype_int16 yypgoto[] =
 {
-     -71,   -71,   -71,   -71,   -71,   -71,   -71,    92,     3,    88,
-     -71,   -71,   -70,   -71,   -71,   -71,   -71,    34,    -1,   -71,
-     -71,   118,   -71,   -18,    81,   -71,    85,   106,   107,   108,
-     109,    31,   -66,    20,    25,   -24,   -71,   -71,   -71,   -71
+     -47,   -47,   -47,   -47,   -47,   120,   -47,    88,     2,   -46,
+     -47,   -47,   -43,   -47,   -47,   -47,   -47,    31,    -1,   -47,
+     -47,   129,   -47,   -20,    85,   -47,    94,    83,    92,    93,
+      91,    28,   -26,    46,    47,   -27,   -47,   -47,   -47,   -47
 };
 
-  /* YYDEFGOTO[NTERM-NUM].  */
-static const yytype_int16 yydefgoto[] =
+/* YYDEFGOTO[NTERM-NUM].  */
+static const yytype_uint8 yydefgoto[] =
 {
-      -1,     1,     2,    10,    11,    22,    23,    24,    12,   117,
-     118,   119,   120,   149,   137,   145,   152,    36,   121,    19,
-      20,    21,    53,   122,    38,    39,    40,    41,    42,    43,
-      44,    45,    46,    47,    48,    49,    50,   110,   111,    51
+       0,     1,     2,    10,    11,    24,    25,    26,    12,   122,
+     123,   124,   125,   155,   143,   151,   158,    39,   126,    21,
+      22,    23,    56,   127,    41,    42,    43,    44,    45,    46,
+      47,    48,    49,    50,    51,    52,    53,   115,   116,    54
 };
 
-  /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
-     positive, shift that token.  If negative, reduce the rule whose
-     number is the opposite.  If YYTABLE_NINF, syntax error.  */
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_uint8 yytable[] =
 {
-      37,    13,    58,    59,    60,    61,    98,    99,   100,   101,
-     113,   114,    62,   115,   116,     5,     6,     7,     8,     9,
-      25,    70,    71,    64,     5,     6,     7,     8,     9,     4,
-      65,    26,    27,    28,    85,     5,     6,     7,     8,     9,
-      29,    30,     3,    86,     5,     6,     7,     8,     9,   131,
-      31,    32,    33,    34,    35,    14,   106,   107,   108,    25,
-      26,    27,    28,    83,    15,   109,   112,    84,    17,    29,
-      30,   144,    16,   147,    80,    81,    82,    18,   151,    31,
-      32,    33,    34,    35,   155,    72,    73,    52,    76,    77,
-      74,    75,    78,    79,    55,    37,   102,   103,    26,    27,
-      28,    96,    97,   104,   105,    56,   134,    29,    30,   136,
-     139,   140,    63,    66,    67,    69,    68,    31,    32,    33,
-      34,    35,    57,    86,   146,    89,   123,   138,   124,   127,
-     128,   125,   153,   129,   130,   132,   148,   141,    54,   133,
-     143,   154,   135,    87,   142,   150,    91,   126,    88,    90,
-       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
-       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
-       0,     0,    92,     0,    93,     0,    94,     0,    95
+      40,    13,    62,    63,    64,    65,    15,     5,     6,     7,
+       8,     9,    91,    66,    87,     4,    74,    75,    88,    68,
+      27,     5,     6,     7,     8,     9,    69,    80,    81,    16,
+      27,    82,    83,   118,   119,    89,   120,   121,     5,     6,
+       7,     8,     9,    76,    77,     3,    14,   128,    78,    79,
+     103,   104,   105,   106,    29,    30,    31,   111,   112,   113,
+      17,    27,    18,    32,    33,    19,    90,   114,   117,    29,
+      30,    31,    20,    34,    35,    36,    37,    38,    32,    33,
+      55,   137,    59,     5,     6,     7,     8,     9,    34,    35,
+      36,    37,    38,     5,     6,     7,     8,     9,    40,    29,
+      30,    31,   101,   102,   150,    28,   153,    58,    32,    33,
+     140,   157,    60,   142,   145,   146,    67,   161,    34,    35,
+      36,    37,    38,    84,    85,    86,   107,   108,   152,   109,
+     110,    70,    71,   144,    72,    73,   159,   130,   131,    90,
+     154,    93,    94,   129,   133,   134,   135,    92,    61,   132,
+     136,    57,   147,    97,    96,   138,   139,   141,   149,   160,
+     148,   156,    95,    98,   100,    99
 };
 
-static const yytype_int16 yycheck[] =
+static const yytype_uint8 yycheck[] =
 {
-      18,     2,    26,    27,    28,    29,    72,    73,    74,    75,
-       4,     5,    30,     7,     8,     9,    10,    11,    12,    13,
-      17,    16,    17,    15,     9,    10,    11,    12,    13,     3,
-      22,    25,    26,    27,    52,     9,    10,    11,    12,    13,
-      34,    35,     0,    37,     9,    10,    11,    12,    13,   119,
-      44,    45,    46,    47,    48,    48,    80,    81,    82,    56,
-      25,    26,    27,    35,    48,    83,    84,    39,    35,    34,
-      35,   141,    42,   143,    28,    29,    30,    39,   148,    44,
-      45,    46,    47,    48,   154,    18,    19,    22,    20,    21,
-      23,    24,    26,    27,    36,   113,    76,    77,    25,    26,
-      27,    70,    71,    78,    79,    41,   124,    34,    35,   127,
-     128,   129,    40,    14,    32,    31,    33,    44,    45,    46,
-      47,    48,    48,    37,   142,    36,    36,   128,    41,    35,
-      35,    40,   150,    35,    38,    42,     6,    36,    20,    42,
-      36,    36,    42,    55,    42,    42,    65,   113,    56,    64,
-      -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
-      -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
-      -1,    -1,    66,    -1,    67,    -1,    68,    -1,    69
+      20,     2,    29,    30,    31,    32,     4,     9,    10,    11,
+      12,    13,    58,    33,    35,     3,    16,    17,    39,    15,
+      18,     9,    10,    11,    12,    13,    22,    20,    21,    48,
+      28,    26,    27,     4,     5,    55,     7,     8,     9,    10,
+      11,    12,    13,    18,    19,     0,    48,    93,    23,    24,
+      76,    77,    78,    79,    25,    26,    27,    84,    85,    86,
+      42,    59,    35,    34,    35,    48,    37,    87,    88,    25,
+      26,    27,    39,    44,    45,    46,    47,    48,    34,    35,
+      22,   124,    41,     9,    10,    11,    12,    13,    44,    45,
+      46,    47,    48,     9,    10,    11,    12,    13,   118,    25,
+      26,    27,    74,    75,   147,    35,   149,    36,    34,    35,
+     130,   154,    48,   133,   134,   135,    40,   160,    44,    45,
+      46,    47,    48,    28,    29,    30,    80,    81,   148,    82,
+      83,    14,    32,   134,    33,    31,   156,    41,    40,    37,
+       6,    36,    36,    36,    35,    35,    35,    59,    28,   118,
+      38,    22,    36,    70,    69,    42,    42,    42,    36,    36,
+      42,    42,    68,    71,    73,    72
 };
 
-  /* YYSTOS[STATE-NUM] -- The (internal number of the) accessing
-     symbol of state STATE-NUM.  */
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
        0,    52,    53,     0,     3,     9,    10,    11,    12,    13,
-      54,    55,    59,    69,    48,    48,    42,    35,    39,    70,
-      71,    72,    56,    57,    58,    59,    25,    26,    27,    34,
-      35,    44,    45,    46,    47,    48,    68,    74,    75,    76,
-      77,    78,    79,    80,    81,    82,    83,    84,    85,    86,
-      87,    90,    22,    73,    72,    36,    41,    48,    86,    86,
-      86,    86,    74,    40,    15,    22,    14,    32,    33,    31,
-      16,    17,    18,    19,    23,    24,    20,    21,    26,    27,
-      28,    29,    30,    35,    39,    74,    37,    60,    58,    36,
-      77,    75,    78,    79,    80,    81,    82,    82,    83,    83,
-      83,    83,    84,    84,    85,    85,    86,    86,    86,    74,
-      88,    89,    74,     4,     5,     7,     8,    60,    61,    62,
-      63,    69,    74,    36,    41,    40,    68,    35,    35,    35,
-      38,    63,    42,    42,    74,    42,    74,    65,    69,    74,
-      74,    36,    42,    36,    63,    66,    74,    63,     6,    64,
-      42,    63,    67,    74,    36,    63
+      54,    55,    59,    69,    48,    59,    48,    42,    35,    48,
+      39,    70,    71,    72,    56,    57,    58,    59,    35,    25,
+      26,    27,    34,    35,    44,    45,    46,    47,    48,    68,
+      74,    75,    76,    77,    78,    79,    80,    81,    82,    83,
+      84,    85,    86,    87,    90,    22,    73,    72,    36,    41,
+      48,    56,    86,    86,    86,    86,    74,    40,    15,    22,
+      14,    32,    33,    31,    16,    17,    18,    19,    23,    24,
+      20,    21,    26,    27,    28,    29,    30,    35,    39,    74,
+      37,    60,    58,    36,    36,    77,    75,    78,    79,    80,
+      81,    82,    82,    83,    83,    83,    83,    84,    84,    85,
+      85,    86,    86,    86,    74,    88,    89,    74,     4,     5,
+       7,     8,    60,    61,    62,    63,    69,    74,    60,    36,
+      41,    40,    68,    35,    35,    35,    38,    63,    42,    42,
+      74,    42,    74,    65,    69,    74,    74,    36,    42,    36,
+      63,    66,    74,    63,     6,    64,    42,    63,    67,    74,
+      36,    63
 };
 
-  /* YYR1[YYN] -- Symbol number of symbol that rule YYN derives.  */
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    51,    52,    53,    53,    54,    54,    55,    56,    56,
-      57,    57,    58,    59,    59,    59,    59,    59,    60,    61,
-      61,    62,    62,    63,    63,    63,    63,    63,    63,    63,
-      64,    64,    65,    65,    65,    66,    66,    67,    67,    68,
-      68,    69,    70,    70,    71,    71,    72,    73,    73,    74,
-      75,    75,    76,    76,    77,    77,    78,    78,    79,    79,
-      80,    80,    81,    81,    81,    82,    82,    82,    82,    82,
-      83,    83,    83,    84,    84,    84,    85,    85,    85,    85,
-      86,    86,    86,    86,    86,    87,    87,    87,    88,    88,
-      89,    89,    90,    90,    90,    90,    90,    90
+       0,    51,    52,    53,    53,    54,    54,    55,    55,    56,
+      56,    57,    57,    58,    59,    59,    59,    59,    59,    60,
+      61,    61,    62,    62,    63,    63,    63,    63,    63,    63,
+      63,    64,    64,    65,    65,    65,    66,    66,    67,    67,
+      68,    68,    69,    70,    70,    71,    71,    72,    73,    73,
+      74,    75,    75,    76,    76,    77,    77,    78,    78,    79,
+      79,    80,    80,    81,    81,    81,    82,    82,    82,    82,
+      82,    83,    83,    83,    84,    84,    84,    85,    85,    85,
+      85,    86,    86,    86,    86,    86,    87,    87,    87,    88,
+      88,    89,    89,    90,    90,    90,    90,    90,    90
 };
 
-  /* YYR2[YYN] -- Number of symbols on the right hand side of rule YYN.  */
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     0,     2,     1,     2,     6,     0,     1,
-       1,     3,     2,     1,     1,     1,     1,     1,     3,     0,
-       1,     1,     2,     1,     6,     5,     9,     3,     2,     2,
-       0,     2,     0,     1,     1,     0,     1,     0,     1,     0,
-       1,     4,     0,     1,     1,     2,     3,     0,     2,     1,
-       1,     3,     1,     3,     1,     3,     1,     3,     1,     3,
-       1,     3,     1,     3,     3,     1,     3,     3,     3,     3,
-       1,     3,     3,     1,     3,     3,     1,     3,     3,     3,
-       2,     2,     2,     2,     1,     1,     4,     4,     0,     1,
-       1,     3,     1,     1,     1,     1,     1,     3
+       0,     2,     1,     0,     2,     1,     2,     6,     7,     0,
+       1,     1,     3,     2,     1,     1,     1,     1,     1,     3,
+       0,     1,     1,     2,     1,     6,     5,     9,     3,     2,
+       2,     0,     2,     0,     1,     1,     0,     1,     0,     1,
+       0,     1,     4,     0,     1,     1,     2,     3,     0,     2,
+       1,     1,     3,     1,     3,     1,     3,     1,     3,     1,
+       3,     1,     3,     1,     3,     3,     1,     3,     3,     3,
+       3,     1,     3,     3,     1,     3,     3,     1,     3,     3,
+       3,     2,     2,     2,     2,     1,     1,     4,     4,     0,
+       1,     1,     3,     1,     1,     1,     1,     1,     3
 };
 
 
@@ -812,6 +817,7 @@ enum { YYENOMEM = -2 };
 #define YYACCEPT        goto yyacceptlab
 #define YYABORT         goto yyabortlab
 #define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
 
 
 #define YYRECOVERING()  (!!yyerrstatus)
@@ -852,10 +858,7 @@ do {                                            \
     YYFPRINTF Args;                             \
 } while (0)
 
-/* This macro is provided for backward compatibility. */
-# ifndef YY_LOCATION_PRINT
-#  define YY_LOCATION_PRINT(File, Loc) ((void) 0)
-# endif
+
 
 
 # define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
@@ -879,15 +882,11 @@ yy_symbol_value_print (FILE *yyo,
                        yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
 {
   FILE *yyoutput = yyo;
-  YYUSE (yyoutput);
+  YY_USE (yyoutput);
   if (!yyvaluep)
     return;
-# ifdef YYPRINT
-  if (yykind < YYNTOKENS)
-    YYPRINT (yyo, yytoknum[yykind], *yyvaluep);
-# endif
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YYUSE (yykind);
+  YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
@@ -1268,13 +1267,13 @@ static void
 yydestruct (const char *yymsg,
             yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
 {
-  YYUSE (yyvaluep);
+  YY_USE (yyvaluep);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YYUSE (yykind);
+  YY_USE (yykind);
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
@@ -1340,6 +1339,7 @@ yyparse (void)
   YYDPRINTF ((stderr, "Starting parse\n"));
 
   yychar = YYEMPTY; /* Cause a token to be read.  */
+
   goto yysetstate;
 
 
@@ -1365,7 +1365,7 @@ yysetstate:
 
   if (yyss + yystacksize - 1 <= yyssp)
 #if !defined yyoverflow && !defined YYSTACK_RELOCATE
-    goto yyexhaustedlab;
+    YYNOMEM;
 #else
     {
       /* Get the current used size of the three stacks, in elements.  */
@@ -1393,7 +1393,7 @@ yysetstate:
 # else /* defined YYSTACK_RELOCATE */
       /* Extend the stack our own way.  */
       if (YYMAXDEPTH <= yystacksize)
-        goto yyexhaustedlab;
+        YYNOMEM;
       yystacksize *= 2;
       if (YYMAXDEPTH < yystacksize)
         yystacksize = YYMAXDEPTH;
@@ -1404,7 +1404,7 @@ yysetstate:
           YY_CAST (union yyalloc *,
                    YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
         if (! yyptr)
-          goto yyexhaustedlab;
+          YYNOMEM;
         YYSTACK_RELOCATE (yyss_alloc, yyss);
         YYSTACK_RELOCATE (yyvs_alloc, yyvs);
 #  undef YYSTACK_RELOCATE
@@ -1426,6 +1426,7 @@ yysetstate:
     }
 #endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
 
+
   if (yystate == YYFINAL)
     YYACCEPT;
 
@@ -1538,7 +1539,7 @@ yyreduce:
   switch (yyn)
     {
 
-#line 1542 "mini_lang.tab.c"
+#line 1543 "mini_lang.tab.c"
 
       default: break;
     }
@@ -1614,7 +1615,7 @@ yyerrlab:
           }
         yyerror (yymsgp);
         if (yysyntax_error_status == YYENOMEM)
-          goto yyexhaustedlab;
+          YYNOMEM;
       }
     }
 
@@ -1650,6 +1651,7 @@ yyerrorlab:
      label yyerrorlab therefore never appears in user code.  */
   if (0)
     YYERROR;
+  ++yynerrs;
 
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYERROR.  */
@@ -1710,7 +1712,7 @@ yyerrlab1:
 `-------------------------------------*/
 yyacceptlab:
   yyresult = 0;
-  goto yyreturn;
+  goto yyreturnlab;
 
 
 /*-----------------------------------.
@@ -1718,24 +1720,22 @@ yyacceptlab:
 `-----------------------------------*/
 yyabortlab:
   yyresult = 1;
-  goto yyreturn;
+  goto yyreturnlab;
 
 
-#if 1
-/*-------------------------------------------------.
-| yyexhaustedlab -- memory exhaustion comes here.  |
-`-------------------------------------------------*/
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
 yyexhaustedlab:
   yyerror (YY_("memory exhausted"));
   yyresult = 2;
-  goto yyreturn;
-#endif
+  goto yyreturnlab;
 
 
-/*-------------------------------------------------------.
-| yyreturn -- parsing is finished, clean up and return.  |
-`-------------------------------------------------------*/
-yyreturn:
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
   if (yychar != YYEMPTY)
     {
       /* Make sure we have latest lookahead translation.  See comments at
@@ -1763,7 +1763,7 @@ yyreturn:
   return yyresult;
 }
 
-#line 263 "mini_lang.y"
+#line 264 "mini_lang.y"
   /* ==================== User code / adapter ==================== */
 
 /* Stand-alone mode: use your C++ Lexer to feed tokens to Bison.
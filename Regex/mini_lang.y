@@ -56,9 +56,10 @@ top
     | var_decl T_SEMICOLON
     ;
 
-/* functions: fn ident '(' params? ')' block */
+/* functions: fn type? ident '(' params? ')' block */
 function
     : T_FUNCTION T_IDENTIFIER T_PARENL param_list_opt T_PARENR block
+    | T_FUNCTION type T_IDENTIFIER T_PARENL param_list_opt T_PARENR block
     ;
 
 param_list_opt
@@ -0,0 +1,71 @@
+#include "opt.hpp"
+#include "ssa.hpp"
+#include "constfold.hpp"
+#include "dce.hpp"
+#include "copyprop.hpp"
+#include "gvn.hpp"
+#include "licm.hpp"
+#include "ivopt.hpp"
+#include "inline.hpp"
+#include "tailcall.hpp"
+#include <algorithm>
+
+using namespace std;
+
+struct OptPass {
+    const char* name;
+    int level;  // lowest level that runs the pass
+    bool (*run)(IRProgram&, IRFunction&);
+};
+
+static const OptPass passes[] = {
+    {"sccp", 1, propagateConstants},
+    {"copyprop", 1, propagateCopies},
+    {"lvn", 1, numberValuesLocal},
+    {"gvn", 2, numberValuesGlobal},
+    {"licm", 2, hoistLoopInvariants},
+    {"ivopt", 2, reduceInductionVariables},
+    {"dce", 1, eliminateDeadCode},
+    {"simplify-cfg", 1, simplifyControlFlow},
+};
+
+// Each pass can expose work for the others; a bound keeps a pass pair that
+// keeps undoing each other from looping forever.
+static const int maxRounds = 8;
+
+void optimizeFunction(IRProgram& ir, IRFunction& fn, int level, const vector<string>& disabled) {
+    if (level <= 0) return;
+    vector<const OptPass*> enabled;
+    for (const auto& pass : passes) {
+        if (pass.level <= level && find(disabled.begin(), disabled.end(), pass.name) == disabled.end()) enabled.push_back(&pass);
+    }
+    constructSSA(ir, fn);
+    for (int round = 0; round < maxRounds; ++round) {
+        bool changed = false;
+        for (const OptPass* pass : enabled) changed |= pass->run(ir, fn);
+        if (!changed) break;
+    }
+    destructSSA(ir, fn);
+    coalesceTemps(fn);
+    tidyFunction(fn);
+}
+
+void optimizeProgram(IRProgram& ir, int level, const vector<string>& disabled) {
+    if (level >= 1 && find(disabled.begin(), disabled.end(), "tailcall") == disabled.end()) {
+        for (auto& fn : ir.functions) eliminateTailRecursion(ir, fn);
+    }
+    if (level >= 2 && find(disabled.begin(), disabled.end(), "inline") == disabled.end()) inlineCalls(ir);
+    for (auto& fn : ir.functions) optimizeFunction(ir, fn, level, disabled);
+}
+
+size_t countInstructions(const IRFunction& fn) {
+    size_t n = 0;
+    for (const auto& ins : fn.instructions) n += ins.op != IROp::Label;
+    return n;
+}
+
+size_t countInstructions(const IRProgram& ir) {
+    size_t n = 0;
+    for (const auto& fn : ir.functions) n += countInstructions(fn);
+    return n;
+}
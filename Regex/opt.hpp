@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+using namespace std;
+
+// Optimization levels: 0 leaves the IR alone, 1 runs the scalar SSA passes
+// and the control-flow cleanups until none of them changes the function
+// (for a whole program, after turning self tail calls into loops), 2 adds
+// the passes that look across blocks (global value numbering, loop-invariant
+// code motion, induction-variable strength reduction) and, for a whole
+// program, first inlines small functions into their callers, after which a
+// run-time error in an inlined body names the caller (see inlineCalls).
+constexpr int maxOptLevel = 2;
+
+// Takes fn into SSA, runs the passes enabled at level and takes it back out.
+// Passes named in disabled ("gvn", "licm", ..., and "tailcall" and "inline"
+// for optimizeProgram) are skipped, for measuring what one pass contributes.
+void optimizeFunction(IRProgram& ir, IRFunction& fn, int level, const vector<string>& disabled = {});
+void optimizeProgram(IRProgram& ir, int level, const vector<string>& disabled = {});
+
+// Instructions that do work, i.e. everything but labels.
+size_t countInstructions(const IRFunction& fn);
+size_t countInstructions(const IRProgram& ir);
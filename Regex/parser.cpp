@@ -14,6 +14,41 @@ static bool isBoolIdent(const Token& tok){
 Parser::Parser(vector<Token> toks, string src)
     : tokens(move(toks)), source(move(src)) {}
 
+void Parser::enableFusedAnalysis(ScopeAnalyzer& scopeInfo, TypeChecker& typeInfo){
+    fusedScope = &scopeInfo;
+    fusedTypes = &typeInfo;
+}
+
+void Parser::pushExprType(const Expr* e, Type t){ exprTypes.push_back(fusedTypes->recordType(e, t)); }
+Type Parser::popExprType(){
+    resolvePendingIdent();
+    Type t = exprTypes.back();
+    exprTypes.pop_back();
+    return t;
+}
+// An identifier followed by '(' or ')' may still turn out to be a callee
+// (e.g. "(f)(x)"), so its resolution waits until it is consumed.
+void Parser::resolvePendingIdent(){
+    if (!pendingIdent) return;
+    const Ident* id = pendingIdent;
+    pendingIdent = nullptr;
+    pushExprType(id, fusedTypes->symbolType(fusedScope->resolveIdentifier(id)));
+}
+ExprPtr Parser::makeUnary(UnaryOp op, ExprPtr rhs){
+    auto u = makeNode<UnaryExpr>(op, move(rhs));
+    if (analyzing()) pushExprType(u.get(), fusedTypes->inferUnary(u.get(), popExprType()));
+    return u;
+}
+ExprPtr Parser::makeBinary(BinaryOp op, ExprPtr lhs, ExprPtr rhs){
+    auto b = makeNode<BinaryExpr>(op, move(lhs), move(rhs));
+    if (analyzing()){
+        Type rt = popExprType();
+        Type lt = popExprType();
+        pushExprType(b.get(), fusedTypes->inferBinary(b.get(), lt, rt));
+    }
+    return b;
+}
+
 void Parser::pushScope(){ scopes.emplace_back(); }
 void Parser::popScope(){ if (!scopes.empty()) scopes.pop_back(); }
 void Parser::declareVar(const string& name, TypeKind k){
@@ -72,12 +107,13 @@ const Token& Parser::expect(TokenType t, ParseError errKind, const char* msg){
 }
 
 shared_ptr<Program> Parser::parse(){
-    auto prog = make_shared<Program>();
+    auto prog = makeNode<Program>();
     pushScope();
     while (!atEnd()){
         prog->decls.push_back(parseTopLevel());
     }
     popScope();
+    prog->nodeCount = nextNodeId;
     return prog;
 }
 
@@ -88,15 +124,21 @@ DeclPtr Parser::parseTopLevel(){
     }
     if (check(TokenType::T_INT) || check(TokenType::T_FLOAT) || check(TokenType::T_BOOL)
         || check(TokenType::T_STRING) || check(TokenType::T_CHAR)) {
-        auto vd = parseVarDeclStmt();
+        auto tv = makeNode<TopVarDecl>(nullptr);
+        parseVarDeclStmt(tv.get());
         expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';'");
-        return make_shared<TopVarDecl>(vd);
+        return tv;
     }
     throw ParseException(ParseError::UnexpectedToken, "Unexpected token at top-level: " + toString(peek()), peek());
 }
 
 shared_ptr<FunctionDecl> Parser::parseFunction(){
     expect(TokenType::T_FUNCTION, ParseError::FailedToFindToken, "'fn'");
+    optional<Type> retType;
+    if (check(TokenType::T_INT) || check(TokenType::T_FLOAT) || check(TokenType::T_BOOL)
+        || check(TokenType::T_STRING) || check(TokenType::T_CHAR)) {
+        retType = parseType();
+    }
     const Token& nameTok = expect(TokenType::T_IDENTIFIER, ParseError::ExpectedIdentifier, "function name");
     expect(TokenType::T_PARENL, ParseError::FailedToFindToken, "'('");
     vector<Param> params;
@@ -104,15 +146,22 @@ shared_ptr<FunctionDecl> Parser::parseFunction(){
         params = parseParams();
     }
     expect(TokenType::T_PARENR, ParseError::FailedToFindToken, "')'");
-    pushScope();
-    for (const auto& p : params) declareVar(p.name, p.type.kind);
-    auto body = parseBlock();
-    popScope();
-    auto fn = make_shared<FunctionDecl>();
+    auto fn = makeNode<FunctionDecl>();
     fn->name = nameTok.lexeme;
     fn->params = move(params);
-    fn->retType = nullopt;
-    fn->body = body;
+    fn->retType = retType;
+    if (analyzing()){
+        fusedScope->beginFunction(fn.get());
+        fusedTypes->beginFunction(fn.get());
+    }
+    pushScope();
+    for (const auto& p : fn->params) declareVar(p.name, p.type.kind);
+    fn->body = parseBlock();
+    popScope();
+    if (analyzing()){
+        fusedScope->endFunction();
+        fusedTypes->endFunction(fn.get());
+    }
     return fn;
 }
 
@@ -141,11 +190,13 @@ Type Parser::parseType(){
 shared_ptr<BlockStmt> Parser::parseBlock(){
     expect(TokenType::T_BRACEL, ParseError::FailedToFindToken, "'{'");
     pushScope();
-    auto blk = make_shared<BlockStmt>();
+    if (analyzing()) fusedScope->beginScope();
+    auto blk = makeNode<BlockStmt>();
     while (!check(TokenType::T_BRACER)){
         blk->stmts.push_back(parseStmt());
     }
     expect(TokenType::T_BRACER, ParseError::FailedToFindToken, "'}'");
+    if (analyzing()) fusedScope->endScope();
     popScope();
     return blk;
 }
@@ -167,20 +218,27 @@ StmtPtr Parser::parseIf(){
     expect(TokenType::T_PARENL, ParseError::FailedToFindToken, "'(' after if");
     auto cond = parseExpr();
     expect(TokenType::T_PARENR, ParseError::FailedToFindToken, "')' after if condition");
+    if (analyzing()) fusedTypes->checkCondition(cond.get(), "if", popExprType());
     auto thenS = parseStmt();
     optional<StmtPtr> elseS;
     if (match({TokenType::T_ELSE})) elseS = parseStmt();
-    return make_shared<IfStmt>(cond, thenS, elseS);
+    return makeNode<IfStmt>(cond, thenS, elseS);
 }
 StmtPtr Parser::parseWhile(){
     expect(TokenType::T_PARENL, ParseError::FailedToFindToken, "'(' after while");
     auto cond = parseExpr();
     expect(TokenType::T_PARENR, ParseError::FailedToFindToken, "')' after while condition");
+    if (analyzing()){
+        fusedTypes->checkCondition(cond.get(), "while", popExprType());
+        fusedTypes->enterLoop();
+    }
     auto body = parseStmt();
-    return make_shared<WhileStmt>(cond, body);
+    if (analyzing()) fusedTypes->exitLoop();
+    return makeNode<WhileStmt>(cond, body);
 }
 StmtPtr Parser::parseFor(){
     expect(TokenType::T_PARENL, ParseError::FailedToFindToken, "'(' after for");
+    if (analyzing()) fusedScope->beginScope();
     optional<StmtPtr> init;
     if (!check(TokenType::T_SEMICOLON)){
         if (check(TokenType::T_INT) || check(TokenType::T_FLOAT) || check(TokenType::T_BOOL)
@@ -188,13 +246,15 @@ StmtPtr Parser::parseFor(){
             init = parseVarDeclStmt();
         } else {
             auto e = parseExpr();
-            init = make_shared<ExprStmt>(e);
+            if (analyzing()) popExprType();
+            init = makeNode<ExprStmt>(e);
         }
     }
     expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';' after for init");
     optional<ExprPtr> cond;
     if (!check(TokenType::T_SEMICOLON)){
         cond = parseExpr();
+        if (analyzing()) fusedTypes->checkCondition(cond->get(), "for", popExprType());
     }
     expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';' after for condition");
     optional<ExprPtr> incr;
@@ -202,42 +262,60 @@ StmtPtr Parser::parseFor(){
         incr = parseExpr();
     }
     expect(TokenType::T_PARENR, ParseError::FailedToFindToken, "')' after for increment");
+    if (analyzing()){
+        if (incr) popExprType();
+        fusedTypes->enterLoop();
+    }
     auto body = parseStmt();
-    return make_shared<ForStmt>(init, cond, incr, body);
+    if (analyzing()){
+        fusedTypes->exitLoop();
+        fusedScope->endScope();
+    }
+    return makeNode<ForStmt>(init, cond, incr, body);
 }
 StmtPtr Parser::parseReturn(){
     if (!check(TokenType::T_SEMICOLON)){
         auto e = parseExpr();
         expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';' after return expr");
-        return make_shared<ReturnStmt>(e);
+        auto r = makeNode<ReturnStmt>(e);
+        if (analyzing()) fusedTypes->checkReturn(r.get(), popExprType());
+        return r;
     } else {
         expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';' after return");
-        return make_shared<ReturnStmt>(nullopt);
+        auto r = makeNode<ReturnStmt>(nullopt);
+        if (analyzing()) fusedTypes->checkReturn(r.get(), Type::Unknown());
+        return r;
     }
 }
 StmtPtr Parser::parseExprStmt(){
     auto e = parseExpr();
     expect(TokenType::T_SEMICOLON, ParseError::FailedToFindToken, "';' after expression");
-    return make_shared<ExprStmt>(e);
+    if (analyzing()) popExprType();
+    return makeNode<ExprStmt>(e);
 }
 
-shared_ptr<VarDeclStmt> Parser::parseVarDeclStmt(){
+shared_ptr<VarDeclStmt> Parser::parseVarDeclStmt(TopVarDecl* owner){
     Type t = parseType();
     const Token& nameTok = expect(TokenType::T_IDENTIFIER, ParseError::ExpectedIdentifier, "variable name");
+    ++suppressAnalysis;
     while (match({TokenType::T_BRACKETL})){
         if (!check(TokenType::T_BRACKETR)){
             parseExpr();
         }
         expect(TokenType::T_BRACKETR, ParseError::FailedToFindToken, "']' after array declarator");
     }
-    optional<ExprPtr> init;
+    --suppressAnalysis;
+    auto vd = makeNode<VarDeclStmt>(t, nameTok.lexeme, nullopt);
+    if (owner) owner->decl = vd;
+    if (analyzing()) fusedScope->declareVariable(vd.get(), owner ? static_cast<const Node*>(owner) : vd.get());
     if (match({TokenType::T_ASSIGNOP})){
         ExprPtr rhs = parseExpr();
-        init = rhs;
+        vd->init = rhs;
+        if (analyzing()) fusedTypes->checkVarDeclInit(vd.get(), popExprType());
         checkLiteralAgainst(t.kind, rhs, "Variable initialization");
     }
     declareVar(nameTok.lexeme, t.kind);
-    return make_shared<VarDeclStmt>(t, nameTok.lexeme, init);
+    return vd;
 }
 
 ExprPtr Parser::parseExpr(){ return parseAssignment(); }
@@ -251,7 +329,7 @@ ExprPtr Parser::parseAssignment(){
                 checkLiteralAgainst(*k, rhs, "Assignment");
             }
         }
-        return make_shared<BinaryExpr>(BinaryOp::Assign, left, rhs);
+        return makeBinary(BinaryOp::Assign, left, rhs);
     }
     return left;
 }
@@ -259,7 +337,7 @@ ExprPtr Parser::parseOr(){
     auto e = parseAnd();
     while (match({TokenType::T_OROR})){
         auto r = parseAnd();
-        e = make_shared<BinaryExpr>(BinaryOp::Or, e, r);
+        e = makeBinary(BinaryOp::Or, e, r);
     }
     return e;
 }
@@ -267,7 +345,7 @@ ExprPtr Parser::parseAnd(){
     auto e = parseBitOr();
     while (match({TokenType::T_ANDAND})){
         auto r = parseBitOr();
-        e = make_shared<BinaryExpr>(BinaryOp::And, e, r);
+        e = makeBinary(BinaryOp::And, e, r);
     }
     return e;
 }
@@ -275,7 +353,7 @@ ExprPtr Parser::parseBitOr(){
     auto e = parseBitXor();
     while (match({TokenType::T_PIPE})){
         auto r = parseBitXor();
-        e = make_shared<BinaryExpr>(BinaryOp::BitOr, e, r);
+        e = makeBinary(BinaryOp::BitOr, e, r);
     }
     return e;
 }
@@ -283,7 +361,7 @@ ExprPtr Parser::parseBitXor(){
     auto e = parseBitAnd();
     while (match({TokenType::T_CARET})){
         auto r = parseBitAnd();
-        e = make_shared<BinaryExpr>(BinaryOp::BitXor, e, r);
+        e = makeBinary(BinaryOp::BitXor, e, r);
     }
     return e;
 }
@@ -291,7 +369,7 @@ ExprPtr Parser::parseBitAnd(){
     auto e = parseEquality();
     while (match({TokenType::T_AMP})){
         auto r = parseEquality();
-        e = make_shared<BinaryExpr>(BinaryOp::BitAnd, e, r);
+        e = makeBinary(BinaryOp::BitAnd, e, r);
     }
     return e;
 }
@@ -300,7 +378,7 @@ ExprPtr Parser::parseEquality(){
     while (match({TokenType::T_EQUALSOP, TokenType::T_NOTEQ})){
         TokenType op = prev().type;
         auto r = parseRel();
-        e = make_shared<BinaryExpr>(op==TokenType::T_EQUALSOP? BinaryOp::Eq : BinaryOp::Neq, e, r);
+        e = makeBinary(op==TokenType::T_EQUALSOP? BinaryOp::Eq : BinaryOp::Neq, e, r);
     }
     return e;
 }
@@ -314,7 +392,7 @@ ExprPtr Parser::parseRel(){
         else if (op==TokenType::T_LE) bop=BinaryOp::Le;
         else if (op==TokenType::T_GT) bop=BinaryOp::Gt;
         else bop=BinaryOp::Ge;
-        e = make_shared<BinaryExpr>(bop, e, r);
+        e = makeBinary(bop, e, r);
     }
     return e;
 }
@@ -323,7 +401,7 @@ ExprPtr Parser::parseShift(){
     while (match({TokenType::T_SHL, TokenType::T_SHR})){
         TokenType op = prev().type;
         auto r = parseAdd();
-        e = make_shared<BinaryExpr>(op==TokenType::T_SHL? BinaryOp::Shl : BinaryOp::Shr, e, r);
+        e = makeBinary(op==TokenType::T_SHL? BinaryOp::Shl : BinaryOp::Shr, e, r);
     }
     return e;
 }
@@ -332,7 +410,7 @@ ExprPtr Parser::parseAdd(){
     while (match({TokenType::T_PLUS, TokenType::T_MINUS})){
         TokenType op = prev().type;
         auto r = parseMul();
-        e = make_shared<BinaryExpr>(op==TokenType::T_PLUS? BinaryOp::Add : BinaryOp::Sub, e, r);
+        e = makeBinary(op==TokenType::T_PLUS? BinaryOp::Add : BinaryOp::Sub, e, r);
     }
     return e;
 }
@@ -343,34 +421,65 @@ ExprPtr Parser::parseMul(){
         auto r = parseUnary();
         BinaryOp bop = (op==TokenType::T_STAR? BinaryOp::Mul :
                         op==TokenType::T_SLASH? BinaryOp::Div : BinaryOp::Mod);
-        e = make_shared<BinaryExpr>(bop, e, r);
+        e = makeBinary(bop, e, r);
     }
     return e;
 }
 ExprPtr Parser::parseUnary(){
-    if (match({TokenType::T_NOT}))  return make_shared<UnaryExpr>(UnaryOp::Not,    parseUnary());
-    if (match({TokenType::T_TILDE}))return make_shared<UnaryExpr>(UnaryOp::BitNot, parseUnary());
-    if (match({TokenType::T_MINUS}))return make_shared<UnaryExpr>(UnaryOp::Neg,    parseUnary());
-    if (match({TokenType::T_PLUS})) return make_shared<UnaryExpr>(UnaryOp::Pos,    parseUnary());
+    if (match({TokenType::T_NOT}))  return makeUnary(UnaryOp::Not,    parseUnary());
+    if (match({TokenType::T_TILDE}))return makeUnary(UnaryOp::BitNot, parseUnary());
+    if (match({TokenType::T_MINUS}))return makeUnary(UnaryOp::Neg,    parseUnary());
+    if (match({TokenType::T_PLUS})) return makeUnary(UnaryOp::Pos,    parseUnary());
     return parsePostfix();
 }
 ExprPtr Parser::parsePostfix(){
+    size_t calleeDiagMark = analyzing() ? fusedTypes->diagnosticMark() : 0;
     auto e = parsePrimary();
+    if (pendingIdent == e.get() && !check(TokenType::T_PARENL) && !check(TokenType::T_PARENR)){
+        resolvePendingIdent();
+    }
     for(;;){
         if (match({TokenType::T_PARENL})){
-            vector<ExprPtr> args;
+            auto call = makeNode<CallExpr>(e, vector<ExprPtr>{});
+            vector<Type> argTypes;
+            vector<size_t> argDiagEnds;
+            size_t argDiagStart = 0;
+            if (analyzing()){
+                // The multi-pass checker never type-checks a callee expression.
+                if (pendingIdent == e.get()) pendingIdent = nullptr;
+                else {
+                    popExprType();
+                    fusedTypes->discardDiagnosticsFrom(calleeDiagMark);
+                }
+                fusedScope->resolveCallee(call.get());
+                argDiagStart = fusedTypes->diagnosticMark();
+            }
+            auto parseArg = [&](){
+                call->args.push_back(parseExpr());
+                if (analyzing()){
+                    argTypes.push_back(popExprType());
+                    argDiagEnds.push_back(fusedTypes->diagnosticMark());
+                }
+            };
             if (!check(TokenType::T_PARENR)){
-                args.push_back(parseExpr());
+                parseArg();
                 while (match({TokenType::T_COMMA})){
-                    args.push_back(parseExpr());
+                    parseArg();
                 }
             }
             expect(TokenType::T_PARENR, ParseError::FailedToFindToken, "')' after call args");
-            e = make_shared<CallExpr>(e, move(args));
+            if (analyzing()) pushExprType(call.get(), fusedTypes->inferCall(call.get(), argTypes, argDiagEnds, argDiagStart));
+            e = call;
         } else if (match({TokenType::T_BRACKETL})){
             auto idx = parseExpr();
             expect(TokenType::T_BRACKETR, ParseError::FailedToFindToken, "']' after index");
-            e = make_shared<IndexExpr>(e, idx);
+            auto ix = makeNode<IndexExpr>(e, idx);
+            if (analyzing()){
+                Type indexType = popExprType();
+                Type baseType = popExprType();
+                pushExprType(ix.get(), fusedTypes->inferIndex(ix.get(), baseType, indexType));
+            }
+            e = ix;
         } else {
             break;
         }
@@ -381,27 +490,39 @@ ExprPtr Parser::parsePrimary(){
     if (match({TokenType::T_INTLIT})){
         const auto& t = prev();
         long long v = strtoll(t.value.c_str(), nullptr, 10);
-        return make_shared<IntLit>(t.value, v);
+        auto lit = makeNode<IntLit>(t.value, v);
+        if (analyzing()) pushExprType(lit.get(), Type::Int());
+        return lit;
     }
     if (match({TokenType::T_FLOATLIT})){
         const auto& t = prev();
         double v = strtod(t.value.c_str(), nullptr);
-        return make_shared<FloatLit>(t.value, v);
+        auto lit = makeNode<FloatLit>(t.value, v);
+        if (analyzing()) pushExprType(lit.get(), Type::Float());
+        return lit;
     }
     if (match({TokenType::T_STRINGLIT})){
         const auto& t = prev();
-        return make_shared<StringLit>(t.value);
+        auto lit = makeNode<StringLit>(t.value);
+        if (analyzing()) pushExprType(lit.get(), Type::String());
+        return lit;
     }
     if (match({TokenType::T_CHARLIT})){
         const auto& t = prev();
-        return make_shared<CharLit>(t.value);
+        auto lit = makeNode<CharLit>(t.value);
+        if (analyzing()) pushExprType(lit.get(), Type::Char());
+        return lit;
     }
     if (!atEnd() && isBoolIdent(peek())){
         const auto& t = advance();
-        return make_shared<BoolLit>(t.lexeme == "true");
+        auto lit = makeNode<BoolLit>(t.lexeme == "true");
+        if (analyzing()) pushExprType(lit.get(), Type::Bool());
+        return lit;
     }
     if (match({TokenType::T_IDENTIFIER})){
-        return make_shared<Ident>(prev().lexeme);
+        auto id = makeNode<Ident>(prev().lexeme);
+        if (analyzing()) pendingIdent = id.get();
+        return id;
     }
     if (match({TokenType::T_PARENL})){
         auto e = parseExpr();
@@ -7,6 +7,7 @@
 #include <initializer_list>
 #include "token.hpp"
 #include "ast.hpp"
+#include "typechk.hpp"
 
 using namespace std;
 
@@ -34,11 +35,32 @@ class Parser {
 public:
     Parser(vector<Token> toks, string source = "");
     shared_ptr<Program> parse();
+    void enableFusedAnalysis(ScopeAnalyzer& scopeInfo, TypeChecker& typeInfo);
 
 private:
     vector<Token> tokens;
     string source;
     size_t i = 0;
+    uint32_t nextNodeId = 0;
+
+    template <typename T, typename... Args>
+    shared_ptr<T> makeNode(Args&&... args){
+        auto n = make_shared<T>(forward<Args>(args)...);
+        n->nodeId = nextNodeId++;
+        return n;
+    }
+
+    ScopeAnalyzer* fusedScope = nullptr;
+    TypeChecker* fusedTypes = nullptr;
+    vector<Type> exprTypes;
+    const Ident* pendingIdent = nullptr;
+    int suppressAnalysis = 0;
+    bool analyzing() const { return fusedScope && suppressAnalysis == 0; }
+    void pushExprType(const Expr* e, Type t);
+    Type popExprType();
+    void resolvePendingIdent();
+    ExprPtr makeUnary(UnaryOp op, ExprPtr rhs);
+    ExprPtr makeBinary(BinaryOp op, ExprPtr lhs, ExprPtr rhs);
 
     vector<unordered_map<string, TypeKind>> scopes;
     void pushScope();
@@ -57,7 +79,7 @@ private:
 
     DeclPtr parseTopLevel();
     shared_ptr<FunctionDecl> parseFunction();
-    shared_ptr<VarDeclStmt> parseVarDeclStmt();
+    shared_ptr<VarDeclStmt> parseVarDeclStmt(TopVarDecl* owner = nullptr);
     vector<Param> parseParams();
     Param parseParam();
     Type parseType();
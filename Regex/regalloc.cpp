@@ -0,0 +1,335 @@
+#include "regalloc.hpp"
+#include <algorithm>
+#include <queue>
+
+using namespace std;
+
+static const char* const registerNames[registerCount] = {
+    "%rbx", "%r12", "%r13", "%r14", "%r15",
+    "%rdi", "%rsi", "%r8", "%r9", "%r10", "%r11",
+    "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8",
+    "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15"};
+
+static const uint8_t registerEncodings[registerCount] = {
+    3, 12, 13, 14, 15,
+    7, 6, 8, 9, 10, 11,
+    2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+const char* registerName(int reg) {
+    return registerNames[reg];
+}
+
+int registerEncoding(int reg) {
+    return registerEncodings[reg];
+}
+
+int RegisterAllocation::location(uint32_t value, uint32_t instr) const {
+    if (value >= segments.size()) return memory;
+    const auto& pieces = segments[value];
+    auto it = upper_bound(pieces.begin(), pieces.end(), instr,
+                          [](uint32_t at, const LiveInterval& piece) { return at < piece.start; });
+    if (it == pieces.begin() || (--it)->end < instr) return memory;
+    return it->reg;
+}
+
+vector<SpillMove> RegisterAllocation::edgeMoves(uint32_t from, uint32_t to) const {
+    vector<SpillMove> moves;
+    uint32_t last = from == CFG::none ? 0 : cfg.blockStart[from + 1] - 1;
+    uint32_t first = cfg.blockStart[to];
+    for (uint32_t v : liveIn[to]) {
+        int out = from == CFG::none ? memory : location(v, last);
+        int in = location(v, first);
+        if (out != in && out != memory) moves.push_back({v, out, memory});
+    }
+    for (uint32_t v : liveIn[to]) {
+        int out = from == CFG::none ? memory : location(v, last);
+        int in = location(v, first);
+        if (out != in && in != memory) moves.push_back({v, memory, in});
+    }
+    return moves;
+}
+
+// Positions of instructions that call out: every caller-saved register is
+// dead after them.
+static bool callsOut(const IRInstr& ins) {
+    switch (ins.op) {
+        case IROp::Call:
+        case IROp::IndexLoad:
+        case IROp::IndexStore:
+            return true;
+        default:
+            return isBinaryOp(ins.op) && (ins.opType.kind == TypeKind::String ||
+                                          (ins.op == IROp::Mod && ins.opType.kind == TypeKind::Float));
+    }
+}
+
+namespace {
+
+class LinearScan {
+public:
+    LinearScan(const IRFunction& fn, RegisterAllocation& ra) : fn(fn), ra(ra), cfg(ra.cfg) {}
+
+    void run() {
+        valueCount = (uint32_t)fn.vars.size() + fn.tempCount;
+        ra.segments.assign(valueCount, {});
+        ra.liveIn.assign(cfg.blockCount(), {});
+        if (fn.instructions.empty()) return;
+        classify();
+        computeLiveness();
+        buildIntervals();
+        scan();
+        finish();
+    }
+
+private:
+    const IRFunction& fn;
+    RegisterAllocation& ra;
+    const CFG& cfg;
+    uint32_t valueCount = 0;
+    vector<uint8_t> allocatable, isFloat;
+    vector<uint32_t> calls;
+    vector<LiveInterval> intervals;
+    vector<vector<uint32_t>> liveOut;
+
+    uint32_t valueOf(Operand o) const {
+        if (o.kind() == OperandKind::Local) return o.index();
+        if (o.kind() == OperandKind::Temp) return (uint32_t)fn.vars.size() + o.index();
+        return CFG::none;
+    }
+
+    void classify() {
+        allocatable.assign(valueCount, 1);
+        isFloat.assign(valueCount, 0);
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) isFloat[v] = fn.vars[v].type.kind == TypeKind::Float;
+        for (uint32_t i = 0; i < fn.instructions.size(); ++i) {
+            const IRInstr& ins = fn.instructions[i];
+            if (ins.op == IROp::IndexLoad) allocatable[ins.a.index()] = 0;
+            if (ins.op == IROp::IndexStore) allocatable[ins.dst.index()] = 0;
+            if (writesDst(ins) && ins.dst.kind() == OperandKind::Temp && ins.type.kind == TypeKind::Float) {
+                isFloat[valueOf(ins.dst)] = 1;
+            }
+            if (callsOut(ins)) calls.push_back(i);
+        }
+    }
+
+    template <class F>
+    void forEachValue(const IRInstr& ins, F use, bool defs) const {
+        IRInstr probe = ins;
+        forEachUse(probe, [&](Operand& o) {
+            uint32_t v = valueOf(o);
+            if (v != CFG::none && allocatable[v]) use(v);
+        });
+        if (defs && writesDst(ins)) {
+            uint32_t v = valueOf(ins.dst);
+            if (v != CFG::none && allocatable[v]) use(v);
+        }
+    }
+
+    void computeLiveness() {
+        uint32_t n = cfg.blockCount(), words = (valueCount + 63) / 64;
+        vector<vector<uint64_t>> use(n, vector<uint64_t>(words, 0)), def = use, in = use, out = use;
+        for (uint32_t b = 0; b < n; ++b) {
+            for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+                const IRInstr& ins = fn.instructions[i];
+                forEachValue(ins, [&](uint32_t v) {
+                    if (!(def[b][v / 64] >> (v % 64) & 1)) use[b][v / 64] |= uint64_t(1) << (v % 64);
+                }, false);
+                if (!writesDst(ins)) continue;
+                uint32_t v = valueOf(ins.dst);
+                if (v != CFG::none && allocatable[v]) def[b][v / 64] |= uint64_t(1) << (v % 64);
+            }
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (uint32_t b = n; b-- > 0;) {
+                for (uint32_t s : cfg.successors(b)) {
+                    for (uint32_t w = 0; w < words; ++w) out[b][w] |= in[s][w];
+                }
+                for (uint32_t w = 0; w < words; ++w) {
+                    uint64_t live = use[b][w] | (out[b][w] & ~def[b][w]);
+                    if (live != in[b][w]) {
+                        in[b][w] = live;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        liveOut.resize(n);
+        for (uint32_t b = 0; b < n; ++b) {
+            for (uint32_t v = 0; v < valueCount; ++v) {
+                if (in[b][v / 64] >> (v % 64) & 1) ra.liveIn[b].push_back(v);
+                if (out[b][v / 64] >> (v % 64) & 1) liveOut[b].push_back(v);
+            }
+        }
+    }
+
+    void buildIntervals() {
+        vector<uint32_t> first(valueCount, CFG::none), last(valueCount, 0);
+        auto cover = [&](uint32_t v, uint32_t at) {
+            first[v] = min(first[v], at);
+            last[v] = max(last[v], at);
+        };
+        for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+            if (cfg.blockStart[b] == cfg.blockStart[b + 1]) continue;
+            for (uint32_t v : ra.liveIn[b]) cover(v, cfg.blockStart[b]);
+            for (uint32_t v : liveOut[b]) cover(v, cfg.blockStart[b + 1] - 1);
+        }
+        for (uint32_t i = 0; i < fn.instructions.size(); ++i) {
+            forEachValue(fn.instructions[i], [&](uint32_t v) { cover(v, i); }, true);
+        }
+        for (uint32_t v = 0; v < valueCount; ++v) {
+            if (first[v] == CFG::none) continue;
+            intervals.push_back({v, first[v], last[v], RegisterAllocation::memory});
+            ra.intervals++;
+        }
+    }
+
+    // True if a call inside [start, end] clobbers caller-saved registers
+    // while value is live: the value is defined before the call or read
+    // after it.
+    bool crossesCall(const LiveInterval& piece) const {
+        auto it = lower_bound(calls.begin(), calls.end(), piece.start);
+        if (it != calls.end() && *it == piece.start) {
+            const IRInstr& ins = fn.instructions[*it];
+            if (writesDst(ins) && valueOf(ins.dst) == piece.value) ++it;
+        }
+        return it != calls.end() && *it <= piece.end;
+    }
+
+    vector<int> candidates(const LiveInterval& piece) const {
+        vector<int> regs;
+        bool crosses = crossesCall(piece);
+        if (isFloat[piece.value]) {
+            if (!crosses) {
+                for (int r = firstFloatRegister; r < registerCount; ++r) regs.push_back(r);
+            }
+            return regs;
+        }
+        // Caller-saved first: they need no save in the prologue.
+        if (!crosses) {
+            for (int r = firstCallerSaved; r < firstFloatRegister; ++r) regs.push_back(r);
+        }
+        for (int r = 0; r < firstCallerSaved; ++r) regs.push_back(r);
+        return regs;
+    }
+
+    void scan() {
+        auto later = [&](uint32_t x, uint32_t y) {
+            const LiveInterval& a = intervals[x];
+            const LiveInterval& b = intervals[y];
+            return a.start != b.start ? a.start > b.start : a.value > b.value;
+        };
+        priority_queue<uint32_t, vector<uint32_t>, decltype(later)> unhandled(later);
+        for (uint32_t k = 0; k < intervals.size(); ++k) unhandled.push(k);
+        vector<uint32_t> active;
+        vector<int> holder(registerCount, -1);  // register -> active interval
+
+        auto queueTail = [&](uint32_t value, uint32_t start, uint32_t end) {
+            if (start > end) return;
+            intervals.push_back({value, start, end, RegisterAllocation::memory});
+            unhandled.push((uint32_t)intervals.size() - 1);
+        };
+
+        while (!unhandled.empty()) {
+            uint32_t cur = unhandled.top();
+            unhandled.pop();
+            uint32_t at = intervals[cur].start;
+            for (size_t k = 0; k < active.size();) {
+                if (intervals[active[k]].end < at) {
+                    holder[intervals[active[k]].reg] = -1;
+                    active[k] = active.back();
+                    active.pop_back();
+                } else {
+                    ++k;
+                }
+            }
+
+            vector<int> regs = candidates(intervals[cur]);
+            int chosen = RegisterAllocation::memory;
+            for (int r : regs) {
+                if (holder[r] < 0) {
+                    chosen = r;
+                    break;
+                }
+            }
+            uint32_t block = cfg.blockOf(at);
+            uint32_t blockStart = cfg.blockStart[block], nextBlock = cfg.blockStart[block + 1];
+            if (chosen == RegisterAllocation::memory && !regs.empty()) {
+                int victim = -1;
+                for (int r : regs) {
+                    if (victim < 0 || intervals[holder[r]].end > intervals[holder[victim]].end) victim = r;
+                }
+                uint32_t evicted = (uint32_t)holder[victim];
+                if (intervals[evicted].end > intervals[cur].end) {
+                    // Evict the victim from the start of this block; it gets
+                    // another chance at the next one.
+                    uint32_t value = intervals[evicted].value, end = intervals[evicted].end;
+                    if (intervals[evicted].start < blockStart) {
+                        intervals[evicted].end = blockStart - 1;
+                        intervals.push_back({value, blockStart, min(end, nextBlock - 1), RegisterAllocation::memory});
+                    } else {
+                        intervals[evicted].reg = RegisterAllocation::memory;
+                        intervals[evicted].end = min(end, nextBlock - 1);
+                    }
+                    active.erase(find(active.begin(), active.end(), evicted));
+                    holder[victim] = -1;
+                    queueTail(value, nextBlock, end);
+                    chosen = victim;
+                    ra.splits++;
+                }
+            }
+            if (chosen == RegisterAllocation::memory) {
+                if (!regs.empty() && intervals[cur].end >= nextBlock) {
+                    uint32_t end = intervals[cur].end;
+                    intervals[cur].end = nextBlock - 1;
+                    queueTail(intervals[cur].value, nextBlock, end);
+                    ra.splits++;
+                }
+                continue;
+            }
+            intervals[cur].reg = chosen;
+            holder[chosen] = (int)cur;
+            active.push_back(cur);
+        }
+    }
+
+    void finish() {
+        for (const auto& piece : intervals) ra.segments[piece.value].push_back(piece);
+        for (auto& pieces : ra.segments) {
+            if (pieces.empty()) continue;
+            sort(pieces.begin(), pieces.end(), [](const LiveInterval& a, const LiveInterval& b) { return a.start < b.start; });
+            vector<LiveInterval> merged;
+            bool inMemory = false;
+            for (const auto& piece : pieces) {
+                inMemory |= piece.reg == RegisterAllocation::memory;
+                if (isCalleeSaved(piece.reg)) ra.calleeSaved |= 1u << piece.reg;
+                if (!merged.empty() && merged.back().reg == piece.reg && merged.back().end + 1 == piece.start) {
+                    merged.back().end = piece.end;
+                } else {
+                    merged.push_back(piece);
+                }
+            }
+            pieces.swap(merged);
+            if (inMemory) ra.spilled++;
+        }
+        auto count = [&](uint32_t from, uint32_t to) {
+            for (const auto& m : ra.edgeMoves(from, to)) {
+                if (m.to == RegisterAllocation::memory) ra.stores++;
+                else ra.reloads++;
+            }
+        };
+        count(CFG::none, 0);
+        for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+            for (uint32_t s : cfg.successors(b)) count(b, s);
+        }
+    }
+};
+
+}  // namespace
+
+RegisterAllocation allocateRegisters(const IRFunction& fn) {
+    RegisterAllocation ra;
+    ra.cfg = buildCFG(fn);
+    LinearScan(fn, ra).run();
+    return ra;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "cfg.hpp"
+
+using namespace std;
+
+// Registers the allocator hands out. rax, rcx, rdx, xmm0 and xmm1 stay free
+// as scratch for the code generator, and rsp/rbp hold the frame.
+//   0 .. 4    rbx, r12 .. r15   callee-saved
+//   5 .. 10   rdi, rsi, r8 .. r11   caller-saved
+//   11 .. 24  xmm2 .. xmm15     caller-saved
+static constexpr int registerCount = 25;
+static constexpr int firstCallerSaved = 5;
+static constexpr int firstFloatRegister = 11;
+
+const char* registerName(int reg);
+int registerEncoding(int reg);  // hardware number: 0 rax .. 15 r15, or xmm0 .. xmm15
+inline bool isFloatRegister(int reg) { return reg >= firstFloatRegister; }
+inline bool isCalleeSaved(int reg) { return reg >= 0 && reg < firstCallerSaved; }
+
+// A piece of a value's live interval, instructions [start, end], in one
+// register or in the value's stack slot.
+struct LiveInterval {
+    uint32_t value;
+    uint32_t start, end;
+    int reg;
+};
+
+// A store to (reg -> memory) or a reload from (memory -> reg) a value's
+// stack slot on a control-flow edge.
+struct SpillMove {
+    uint32_t value;
+    int from, to;
+};
+
+// Linear-scan allocation for one non-SSA IRFunction. Values are numbered like
+// stack slots: locals first, then vars.size() + temp id. Locals used as
+// arrays are never allocated.
+//
+// Intervals are the hull of each value's liveness over the instruction order
+// (Poletto and Sarkar). When registers run out the interval that ends last is
+// split at the start of the current block: it waits in memory until the next
+// block starts and is then allocated again. A value therefore changes place
+// only between blocks, and every store and reload sits on a CFG edge, as
+// given by edgeMoves. Intervals live across a call get callee-saved general
+// registers or memory; floats have no callee-saved register.
+struct RegisterAllocation {
+    static constexpr int memory = -1;
+
+    CFG cfg;
+    vector<vector<LiveInterval>> segments;  // value -> pieces in instruction order
+    vector<vector<uint32_t>> liveIn;        // block -> values live on entry
+    uint32_t calleeSaved = 0;               // bit r set when register r is used
+
+    // Report
+    uint32_t intervals = 0;  // values with a live interval
+    uint32_t spilled = 0;    // of those, values that spend some of it in memory
+    uint32_t splits = 0;
+    uint32_t stores = 0;     // spill moves over all edges
+    uint32_t reloads = 0;
+
+    int location(uint32_t value, uint32_t instr) const;
+    // Moves that bring values live into block to from the end of block from
+    // (CFG::none for function entry, where every value is in its slot);
+    // stores come before reloads.
+    vector<SpillMove> edgeMoves(uint32_t from, uint32_t to) const;
+};
+
+RegisterAllocation allocateRegisters(const IRFunction& fn);
@@ -1,5 +1,7 @@
 #include "scope.hpp"
+#include "workpool.hpp"
 #include <cassert>
+#include <algorithm>
 using namespace std;
 
 static const char* scopeErrorName(ScopeError e) {
@@ -12,32 +14,53 @@ static const char* scopeErrorName(ScopeError e) {
     }
 }
 
-ScopeAnalyzer::ScopeAnalyzer() {
+ScopeAnalyzer::ScopeAnalyzer() : resolutions(&resolvedByNode) {
+    enterNewScope();
+}
+
+ScopeAnalyzer::ScopeAnalyzer(const ScopeAnalyzer* parent, size_t visibleOrder, vector<const Symbol*>* resolutions)
+    : resolutions(resolutions), parentScope(parent), visibleOrder(visibleOrder) {
     enterNewScope();
 }
 
 void ScopeAnalyzer::enterNewScope() {
-    auto frame = make_unique<ScopeFrame>();
-    frame->parent = current;
-    current = frame.get();
-    ownedFrames.emplace_back(move(frame));
+    scopeMarks.push_back(undoLog.size());
 }
 
 void ScopeAnalyzer::exitCurrentScope() {
-    assert(current && "attempted to pop scope when none exists");
-    current = current->parent;
+    assert(!scopeMarks.empty() && "attempted to pop scope when none exists");
+    size_t mark = scopeMarks.back();
+    scopeMarks.pop_back();
+    while (undoLog.size() > mark) {
+        undoLog.back()->pop_back();
+        undoLog.pop_back();
+    }
 }
 
 void ScopeAnalyzer::report(ScopeError kind, const string& name, const Node* where, const string& message) {
     diagnostics.push_back(ScopeDiagnostic{kind, name, message, where});
 }
 
+vector<SymbolBinding>& ScopeAnalyzer::bindingStackFor(const string& name) {
+    return bindings[name];
+}
+
+Symbol* ScopeAnalyzer::bindInCurrentScope(vector<SymbolBinding>& stack, Symbol sym) {
+    symbols.push_back(move(sym));
+    stack.push_back(SymbolBinding{&symbols.back(), scopeMarks.size(), currentOrder});
+    undoLog.push_back(&stack);
+    return &symbols.back();
+}
+
 const Symbol* ScopeAnalyzer::lookupAnySymbol(const string& name) const {
-    for (auto* f = current; f; f = f->parent) {
-        auto it = f->table.find(name);
-        if (it != f->table.end()) return &it->second;
-    }
-    return nullptr;
+    auto it = bindings.find(name);
+    if (it != bindings.end() && !it->second.empty()) return it->second.back().symbol;
+    if (!parentScope) return nullptr;
+    // The global scope never holds more than one binding per name.
+    it = parentScope->bindings.find(name);
+    if (it == parentScope->bindings.end() || it->second.empty()) return nullptr;
+    const SymbolBinding& b = it->second.back();
+    return b.order <= visibleOrder ? b.symbol : nullptr;
 }
 
 const Symbol* ScopeAnalyzer::lookupVariableSymbol(const string& name) const {
@@ -50,34 +73,44 @@ const Symbol* ScopeAnalyzer::lookupFunctionSymbol(const string& name) const {
     return (s && s->kind == SymbolKind::Function) ? s : nullptr;
 }
 
-void ScopeAnalyzer::declareVariableInCurrentScope(const string& name, const Type& type, const Node* where) {
-    assert(current && "no active scope");
-    auto it = current->table.find(name);
-    if (it != current->table.end()) {
+const Symbol* ScopeAnalyzer::declareVariableInCurrentScope(const string& name, const Type& type, const Node* where) {
+    assert(!scopeMarks.empty() && "no active scope");
+    auto& stack = bindingStackFor(name);
+    if (!stack.empty() && stack.back().depth == scopeMarks.size()) {
         report(ScopeError::VariableRedefinition, name, where, "conflicting variable name in the same scope");
-        return;
+        return nullptr;
     }
     Symbol sym;
     sym.kind = SymbolKind::Variable;
     sym.name = name;
     sym.variableType = type;
-    current->table.emplace(name, move(sym));
+    return bindInCurrentScope(stack, move(sym));
+}
+
+void ScopeAnalyzer::recordSymbol(const Node* n, const Symbol* sym) {
+    auto& table = *resolutions;
+    if (n->nodeId >= table.size()) table.resize(max<size_t>(n->nodeId + 1, table.size() * 2), nullptr);
+    table[n->nodeId] = sym;
+}
+
+const Symbol* ScopeAnalyzer::recordedSymbol(const Node* n) const {
+    return n->nodeId < resolvedByNode.size() ? resolvedByNode[n->nodeId] : nullptr;
 }
 
 void ScopeAnalyzer::declareFunctionPrototypeInCurrentScope(const string& name, const FunctionSignature& sig, const Node* where) {
-    assert(current && "no active scope");
-    auto it = current->table.find(name);
-    if (it == current->table.end()) {
+    assert(!scopeMarks.empty() && "no active scope");
+    auto& stack = bindingStackFor(name);
+    if (stack.empty() || stack.back().depth != scopeMarks.size()) {
         Symbol sym;
         sym.kind = SymbolKind::Function;
         sym.name = name;
         sym.functionSig = sig;
         sym.isPrototype = true;
         sym.isDefined = false;
-        current->table.emplace(name, move(sym));
+        bindInCurrentScope(stack, move(sym));
         return;
     }
-    Symbol& existing = it->second;
+    Symbol& existing = *stack.back().symbol;
     if (existing.kind != SymbolKind::Function) {
         report(ScopeError::VariableRedefinition, name, where, "name already used for a variable in this scope");
         return;
@@ -93,19 +126,19 @@ void ScopeAnalyzer::declareFunctionPrototypeInCurrentScope(const string& name, c
 }
 
 void ScopeAnalyzer::declareFunctionDefinitionInCurrentScope(const string& name, const FunctionSignature& sig, const Node* where) {
-    assert(current && "no active scope");
-    auto it = current->table.find(name);
-    if (it == current->table.end()) {
+    assert(!scopeMarks.empty() && "no active scope");
+    auto& stack = bindingStackFor(name);
+    if (stack.empty() || stack.back().depth != scopeMarks.size()) {
         Symbol sym;
         sym.kind = SymbolKind::Function;
         sym.name = name;
         sym.functionSig = sig;
         sym.isPrototype = false;
         sym.isDefined = true;
-        current->table.emplace(name, move(sym));
+        bindInCurrentScope(stack, move(sym));
         return;
     }
-    Symbol& existing = it->second;
+    Symbol& existing = *stack.back().symbol;
     if (existing.kind != SymbolKind::Function) {
         report(ScopeError::VariableRedefinition, name, where, "name already used for a variable in this scope");
         return;
@@ -123,9 +156,48 @@ void ScopeAnalyzer::declareFunctionDefinitionInCurrentScope(const string& name,
 }
 
 void ScopeAnalyzer::analyzeProgram(const Program& program) {
+    if (resolvedByNode.size() < program.nodeCount) resolvedByNode.resize(program.nodeCount, nullptr);
     for (const auto& d : program.decls) analyzeTopLevelDecl(d.get());
 }
 
+void ScopeAnalyzer::analyzeProgramParallel(const Program& program, unsigned threads) {
+    if (resolvedByNode.size() < program.nodeCount) resolvedByNode.resize(program.nodeCount, nullptr);
+    size_t declCount = program.decls.size();
+    vector<size_t> globalDiagEnds(declCount);
+    vector<const FunctionDecl*> bodies(declCount, nullptr);
+    size_t firstDiag = diagnostics.size();
+    for (size_t i = 0; i < declCount; ++i) {
+        currentOrder = i;
+        const Decl* d = program.decls[i].get();
+        if (auto* fn = dynamic_cast<const FunctionDecl*>(d)) {
+            declareFunction(fn);
+            bodies[i] = fn;
+        } else if (auto* tv = dynamic_cast<const TopVarDecl*>(d)) analyzeTopVarDecl(tv);
+        globalDiagEnds[i] = diagnostics.size();
+    }
+
+    size_t firstBody = bodyAnalyzers.size();
+    for (size_t i = 0; i < declCount; ++i) {
+        bodyAnalyzers.emplace_back(bodies[i] ? new ScopeAnalyzer(this, i, resolutions) : nullptr);
+    }
+    WorkStealingPool pool(threads);
+    pool.run(declCount, [&](size_t i) {
+        if (bodies[i]) bodyAnalyzers[firstBody + i]->analyzeFunctionBody(bodies[i]);
+    });
+
+    // Interleave per decl: the decl's own diagnostics, then its body's.
+    vector<ScopeDiagnostic> globalDiags(diagnostics.begin() + firstDiag, diagnostics.end());
+    diagnostics.resize(firstDiag);
+    size_t from = firstDiag;
+    for (size_t i = 0; i < declCount; ++i) {
+        for (size_t k = from; k < globalDiagEnds[i]; ++k) diagnostics.push_back(globalDiags[k - firstDiag]);
+        from = globalDiagEnds[i];
+        if (const auto& body = bodyAnalyzers[firstBody + i]) {
+            diagnostics.insert(diagnostics.end(), body->diagnostics.begin(), body->diagnostics.end());
+        }
+    }
+}
+
 void ScopeAnalyzer::analyzeTopLevelDecl(const Decl* decl) {
     if (auto* fn = dynamic_cast<const FunctionDecl*>(decl)) analyzeFunctionDecl(fn);
     else if (auto* tv = dynamic_cast<const TopVarDecl*>(decl)) analyzeTopVarDecl(tv);
@@ -133,21 +205,55 @@ void ScopeAnalyzer::analyzeTopLevelDecl(const Decl* decl) {
 
 void ScopeAnalyzer::analyzeTopVarDecl(const TopVarDecl* tv) {
     const auto& s = *tv->decl;
-    declareVariableInCurrentScope(s.name, s.type, tv);
+    declareVariable(&s, tv);
     if (s.init) analyzeExpression(s.init->get());
 }
 
 void ScopeAnalyzer::analyzeFunctionDecl(const FunctionDecl* fn) {
+    beginFunction(fn);
+    analyzeBlock(fn->body.get());
+    endFunction();
+}
+
+void ScopeAnalyzer::beginFunction(const FunctionDecl* fn) {
+    declareFunction(fn);
+    enterFunctionScope(fn);
+}
+
+void ScopeAnalyzer::declareFunction(const FunctionDecl* fn) {
     FunctionSignature sig;
     sig.returnType = fn->retType;
     for (const auto& p : fn->params) sig.paramTypes.push_back(p.type);
     declareFunctionDefinitionInCurrentScope(fn->name, sig, fn);
+}
+
+void ScopeAnalyzer::enterFunctionScope(const FunctionDecl* fn) {
     enterNewScope();
     for (const auto& p : fn->params) declareVariableInCurrentScope(p.name, p.type, fn);
+}
+
+void ScopeAnalyzer::analyzeFunctionBody(const FunctionDecl* fn) {
+    enterFunctionScope(fn);
     analyzeBlock(fn->body.get());
     exitCurrentScope();
 }
 
+void ScopeAnalyzer::endFunction() {
+    exitCurrentScope();
+}
+
+void ScopeAnalyzer::beginScope() {
+    enterNewScope();
+}
+
+void ScopeAnalyzer::endScope() {
+    exitCurrentScope();
+}
+
+void ScopeAnalyzer::declareVariable(const VarDeclStmt* s, const Node* where) {
+    if (const Symbol* sym = declareVariableInCurrentScope(s->name, s->type, where)) recordSymbol(s, sym);
+}
+
 void ScopeAnalyzer::analyzeBlock(const BlockStmt* block) {
     enterNewScope();
     for (const auto& s : block->stmts) analyzeStatement(s.get());
@@ -193,7 +299,7 @@ void ScopeAnalyzer::analyzeExprStatement(const ExprStmt* s) {
 }
 
 void ScopeAnalyzer::analyzeVarDeclStatement(const VarDeclStmt* s) {
-    declareVariableInCurrentScope(s->name, s->type, s);
+    declareVariable(s, s);
     if (s->init) analyzeExpression(s->init->get());
 }
 
@@ -221,33 +327,45 @@ void ScopeAnalyzer::analyzeBinaryExpression(const BinaryExpr* e) {
 }
 
 void ScopeAnalyzer::analyzeCallExpression(const CallExpr* e) {
-    if (auto* id = dynamic_cast<const Ident*>(e->callee.get())) {
-        const Symbol* fn = lookupFunctionSymbol(id->name);
-        if (!fn) {
-            if (lookupVariableSymbol(id->name)) report(ScopeError::UndefinedFunctionCalled, id->name, e, "identifier is a variable, not a function");
-            else report(ScopeError::UndefinedFunctionCalled, id->name, e, "call to undefined function");
-        } else resolvedCalls[e] = fn;
-    } else analyzeExpression(e->callee.get());
+    if (dynamic_cast<const Ident*>(e->callee.get())) resolveCallee(e);
+    else analyzeExpression(e->callee.get());
     for (const auto& arg : e->args) analyzeExpression(arg.get());
 }
 
+void ScopeAnalyzer::resolveCallee(const CallExpr* e) {
+    auto* id = dynamic_cast<const Ident*>(e->callee.get());
+    if (!id) return;
+    const Symbol* fn = lookupFunctionSymbol(id->name);
+    if (!fn) {
+        if (lookupVariableSymbol(id->name)) report(ScopeError::UndefinedFunctionCalled, id->name, e, "identifier is a variable, not a function");
+        else report(ScopeError::UndefinedFunctionCalled, id->name, e, "call to undefined function");
+    } else recordSymbol(e, fn);
+}
+
 void ScopeAnalyzer::analyzeIndexExpression(const IndexExpr* e) {
     analyzeExpression(e->base.get());
     analyzeExpression(e->index.get());
 }
 
 void ScopeAnalyzer::analyzeIdentifierUse(const Ident* id, bool) {
+    resolveIdentifier(id);
+}
+
+const Symbol* ScopeAnalyzer::resolveIdentifier(const Ident* id) {
     const Symbol* var = lookupVariableSymbol(id->name);
     if (!var) report(ScopeError::UndeclaredVariableAccessed, id->name, id, "use of undeclared variable");
-    else resolvedIdents[id] = var;
+    else recordSymbol(id, var);
+    return var;
 }
 
 const Symbol* ScopeAnalyzer::getResolvedSymbolForIdent(const Ident* id) const {
-    auto it = resolvedIdents.find(id);
-    return it == resolvedIdents.end() ? nullptr : it->second;
+    return recordedSymbol(id);
 }
 
 const Symbol* ScopeAnalyzer::getResolvedSymbolForCall(const CallExpr* call) const {
-    auto it = resolvedCalls.find(call);
-    return it == resolvedCalls.end() ? nullptr : it->second;
+    return recordedSymbol(call);
+}
+
+const Symbol* ScopeAnalyzer::getDeclaredSymbol(const VarDeclStmt* decl) const {
+    return recordedSymbol(decl);
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <deque>
 #include <optional>
 #include <memory>
 #include "ast.hpp"
@@ -47,25 +48,52 @@ struct Symbol {
     bool isDefined = false;
 };
 
-struct ScopeFrame {
-    unordered_map<string, Symbol> table;
-    ScopeFrame* parent = nullptr;
+// One entry on a name's binding stack; depth is the scope nesting level
+// that declared it, order the index of the top-level decl being analyzed.
+struct SymbolBinding {
+    Symbol* symbol;
+    size_t depth;
+    size_t order;
 };
 
 class ScopeAnalyzer {
 public:
     ScopeAnalyzer();
     ~ScopeAnalyzer() = default;
+    ScopeAnalyzer(const ScopeAnalyzer&) = delete;
+    ScopeAnalyzer& operator=(const ScopeAnalyzer&) = delete;
     void analyzeProgram(const Program& program);
+    // Declares top-level names on the calling thread, then analyzes function
+    // bodies on a work-stealing pool. Diagnostics and resolutions match
+    // analyzeProgram exactly.
+    void analyzeProgramParallel(const Program& program, unsigned threads);
     const vector<ScopeDiagnostic>& getDiagnostics() const { return diagnostics; }
     bool hasErrors() const { return !diagnostics.empty(); }
     const Symbol* getResolvedSymbolForIdent(const Ident* id) const;
     const Symbol* getResolvedSymbolForCall(const CallExpr* call) const;
+    const Symbol* getDeclaredSymbol(const VarDeclStmt* decl) const;
+
+    // Incremental entry points; Parser drives these in fused mode as nodes are built.
+    void beginFunction(const FunctionDecl* fn);
+    void endFunction();
+    void beginScope();
+    void endScope();
+    void declareVariable(const VarDeclStmt* s, const Node* where);
+    const Symbol* resolveIdentifier(const Ident* id);
+    void resolveCallee(const CallExpr* e);
 
 private:
+    // Body analyzer for one function: local names live in its own table,
+    // top-level names are read from parent as of decl index visibleOrder.
+    ScopeAnalyzer(const ScopeAnalyzer* parent, size_t visibleOrder, vector<const Symbol*>* resolutions);
+
     void enterNewScope();
     void exitCurrentScope();
-    void declareVariableInCurrentScope(const string& name, const Type& type, const Node* where);
+    vector<SymbolBinding>& bindingStackFor(const string& name);
+    Symbol* bindInCurrentScope(vector<SymbolBinding>& stack, Symbol sym);
+    void recordSymbol(const Node* n, const Symbol* sym);
+    const Symbol* recordedSymbol(const Node* n) const;
+    const Symbol* declareVariableInCurrentScope(const string& name, const Type& type, const Node* where);
     void declareFunctionPrototypeInCurrentScope(const string& name, const FunctionSignature& sig, const Node* where);
     void declareFunctionDefinitionInCurrentScope(const string& name, const FunctionSignature& sig, const Node* where);
     const Symbol* lookupAnySymbol(const string& name) const;
@@ -74,6 +102,9 @@ private:
     void report(ScopeError kind, const string& name, const Node* where, const string& message);
     void analyzeTopLevelDecl(const Decl* decl);
     void analyzeFunctionDecl(const FunctionDecl* fn);
+    void declareFunction(const FunctionDecl* fn);
+    void enterFunctionScope(const FunctionDecl* fn);
+    void analyzeFunctionBody(const FunctionDecl* fn);
     void analyzeTopVarDecl(const TopVarDecl* tv);
     void analyzeBlock(const BlockStmt* block);
     void analyzeStatement(const Stmt* stmt);
@@ -90,9 +121,19 @@ private:
     void analyzeIndexExpression(const IndexExpr* e);
     void analyzeIdentifierUse(const Ident* id, bool isCalleeContext);
 
-    vector<unique_ptr<ScopeFrame>> ownedFrames;
-    ScopeFrame* current = nullptr;
+    deque<Symbol> symbols;
+    unordered_map<string, vector<SymbolBinding>> bindings;
+    vector<vector<SymbolBinding>*> undoLog;
+    vector<size_t> scopeMarks;
     vector<ScopeDiagnostic> diagnostics;
-    unordered_map<const Ident*, const Symbol*> resolvedIdents;
-    unordered_map<const CallExpr*, const Symbol*> resolvedCalls;
+    // Indexed by Node::nodeId: the symbol an Ident or CallExpr resolves to, or
+    // the symbol a VarDeclStmt declares. Read-only once analysis is done.
+    vector<const Symbol*> resolvedByNode;
+    // Where recordSymbol writes; body analyzers share their parent's table,
+    // which is presized so concurrent writes never reallocate.
+    vector<const Symbol*>* resolutions;
+    const ScopeAnalyzer* parentScope = nullptr;
+    size_t visibleOrder = 0;
+    size_t currentOrder = 0;
+    vector<unique_ptr<ScopeAnalyzer>> bodyAnalyzers;
 };
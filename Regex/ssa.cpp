@@ -0,0 +1,346 @@
+#include "ssa.hpp"
+#include <algorithm>
+
+using namespace std;
+
+static IRInstr labelInstr(Operand label) {
+    IRInstr ins;
+    ins.op = IROp::Label;
+    ins.a = label;
+    return ins;
+}
+
+static IRInstr gotoInstr(Operand label) {
+    IRInstr ins;
+    ins.op = IROp::Goto;
+    ins.a = label;
+    return ins;
+}
+
+static Operand freshLabel(IRProgram& ir, const char* base) {
+    ir.labelBases.push_back(base);
+    return Operand::label((uint32_t)ir.labelBases.size() - 1);
+}
+
+// Drops unreachable blocks and gives every remaining block a leading label.
+// An entry block that is also a jump target gets an empty block in front, so
+// the entry never has predecessors.
+static void labelBlocks(IRProgram& ir, IRFunction& fn) {
+    const auto& code = fn.instructions;
+    vector<IRInstr> out;
+    if (code.empty()) {
+        out.push_back(labelInstr(freshLabel(ir, "entry")));
+        fn.instructions.swap(out);
+        return;
+    }
+    CFG cfg = buildCFG(fn);
+    out.reserve(code.size() + cfg.blockCount() / 2 + 1);
+    if (code[0].op == IROp::Label) out.push_back(labelInstr(freshLabel(ir, "entry")));
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        if (!cfg.reachable(b)) continue;
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        if (code[first].op != IROp::Label) out.push_back(labelInstr(freshLabel(ir, b == 0 ? "entry" : "bb")));
+        out.insert(out.end(), code.begin() + first, code.begin() + last);
+    }
+    fn.instructions.swap(out);
+}
+
+// Cooper-Harvey-Kennedy: walk up from each predecessor of a join block to
+// its immediate dominator. Result is CSR like the CFG's own edges.
+static void dominanceFrontiers(const CFG& cfg, vector<uint32_t>& offset, vector<uint32_t>& frontier) {
+    uint32_t n = cfg.blockCount();
+    vector<pair<uint32_t, uint32_t>> edges;
+    vector<uint32_t> lastAdded(n, CFG::none);
+    for (uint32_t b = 0; b < n; ++b) {
+        if (cfg.predecessors(b).size() < 2) continue;
+        for (uint32_t p : cfg.predecessors(b)) {
+            for (uint32_t runner = p; runner != cfg.idom[b]; runner = cfg.idom[runner]) {
+                if (lastAdded[runner] == b) break;
+                lastAdded[runner] = b;
+                edges.push_back({runner, b});
+            }
+        }
+    }
+    offset.assign(n + 1, 0);
+    for (const auto& e : edges) offset[e.first + 1]++;
+    for (uint32_t b = 0; b < n; ++b) offset[b + 1] += offset[b];
+    frontier.resize(edges.size());
+    vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+    for (const auto& e : edges) frontier[fill[e.first]++] = e.second;
+}
+
+// Locals that name arrays are read and written through IndexLoad/IndexStore
+// and cannot be versioned.
+static vector<uint8_t> renamableLocals(const IRFunction& fn) {
+    vector<uint8_t> renamable(fn.vars.size(), 1);
+    for (const auto& ins : fn.instructions) {
+        if (ins.op == IROp::IndexStore && ins.dst.kind() == OperandKind::Local) renamable[ins.dst.index()] = 0;
+        if (ins.op == IROp::IndexLoad && ins.a.kind() == OperandKind::Local) renamable[ins.a.index()] = 0;
+    }
+    return renamable;
+}
+
+static bool isRenamable(const vector<uint8_t>& renamable, Operand o) {
+    return o.kind() == OperandKind::Local && o.index() < renamable.size() && renamable[o.index()];
+}
+
+// Semi-pruned placement: only locals read before being written in some
+// block can need a phi.
+static vector<vector<uint32_t>> placePhis(const IRFunction& fn, const CFG& cfg, const vector<uint8_t>& renamable) {
+    uint32_t n = cfg.blockCount();
+    size_t varCount = renamable.size();
+    vector<uint8_t> global(varCount, 0);
+    vector<vector<uint32_t>> defBlocks(varCount);
+    vector<uint32_t> definedIn(varCount, CFG::none);
+    for (uint32_t b = 0; b < n; ++b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            const IRInstr& ins = fn.instructions[i];
+            forEachUse(ins, [&](const Operand& o) {
+                if (isRenamable(renamable, o) && definedIn[o.index()] != b) global[o.index()] = 1;
+            });
+            if (writesDst(ins) && isRenamable(renamable, ins.dst)) {
+                uint32_t v = ins.dst.index();
+                if (definedIn[v] != b) defBlocks[v].push_back(b);
+                definedIn[v] = b;
+            }
+        }
+    }
+
+    vector<uint32_t> dfOffset, df;
+    dominanceFrontiers(cfg, dfOffset, df);
+    vector<vector<uint32_t>> phisAt(n);
+    vector<uint32_t> hasPhi(n, CFG::none), queued(n, CFG::none);
+    vector<uint32_t> work;
+    for (uint32_t v = 0; v < varCount; ++v) {
+        if (!global[v] || defBlocks[v].empty()) continue;
+        work = defBlocks[v];
+        for (uint32_t b : work) queued[b] = v;
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t k = dfOffset[b]; k < dfOffset[b + 1]; ++k) {
+                uint32_t d = df[k];
+                if (hasPhi[d] == v) continue;
+                hasPhi[d] = v;
+                phisAt[d].push_back(v);
+                if (queued[d] != v) {
+                    queued[d] = v;
+                    work.push_back(d);
+                }
+            }
+        }
+    }
+    return phisAt;
+}
+
+static void insertPhis(IRFunction& fn, const CFG& cfg, const vector<vector<uint32_t>>& phisAt) {
+    const auto& code = fn.instructions;
+    vector<IRInstr> out;
+    out.reserve(code.size());
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        uint32_t first = cfg.blockStart[b];
+        out.push_back(code[first]);  // the block's label
+        for (uint32_t v : phisAt[b]) {
+            IRInstr phi;
+            phi.op = IROp::Phi;
+            phi.type = fn.vars[v].type;
+            phi.dst = Operand::local(v);
+            phi.a = Operand::imm((uint32_t)fn.phiArgs.size());
+            phi.b = Operand::imm((uint32_t)cfg.predecessors(b).size());
+            out.push_back(phi);
+            // Unfilled arguments name the variable itself; renaming
+            // overwrites each as its predecessor is visited.
+            for (uint32_t p : cfg.predecessors(b)) fn.phiArgs.push_back(PhiArg{blockLabel(fn, cfg, p), Operand::local(v)});
+        }
+        out.insert(out.end(), code.begin() + first + 1, code.begin() + cfg.blockStart[b + 1]);
+    }
+    fn.instructions.swap(out);
+}
+
+static void renameVariables(IRFunction& fn, const CFG& cfg, const vector<uint8_t>& renamable) {
+    size_t originalVars = renamable.size();
+    vector<vector<uint32_t>> current(originalVars);
+    vector<uint32_t> versionCount(originalVars, 0);
+    vector<uint32_t> pushed;  // undo log of variables whose stack grew
+
+    auto top = [&](uint32_t v) { return current[v].empty() ? v : current[v].back(); };
+    auto define = [&](Operand& dst) {
+        uint32_t v = dst.index();
+        uint32_t slot = (uint32_t)fn.vars.size();
+        IRVar version{fn.vars[v].name + "#" + to_string(++versionCount[v]), fn.vars[v].type};
+        fn.vars.push_back(move(version));
+        current[v].push_back(slot);
+        pushed.push_back(v);
+        dst = Operand::local(slot);
+    };
+
+    auto visit = [&](uint32_t b) {
+        for (uint32_t i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; ++i) {
+            IRInstr& ins = fn.instructions[i];
+            if (ins.op != IROp::Phi) {
+                forEachUse(ins, [&](Operand& o) {
+                    if (isRenamable(renamable, o)) o = Operand::local(top(o.index()));
+                });
+            }
+            if (writesDst(ins) && isRenamable(renamable, ins.dst)) define(ins.dst);
+        }
+        for (uint32_t s : cfg.successors(b)) {
+            auto preds = cfg.predecessors(s);
+            uint32_t j = (uint32_t)(find(preds.begin(), preds.end(), b) - preds.begin());
+            for (uint32_t i = cfg.blockStart[s] + 1; i < cfg.blockStart[s + 1] && fn.instructions[i].op == IROp::Phi; ++i) {
+                PhiArg& arg = fn.phiArgs[fn.instructions[i].a.index() + j];
+                arg.value = Operand::local(top(arg.value.index()));
+            }
+        }
+    };
+
+    // Iterative preorder walk of the dominator tree; each frame remembers
+    // how far the undo log reached when its block was entered.
+    struct Frame { uint32_t block, nextChild, mark; };
+    vector<Frame> stack;
+    stack.push_back({0, cfg.domChildOffset[0], 0});
+    visit(0);
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        if (f.nextChild < cfg.domChildOffset[f.block + 1]) {
+            uint32_t c = cfg.domChildren[f.nextChild++];
+            uint32_t mark = (uint32_t)pushed.size();
+            stack.push_back({c, cfg.domChildOffset[c], mark});
+            visit(c);
+        } else {
+            while (pushed.size() > f.mark) {
+                current[pushed.back()].pop_back();
+                pushed.pop_back();
+            }
+            stack.pop_back();
+        }
+    }
+}
+
+void constructSSA(IRProgram& ir, IRFunction& fn) {
+    if (fn.inSSA) return;
+    labelBlocks(ir, fn);
+    vector<uint8_t> renamable = renamableLocals(fn);
+    CFG cfg = buildCFG(fn);
+    vector<vector<uint32_t>> phisAt = placePhis(fn, cfg, renamable);
+    fn.phiArgs.clear();
+    insertPhis(fn, cfg, phisAt);
+    cfg = buildCFG(fn);
+    renameVariables(fn, cfg, renamable);
+    fn.inSSA = true;
+}
+
+vector<uint8_t> ssaValueLocals(const IRFunction& fn) {
+    vector<uint8_t> single = renamableLocals(fn);
+    vector<uint32_t> defs(fn.vars.size(), 0);
+    for (const auto& ins : fn.instructions) {
+        if (writesDst(ins) && ins.dst.kind() == OperandKind::Local) defs[ins.dst.index()]++;
+    }
+    for (size_t v = 0; v < single.size(); ++v) single[v] = single[v] && defs[v] == 1;
+    return single;
+}
+
+// Copies for the edge pred -> succ. Phis of one block read their arguments
+// simultaneously, so the copies are ordered to write no variable another copy
+// still has to read; only a cycle (a swap) needs a temp.
+static void emitEdgeCopies(IRFunction& fn, const CFG& cfg, uint32_t pred, uint32_t succ, vector<IRInstr>& out) {
+    const auto& code = fn.instructions;
+    Operand predLabel = blockLabel(fn, cfg, pred);
+    vector<IRInstr> pending;
+    for (uint32_t i = cfg.blockStart[succ] + 1; i < cfg.blockStart[succ + 1] && code[i].op == IROp::Phi; ++i) {
+        IRInstr copy;
+        copy.op = IROp::Copy;
+        copy.type = code[i].type;
+        copy.dst = code[i].dst;
+        for (uint32_t k = 0; k < code[i].b.index(); ++k) {
+            const PhiArg& arg = fn.phiArgs[code[i].a.index() + k];
+            if (arg.label == predLabel) copy.a = arg.value;
+        }
+        if (copy.a != copy.dst) pending.push_back(copy);
+    }
+    while (!pending.empty()) {
+        bool progress = false;
+        for (size_t k = 0; k < pending.size();) {
+            bool blocked = false;
+            for (const auto& other : pending) blocked |= &other != &pending[k] && other.a == pending[k].dst;
+            if (blocked) {
+                ++k;
+                continue;
+            }
+            out.push_back(pending[k]);
+            pending.erase(pending.begin() + k);
+            progress = true;
+        }
+        if (progress) continue;
+        // Everything left is on a cycle: save one destination's old value
+        // and let its readers take it from the temp.
+        IRInstr save;
+        save.op = IROp::Copy;
+        save.type = pending[0].type;
+        save.dst = Operand::temp(fn.tempCount++);
+        save.a = pending[0].dst;
+        out.push_back(save);
+        for (auto& other : pending) {
+            if (other.a == save.a) other.a = save.dst;
+        }
+    }
+}
+
+void destructSSA(IRProgram& ir, IRFunction& fn) {
+    if (!fn.inSSA) return;
+    CFG cfg = buildCFG(fn);
+    const auto& code = fn.instructions;
+    vector<IRInstr> out, splitBlocks;
+    out.reserve(code.size());
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        uint32_t first = cfg.blockStart[b], last = cfg.blockStart[b + 1];
+        uint32_t bodyEnd = last;
+        if (last > first && isTerminator(code[last - 1].op)) bodyEnd = last - 1;
+        for (uint32_t i = first; i < bodyEnd; ++i) {
+            if (code[i].op != IROp::Phi) out.push_back(code[i]);
+        }
+        if (bodyEnd == last) {
+            // Falls through into the next block.
+            if (b + 1 < cfg.blockCount() && hasPhis(fn, cfg, b + 1)) emitEdgeCopies(fn, cfg, b, b + 1, out);
+            continue;
+        }
+        IRInstr term = code[bodyEnd];
+        if (term.op == IROp::Goto) {
+            uint32_t target = *cfg.successors(b).begin();
+            if (hasPhis(fn, cfg, target)) emitEdgeCopies(fn, cfg, b, target, out);
+            out.push_back(term);
+        } else if (term.op == IROp::IfGoto) {
+            uint32_t taken = CFG::none;
+            for (uint32_t s : cfg.successors(b)) {
+                if (blockLabel(fn, cfg, s) == term.b) taken = s;
+            }
+            if (hasPhis(fn, cfg, taken)) {
+                Operand split = freshLabel(ir, "split");
+                splitBlocks.push_back(labelInstr(split));
+                emitEdgeCopies(fn, cfg, b, taken, splitBlocks);
+                splitBlocks.push_back(gotoInstr(term.b));
+                term.b = split;
+            }
+            out.push_back(term);
+            if (b + 1 < cfg.blockCount() && hasPhis(fn, cfg, b + 1)) {
+                out.push_back(labelInstr(freshLabel(ir, "split")));
+                emitEdgeCopies(fn, cfg, b, b + 1, out);
+                out.push_back(gotoInstr(blockLabel(fn, cfg, b + 1)));
+            }
+        } else {
+            out.push_back(term);
+        }
+    }
+    if (!splitBlocks.empty()) {
+        // Split blocks go after the last block, which must not fall into them.
+        if (out.empty() || !isTerminator(out.back().op)) {
+            IRInstr ret;
+            ret.op = IROp::ReturnVoid;
+            out.push_back(ret);
+        }
+        out.insert(out.end(), splitBlocks.begin(), splitBlocks.end());
+    }
+    fn.instructions.swap(out);
+    fn.phiArgs.clear();
+    fn.inSSA = false;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "ir.hpp"
+#include "cfg.hpp"
+
+using namespace std;
+
+// Rewrites fn into SSA form. Unreachable blocks are dropped, every block is
+// given a leading label (phi arguments name their predecessor by label), and
+// each definition of a scalar local gets its own version var "name#N".
+// Globals and locals used as array bases are memory and keep their slots.
+// A use with no reaching definition reads the original slot, which for a
+// parameter is its incoming value.
+void constructSSA(IRProgram& ir, IRFunction& fn);
+
+// Replaces phis with copies on the incoming edges, ordered so that a temp is
+// needed only to break a cycle. Edges leaving a conditional branch get their
+// own block so the copies run on that edge only.
+void destructSSA(IRProgram& ir, IRFunction& fn);
+
+// Locals that behave as SSA values in fn: defined exactly once and never used
+// as an array base. Other locals (and globals) must be treated as memory.
+vector<uint8_t> ssaValueLocals(const IRFunction& fn);
@@ -0,0 +1,193 @@
+#include "superinstr.hpp"
+
+using namespace std;
+
+static bool isIntCompare(OpCode op) {
+    return op >= OpCode::EqI && op <= OpCode::GeI;
+}
+
+static OpCode compareJump(OpCode cmp, bool negate) {
+    static const OpCode jumps[] = {OpCode::JumpIfEqI, OpCode::JumpIfNeI, OpCode::JumpIfLtI,
+                                   OpCode::JumpIfLeI, OpCode::JumpIfGtI, OpCode::JumpIfGeI};
+    static const OpCode negated[] = {OpCode::JumpIfNeI, OpCode::JumpIfEqI, OpCode::JumpIfGeI,
+                                     OpCode::JumpIfGtI, OpCode::JumpIfLeI, OpCode::JumpIfLtI};
+    size_t k = (size_t)cmp - (size_t)OpCode::EqI;
+    return negate ? negated[k] : jumps[k];
+}
+
+static bool isBranch(OpCode op) {
+    return op == OpCode::Jump || op == OpCode::JumpIf || (op >= OpCode::JumpIfEqI && op <= OpCode::JumpIfGeI);
+}
+
+static uint32_t& branchTarget(VMInstr& ins) {
+    if (ins.op == OpCode::Jump) return ins.a;
+    if (ins.op == OpCode::JumpIf) return ins.b;
+    return ins.c;
+}
+
+static uint32_t branchTarget(const VMInstr& ins) {
+    if (ins.op == OpCode::Jump) return ins.a;
+    if (ins.op == OpCode::JumpIf) return ins.b;
+    return ins.c;
+}
+
+template<class F>
+static void forEachRead(const VMInstr& ins, F f) {
+    switch (ins.op) {
+        case OpCode::LoadGlobal: case OpCode::Jump: case OpCode::Call: case OpCode::TailCall: case OpCode::RetVoid: break;
+        case OpCode::StoreGlobal: f(ins.b); break;
+        case OpCode::Move: case OpCode::NegI: case OpCode::NegF: case OpCode::Not:
+        case OpCode::BitNot: case OpCode::IntToFloat: case OpCode::AddImm:
+            f(ins.b);
+            break;
+        case OpCode::JumpIf: case OpCode::Arg: case OpCode::Ret: f(ins.a); break;
+        case OpCode::StoreIndex: case OpCode::LoadIndexAdd: f(ins.a); f(ins.b); f(ins.c); break;
+        case OpCode::Arg2: f(ins.a); f(ins.b); break;
+        default:
+            if (ins.op >= OpCode::JumpIfEqI && ins.op <= OpCode::JumpIfGeI) {
+                f(ins.a);
+                f(ins.b);
+            } else {
+                f(ins.b);
+                f(ins.c);
+            }
+            break;
+    }
+}
+
+const char* fusionName(Fusion fusion) {
+    switch (fusion) {
+        case Fusion::CompareJump: return "compare-jump";
+        case Fusion::CompareSkip: return "compare-skip";
+        case Fusion::AddImmediate: return "add-immediate";
+        case Fusion::LoadIndexAdd: return "load-index-add";
+        case Fusion::ArgPair: return "arg-pair";
+    }
+    return "?";
+}
+
+uint64_t fusionWeight(const NGramProfile& profile, Fusion fusion) {
+    auto count = [](const unordered_map<uint32_t, uint64_t>& grams, uint32_t key) {
+        auto it = grams.find(key);
+        return it == grams.end() ? 0 : it->second;
+    };
+    auto unigram = [&](const vector<uint64_t>& counts, OpCode op) {
+        return (size_t)op < counts.size() ? counts[(size_t)op] : 0;
+    };
+    uint64_t n = 0;
+    switch (fusion) {
+        case Fusion::CompareJump:
+        case Fusion::CompareSkip:
+            for (uint32_t op = (uint32_t)OpCode::EqI; op <= (uint32_t)OpCode::GeI; ++op) {
+                if (fusion == Fusion::CompareJump) n += count(profile.bigrams, NGramProfile::key((OpCode)op, OpCode::JumpIf));
+                else n += count(profile.trigrams, NGramProfile::key((OpCode)op, OpCode::JumpIf, OpCode::Jump));
+            }
+            return n;
+        case Fusion::AddImmediate:
+            return unigram(profile.immediates, OpCode::AddI) + unigram(profile.immediates, OpCode::SubI);
+        case Fusion::LoadIndexAdd:
+            return count(profile.bigrams, NGramProfile::key(OpCode::LoadIndex, OpCode::AddI));
+        case Fusion::ArgPair:
+            return count(profile.bigrams, NGramProfile::key(OpCode::Arg, OpCode::Arg));
+    }
+    return 0;
+}
+
+uint32_t selectFusions(const NGramProfile& profile, double minShare) {
+    uint32_t mask = 0;
+    for (uint32_t f = 0; f < fusionCount; ++f) {
+        uint64_t weight = fusionWeight(profile, (Fusion)f);
+        if (weight && (double)weight >= minShare * (double)profile.total) mask |= 1u << f;
+    }
+    return mask;
+}
+
+static size_t fuseFunction(VMFunction& fn, uint32_t mask) {
+    const vector<VMInstr>& code = fn.code;
+    size_t n = code.size();
+    vector<uint32_t> reads(fn.registerCount, 0);
+    vector<uint8_t> target(n + 1, 0);
+    for (const auto& ins : code) {
+        forEachRead(ins, [&](uint32_t reg) { reads[reg]++; });
+        if (isBranch(ins.op)) target[branchTarget(ins)] = 1;
+    }
+    auto enabled = [&](Fusion f) { return (mask >> (uint32_t)f) & 1; };
+    auto immediate = [&](uint32_t reg, bool negate, uint32_t& out) {
+        if (reg < fn.constantBase || reg >= fn.constantBase + fn.constants.size()) return false;
+        int64_t v = fn.constants[reg - fn.constantBase].i;
+        if (negate) {
+            if (v == INT64_MIN) return false;
+            v = -v;
+        }
+        if (v < INT32_MIN || v > INT32_MAX) return false;
+        out = (uint32_t)(int32_t)v;
+        return true;
+    };
+
+    vector<VMInstr> out;
+    vector<uint32_t> newPc(n + 1, 0);
+    size_t formed = 0;
+    for (size_t pc = 0; pc < n;) {
+        const VMInstr& ins = code[pc];
+        newPc[pc] = (uint32_t)out.size();
+        size_t length = 1;
+        VMInstr fused = ins;
+        bool straight1 = pc + 1 < n && !target[pc + 1];
+        bool straight2 = straight1 && pc + 2 < n && !target[pc + 2];
+        uint32_t imm = 0;
+        if (isIntCompare(ins.op) && straight1 && code[pc + 1].op == OpCode::JumpIf && code[pc + 1].a == ins.a && reads[ins.a] == 1) {
+            if (enabled(Fusion::CompareSkip) && straight2 && code[pc + 2].op == OpCode::Jump && code[pc + 1].b == pc + 3) {
+                fused.op = compareJump(ins.op, true);
+                fused.c = code[pc + 2].a;
+                length = 3;
+            } else if (enabled(Fusion::CompareJump)) {
+                fused.op = compareJump(ins.op, false);
+                fused.c = code[pc + 1].b;
+                length = 2;
+            }
+            if (length > 1) {
+                fused.a = ins.b;
+                fused.b = ins.c;
+            }
+        } else if (enabled(Fusion::LoadIndexAdd) && ins.op == OpCode::LoadIndex && straight1 && reads[ins.a] == 1) {
+            const VMInstr& add = code[pc + 1];
+            if (add.op == OpCode::AddI && add.a != ins.a &&
+                ((add.b == add.a && add.c == ins.a) || (add.c == add.a && add.b == ins.a))) {
+                fused.op = OpCode::LoadIndexAdd;
+                fused.a = add.a;
+                length = 2;
+            }
+        } else if (enabled(Fusion::ArgPair) && ins.op == OpCode::Arg && straight1 && code[pc + 1].op == OpCode::Arg) {
+            fused.op = OpCode::Arg2;
+            fused.b = code[pc + 1].a;
+            length = 2;
+        } else if (enabled(Fusion::AddImmediate) && ins.op == OpCode::AddI && immediate(ins.c, false, imm)) {
+            fused.op = OpCode::AddImm;
+            fused.c = imm;
+        } else if (enabled(Fusion::AddImmediate) && ins.op == OpCode::AddI && immediate(ins.b, false, imm)) {
+            fused.op = OpCode::AddImm;
+            fused.b = ins.c;
+            fused.c = imm;
+        } else if (enabled(Fusion::AddImmediate) && ins.op == OpCode::SubI && immediate(ins.c, true, imm)) {
+            fused.op = OpCode::AddImm;
+            fused.c = imm;
+        }
+        if (fused.op != ins.op) formed++;
+        for (size_t k = 1; k < length; ++k) newPc[pc + k] = (uint32_t)out.size();
+        out.push_back(fused);
+        pc += length;
+    }
+    newPc[n] = (uint32_t)out.size();
+    for (auto& ins : out) {
+        if (isBranch(ins.op)) branchTarget(ins) = newPc[branchTarget(ins)];
+    }
+    for (auto& label : fn.labels) label.first = newPc[label.first];
+    fn.code = move(out);
+    return formed;
+}
+
+size_t formSuperinstructions(BytecodeProgram& program, uint32_t mask) {
+    size_t formed = 0;
+    for (auto& fn : program.functions) formed += fuseFunction(fn, mask);
+    return formed;
+}
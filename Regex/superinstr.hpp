@@ -0,0 +1,30 @@
+#pragma once
+#include "vm.hpp"
+
+using namespace std;
+
+// Bytecode superinstructions. Each fusion turns a short instruction sequence
+// into one opcode with the same effect; which ones are worth forming is
+// decided from an NGramProfile gathered on a training corpus.
+enum class Fusion : uint8_t {
+    CompareJump,   // cmp t, x, y; jif t, L                 -> jcmp x, y, L
+    CompareSkip,   // cmp t, x, y; jif t, L1; jmp L2; L1:   -> jncmp x, y, L2
+    AddImmediate,  // addi/subi with a constant register    -> addimm
+    LoadIndexAdd,  // ldx t, a, i; addi d, d, t             -> ldxadd d, a, i
+    ArgPair,       // arg x; arg y                          -> arg2 x, y
+};
+static constexpr uint32_t fusionCount = 5;
+
+const char* fusionName(Fusion fusion);
+
+// How many executions in the profiled run the fusion would have covered.
+uint64_t fusionWeight(const NGramProfile& profile, Fusion fusion);
+
+// The fusions covering at least minShare of all profiled executions, as a
+// bit set indexed by Fusion.
+uint32_t selectFusions(const NGramProfile& profile, double minShare = 0.005);
+
+// Rewrites every function with the fusions in mask. A sequence is fused only
+// when no instruction after its first is a branch target and the temporary
+// it stops writing is read nowhere else. Returns the number formed.
+size_t formSuperinstructions(BytecodeProgram& program, uint32_t mask);
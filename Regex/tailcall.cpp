@@ -0,0 +1,71 @@
+#include "tailcall.hpp"
+#include <algorithm>
+
+using namespace std;
+
+bool eliminateTailRecursion(IRProgram& ir, IRFunction& fn) {
+    if (fn.inSSA) return false;
+    const uint32_t none = UINT32_MAX;
+    const vector<IRInstr>& code = fn.instructions;
+    uint32_t self = none;
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        if (&ir.functions[f] == &fn) self = f;
+    }
+    if (self == none) return false;
+
+    // The call each Param feeds, as in the inliner.
+    vector<uint32_t> owner(code.size(), none), pending;
+    vector<uint8_t> site(code.size(), 0);
+    bool any = false;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const IRInstr& ins = code[i];
+        if (ins.op == IROp::IndexLoad || ins.op == IROp::IndexStore) return false;
+        if (ins.op == IROp::Param) pending.push_back(i);
+        if (ins.op != IROp::Call) continue;
+        uint32_t argc = ins.b.index();
+        if (argc > pending.size()) return false;
+        for (size_t k = pending.size() - argc; k < pending.size(); ++k) owner[pending[k]] = i;
+        pending.resize(pending.size() - argc);
+        if (ins.a.index() == self && argc == fn.paramCount && isTailCall(fn, i)) site[i] = any = true;
+    }
+    if (!any) return false;
+
+    vector<uint8_t> reset = localsReadBeforeWrite(fn);
+    for (uint32_t v = fn.paramCount; v < fn.vars.size(); ++v) {
+        if (reset[v] && fn.vars[v].type.kind == TypeKind::String) return false;
+    }
+
+    ir.labelBases.push_back("tail_entry");
+    Operand entry = Operand::label((uint32_t)ir.labelBases.size() - 1);
+    vector<IRInstr> out;
+    out.reserve(code.size() + 1);
+    out.push_back(makeInstr(IROp::Label, Type::Unknown(), Operand::none(), entry));
+    vector<Operand> args;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const IRInstr& ins = code[i];
+        if (ins.op == IROp::Param && owner[i] != none && site[owner[i]]) {
+            Operand t = Operand::temp(fn.tempCount++);
+            out.push_back(makeInstr(IROp::Copy, fn.vars[args.size()].type, t, ins.a));
+            args.push_back(t);
+            continue;
+        }
+        if (!site[i]) {
+            out.push_back(ins);
+            continue;
+        }
+        for (uint32_t p = 0; p < fn.paramCount; ++p) {
+            out.push_back(makeInstr(IROp::Copy, fn.vars[p].type, Operand::local(p), args[p]));
+        }
+        args.clear();
+        for (uint32_t v = fn.paramCount; v < fn.vars.size(); ++v) {
+            if (!reset[v]) continue;
+            Type type = fn.vars[v].type;
+            Operand zero = type.kind == TypeKind::Float ? ir.floatConstant(0) : ir.intConstant(type, 0);
+            out.push_back(makeInstr(IROp::Copy, type, Operand::local(v), zero));
+        }
+        out.push_back(makeInstr(IROp::Goto, Type::Unknown(), Operand::none(), entry));
+        ++i;  // the Return, if any
+    }
+    fn.instructions.swap(out);
+    return true;
+}
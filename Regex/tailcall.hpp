@@ -0,0 +1,14 @@
+#pragma once
+#include "ir.hpp"
+
+using namespace std;
+
+// Tail-recursion elimination on a function that is not in SSA form. A call
+// of fn to itself whose result is returned straight away (see isTailCall)
+// becomes a copy of each argument into its parameter, a reset to zero of the
+// locals the body may read before writing, and a jump back to the top of
+// the body, so the recursion runs as a loop in one frame. The arguments are
+// all evaluated, into new temporaries, before any parameter is written.
+// Functions with arrays, and those where a string local would need a reset,
+// are left alone. Returns true if fn changed.
+bool eliminateTailRecursion(IRProgram& ir, IRFunction& fn);
@@ -0,0 +1,208 @@
+#include "tier.hpp"
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+static const uint32_t noLabel = UINT32_MAX;
+
+TieredVM::TieredVM(const IRProgram& ir, const BytecodeProgram& bytecode, uint32_t threshold, bool background, X86Registers registers)
+    : ir(ir), bytecode(bytecode), vm(bytecode), background(background), registers(registers),
+      compiled(new atomic<Unit*>[ir.functions.size()]), requested(ir.functions.size(), 0) {
+    for (size_t f = 0; f < ir.functions.size(); ++f) compiled[f].store(nullptr, memory_order_relaxed);
+    for (const auto& fn : ir.functions) {
+        // A temp's type is the type of the instructions that write it.
+        vector<uint8_t> kind(fn.vars.size() + fn.tempCount, Plain);
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+            if (fn.vars[v].type.kind == TypeKind::String) kind[v] = String;
+        }
+        bool isString = false;
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::Return && ins.type.kind == TypeKind::String) isString = true;
+            if (ins.op == IROp::IndexLoad) kind[ins.a.index()] |= Array;
+            if (ins.op == IROp::IndexStore) kind[ins.dst.index()] |= Array;
+            if (ins.dst.kind() == OperandKind::Temp && ins.type.kind == TypeKind::String) {
+                kind[fn.vars.size() + ins.dst.index()] = String;
+            }
+        }
+        returnsString.push_back(isString);
+        kinds.push_back(move(kind));
+    }
+    for (const string& text : bytecode.strings) stringFor[text.c_str()] = &text;
+    vm.setTier(this, threshold);
+}
+
+TieredVM::~TieredVM() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+bool TieredVM::run(const string& entry) {
+    return vm.run(entry);
+}
+
+vector<string> TieredVM::promoted() const {
+    lock_guard<mutex> guard(lock);
+    return order;
+}
+
+double TieredVM::compileMs() const {
+    lock_guard<mutex> guard(lock);
+    return compileTime;
+}
+
+void TieredVM::hot(uint32_t function) {
+    if (requested[function] || compiled[function].load(memory_order_acquire)) return;
+    requested[function] = 1;
+    if (!background) {
+        compile(function);
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        queue.push_back(function);
+    }
+    if (!worker.joinable()) worker = thread(&TieredVM::compileLoop, this);
+    wake.notify_one();
+}
+
+bool TieredVM::ready(uint32_t function) {
+    return compiled[function].load(memory_order_acquire) != nullptr;
+}
+
+void TieredVM::compileLoop() {
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [&] { return stopping || !queue.empty(); });
+        if (stopping) return;
+        uint32_t function = queue.front();
+        queue.pop_front();
+        guard.unlock();
+        compile(function);
+        guard.lock();
+    }
+}
+
+// Compiles function and its callees, then publishes the code for every one
+// of them that has none yet. A function the JIT cannot compile stays in the
+// interpreter.
+void TieredVM::compile(uint32_t function) {
+    auto start = chrono::steady_clock::now();
+    auto unit = make_unique<Unit>();
+    try {
+        unit->jit = make_unique<JIT>(ir, vector<uint32_t>{function}, registers);
+    } catch (const runtime_error&) {
+        return;
+    }
+    vector<uint8_t> used(ir.globals.size(), 0);
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        if (!unit->jit->compiled(f)) continue;
+        for (const auto& ins : ir.functions[f].instructions) {
+            for (Operand o : {ins.dst, ins.a, ins.b}) {
+                if (o.kind() == OperandKind::Global) used[o.index()] = 1;
+            }
+        }
+    }
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        if (used[g]) unit->globals.push_back(g);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    lock_guard<mutex> guard(lock);
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) {
+        if (unit->jit->compiled(f) && !compiled[f].load(memory_order_relaxed)) compiled[f].store(unit.get(), memory_order_release);
+    }
+    units.push_back(move(unit));
+    order.push_back(ir.functions[function].name);
+    compileTime += ms;
+}
+
+int64_t TieredVM::toWord(Value v, bool isString) const {
+    if (isString) return (int64_t)(intptr_t)(v.s ? v.s->c_str() : nullptr);
+    return v.i;
+}
+
+// The VM string with the text of a JIT string; the JIT hands back either
+// text it was given or its own copy of a constant.
+Value TieredVM::fromWord(int64_t word, bool isString) {
+    Value v;
+    v.i = word;
+    if (!isString || !word) return v;
+    const char* text = (const char*)(intptr_t)word;
+    auto it = stringFor.find(text);
+    if (it == stringFor.end()) {
+        const string* same = nullptr;
+        for (const string& s : bytecode.strings) {
+            if (s == text) {
+                same = &s;
+                break;
+            }
+        }
+        if (!same) {
+            extraStrings.push_back(text);
+            same = &extraStrings.back();
+        }
+        it = stringFor.emplace(text, same).first;
+    }
+    v.s = it->second;
+    return v;
+}
+
+// Runs function from its entry (label noLabel) or from a loop entry, on the
+// words already prepared, with the globals the unit uses copied in and back
+// out, also when it fails.
+uint64_t TieredVM::runCompiled(Unit& unit, uint32_t function, uint32_t label, vector<Value>& globals, size_t depth) {
+    int64_t* shared = unit.jit->globalWords();
+    for (uint32_t g : unit.globals) shared[g] = toWord(globals[g], ir.globals[g].type.kind == TypeKind::String);
+    uint64_t result = 0;
+    bool failed = false;
+    string message;
+    try {
+        if (label == noLabel) result = unit.jit->callFunction(function, words.data(), (uint32_t)depth);
+        else result = unit.jit->enterLoop(function, label, words.data(), (uint32_t)depth);
+    } catch (const runtime_error& e) {
+        failed = true;
+        message = e.what();
+    }
+    for (uint32_t g : unit.globals) globals[g] = fromWord(shared[g], ir.globals[g].type.kind == TypeKind::String);
+    if (failed) throw runtime_error(message);
+    return result;
+}
+
+Value TieredVM::call(uint32_t function, const Value* args, vector<Value>& globals, size_t depth) {
+    Unit& unit = *compiled[function].load(memory_order_acquire);
+    const IRFunction& fn = ir.functions[function];
+    calls++;
+    words.resize(fn.paramCount);
+    for (uint32_t p = 0; p < fn.paramCount; ++p) words[p] = toWord(args[p], kinds[function][p] == String);
+    return fromWord((int64_t)runCompiled(unit, function, noLabel, globals, depth), returnsString[function]);
+}
+
+bool TieredVM::enterLoop(uint32_t function, uint32_t pc, const Value* r, const vector<vector<Value>>& arrays,
+                         vector<Value>& globals, size_t depth, Value& result) {
+    Unit& unit = *compiled[function].load(memory_order_acquire);
+    uint32_t label = noLabel;
+    for (const auto& l : bytecode.functions[function].labels) {
+        if (l.first == pc && unit.jit->hasLoopEntry(function, l.second)) label = l.second;
+    }
+    if (label == noLabel) return false;
+    const vector<uint8_t>& kind = kinds[function];
+    words.resize(kind.size());
+    vector<Value> elements;
+    for (uint32_t v = 0; v < kind.size(); ++v) {
+        if (!(kind[v] & Array)) {
+            words[v] = toWord(r[v], kind[v] == String);
+            continue;
+        }
+        elements.clear();
+        if (r[v].i) elements = arrays[r[v].i - 1];
+        for (Value& e : elements) e.i = toWord(e, kind[v] == StringArray);
+        words[v] = (int64_t)(intptr_t)unit.jit->newArray(elements.data(), elements.size());
+    }
+    replaced++;
+    result = fromWord((int64_t)runCompiled(unit, function, label, globals, depth), returnsString[function]);
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <ostream>
+#include <unordered_map>
+#include "ir.hpp"
+#include "vm.hpp"
+#include "jit.hpp"
+
+using namespace std;
+
+// Tiered execution: a program starts in the bytecode VM, and a function that
+// has been entered or has looped threshold times is compiled by the JIT on a
+// background thread, together with everything it calls. Once the code is
+// ready, calls to the function run natively, and a frame still looping in
+// the interpreter moves to the compiled code at its next loop header
+// (on-stack replacement). Globals the compiled code uses are copied in and
+// out around each switch. Results and errors match the VM whenever and
+// whatever gets promoted: compiled code reuses the frame on tail calls as the
+// VM does, so a deep tail recursion runs the same either side. bytecode must
+// be compiled from ir, and both must outlive the TieredVM.
+class TieredVM : private VMTier {
+public:
+    TieredVM(const IRProgram& ir, const BytecodeProgram& bytecode, uint32_t threshold = 1000,
+             bool background = true, X86Registers registers = X86Registers::LinearScan);
+    ~TieredVM() override;
+    TieredVM(const TieredVM&) = delete;
+    TieredVM& operator=(const TieredVM&) = delete;
+
+    bool run(const string& entry = "main");
+    const string& error() const { return vm.error(); }
+    uint64_t interpreted() const { return vm.executed(); }
+    void printGlobals(ostream& os) const { vm.printGlobals(os); }
+
+    // Report: functions compiled (roots of a compilation, in order), compile
+    // time so far, calls the interpreter handed to compiled code and frames
+    // it moved there mid-loop.
+    vector<string> promoted() const;
+    double compileMs() const;
+    uint64_t compiledCalls() const { return calls; }
+    uint64_t loopEntries() const { return replaced; }
+
+private:
+    // One compilation: a hot function and its callees, and the globals their
+    // code reads or writes.
+    struct Unit {
+        unique_ptr<JIT> jit;
+        vector<uint32_t> globals;
+    };
+
+    const IRProgram& ir;
+    const BytecodeProgram& bytecode;
+    VM vm;
+    bool background;
+    X86Registers registers;
+    enum ValueKind : uint8_t { Plain, String, Array, StringArray };
+
+    vector<uint8_t> returnsString;  // function -> its result is a string
+    vector<vector<uint8_t>> kinds;  // function -> local or temp -> ValueKind
+    unique_ptr<atomic<Unit*>[]> compiled;  // function -> code to run it, once published
+    vector<uint8_t> requested;      // function -> hot() queued it (interpreter thread only)
+    uint64_t calls = 0, replaced = 0;
+    vector<int64_t> words;          // argument scratch
+    unordered_map<const char*, const string*> stringFor;  // JIT string -> VM string
+    deque<string> extraStrings;     // JIT strings with no VM equal
+
+    mutable mutex lock;             // guards the fields below
+    condition_variable wake;
+    deque<uint32_t> queue;
+    vector<unique_ptr<Unit>> units;
+    vector<string> order;
+    double compileTime = 0;
+    bool stopping = false;
+    thread worker;
+
+    void hot(uint32_t function) override;
+    bool ready(uint32_t function) override;
+    Value call(uint32_t function, const Value* args, vector<Value>& globals, size_t depth) override;
+    bool enterLoop(uint32_t function, uint32_t pc, const Value* r, const vector<vector<Value>>& arrays,
+                   vector<Value>& globals, size_t depth, Value& result) override;
+
+    void compileLoop();
+    void compile(uint32_t function);
+    uint64_t runCompiled(Unit& unit, uint32_t function, uint32_t label, vector<Value>& globals, size_t depth);
+    int64_t toWord(Value v, bool isString) const;
+    Value fromWord(int64_t word, bool isString);
+};
@@ -1,8 +1,12 @@
 #include "typechk.hpp"
+#include "workpool.hpp"
+#include <algorithm>
+#include <memory>
 using namespace std;
 
 TypeChecker::TypeChecker(const ScopeAnalyzer& scopeInfo)
     : scope(scopeInfo),
+      typeTable(&exprTypes),
       currentFunctionReturnType(Type::Unknown()),
       functionHasReturnType(false),
       functionHasReturnStatement(false),
@@ -20,6 +24,10 @@ void TypeChecker::report(TypeChkError kind, const Node* where, const string& mes
     diagnostics.push_back(TypeChkDiagnostic{kind, message, where});
 }
 
+void TypeChecker::discardDiagnosticsFrom(size_t mark) {
+    if (mark < diagnostics.size()) diagnostics.erase(diagnostics.begin() + mark, diagnostics.end());
+}
+
 bool TypeChecker::isNumeric(const Type& t) const {
     return t.kind == TypeKind::Int || t.kind == TypeKind::Float;
 }
@@ -33,11 +41,29 @@ bool TypeChecker::isBoolean(const Type& t) const {
 }
 
 void TypeChecker::analyzeProgram(const Program& program) {
+    if (exprTypes.size() < program.nodeCount) exprTypes.resize(program.nodeCount, TypeKind::Unknown);
     for (const auto& d : program.decls) {
         analyzeTopLevelDecl(d.get());
     }
 }
 
+void TypeChecker::analyzeProgramParallel(const Program& program, unsigned threads) {
+    if (exprTypes.size() < program.nodeCount) exprTypes.resize(program.nodeCount, TypeKind::Unknown);
+    size_t declCount = program.decls.size();
+    vector<unique_ptr<TypeChecker>> checkers(declCount);
+    for (size_t i = 0; i < declCount; ++i) {
+        checkers[i].reset(new TypeChecker(scope));
+        checkers[i]->typeTable = typeTable;
+    }
+    WorkStealingPool pool(threads);
+    pool.run(declCount, [&](size_t i) {
+        checkers[i]->analyzeTopLevelDecl(program.decls[i].get());
+    });
+    for (const auto& c : checkers) {
+        diagnostics.insert(diagnostics.end(), c->diagnostics.begin(), c->diagnostics.end());
+    }
+}
+
 void TypeChecker::analyzeTopLevelDecl(const Decl* decl) {
     if (auto* fn = dynamic_cast<const FunctionDecl*>(decl)) {
         analyzeFunctionDecl(fn);
@@ -52,6 +78,12 @@ void TypeChecker::analyzeTopVarDecl(const TopVarDecl* tv) {
 }
 
 void TypeChecker::analyzeFunctionDecl(const FunctionDecl* fn) {
+    beginFunction(fn);
+    analyzeBlock(fn->body.get());
+    endFunction(fn);
+}
+
+void TypeChecker::beginFunction(const FunctionDecl* fn) {
     functionHasReturnStatement = false;
     if (fn->retType) {
         currentFunctionReturnType = *fn->retType;
@@ -60,12 +92,22 @@ void TypeChecker::analyzeFunctionDecl(const FunctionDecl* fn) {
         currentFunctionReturnType = Type::Unknown();
         functionHasReturnType = false;
     }
-    analyzeBlock(fn->body.get());
+}
+
+void TypeChecker::endFunction(const FunctionDecl* fn) {
     if (functionHasReturnType && !functionHasReturnStatement) {
         report(TypeChkError::ReturnStmtNotFound, fn, "function '" + fn->name + "' is missing a return statement");
     }
 }
 
+void TypeChecker::enterLoop() {
+    loopDepth++;
+}
+
+void TypeChecker::exitLoop() {
+    loopDepth--;
+}
+
 void TypeChecker::analyzeBlock(const BlockStmt* block) {
     for (const auto& s : block->stmts) {
         analyzeStatement(s.get());
@@ -103,44 +145,42 @@ void TypeChecker::analyzeStatement(const Stmt* stmt) {
     }
 }
 
-void TypeChecker::analyzeIfStatement(const IfStmt* s) {
-    Type condType = checkExpression(s->cond.get());
+void TypeChecker::checkCondition(const Expr* cond, const char* context, Type condType) {
     if (!isBoolean(condType) && condType.kind != TypeKind::Unknown) {
-        report(TypeChkError::NonBooleanCondStmt, s->cond.get(), "if condition must be boolean");
+        report(TypeChkError::NonBooleanCondStmt, cond, string(context) + " condition must be boolean");
     }
+}
+
+void TypeChecker::analyzeIfStatement(const IfStmt* s) {
+    checkCondition(s->cond.get(), "if", checkExpression(s->cond.get()));
     analyzeStatement(s->thenS.get());
     if (s->elseS) analyzeStatement(s->elseS->get());
 }
 
 void TypeChecker::analyzeWhileStatement(const WhileStmt* s) {
-    Type condType = checkExpression(s->cond.get());
-    if (!isBoolean(condType) && condType.kind != TypeKind::Unknown) {
-        report(TypeChkError::NonBooleanCondStmt, s->cond.get(), "while condition must be boolean");
-    }
-    loopDepth++;
+    checkCondition(s->cond.get(), "while", checkExpression(s->cond.get()));
+    enterLoop();
     analyzeStatement(s->body.get());
-    loopDepth--;
+    exitLoop();
 }
 
 void TypeChecker::analyzeForStatement(const ForStmt* s) {
     if (s->init) analyzeStatement(s->init->get());
-    if (s->cond) {
-        Type condType = checkExpression(s->cond->get());
-        if (!isBoolean(condType) && condType.kind != TypeKind::Unknown) {
-            report(TypeChkError::NonBooleanCondStmt, s->cond->get(), "for condition must be boolean");
-        }
-    }
+    if (s->cond) checkCondition(s->cond->get(), "for", checkExpression(s->cond->get()));
     if (s->incr) checkExpression(s->incr->get());
-    loopDepth++;
+    enterLoop();
     analyzeStatement(s->body.get());
-    loopDepth--;
+    exitLoop();
 }
 
 void TypeChecker::analyzeReturnStatement(const ReturnStmt* s) {
+    checkReturn(s, s->expr ? checkExpression(s->expr->get()) : Type::Unknown());
+}
+
+void TypeChecker::checkReturn(const ReturnStmt* s, Type exprType) {
     functionHasReturnStatement = true;
     if (!functionHasReturnType) {
         if (s->expr) {
-            checkExpression(s->expr->get());
             report(TypeChkError::ErroneousReturnType, s, "void function should not return a value");
         }
         return;
@@ -149,7 +189,6 @@ void TypeChecker::analyzeReturnStatement(const ReturnStmt* s) {
         report(TypeChkError::ErroneousReturnType, s, "non-void function must return a value");
         return;
     }
-    Type exprType = checkExpression(s->expr->get());
     if (exprType.kind != TypeKind::Unknown &&
         exprType.kind != currentFunctionReturnType.kind) {
         report(TypeChkError::ErroneousReturnType, s, "return expression type does not match function return type");
@@ -161,20 +200,37 @@ void TypeChecker::analyzeExprStatement(const ExprStmt* s) {
 }
 
 void TypeChecker::analyzeVarDeclStatement(const VarDeclStmt* s) {
-    if (s->init) {
-        Type initType = checkExpression(s->init->get());
-        if (initType.kind != TypeKind::Unknown &&
-            initType.kind != s->type.kind) {
-            report(TypeChkError::ErroneousVarDecl, s, "initializer type does not match declared type '" + s->type.str() + "'");
-        }
+    if (s->init) checkVarDeclInit(s, checkExpression(s->init->get()));
+}
+
+void TypeChecker::checkVarDeclInit(const VarDeclStmt* s, Type initType) {
+    if (initType.kind != TypeKind::Unknown &&
+        initType.kind != s->type.kind) {
+        report(TypeChkError::ErroneousVarDecl, s, "initializer type does not match declared type '" + s->type.str() + "'");
     }
 }
 
+Type TypeChecker::recordType(const Expr* e, Type t) {
+    auto& table = *typeTable;
+    if (e->nodeId >= table.size()) table.resize(max<size_t>(e->nodeId + 1, table.size() * 2), TypeKind::Unknown);
+    table[e->nodeId] = t.kind;
+    return t;
+}
+
+Type TypeChecker::getExpressionType(const Expr* e) const {
+    if (!e || e->nodeId >= exprTypes.size()) return Type::Unknown();
+    return Type{exprTypes[e->nodeId]};
+}
+
 Type TypeChecker::checkExpression(const Expr* expr) {
     if (!expr) {
         report(TypeChkError::EmptyExpression, nullptr, "empty expression");
         return Type::Unknown();
     }
+    return recordType(expr, inferExpression(expr));
+}
+
+Type TypeChecker::inferExpression(const Expr* expr) {
     if (dynamic_cast<const IntLit*>(expr)) return Type::Int();
     if (dynamic_cast<const FloatLit*>(expr)) return Type::Float();
     if (dynamic_cast<const StringLit*>(expr)) return Type::String();
@@ -189,7 +245,10 @@ Type TypeChecker::checkExpression(const Expr* expr) {
 }
 
 Type TypeChecker::checkIdentifier(const Ident* id) {
-    const Symbol* sym = scope.getResolvedSymbolForIdent(id);
+    return symbolType(scope.getResolvedSymbolForIdent(id));
+}
+
+Type TypeChecker::symbolType(const Symbol* sym) const {
     if (!sym) return Type::Unknown();
     if (sym->variableType) return *sym->variableType;
     if (sym->functionSig && sym->functionSig->returnType) return *sym->functionSig->returnType;
@@ -197,7 +256,10 @@ Type TypeChecker::checkIdentifier(const Ident* id) {
 }
 
 Type TypeChecker::checkUnaryExpression(const UnaryExpr* e) {
-    Type rhsType = checkExpression(e->rhs.get());
+    return inferUnary(e, checkExpression(e->rhs.get()));
+}
+
+Type TypeChecker::inferUnary(const UnaryExpr* e, Type rhsType) {
     if (rhsType.kind == TypeKind::Unknown) return rhsType;
     switch (e->op) {
         case UnaryOp::Not:
@@ -223,6 +285,10 @@ Type TypeChecker::checkUnaryExpression(const UnaryExpr* e) {
 Type TypeChecker::checkBinaryExpression(const BinaryExpr* e) {
     Type leftType = checkExpression(e->lhs.get());
     Type rightType = checkExpression(e->rhs.get());
+    return inferBinary(e, leftType, rightType);
+}
+
+Type TypeChecker::inferBinary(const BinaryExpr* e, Type leftType, Type rightType) {
     if (leftType.kind == TypeKind::Unknown || rightType.kind == TypeKind::Unknown) {
         return Type::Unknown();
     }
@@ -306,9 +372,39 @@ Type TypeChecker::checkCallExpression(const CallExpr* e) {
     return Type::Unknown();
 }
 
+// Arguments were already checked in source order; their diagnostics sit at the
+// tail of the list. Rebuild that tail into the order checkCallExpression produces.
+Type TypeChecker::inferCall(const CallExpr* e, const vector<Type>& argTypes, const vector<size_t>& argDiagEnds, size_t argDiagStart) {
+    const Symbol* fnSym = scope.getResolvedSymbolForCall(e);
+    if (!fnSym || !fnSym->functionSig) return Type::Unknown();
+    const FunctionSignature& sig = *fnSym->functionSig;
+    vector<TypeChkDiagnostic> argDiags(diagnostics.begin() + argDiagStart, diagnostics.end());
+    discardDiagnosticsFrom(argDiagStart);
+    if (argTypes.size() != sig.paramTypes.size()) {
+        report(TypeChkError::FnCallParamCount, e, "function call has incorrect number of arguments");
+    }
+    size_t n = argTypes.size();
+    if (sig.paramTypes.size() < n) n = sig.paramTypes.size();
+    size_t from = argDiagStart;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t d = from; d < argDiagEnds[i]; ++d) diagnostics.push_back(argDiags[d - argDiagStart]);
+        from = argDiagEnds[i];
+        if (argTypes[i].kind != TypeKind::Unknown &&
+            argTypes[i].kind != sig.paramTypes[i].kind) {
+            report(TypeChkError::FnCallParamType, e->args[i].get(), "argument type does not match parameter type");
+        }
+    }
+    if (sig.returnType) return *sig.returnType;
+    return Type::Unknown();
+}
+
 Type TypeChecker::checkIndexExpression(const IndexExpr* e) {
     Type baseType = checkExpression(e->base.get());
     Type indexType = checkExpression(e->index.get());
+    return inferIndex(e, baseType, indexType);
+}
+
+Type TypeChecker::inferIndex(const IndexExpr* e, Type baseType, Type indexType) {
     if (!isInteger(indexType) && indexType.kind != TypeKind::Unknown) {
         report(TypeChkError::ExpressionTypeMismatch, e->index.get(), "index expression must be integer");
     }
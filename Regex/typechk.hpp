@@ -32,13 +32,40 @@ struct TypeChkDiagnostic {
 class TypeChecker {
 public:
     TypeChecker(const ScopeAnalyzer& scopeInfo);
+    TypeChecker(const TypeChecker&) = delete;
+    TypeChecker& operator=(const TypeChecker&) = delete;
     void analyzeProgram(const Program& program);
+    // Checks each top-level declaration, variable or function, on a
+    // work-stealing pool, each with its own checker; diagnostics are merged in
+    // declaration order.
+    void analyzeProgramParallel(const Program& program, unsigned threads);
     bool hasErrors() const;
     const vector<TypeChkDiagnostic>& getDiagnostics() const;
+    Type getExpressionType(const Expr* e) const;
+
+    // Bottom-up entry points; Parser drives these in fused mode with the
+    // types of child expressions already inferred.
+    void beginFunction(const FunctionDecl* fn);
+    void endFunction(const FunctionDecl* fn);
+    void enterLoop();
+    void exitLoop();
+    void checkCondition(const Expr* cond, const char* context, Type condType);
+    void checkVarDeclInit(const VarDeclStmt* s, Type initType);
+    void checkReturn(const ReturnStmt* s, Type exprType);
+    Type symbolType(const Symbol* sym) const;
+    Type recordType(const Expr* e, Type t);
+    Type inferUnary(const UnaryExpr* e, Type rhsType);
+    Type inferBinary(const BinaryExpr* e, Type leftType, Type rightType);
+    Type inferIndex(const IndexExpr* e, Type baseType, Type indexType);
+    Type inferCall(const CallExpr* e, const vector<Type>& argTypes, const vector<size_t>& argDiagEnds, size_t argDiagStart);
+    size_t diagnosticMark() const { return diagnostics.size(); }
+    void discardDiagnosticsFrom(size_t mark);
 
 private:
     const ScopeAnalyzer& scope;
     vector<TypeChkDiagnostic> diagnostics;
+    vector<TypeKind> exprTypes;  // indexed by Node::nodeId
+    vector<TypeKind>* typeTable;  // exprTypes, or the parent's for a per-declaration checker
     Type currentFunctionReturnType;
     bool functionHasReturnType;
     bool functionHasReturnStatement;
@@ -60,6 +87,7 @@ private:
     void analyzeVarDeclStatement(const VarDeclStmt* s);
 
     Type checkExpression(const Expr* expr);
+    Type inferExpression(const Expr* expr);
     Type checkUnaryExpression(const UnaryExpr* e);
     Type checkBinaryExpression(const BinaryExpr* e);
     Type checkCallExpression(const CallExpr* e);
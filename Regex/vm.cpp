@@ -0,0 +1,775 @@
+#include "vm.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+static Value constantValue(const IRProgram& ir, BytecodeProgram& program, uint32_t index) {
+    const IRConst& c = ir.constants[index];
+    Value v;
+    v.i = 0;
+    if (c.type.kind == TypeKind::Float) {
+        v.f = c.floatValue;
+    } else if (c.type.kind == TypeKind::String) {
+        program.strings.push_back(c.text);
+        v.s = &program.strings.back();
+    } else {
+        v.i = c.intValue;
+    }
+    return v;
+}
+
+namespace {
+
+// Lowers one IRFunction. Locals keep their slot as register number, temps
+// follow, then one register per distinct constant, then the two scratch
+// registers that stage global operands.
+class FunctionLowering {
+public:
+    FunctionLowering(const IRProgram& ir, BytecodeProgram& program, const IRFunction& fn)
+        : ir(ir), program(program), fn(fn) {}
+
+    VMFunction lower() {
+        if (fn.inSSA) throw runtime_error("cannot compile " + fn.name + " while it is in SSA form");
+        out.name = fn.name;
+        out.paramCount = fn.paramCount;
+        out.constantBase = (uint32_t)fn.vars.size() + fn.tempCount;
+        vector<uint8_t> isArray(fn.vars.size(), 0);
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::IndexLoad) isArray[ins.a.index()] = 1;
+            if (ins.op == IROp::IndexStore) isArray[ins.dst.index()] = 1;
+            for (Operand o : {ins.a, ins.b}) {
+                if (o.kind() == OperandKind::Const && !constantRegister.count(o.index())) {
+                    constantRegister[o.index()] = out.constantBase + (uint32_t)out.constants.size();
+                    out.constants.push_back(constantValue(ir, program, o.index()));
+                }
+            }
+        }
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+            if (isArray[v]) out.arrays.push_back(v);
+        }
+        scratch[0] = out.constantBase + (uint32_t)out.constants.size();
+        scratch[1] = scratch[0] + 1;
+        out.registerCount = scratch[1] + 1;
+
+        for (size_t i = 0; i < fn.instructions.size(); ++i) {
+            const IRInstr& ins = fn.instructions[i];
+            if (isTailCall(fn, i)) {
+                emit(OpCode::TailCall, ins.dst.isNone() ? noRegister : use(ins.dst, 0), ins.a.index(), ins.b.index());
+                ++i;
+                continue;
+            }
+            lowerInstr(ins);
+        }
+        emit(OpCode::RetVoid);
+        for (auto& jump : jumps) {
+            uint32_t& target = out.code[jump.first].op == OpCode::Jump ? out.code[jump.first].a : out.code[jump.first].b;
+            target = labelPc.at(jump.second);
+        }
+        return move(out);
+    }
+
+private:
+    const IRProgram& ir;
+    BytecodeProgram& program;
+    const IRFunction& fn;
+    VMFunction out;
+    uint32_t scratch[2] = {0, 0};
+    unordered_map<uint32_t, uint32_t> constantRegister;  // constant index -> register
+    unordered_map<uint32_t, uint32_t> labelPc;
+    vector<pair<uint32_t, uint32_t>> jumps;  // instruction -> label id
+
+    void emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        VMInstr ins;
+        ins.op = op;
+        ins.a = a;
+        ins.b = b;
+        ins.c = c;
+        out.code.push_back(ins);
+    }
+
+    void emitJump(OpCode op, uint32_t cond, Operand label) {
+        jumps.push_back({(uint32_t)out.code.size(), label.index()});
+        if (op == OpCode::Jump) emit(op);
+        else emit(op, cond);
+    }
+
+    // Register holding the value of o, loading a global into scratch[which].
+    uint32_t use(Operand o, int which) {
+        switch (o.kind()) {
+            case OperandKind::Local: return o.index();
+            case OperandKind::Temp: return (uint32_t)fn.vars.size() + o.index();
+            case OperandKind::Const: return constantRegister.at(o.index());
+            case OperandKind::Global:
+                emit(OpCode::LoadGlobal, scratch[which], o.index());
+                return scratch[which];
+            default:
+                throw runtime_error("operand cannot be read in " + fn.name);
+        }
+    }
+
+    // Register an instruction writes for dst; a global goes through scratch[0]
+    // and is stored by finish.
+    uint32_t target(Operand dst) {
+        if (dst.kind() == OperandKind::Global) return scratch[0];
+        return use(dst, 0);
+    }
+
+    void finish(Operand dst) {
+        if (dst.kind() == OperandKind::Global) emit(OpCode::StoreGlobal, dst.index(), scratch[0]);
+    }
+
+    OpCode select(IROp op, TypeKind kind) {
+        bool f = kind == TypeKind::Float;
+        switch (op) {
+            case IROp::Neg: return f ? OpCode::NegF : OpCode::NegI;
+            case IROp::Pos: return OpCode::Move;
+            case IROp::Not: return OpCode::Not;
+            case IROp::BitNot: return OpCode::BitNot;
+            case IROp::IntToFloat: return OpCode::IntToFloat;
+            case IROp::Add: return f ? OpCode::AddF : OpCode::AddI;
+            case IROp::Sub: return f ? OpCode::SubF : OpCode::SubI;
+            case IROp::Mul: return f ? OpCode::MulF : OpCode::MulI;
+            case IROp::Div: return f ? OpCode::DivF : OpCode::DivI;
+            case IROp::Mod: return f ? OpCode::ModF : OpCode::ModI;
+            case IROp::Shl: return OpCode::Shl;
+            case IROp::Shr: return OpCode::Shr;
+            case IROp::BitAnd: case IROp::And: return OpCode::BitAnd;  // bools are 0 or 1
+            case IROp::BitOr: case IROp::Or: return OpCode::BitOr;
+            case IROp::BitXor: return OpCode::BitXor;
+            case IROp::Eq: return kind == TypeKind::String ? OpCode::EqS : f ? OpCode::EqF : OpCode::EqI;
+            case IROp::Neq: return kind == TypeKind::String ? OpCode::NeS : f ? OpCode::NeF : OpCode::NeI;
+            case IROp::Lt: return f ? OpCode::LtF : OpCode::LtI;
+            case IROp::Le: return f ? OpCode::LeF : OpCode::LeI;
+            case IROp::Gt: return f ? OpCode::GtF : OpCode::GtI;
+            case IROp::Ge: return f ? OpCode::GeF : OpCode::GeI;
+            default: throw runtime_error(string("no opcode for ") + irOpName(op));
+        }
+    }
+
+    void lowerInstr(const IRInstr& ins) {
+        switch (ins.op) {
+            case IROp::Label:
+                labelPc[ins.a.index()] = (uint32_t)out.code.size();
+                out.labels.push_back({(uint32_t)out.code.size(), ins.a.index()});
+                return;
+            case IROp::Goto:
+                emitJump(OpCode::Jump, 0, ins.a);
+                return;
+            case IROp::IfGoto:
+                emitJump(OpCode::JumpIf, use(ins.a, 0), ins.b);
+                return;
+            case IROp::Copy:
+                if (ins.dst.kind() == OperandKind::Global) emit(OpCode::StoreGlobal, ins.dst.index(), use(ins.a, 0));
+                else if (ins.a.kind() == OperandKind::Global) emit(OpCode::LoadGlobal, use(ins.dst, 0), ins.a.index());
+                else emit(OpCode::Move, use(ins.dst, 0), use(ins.a, 0));
+                return;
+            case IROp::Param:
+                emit(OpCode::Arg, use(ins.a, 0));
+                return;
+            case IROp::Call:
+                emit(OpCode::Call, ins.dst.isNone() ? noRegister : target(ins.dst), ins.a.index(), ins.b.index());
+                finish(ins.dst);
+                return;
+            case IROp::Return:
+                emit(OpCode::Ret, use(ins.a, 0));
+                return;
+            case IROp::ReturnVoid:
+                emit(OpCode::RetVoid);
+                return;
+            case IROp::IndexLoad: {
+                uint32_t index = use(ins.b, 1);
+                emit(OpCode::LoadIndex, target(ins.dst), use(ins.a, 0), index);
+                finish(ins.dst);
+                return;
+            }
+            case IROp::IndexStore: {
+                uint32_t index = use(ins.a, 0), value = use(ins.b, 1);
+                emit(OpCode::StoreIndex, use(ins.dst, 0), index, value);
+                return;
+            }
+            case IROp::Phi:
+                throw runtime_error("phi outside SSA form in " + fn.name);
+            default: {
+                OpCode op = select(ins.op, ins.opType.kind);
+                uint32_t a = use(ins.a, 0);
+                uint32_t b = isBinaryOp(ins.op) ? use(ins.b, 1) : 0;
+                emit(op, target(ins.dst), a, b);
+                finish(ins.dst);
+                return;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+BytecodeProgram compileBytecode(const IRProgram& ir) {
+    BytecodeProgram program;
+    program.globalInfo = ir.globals;
+    for (const auto& g : ir.globals) {
+        Value v;
+        v.i = 0;
+        if (!g.init.isNone()) v = constantValue(ir, program, g.init.index());
+        program.globals.push_back(v);
+    }
+    for (const auto& fn : ir.functions) program.functions.push_back(FunctionLowering(ir, program, fn).lower());
+    return program;
+}
+
+const char* opCodeName(OpCode op) {
+    switch (op) {
+        case OpCode::Move: return "move";
+        case OpCode::LoadGlobal: return "ldg";
+        case OpCode::StoreGlobal: return "stg";
+        case OpCode::NegI: return "negi";
+        case OpCode::NegF: return "negf";
+        case OpCode::Not: return "not";
+        case OpCode::BitNot: return "bnot";
+        case OpCode::IntToFloat: return "i2f";
+        case OpCode::AddI: return "addi";
+        case OpCode::SubI: return "subi";
+        case OpCode::MulI: return "muli";
+        case OpCode::DivI: return "divi";
+        case OpCode::ModI: return "modi";
+        case OpCode::Shl: return "shl";
+        case OpCode::Shr: return "shr";
+        case OpCode::BitAnd: return "band";
+        case OpCode::BitOr: return "bor";
+        case OpCode::BitXor: return "bxor";
+        case OpCode::AddF: return "addf";
+        case OpCode::SubF: return "subf";
+        case OpCode::MulF: return "mulf";
+        case OpCode::DivF: return "divf";
+        case OpCode::ModF: return "modf";
+        case OpCode::EqI: return "eqi";
+        case OpCode::NeI: return "nei";
+        case OpCode::LtI: return "lti";
+        case OpCode::LeI: return "lei";
+        case OpCode::GtI: return "gti";
+        case OpCode::GeI: return "gei";
+        case OpCode::EqF: return "eqf";
+        case OpCode::NeF: return "nef";
+        case OpCode::LtF: return "ltf";
+        case OpCode::LeF: return "lef";
+        case OpCode::GtF: return "gtf";
+        case OpCode::GeF: return "gef";
+        case OpCode::EqS: return "eqs";
+        case OpCode::NeS: return "nes";
+        case OpCode::Jump: return "jmp";
+        case OpCode::JumpIf: return "jif";
+        case OpCode::Arg: return "arg";
+        case OpCode::Call: return "call";
+        case OpCode::Ret: return "ret";
+        case OpCode::RetVoid: return "retv";
+        case OpCode::TailCall: return "tcall";
+        case OpCode::LoadIndex: return "ldx";
+        case OpCode::StoreIndex: return "stx";
+        case OpCode::JumpIfEqI: return "jeqi";
+        case OpCode::JumpIfNeI: return "jnei";
+        case OpCode::JumpIfLtI: return "jlti";
+        case OpCode::JumpIfLeI: return "jlei";
+        case OpCode::JumpIfGtI: return "jgti";
+        case OpCode::JumpIfGeI: return "jgei";
+        case OpCode::AddImm: return "addimm";
+        case OpCode::LoadIndexAdd: return "ldxadd";
+        case OpCode::Arg2: return "arg2";
+    }
+    return "?";
+}
+
+void printBytecode(const BytecodeProgram& program, ostream& os) {
+    for (const auto& fn : program.functions) {
+        os << fn.name << ": params " << fn.paramCount << ", registers " << fn.registerCount
+           << ", constants at r" << fn.constantBase << "\n";
+        for (uint32_t pc = 0; pc < fn.code.size(); ++pc) {
+            const VMInstr& ins = fn.code[pc];
+            os << "  " << pc << "\t" << opCodeName(ins.op);
+            switch (ins.op) {
+                case OpCode::Jump: os << " " << ins.a; break;
+                case OpCode::JumpIf: os << " r" << ins.a << ", " << ins.b; break;
+                case OpCode::Arg: case OpCode::Ret: os << " r" << ins.a; break;
+                case OpCode::Arg2: os << " r" << ins.a << ", r" << ins.b; break;
+                case OpCode::AddImm: os << " r" << ins.a << ", r" << ins.b << ", " << (int32_t)ins.c; break;
+                case OpCode::JumpIfEqI: case OpCode::JumpIfNeI: case OpCode::JumpIfLtI:
+                case OpCode::JumpIfLeI: case OpCode::JumpIfGtI: case OpCode::JumpIfGeI:
+                    os << " r" << ins.a << ", r" << ins.b << ", " << ins.c;
+                    break;
+                case OpCode::RetVoid: break;
+                case OpCode::LoadGlobal: os << " r" << ins.a << ", " << program.globalInfo[ins.b].name; break;
+                case OpCode::StoreGlobal: os << " " << program.globalInfo[ins.a].name << ", r" << ins.b; break;
+                case OpCode::Call: case OpCode::TailCall:
+                    os << " ";
+                    if (ins.a != noRegister) os << "r" << ins.a << ", ";
+                    os << program.functions[ins.b].name << ", " << ins.c;
+                    break;
+                case OpCode::Move: case OpCode::NegI: case OpCode::NegF: case OpCode::Not:
+                case OpCode::BitNot: case OpCode::IntToFloat:
+                    os << " r" << ins.a << ", r" << ins.b;
+                    break;
+                default: os << " r" << ins.a << ", r" << ins.b << ", r" << ins.c; break;
+            }
+            os << "\n";
+        }
+    }
+}
+
+const char* dispatchName(Dispatch dispatch) {
+    switch (dispatch) {
+        case Dispatch::Switch: return "switch";
+        case Dispatch::Threaded: return "threaded";
+        case Dispatch::Handlers: return "handlers";
+    }
+    return "?";
+}
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+// Every opcode in enum order; RET marks those that can end the run: the
+// returns, and the branches, after which a tier may have finished the frame.
+#define VM_OPCODES(X, RET) \
+    X(Move) X(LoadGlobal) X(StoreGlobal) \
+    X(NegI) X(NegF) X(Not) X(BitNot) X(IntToFloat) \
+    X(AddI) X(SubI) X(MulI) X(DivI) X(ModI) X(Shl) X(Shr) X(BitAnd) X(BitOr) X(BitXor) \
+    X(AddF) X(SubF) X(MulF) X(DivF) X(ModF) \
+    X(EqI) X(NeI) X(LtI) X(LeI) X(GtI) X(GeI) \
+    X(EqF) X(NeF) X(LtF) X(LeF) X(GtF) X(GeF) \
+    X(EqS) X(NeS) \
+    RET(Jump) RET(JumpIf) X(Arg) X(Call) RET(Ret) RET(RetVoid) RET(TailCall) X(LoadIndex) X(StoreIndex) \
+    RET(JumpIfEqI) RET(JumpIfNeI) RET(JumpIfLtI) RET(JumpIfLeI) RET(JumpIfGtI) RET(JumpIfGeI) \
+    X(AddImm) X(LoadIndexAdd) X(Arg2)
+
+// State of the running frame, shared by the dispatch loops.
+struct VMCursor {
+    VM& vm;
+    const VMFunction* fn;
+    Value* r;
+    const VMInstr* code;          // Switch
+    const DecodedInstr* decoded;  // Threaded and Handlers
+};
+
+static void checkIndex(int64_t index, const VMFunction& fn) {
+    if (index < 0) throw runtime_error("negative array index " + to_string(index) + " in " + fn.name);
+    if (index >= maxArrayLength) throw runtime_error("array index " + to_string(index) + " out of range in " + fn.name);
+}
+
+static const string& text(const string* s) {
+    static const string empty;
+    return s ? *s : empty;
+}
+
+// The instruction semantics, written once and instantiated per opcode for
+// each dispatch mode. step returns the next instruction, or null once the
+// entry function returns.
+struct VMOps {
+    template<class Instr>
+    static const Instr* code(const VMCursor& s) {
+        if constexpr (is_same<Instr, VMInstr>::value) return s.code;
+        else return s.decoded;
+    }
+
+    template<class Instr>
+    static void switchTo(VMCursor& s, uint32_t function) {
+        s.fn = &s.vm.program.functions[function];
+        if constexpr (is_same<Instr, VMInstr>::value) s.code = s.fn->code.data();
+        else s.decoded = s.vm.decoded[function].data();
+    }
+
+    template<class Instr>
+    static const Instr* start(VMCursor& s, uint32_t entry) {
+        VM& vm = s.vm;
+        vm.frames.push_back({entry, 0, noRegister, vm.enter(vm.program.functions[entry], 0, 0)});
+        s.r = vm.stack.data();
+        switchTo<Instr>(s, entry);
+        return code<Instr>(s);
+    }
+
+    // A taken branch. A backward one closes a loop and heats the function;
+    // when the tier takes the frame over, this returns as the frame would.
+    template<class Instr>
+    static const Instr* branch(VMCursor& s, const Instr* pc, uint32_t target) {
+        const Instr* next = code<Instr>(s) + target;
+        if (next > pc) return next;
+        uint32_t function = (uint32_t)(s.fn - s.vm.program.functions.data());
+        Value result;
+        if (--s.vm.heat[function] <= 0 && s.vm.loopTier(function, target, s.r, result)) return ret<Instr>(s, result);
+        return next;
+    }
+
+    template<class Instr>
+    static const Instr* call(VMCursor& s, const Instr* pc) {
+        VM& vm = s.vm;
+        if (vm.frames.size() >= maxCallDepth) throw runtime_error(string(callStackOverflow) + " in " + s.fn->name);
+        if (--vm.heat[pc->b] <= 0 && vm.callTier(pc->b, pc->a, pc->c, s.r)) return pc + 1;
+        size_t base = vm.frames.back().base + s.fn->registerCount;
+        uint32_t returnPc = (uint32_t)(pc + 1 - code<Instr>(s));
+        switchTo<Instr>(s, pc->b);
+        vm.frames.push_back({pc->b, returnPc, pc->a, vm.enter(*s.fn, base, pc->c)});
+        s.r = vm.stack.data() + base;
+        return code<Instr>(s);
+    }
+
+    // A call whose result the caller returns: the callee takes over the
+    // caller's frame and registers, and returns to the caller's caller, so
+    // the frame count does not grow.
+    template<class Instr>
+    static const Instr* tailCall(VMCursor& s, const Instr* pc) {
+        VM& vm = s.vm;
+        if (--vm.heat[pc->b] <= 0 && vm.callTier(pc->b, pc->a, pc->c, s.r)) return ret<Instr>(s, s.r[pc->a == noRegister ? 0 : pc->a]);
+        VM::Frame& frame = vm.frames.back();
+        vm.leave(*s.fn, frame.base);
+        switchTo<Instr>(s, pc->b);
+        frame.function = pc->b;
+        vm.enter(*s.fn, frame.base, pc->c);
+        s.r = vm.stack.data() + frame.base;
+        return code<Instr>(s);
+    }
+
+    template<class Instr>
+    static const Instr* ret(VMCursor& s, Value result) {
+        VM& vm = s.vm;
+        VM::Frame done = vm.frames.back();
+        vm.frames.pop_back();
+        vm.leave(*s.fn, done.base);
+        if (vm.frames.empty()) return nullptr;
+        const VM::Frame& caller = vm.frames.back();
+        switchTo<Instr>(s, caller.function);
+        s.r = vm.stack.data() + caller.base;
+        if (done.dst != noRegister) s.r[done.dst] = result;
+        return code<Instr>(s) + done.returnPc;
+    }
+
+    template<OpCode OP, class Instr>
+    static const Instr* step(VMCursor& s, const Instr* pc) {
+        const Instr& ins = *pc;
+        Value* r = s.r;
+        if constexpr (OP == OpCode::Move) r[ins.a] = r[ins.b];
+        else if constexpr (OP == OpCode::LoadGlobal) r[ins.a] = s.vm.globals[ins.b];
+        else if constexpr (OP == OpCode::StoreGlobal) s.vm.globals[ins.a] = r[ins.b];
+        else if constexpr (OP == OpCode::NegI) r[ins.a].i = (int64_t)(0 - (uint64_t)r[ins.b].i);
+        else if constexpr (OP == OpCode::NegF) r[ins.a].f = -r[ins.b].f;
+        else if constexpr (OP == OpCode::Not) r[ins.a].i = !r[ins.b].i;
+        else if constexpr (OP == OpCode::BitNot) r[ins.a].i = ~r[ins.b].i;
+        else if constexpr (OP == OpCode::IntToFloat) r[ins.a].f = (double)r[ins.b].i;
+        else if constexpr (OP == OpCode::AddI) r[ins.a].i = (int64_t)((uint64_t)r[ins.b].i + (uint64_t)r[ins.c].i);
+        else if constexpr (OP == OpCode::SubI) r[ins.a].i = (int64_t)((uint64_t)r[ins.b].i - (uint64_t)r[ins.c].i);
+        else if constexpr (OP == OpCode::MulI) r[ins.a].i = (int64_t)((uint64_t)r[ins.b].i * (uint64_t)r[ins.c].i);
+        else if constexpr (OP == OpCode::DivI || OP == OpCode::ModI) {
+            int64_t x = r[ins.b].i, y = r[ins.c].i;
+            if (y == 0) throw runtime_error("division by zero in " + s.fn->name);
+            if (y == -1) r[ins.a].i = OP == OpCode::DivI ? (int64_t)(0 - (uint64_t)x) : 0;
+            else r[ins.a].i = OP == OpCode::DivI ? x / y : x % y;
+        }
+        else if constexpr (OP == OpCode::Shl) r[ins.a].i = (int64_t)((uint64_t)r[ins.b].i << (r[ins.c].i & 63));
+        else if constexpr (OP == OpCode::Shr) r[ins.a].i = r[ins.b].i >> (r[ins.c].i & 63);
+        else if constexpr (OP == OpCode::BitAnd) r[ins.a].i = r[ins.b].i & r[ins.c].i;
+        else if constexpr (OP == OpCode::BitOr) r[ins.a].i = r[ins.b].i | r[ins.c].i;
+        else if constexpr (OP == OpCode::BitXor) r[ins.a].i = r[ins.b].i ^ r[ins.c].i;
+        else if constexpr (OP == OpCode::AddF) r[ins.a].f = r[ins.b].f + r[ins.c].f;
+        else if constexpr (OP == OpCode::SubF) r[ins.a].f = r[ins.b].f - r[ins.c].f;
+        else if constexpr (OP == OpCode::MulF) r[ins.a].f = r[ins.b].f * r[ins.c].f;
+        else if constexpr (OP == OpCode::DivF) r[ins.a].f = r[ins.b].f / r[ins.c].f;
+        else if constexpr (OP == OpCode::ModF) r[ins.a].f = fmod(r[ins.b].f, r[ins.c].f);
+        else if constexpr (OP == OpCode::EqI) r[ins.a].i = r[ins.b].i == r[ins.c].i;
+        else if constexpr (OP == OpCode::NeI) r[ins.a].i = r[ins.b].i != r[ins.c].i;
+        else if constexpr (OP == OpCode::LtI) r[ins.a].i = r[ins.b].i < r[ins.c].i;
+        else if constexpr (OP == OpCode::LeI) r[ins.a].i = r[ins.b].i <= r[ins.c].i;
+        else if constexpr (OP == OpCode::GtI) r[ins.a].i = r[ins.b].i > r[ins.c].i;
+        else if constexpr (OP == OpCode::GeI) r[ins.a].i = r[ins.b].i >= r[ins.c].i;
+        else if constexpr (OP == OpCode::EqF) r[ins.a].i = r[ins.b].f == r[ins.c].f;
+        else if constexpr (OP == OpCode::NeF) r[ins.a].i = r[ins.b].f != r[ins.c].f;
+        else if constexpr (OP == OpCode::LtF) r[ins.a].i = r[ins.b].f < r[ins.c].f;
+        else if constexpr (OP == OpCode::LeF) r[ins.a].i = r[ins.b].f <= r[ins.c].f;
+        else if constexpr (OP == OpCode::GtF) r[ins.a].i = r[ins.b].f > r[ins.c].f;
+        else if constexpr (OP == OpCode::GeF) r[ins.a].i = r[ins.b].f >= r[ins.c].f;
+        else if constexpr (OP == OpCode::EqS) r[ins.a].i = text(r[ins.b].s) == text(r[ins.c].s);
+        else if constexpr (OP == OpCode::NeS) r[ins.a].i = text(r[ins.b].s) != text(r[ins.c].s);
+        else if constexpr (OP == OpCode::Jump) return branch(s, pc, ins.a);
+        else if constexpr (OP == OpCode::JumpIf) return r[ins.a].i ? branch(s, pc, ins.b) : pc + 1;
+        else if constexpr (OP == OpCode::Arg) s.vm.args.push_back(r[ins.a]);
+        else if constexpr (OP == OpCode::Call) return call(s, pc);
+        else if constexpr (OP == OpCode::Ret || OP == OpCode::RetVoid) return ret<Instr>(s, r[ins.a]);
+        else if constexpr (OP == OpCode::TailCall) return tailCall(s, pc);
+        else if constexpr (OP == OpCode::LoadIndex) {
+            int64_t index = r[ins.c].i;
+            checkIndex(index, *s.fn);
+            const vector<Value>& elements = s.vm.array(r[ins.b]);
+            Value v;
+            v.i = 0;
+            if ((size_t)index < elements.size()) v = elements[index];
+            r[ins.a] = v;
+        }
+        else if constexpr (OP == OpCode::StoreIndex) {
+            int64_t index = r[ins.b].i;
+            checkIndex(index, *s.fn);
+            vector<Value>& elements = s.vm.array(r[ins.a]);
+            if ((size_t)index >= elements.size()) elements.resize((size_t)index + 1, Value{0});
+            elements[index] = r[ins.c];
+        }
+        else if constexpr (OP == OpCode::JumpIfEqI) return r[ins.a].i == r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::JumpIfNeI) return r[ins.a].i != r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::JumpIfLtI) return r[ins.a].i < r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::JumpIfLeI) return r[ins.a].i <= r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::JumpIfGtI) return r[ins.a].i > r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::JumpIfGeI) return r[ins.a].i >= r[ins.b].i ? branch(s, pc, ins.c) : pc + 1;
+        else if constexpr (OP == OpCode::AddImm) r[ins.a].i = (int64_t)((uint64_t)r[ins.b].i + (uint64_t)(int64_t)(int32_t)ins.c);
+        else if constexpr (OP == OpCode::LoadIndexAdd) {
+            int64_t index = r[ins.c].i;
+            checkIndex(index, *s.fn);
+            const vector<Value>& elements = s.vm.array(r[ins.b]);
+            if ((size_t)index < elements.size()) r[ins.a].i = (int64_t)((uint64_t)r[ins.a].i + (uint64_t)elements[index].i);
+        }
+        else if constexpr (OP == OpCode::Arg2) {
+            s.vm.args.push_back(r[ins.a]);
+            s.vm.args.push_back(r[ins.b]);
+        }
+        return pc + 1;
+    }
+
+    template<OpCode OP>
+    static const DecodedInstr* handle(VMCursor& s, const DecodedInstr* pc) {
+        return step<OP>(s, pc);
+    }
+
+    static vector<vector<DecodedInstr>> decode(const BytecodeProgram& program, const void* const* labels, const VMHandler* handlers) {
+        vector<vector<DecodedInstr>> out;
+        for (const auto& fn : program.functions) {
+            vector<DecodedInstr> code(fn.code.size());
+            for (size_t pc = 0; pc < fn.code.size(); ++pc) {
+                const VMInstr& ins = fn.code[pc];
+                if (labels) code[pc].label = labels[(size_t)ins.op];
+                else code[pc].handler = handlers[(size_t)ins.op];
+                code[pc].a = ins.a;
+                code[pc].b = ins.b;
+                code[pc].c = ins.c;
+            }
+            out.push_back(move(code));
+        }
+        return out;
+    }
+};
+
+VM::VM(const BytecodeProgram& program, Dispatch dispatch) : program(program), dispatch(dispatch) {}
+
+bool VM::hasComputedGoto() {
+#ifdef VM_COMPUTED_GOTO
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool VM::run(const string& entry) {
+    errorMessage.clear();
+    for (uint32_t f = 0; f < program.functions.size(); ++f) {
+        if (program.functions[f].name != entry) continue;
+        globals = program.globals;
+        stack.clear();
+        frames.clear();
+        args.clear();
+        arrays.clear();
+        freeArrays.clear();
+        heat.assign(program.functions.size(), tier ? (int64_t)max(tierThreshold, 1u) : INT64_MAX);
+        try {
+            if (profiling) {
+                pcCounts.clear();
+                for (const auto& fn : program.functions) pcCounts.emplace_back(fn.code.size(), 0);
+                executeSwitch<true>(f);
+            } else if (dispatch == Dispatch::Threaded) executeThreaded(f);
+            else if (dispatch == Dispatch::Handlers) executeHandlers(f);
+            else executeSwitch<false>(f);
+            return true;
+        } catch (const runtime_error& e) {
+            errorMessage = e.what();
+            return false;
+        }
+    }
+    errorMessage = "no function named " + entry;
+    return false;
+}
+
+size_t VM::enter(const VMFunction& fn, size_t base, uint32_t argc) {
+    if (stack.size() < base + fn.registerCount) stack.resize(base + fn.registerCount);
+    Value* r = stack.data() + base;
+    for (uint32_t i = 0; i < fn.constantBase; ++i) r[i].i = 0;
+    for (uint32_t i = 0; i < fn.constants.size(); ++i) r[fn.constantBase + i] = fn.constants[i];
+    size_t first = args.size() - argc;
+    for (uint32_t i = 0; i < argc && i < fn.paramCount; ++i) r[i] = args[first + i];
+    args.resize(first);
+    return base;
+}
+
+void VM::leave(const VMFunction& fn, size_t base) {
+    for (uint32_t reg : fn.arrays) {
+        int64_t handle = stack[base + reg].i;
+        if (!handle) continue;
+        arrays[handle - 1].clear();
+        freeArrays.push_back((uint32_t)(handle - 1));
+    }
+}
+
+// Past the threshold: reports the function hot the first time, then runs it
+// in the tier once it is ready.
+bool VM::callTier(uint32_t function, uint32_t dst, uint32_t argc, Value* r) {
+    if (heat[function] == 0) tier->hot(function);
+    if (argc != program.functions[function].paramCount || !tier->ready(function)) return false;
+    size_t first = args.size() - argc;
+    Value result = tier->call(function, args.data() + first, globals, frames.size());
+    args.resize(first);
+    if (dst != noRegister) r[dst] = result;
+    return true;
+}
+
+// A hot loop: once the tier is ready, hands it the frame at the loop header.
+// Where it cannot take it, asks again threshold iterations later.
+bool VM::loopTier(uint32_t function, uint32_t pc, const Value* r, Value& result) {
+    if (heat[function] == 0) tier->hot(function);
+    if (!tier->ready(function)) return false;
+    if (tier->enterLoop(function, pc, r, arrays, globals, frames.size() - 1, result)) return true;
+    heat[function] = max(tierThreshold, 1u);
+    return false;
+}
+
+vector<Value>& VM::array(Value& handle) {
+    if (!handle.i) {
+        if (freeArrays.empty()) {
+            arrays.emplace_back();
+            handle.i = (int64_t)arrays.size();
+        } else {
+            handle.i = (int64_t)freeArrays.back() + 1;
+            freeArrays.pop_back();
+        }
+    }
+    return arrays[handle.i - 1];
+}
+
+template<bool profile>
+void VM::executeSwitch(uint32_t entry) {
+    VMCursor s{*this, nullptr, nullptr, nullptr, nullptr};
+    const VMInstr* pc = VMOps::start<VMInstr>(s, entry);
+    uint64_t count = 0;
+    try {
+        for (;;) {
+            count++;
+            if constexpr (profile) pcCounts[s.fn - program.functions.data()][pc - s.code]++;
+            switch (pc->op) {
+#define VM_CASE(name) case OpCode::name: pc = VMOps::step<OpCode::name>(s, pc); break;
+#define VM_RETURN(name) case OpCode::name: pc = VMOps::step<OpCode::name>(s, pc); if (!pc) goto done; break;
+                VM_OPCODES(VM_CASE, VM_RETURN)
+#undef VM_CASE
+#undef VM_RETURN
+            }
+        }
+    done:;
+    } catch (...) {
+        steps += count;
+        throw;
+    }
+    steps += count;
+}
+
+// Label addresses cannot be taken outside this function, so it also builds
+// the decoded stream on first use.
+void VM::executeThreaded(uint32_t entry) {
+#ifdef VM_COMPUTED_GOTO
+#define VM_LABEL(name) &&op_##name,
+    static const void* const labels[] = {VM_OPCODES(VM_LABEL, VM_LABEL)};
+#undef VM_LABEL
+    if (decoded.empty()) decoded = VMOps::decode(program, labels, nullptr);
+    VMCursor s{*this, nullptr, nullptr, nullptr, nullptr};
+    const DecodedInstr* pc = VMOps::start<DecodedInstr>(s, entry);
+    uint64_t count = 0;
+    try {
+#define VM_NEXT() do { count++; goto *pc->label; } while (0)
+        VM_NEXT();
+#define VM_OP(name) op_##name: pc = VMOps::step<OpCode::name>(s, pc); VM_NEXT();
+#define VM_RETURN(name) op_##name: pc = VMOps::step<OpCode::name>(s, pc); if (!pc) goto done; VM_NEXT();
+        VM_OPCODES(VM_OP, VM_RETURN)
+#undef VM_OP
+#undef VM_RETURN
+#undef VM_NEXT
+    done:;
+    } catch (...) {
+        steps += count;
+        throw;
+    }
+    steps += count;
+#else
+    executeSwitch<false>(entry);
+#endif
+}
+
+void VM::executeHandlers(uint32_t entry) {
+#define VM_HANDLER(name) &VMOps::handle<OpCode::name>,
+    static const VMHandler handlers[] = {VM_OPCODES(VM_HANDLER, VM_HANDLER)};
+#undef VM_HANDLER
+    if (decoded.empty()) decoded = VMOps::decode(program, nullptr, handlers);
+    VMCursor s{*this, nullptr, nullptr, nullptr, nullptr};
+    const DecodedInstr* pc = VMOps::start<DecodedInstr>(s, entry);
+    uint64_t count = 0;
+    try {
+        do {
+            count++;
+            pc = pc->handler(s, pc);
+        } while (pc);
+    } catch (...) {
+        steps += count;
+        throw;
+    }
+    steps += count;
+}
+
+void VM::addProfile(NGramProfile& profile) const {
+    const size_t opcodes = (size_t)OpCode::Arg2 + 1;
+    profile.unigrams.resize(opcodes, 0);
+    profile.immediates.resize(opcodes, 0);
+    for (size_t f = 0; f < pcCounts.size(); ++f) {
+        const VMFunction& fn = program.functions[f];
+        const auto& counts = pcCounts[f];
+        vector<uint8_t> target(fn.code.size() + 1, 0);
+        for (const auto& ins : fn.code) {
+            if (ins.op == OpCode::Jump) target[ins.a] = 1;
+            else if (ins.op == OpCode::JumpIf) target[ins.b] = 1;
+            else if (ins.op >= OpCode::JumpIfEqI && ins.op <= OpCode::JumpIfGeI) target[ins.c] = 1;
+        }
+        // Whether pc runs only straight after pc - 1.
+        auto follows = [&](size_t pc) {
+            if (pc == 0 || target[pc]) return false;
+            OpCode prev = fn.code[pc - 1].op;
+            return prev != OpCode::Jump && prev != OpCode::Call && prev != OpCode::Ret && prev != OpCode::RetVoid &&
+                   prev != OpCode::TailCall;
+        };
+        for (size_t pc = 0; pc < fn.code.size(); ++pc) {
+            uint64_t n = counts[pc];
+            if (!n) continue;
+            const VMInstr& ins = fn.code[pc];
+            profile.total += n;
+            profile.unigrams[(size_t)ins.op] += n;
+            auto constant = [&](uint32_t reg) { return reg >= fn.constantBase && reg < fn.constantBase + fn.constants.size(); };
+            if (ins.op >= OpCode::AddI && ins.op <= OpCode::NeS && (constant(ins.b) || constant(ins.c))) profile.immediates[(size_t)ins.op] += n;
+            if (!follows(pc)) continue;
+            profile.bigrams[NGramProfile::key(fn.code[pc - 1].op, ins.op)] += n;
+            if (follows(pc - 1)) profile.trigrams[NGramProfile::key(fn.code[pc - 2].op, fn.code[pc - 1].op, ins.op)] += n;
+        }
+    }
+}
+
+void VM::printGlobals(ostream& os) const {
+    const auto& values = globals.empty() ? program.globals : globals;
+    for (uint32_t g = 0; g < program.globalInfo.size(); ++g) {
+        const IRGlobal& global = program.globalInfo[g];
+        os << global.name << " = ";
+        switch (global.type.kind) {
+            case TypeKind::Float: os << values[g].f; break;
+            case TypeKind::String: os << text(values[g].s); break;
+            case TypeKind::Bool: os << (values[g].i ? "true" : "false"); break;
+            case TypeKind::Char: os << "'" << (char)values[g].i << "'"; break;
+            default: os << values[g].i; break;
+        }
+        os << "\n";
+    }
+}
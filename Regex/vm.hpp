@@ -0,0 +1,205 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <cstdint>
+#include <unordered_map>
+#include "ir.hpp"
+
+using namespace std;
+
+// Register-machine bytecode. Every operand is a register of the current
+// frame unless noted; a frame holds the function's locals, then its temps,
+// then its constants (copied in on entry), then two scratch registers used
+// to stage globals. Int, bool and char share the integer opcodes.
+enum class OpCode : uint8_t {
+    Move,         // a = b
+    LoadGlobal,   // a = globals[b]
+    StoreGlobal,  // globals[a] = b
+    NegI, NegF, Not, BitNot, IntToFloat,  // a = op b
+    AddI, SubI, MulI, DivI, ModI, Shl, Shr, BitAnd, BitOr, BitXor,  // a = b op c
+    AddF, SubF, MulF, DivF, ModF,
+    EqI, NeI, LtI, LeI, GtI, GeI,
+    EqF, NeF, LtF, LeF, GtF, GeF,
+    EqS, NeS,
+    Jump,         // pc = a
+    JumpIf,       // if a: pc = b
+    Arg,          // push a for the next call
+    Call,         // a = call function b with the last c arguments; a is noRegister for void calls
+    Ret,          // return a
+    RetVoid,
+    TailCall,     // Call, then return its result; the callee runs in this frame
+    LoadIndex,    // a = b[c]
+    StoreIndex,   // a[b] = c
+    // Superinstructions, formed from profiled sequences (see superinstr.hpp).
+    JumpIfEqI, JumpIfNeI, JumpIfLtI, JumpIfLeI, JumpIfGtI, JumpIfGeI,  // if a op b: pc = c
+    AddImm,        // a = b + c, with c a sign-extended 32-bit immediate
+    LoadIndexAdd,  // a = a + b[c]
+    Arg2,          // push a, then b
+};
+
+struct VMInstr {
+    OpCode op;
+    uint8_t reserved[3] = {0, 0, 0};
+    uint32_t a = 0, b = 0, c = 0;
+};
+static_assert(sizeof(VMInstr) == 16, "VMInstr must stay a 16-byte record");
+
+// One register. Strings point at text owned by the BytecodeProgram; arrays
+// hold a handle into the VM's array pool, 0 until first touched.
+union Value {
+    int64_t i;
+    double f;
+    const string* s;
+};
+
+struct VMFunction {
+    string name;
+    uint32_t paramCount = 0;
+    uint32_t constantBase = 0;  // first constant register
+    uint32_t registerCount = 0;
+    vector<Value> constants;    // copied to [constantBase, ...) on entry
+    vector<uint32_t> arrays;    // registers holding array handles
+    vector<VMInstr> code;
+    vector<pair<uint32_t, uint32_t>> labels;  // (pc, IR label id), by pc
+};
+
+struct BytecodeProgram {
+    vector<VMFunction> functions;
+    vector<Value> globals;  // initial values
+    vector<IRGlobal> globalInfo;
+    deque<string> strings;  // string constants; deque keeps them in place
+};
+
+static constexpr uint32_t noRegister = UINT32_MAX;
+
+// Lowers an IRProgram that is not in SSA form. Throws runtime_error on IR
+// the bytecode cannot express.
+BytecodeProgram compileBytecode(const IRProgram& ir);
+const char* opCodeName(OpCode op);
+void printBytecode(const BytecodeProgram& program, ostream& os);
+
+// Opcode n-grams of straight-line execution. An n-gram is counted each time
+// its last instruction runs right after the others, with no branch target
+// between them, so it is exactly how often a fused form would have run.
+struct NGramProfile {
+    uint64_t total = 0;
+    vector<uint64_t> unigrams;    // opcode -> executions
+    vector<uint64_t> immediates;  // binary opcode -> executions with a constant operand
+    unordered_map<uint32_t, uint64_t> bigrams, trigrams;  // opcodes packed 8 bits apart, first highest
+
+    static uint32_t key(OpCode a, OpCode b) { return (uint32_t)a << 8 | (uint32_t)b; }
+    static uint32_t key(OpCode a, OpCode b, OpCode c) { return (uint32_t)a << 16 | (uint32_t)b << 8 | (uint32_t)c; }
+};
+
+// How the VM finds the code for the next instruction. Switch decodes the
+// opcode byte in a loop; Threaded pre-decodes each function into label
+// addresses and jumps straight to the next handler with computed goto (GCC
+// and Clang; elsewhere it falls back to Switch); Handlers pre-decodes into
+// one function pointer per instruction called from a tight loop.
+enum class Dispatch { Switch, Threaded, Handlers };
+
+const char* dispatchName(Dispatch dispatch);
+
+struct VMCursor;
+struct DecodedInstr;
+using VMHandler = const DecodedInstr* (*)(VMCursor& cursor, const DecodedInstr* pc);
+
+// A pre-decoded instruction for the Threaded and Handlers dispatch modes.
+// Branch and call targets keep their bytecode pc; the streams line up
+// one to one.
+struct DecodedInstr {
+    union {
+        const void* label;
+        VMHandler handler;
+    };
+    uint32_t a, b, c;
+};
+
+// A faster tier that takes over hot functions (see tier.hpp). The VM counts
+// each function's entries and backward jumps; when the count reaches the
+// threshold given to VM::setTier it calls hot() once for that function. After
+// that, calls to the function and its backward jumps ask ready(); once it
+// says yes, calls go through call() and a running frame moves over at its
+// next backward jump through enterLoop().
+class VMTier {
+public:
+    virtual ~VMTier() = default;
+    virtual void hot(uint32_t function) = 0;
+    virtual bool ready(uint32_t function) = 0;
+    // Both run function to completion, reading and writing globals; depth is
+    // the number of VM frames below it. They throw runtime_error with the
+    // VM's message on a run-time error.
+    virtual Value call(uint32_t function, const Value* args, vector<Value>& globals, size_t depth) = 0;
+    // Continues from the loop header at pc with the frame's registers r,
+    // where an array register holds a handle into arrays (handle - 1, 0 for
+    // none). False, with nothing run, if the tier cannot enter there.
+    virtual bool enterLoop(uint32_t function, uint32_t pc, const Value* r, const vector<vector<Value>>& arrays,
+                           vector<Value>& globals, size_t depth, Value& result) = 0;
+};
+
+// Runs a BytecodeProgram on an explicit frame stack; calls do not recurse on
+// the C++ stack. Integer arithmetic wraps, arrays grow on store, and integer
+// division by zero, a negative index or too deep a call chain stop the run
+// with an error.
+class VM {
+public:
+    explicit VM(const BytecodeProgram& program, Dispatch dispatch = Dispatch::Threaded);
+
+    // Runs entry with no arguments; false on a run-time error.
+    bool run(const string& entry = "main");
+    const string& error() const { return errorMessage; }
+    uint64_t executed() const { return steps; }
+    void printGlobals(ostream& os) const;
+    static bool hasComputedGoto();
+
+    // While set, runs use the switch loop and count executions per pc;
+    // addProfile folds the counts of the last run into profile.
+    void setProfiling(bool on) { profiling = on; }
+    void addProfile(NGramProfile& profile) const;
+
+    // Hands functions to tier once they have been entered or looped threshold
+    // times; null turns it off. executed() counts interpreted instructions only.
+    void setTier(VMTier* tier, uint32_t threshold) {
+        this->tier = tier;
+        tierThreshold = threshold;
+    }
+
+private:
+    friend struct VMOps;
+
+    struct Frame {
+        uint32_t function;
+        uint32_t returnPc;
+        uint32_t dst;
+        size_t base;
+    };
+
+    const BytecodeProgram& program;
+    Dispatch dispatch;
+    vector<vector<DecodedInstr>> decoded;  // function -> instructions, built on the first run
+    vector<Value> globals;
+    vector<Value> stack;  // registers of all live frames
+    vector<Frame> frames;
+    vector<Value> args;
+    vector<vector<Value>> arrays;  // handle - 1 -> elements
+    vector<uint32_t> freeArrays;
+    uint64_t steps = 0;
+    string errorMessage;
+    bool profiling = false;
+    vector<vector<uint64_t>> pcCounts;  // function -> pc -> executions
+    VMTier* tier = nullptr;
+    uint32_t tierThreshold = 0;
+    vector<int64_t> heat;  // function -> entries and backward jumps left until hot
+
+    template<bool profile>
+    void executeSwitch(uint32_t entry);
+    void executeThreaded(uint32_t entry);
+    void executeHandlers(uint32_t entry);
+    size_t enter(const VMFunction& fn, size_t base, uint32_t argc);
+    void leave(const VMFunction& fn, size_t base);
+    vector<Value>& array(Value& handle);
+    bool callTier(uint32_t function, uint32_t dst, uint32_t argc, Value* r);
+    bool loopTier(uint32_t function, uint32_t pc, const Value* r, Value& result);
+};
@@ -0,0 +1,59 @@
+#include "workpool.hpp"
+#include <thread>
+#include <exception>
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount)
+    : workers(threadCount ? threadCount : 1) {}
+
+bool WorkStealingPool::popLocal(WorkQueue& q, size_t& out) {
+    lock_guard<mutex> g(q.lock);
+    if (q.tasks.empty()) return false;
+    out = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(vector<WorkQueue>& queues, unsigned thief, size_t& out) {
+    for (unsigned k = 1; k < queues.size(); ++k) {
+        WorkQueue& victim = queues[(thief + k) % queues.size()];
+        lock_guard<mutex> g(victim.lock);
+        if (victim.tasks.empty()) continue;
+        out = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t taskCount, const function<void(size_t)>& task) {
+    if (taskCount == 0) return;
+    unsigned n = workers;
+    if (n > taskCount) n = (unsigned)taskCount;
+    if (n <= 1) {
+        for (size_t t = 0; t < taskCount; ++t) task(t);
+        return;
+    }
+    vector<WorkQueue> queues(n);
+    for (size_t t = 0; t < taskCount; ++t) queues[t % n].tasks.push_front(t);
+
+    mutex errorLock;
+    exception_ptr firstError;
+    auto worker = [&](unsigned self) {
+        size_t t;
+        while (popLocal(queues[self], t) || steal(queues, self, t)) {
+            try {
+                task(t);
+            } catch (...) {
+                lock_guard<mutex> g(errorLock);
+                if (!firstError) firstError = current_exception();
+            }
+        }
+    };
+    vector<thread> threads;
+    for (unsigned w = 1; w < n; ++w) threads.emplace_back(worker, w);
+    worker(0);
+    for (auto& th : threads) th.join();
+    if (firstError) rethrow_exception(firstError);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <cstddef>
+
+using namespace std;
+
+// Runs tasks 0..n-1 on a fixed set of threads. Tasks are dealt round-robin
+// into per-worker deques; a worker pops from the back of its own deque and
+// steals from the front of the others once it runs dry.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threadCount);
+    unsigned threadCount() const { return workers; }
+    void run(size_t taskCount, const function<void(size_t)>& task);
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    unsigned workers;
+    bool popLocal(WorkQueue& q, size_t& out);
+    bool steal(vector<WorkQueue>& queues, unsigned thief, size_t& out);
+};
@@ -0,0 +1,800 @@
+#include "x86.hpp"
+#include <cstring>
+#include <stdexcept>
+#include "regalloc.hpp"
+
+using namespace std;
+
+static const char* const intArgRegs[] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+// Helpers every output file carries. __rt_elem returns the address of an
+// element of the array whose block pointer is in the slot at rdi, growing
+// the block (a length word, then the elements) with realloc.
+static const char* runtimeText = R"(    .text
+__rt_fail:
+    subq $8, %rsp
+    movq %rdx, %rcx
+    movq %rsi, %rdx
+    movq %rdi, %rsi
+    movq stderr@GOTPCREL(%rip), %rax
+    movq (%rax), %rdi
+    xorl %eax, %eax
+    call fprintf@PLT
+    movl $7, %edi
+    call exit@PLT
+__rt_streq:
+    subq $8, %rsp
+    leaq .Lrt_empty(%rip), %rax
+    testq %rdi, %rdi
+    cmovzq %rax, %rdi
+    testq %rsi, %rsi
+    cmovzq %rax, %rsi
+    call strcmp@PLT
+    testl %eax, %eax
+    sete %al
+    movzbl %al, %eax
+    addq $8, %rsp
+    ret
+__rt_elem:
+    testq %rsi, %rsi
+    js .Lrt_negative
+    cmpq $MAX_LENGTH, %rsi
+    jge .Lrt_range
+    movq (%rdi), %rax
+    testq %rax, %rax
+    jz .Lrt_grow
+    cmpq (%rax), %rsi
+    jge .Lrt_grow
+    leaq 8(%rax,%rsi,8), %rax
+    ret
+.Lrt_grow:
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    subq $8, %rsp
+    movq %rdi, %rbx
+    movq %rsi, %r12
+    movq (%rdi), %rdi
+    xorl %r13d, %r13d
+    testq %rdi, %rdi
+    jz 1f
+    movq (%rdi), %r13
+1:  leaq 1(%r12), %r14
+    leaq (%r13,%r13), %rax
+    cmpq %r14, %rax
+    cmovgq %rax, %r14
+    movq $MAX_LENGTH, %rax
+    cmpq %rax, %r14
+    cmovgq %rax, %r14
+    leaq 8(,%r14,8), %rsi
+    call realloc@PLT
+    movq %r14, (%rax)
+    movq %rax, (%rbx)
+    leaq 8(%rax,%r13,8), %rdi
+    xorl %esi, %esi
+    movq %r14, %rdx
+    subq %r13, %rdx
+    shlq $3, %rdx
+    call memset@PLT
+    movq (%rbx), %rax
+    leaq 8(%rax,%r12,8), %rax
+    addq $8, %rsp
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    ret
+.Lrt_negative:
+    leaq .Lrt_fmt_negative(%rip), %rdi
+    jmp __rt_fail
+.Lrt_range:
+    leaq .Lrt_fmt_range(%rip), %rdi
+    jmp __rt_fail
+    .section .rodata
+.Lrt_empty: .asciz ""
+.Lrt_true: .asciz "true"
+.Lrt_false: .asciz "false"
+.Lrt_fmt_negative: .asciz "Runtime error: negative array index %ld in %s\n"
+.Lrt_fmt_range: .asciz "Runtime error: array index %ld out of range in %s\n"
+.Lrt_fmt_div: .asciz "Runtime error: division by zero in %s\n"
+.Lrt_fmt_overflow: .asciz "Runtime error: @OVERFLOW@ in %s\n"
+    .bss
+__rt_depth: .zero 4
+)";
+
+string quoted(const string& text) {
+    string out = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 32 || c >= 127 || c == '?') {  // '?' so no trigraph forms
+            const char* digits = "01234567";
+            out += '\\';
+            out += digits[c >> 6];
+            out += digits[(c >> 3) & 7];
+            out += digits[c & 7];
+        } else {
+            out += (char)c;
+        }
+    }
+    return out + "\"";
+}
+
+static int64_t floatBits(double f) {
+    int64_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    return bits;
+}
+
+uint32_t stackArgumentWords(const IRProgram& ir) {
+    uint32_t most = 0;
+    for (const auto& fn : ir.functions) {
+        uint32_t ints = 0, floats = 0, stacked = 0;
+        for (uint32_t p = 0; p < fn.paramCount; ++p) {
+            bool f = isFloat(fn.vars[p].type);
+            stacked += f ? floats++ >= 8 : ints++ >= 6;
+        }
+        most = max(most, stacked);
+    }
+    return most + most % 2;
+}
+
+namespace {
+
+class FunctionEmitter {
+public:
+    FunctionEmitter(const IRProgram& ir, uint32_t index, uint32_t argumentWords, ostream& os)
+        : ir(ir), fn(ir.functions[index]), index(index), argumentWords(argumentWords), os(os) {}
+
+    void emit(X86Registers registers) {
+        if (fn.inSSA) throw runtime_error("cannot emit " + fn.name + " while it is in SSA form");
+        if (registers == X86Registers::LinearScan) {
+            allocation = allocateRegisters(fn);
+            alloc = &allocation;
+        }
+        layOutFrame();
+        prologue();
+        if (alloc) resolve(CFG::none, 0);
+        for (at = 0; at < fn.instructions.size(); ++at) {
+            const IRInstr& ins = fn.instructions[at];
+            instruction(ins);
+            if (!alloc) continue;
+            uint32_t b = block();
+            bool jumps = ins.op == IROp::Goto || ins.op == IROp::IfGoto || ins.op == IROp::Return || ins.op == IROp::ReturnVoid;
+            if (!jumps && at + 1 == alloc->cfg.blockStart[b + 1] && b + 1 < alloc->cfg.blockCount()) resolve(b, b + 1);
+        }
+        os << "    xorl %eax, %eax\n";
+        epilogue();
+    }
+
+private:
+    const IRProgram& ir;
+    const IRFunction& fn;
+    uint32_t index;
+    uint32_t argumentWords;  // see stackArgumentWords
+    ostream& os;
+    uint32_t argBase = 0;   // first outgoing-argument slot
+    uint32_t stashSlot = 0;
+    uint32_t saveBase = 0;  // slots for the callee-saved registers in use
+    uint32_t frameBytes = 0;
+    vector<uint32_t> arrays;  // locals used as arrays
+    uint32_t pending = 0;     // params emitted but not yet consumed by a call
+    RegisterAllocation allocation;
+    const RegisterAllocation* alloc = nullptr;  // null when everything is spilled
+    uint32_t at = 0;                            // current instruction
+
+    // A CFG edge whose spill moves need a block of their own.
+    struct EdgeStub {
+        string name, target;
+        uint32_t from, to;
+    };
+    vector<EdgeStub> stubs;
+
+    string label(Operand l) const { return ".L" + to_string(index) + "_" + to_string(l.index()); }
+    string local(const char* what) const { return string(".L") + what + to_string(index); }
+    string slot(uint32_t k) const { return to_string(-8 * (int64_t)(k + 1)) + "(%rbp)"; }
+
+    string home(Operand o) const {
+        switch (o.kind()) {
+            case OperandKind::Local: return slot(o.index());
+            case OperandKind::Temp: return slot((uint32_t)fn.vars.size() + o.index());
+            case OperandKind::Global: return "g_" + ir.globals[o.index()].name + "(%rip)";
+            default: throw runtime_error("operand has no home in " + fn.name);
+        }
+    }
+
+    uint32_t block() const { return alloc->cfg.blockOf(at); }
+
+    // Register holding o at the current instruction, or memory.
+    int regOf(Operand o) const {
+        if (!alloc) return RegisterAllocation::memory;
+        if (o.kind() == OperandKind::Local) return alloc->location(o.index(), at);
+        if (o.kind() == OperandKind::Temp) return alloc->location((uint32_t)fn.vars.size() + o.index(), at);
+        return RegisterAllocation::memory;
+    }
+
+    void move(const SpillMove& m) {
+        int reg = m.to == RegisterAllocation::memory ? m.from : m.to;
+        os << (isFloatRegister(reg) ? "    movsd " : "    movq ");
+        if (m.to == RegisterAllocation::memory) os << registerName(reg) << ", " << slot(m.value) << "\n";
+        else os << slot(m.value) << ", " << registerName(reg) << "\n";
+    }
+
+    void resolve(uint32_t from, uint32_t to) {
+        for (const auto& m : alloc->edgeMoves(from, to)) move(m);
+    }
+
+    // Where a jump to l from the current block should go: l itself, or a
+    // stub that first moves values to where l expects them.
+    string jumpTarget(Operand l) {
+        if (!alloc) return label(l);
+        uint32_t from = block(), to = alloc->cfg.blockOfLabel(l);
+        if (alloc->edgeMoves(from, to).empty()) return label(l);
+        string name = ".Le" + to_string(index) + "_" + to_string(stubs.size());
+        stubs.push_back({name, label(l), from, to});
+        return name;
+    }
+
+    void load(Operand o, const char* reg) {
+        switch (o.kind()) {
+            case OperandKind::Const: {
+                const IRConst& c = ir.constants[o.index()];
+                if (c.type.kind == TypeKind::String) {
+                    os << "    leaq .Lstr" << o.index() << "(%rip), " << reg << "\n";
+                    return;
+                }
+                int64_t v = isFloat(c.type) ? floatBits(c.floatValue) : c.intValue;
+                if (v >= INT32_MIN && v <= INT32_MAX) os << "    movq $" << v << ", " << reg << "\n";
+                else os << "    movabsq $" << v << ", " << reg << "\n";
+                return;
+            }
+            case OperandKind::Imm:
+                os << "    movq $" << o.index() << ", " << reg << "\n";
+                return;
+            default: {
+                int r = regOf(o);
+                if (r == RegisterAllocation::memory) os << "    movq " << home(o) << ", " << reg << "\n";
+                else if (strcmp(registerName(r), reg) != 0) os << "    movq " << registerName(r) << ", " << reg << "\n";
+                return;
+            }
+        }
+    }
+
+    void store(Operand o, const char* reg) {
+        int r = regOf(o);
+        if (r == RegisterAllocation::memory) os << "    movq " << reg << ", " << home(o) << "\n";
+        else if (strcmp(registerName(r), reg) != 0) os << "    movq " << reg << ", " << registerName(r) << "\n";
+    }
+
+    // o as the source operand of an integer instruction: an immediate, a
+    // register or memory. Anything else is loaded into rcx.
+    string source(Operand o) {
+        if (o.kind() == OperandKind::Const) {
+            const IRConst& c = ir.constants[o.index()];
+            if (c.type.kind != TypeKind::String && !isFloat(c.type) && c.intValue >= INT32_MIN && c.intValue <= INT32_MAX) {
+                return "$" + to_string(c.intValue);
+            }
+        } else {
+            int r = regOf(o);
+            if (r == RegisterAllocation::memory) return home(o);
+            if (!isFloatRegister(r)) return registerName(r);
+        }
+        load(o, "%rcx");
+        return "%rcx";
+    }
+
+    void loadFloat(Operand o, const char* xmm) {
+        if (o.kind() == OperandKind::Const && isFloat(ir.constants[o.index()].type)) {
+            os << "    movsd .Lflt" << o.index() << "(%rip), " << xmm << "\n";
+            return;
+        }
+        int r = regOf(o);
+        if (o.kind() == OperandKind::Const || o.kind() == OperandKind::Imm) {
+            load(o, "%rax");
+            os << "    movq %rax, " << xmm << "\n";
+        } else if (r == RegisterAllocation::memory) {
+            os << "    movsd " << home(o) << ", " << xmm << "\n";
+        } else if (!isFloatRegister(r)) {
+            os << "    movq " << registerName(r) << ", " << xmm << "\n";
+        } else if (strcmp(registerName(r), xmm) != 0) {
+            os << "    movapd " << registerName(r) << ", " << xmm << "\n";
+        }
+    }
+
+    // o as the source operand of an SSE instruction; loaded into xmm1 when
+    // it is in a general register.
+    string floatSource(Operand o) {
+        if (o.kind() == OperandKind::Const && isFloat(ir.constants[o.index()].type)) return ".Lflt" + to_string(o.index()) + "(%rip)";
+        if (o.kind() != OperandKind::Const) {
+            int r = regOf(o);
+            if (r == RegisterAllocation::memory) return home(o);
+            if (isFloatRegister(r)) return registerName(r);
+        }
+        loadFloat(o, "%xmm1");
+        return "%xmm1";
+    }
+
+    void storeFloat(Operand o, const char* xmm) {
+        int r = regOf(o);
+        if (r == RegisterAllocation::memory) os << "    movsd " << xmm << ", " << home(o) << "\n";
+        else if (!isFloatRegister(r)) os << "    movq " << xmm << ", " << registerName(r) << "\n";
+        else if (strcmp(registerName(r), xmm) != 0) os << "    movapd " << xmm << ", " << registerName(r) << "\n";
+    }
+
+    void layOutFrame() {
+        vector<uint8_t> isArray(fn.vars.size(), 0);
+        uint32_t depth = 0, maxDepth = 0;
+        for (const auto& ins : fn.instructions) {
+            if (ins.op == IROp::IndexLoad) isArray[ins.a.index()] = 1;
+            if (ins.op == IROp::IndexStore) isArray[ins.dst.index()] = 1;
+            if (ins.op == IROp::Param) maxDepth = max(maxDepth, ++depth);
+            if (ins.op == IROp::Call) depth -= min(depth, ins.b.index());
+        }
+        for (uint32_t v = 0; v < fn.vars.size(); ++v) {
+            if (isArray[v]) arrays.push_back(v);
+        }
+        argBase = (uint32_t)fn.vars.size() + fn.tempCount;
+        stashSlot = argBase + maxDepth;
+        saveBase = stashSlot + 1;
+        uint32_t saved = alloc ? (uint32_t)__builtin_popcount(alloc->calleeSaved) : 0;
+        frameBytes = (8 * (saveBase + saved) + 15) / 16 * 16;
+    }
+
+    void prologue() {
+        os << "fn_" << fn.name << ":\n"
+           << "    pushq %rbp\n"
+           << "    movq %rsp, %rbp\n"
+           << "    subq $" << frameBytes << ", %rsp\n"
+           << "    incl __rt_depth(%rip)\n";
+        saveRegisters(true);
+        uint32_t ints = 0, floats = 0, stacked = 0;
+        for (uint32_t p = 0; p < fn.paramCount; ++p) {
+            if (isFloat(fn.vars[p].type) && floats < 8) {
+                os << "    movq %xmm" << floats++ << ", " << slot(p) << "\n";
+            } else if (!isFloat(fn.vars[p].type) && ints < 6) {
+                os << "    movq " << intArgRegs[ints++] << ", " << slot(p) << "\n";
+            } else {
+                os << "    movq " << 16 + 8 * stacked++ << "(%rbp), %rax\n"
+                   << "    movq %rax, " << slot(p) << "\n";
+            }
+        }
+        uint32_t zeroed = stashSlot + 1 - fn.paramCount;
+        if (zeroed) {
+            os << "    leaq " << slot(stashSlot) << ", %rdi\n"
+               << "    movl $" << zeroed << ", %ecx\n"
+               << "    xorl %eax, %eax\n"
+               << "    rep stosq\n";
+        }
+    }
+
+    void saveRegisters(bool save) {
+        if (!alloc) return;
+        uint32_t k = saveBase;
+        for (int r = 0; r < firstCallerSaved; ++r) {
+            if (!(alloc->calleeSaved >> r & 1)) continue;
+            if (save) os << "    movq " << registerName(r) << ", " << slot(k++) << "\n";
+            else os << "    movq " << slot(k++) << ", " << registerName(r) << "\n";
+        }
+    }
+
+    void epilogue() {
+        os << local("ret") << ":\n";
+        if (!arrays.empty()) {
+            os << "    movq %rax, " << slot(stashSlot) << "\n";
+            for (uint32_t v : arrays) {
+                os << "    movq " << slot(v) << ", %rdi\n"
+                   << "    call free@PLT\n";
+            }
+            os << "    movq " << slot(stashSlot) << ", %rax\n";
+        }
+        saveRegisters(false);
+        os << "    decl __rt_depth(%rip)\n"
+           << "    movq %rax, %xmm0\n"
+           << "    leave\n"
+           << "    ret\n"
+           << local("divzero") << ":\n"
+           << "    leaq .Lrt_fmt_div(%rip), %rdi\n"
+           << "    leaq .Lname" << index << "(%rip), %rsi\n"
+           << "    call __rt_fail\n"
+           << local("overflow") << ":\n"
+           << "    leaq .Lrt_fmt_overflow(%rip), %rdi\n"
+           << "    leaq .Lname" << index << "(%rip), %rsi\n"
+           << "    call __rt_fail\n";
+        for (const auto& stub : stubs) {
+            os << stub.name << ":\n";
+            resolve(stub.from, stub.to);
+            os << "    jmp " << stub.target << "\n";
+        }
+    }
+
+    void call(const IRInstr& ins) {
+        const IRFunction& callee = ir.functions[ins.a.index()];
+        uint32_t argc = ins.b.index();
+        uint32_t first = pending - argc;
+        pending = first;
+        vector<uint32_t> stacked;
+        uint32_t ints = 0, floats = 0;
+        vector<pair<uint32_t, string>> inRegs;
+        for (uint32_t i = 0; i < argc; ++i) {
+            bool f = i < callee.paramCount && isFloat(callee.vars[i].type);
+            if (f && floats < 8) inRegs.push_back({argBase + first + i, "%xmm" + to_string(floats++)});
+            else if (!f && ints < 6) inRegs.push_back({argBase + first + i, intArgRegs[ints++]});
+            else stacked.push_back(argBase + first + i);
+        }
+        // Tail call: this frame goes first and the callee returns straight to
+        // our caller. Its stacked arguments take our incoming slots, which
+        // every caller reserves (argumentWords of them).
+        if (isTailCall(fn, at)) {
+            for (uint32_t v : arrays) {
+                os << "    movq " << slot(v) << ", %rdi\n"
+                   << "    call free@PLT\n";
+            }
+            for (size_t k = 0; k < stacked.size(); ++k) {
+                os << "    movq " << slot(stacked[k]) << ", %rax\n"
+                   << "    movq %rax, " << 16 + 8 * k << "(%rbp)\n";
+            }
+            for (const auto& r : inRegs) os << "    movq " << slot(r.first) << ", " << r.second << "\n";
+            saveRegisters(false);
+            os << "    decl __rt_depth(%rip)\n"
+               << "    leave\n"
+               << "    jmp fn_" << callee.name << "\n";
+            return;
+        }
+        os << "    cmpl $" << maxCallDepth << ", __rt_depth(%rip)\n"
+           << "    jae " << local("overflow") << "\n";
+        if (argumentWords > stacked.size()) os << "    subq $" << 8 * (argumentWords - stacked.size()) << ", %rsp\n";
+        for (size_t k = stacked.size(); k-- > 0;) os << "    pushq " << slot(stacked[k]) << "\n";
+        for (const auto& r : inRegs) os << "    movq " << slot(r.first) << ", " << r.second << "\n";
+        os << "    call fn_" << callee.name << "\n";
+        if (argumentWords) os << "    addq $" << 8 * argumentWords << ", %rsp\n";
+        if (ins.dst.isNone()) return;
+        if (isFloat(ins.type)) storeFloat(ins.dst, "%xmm0");
+        else store(ins.dst, "%rax");
+    }
+
+    void element(Operand array, Operand index) {
+        os << "    leaq " << home(array) << ", %rdi\n";
+        load(index, "%rsi");
+        os << "    leaq .Lname" << this->index << "(%rip), %rdx\n"
+           << "    call __rt_elem\n";
+    }
+
+    void floatBinary(const IRInstr& ins) {
+        const char* arithmetic = nullptr;
+        switch (ins.op) {
+            case IROp::Add: arithmetic = "addsd"; break;
+            case IROp::Sub: arithmetic = "subsd"; break;
+            case IROp::Mul: arithmetic = "mulsd"; break;
+            case IROp::Div: arithmetic = "divsd"; break;
+            case IROp::Mod:
+                loadFloat(ins.a, "%xmm0");
+                loadFloat(ins.b, "%xmm1");
+                os << "    call fmod@PLT\n";
+                storeFloat(ins.dst, "%xmm0");
+                return;
+            default: break;
+        }
+        if (arithmetic) {
+            int d = regOf(ins.dst);
+            bool direct = d != RegisterAllocation::memory && isFloatRegister(d) && regOf(ins.b) != d;
+            const char* acc = direct ? registerName(d) : "%xmm0";
+            loadFloat(ins.a, acc);
+            string b = floatSource(ins.b);
+            os << "    " << arithmetic << " " << b << ", " << acc << "\n";
+            storeFloat(ins.dst, acc);
+            return;
+        }
+        // a < b is compared as b > a, so every test reads "above".
+        bool swapped = ins.op == IROp::Lt || ins.op == IROp::Le;
+        loadFloat(swapped ? ins.b : ins.a, "%xmm0");
+        string other = floatSource(swapped ? ins.a : ins.b);
+        os << "    ucomisd " << other << ", %xmm0\n";
+        switch (ins.op) {
+            case IROp::Eq: os << "    sete %al\n    setnp %cl\n    andb %cl, %al\n"; break;
+            case IROp::Neq: os << "    setne %al\n    setp %cl\n    orb %cl, %al\n"; break;
+            case IROp::Lt: case IROp::Gt: os << "    seta %al\n"; break;
+            case IROp::Le: case IROp::Ge: os << "    setae %al\n"; break;
+            default: throw runtime_error(string("no float form of ") + irOpName(ins.op));
+        }
+        os << "    movzbl %al, %eax\n";
+        store(ins.dst, "%rax");
+    }
+
+    void intBinary(const IRInstr& ins) {
+        static const char* const setcc[] = {"sete", "setne", "setl", "setle", "setg", "setge"};
+        const char* arithmetic = nullptr;
+        switch (ins.op) {
+            case IROp::Add: arithmetic = "addq"; break;
+            case IROp::Sub: arithmetic = "subq"; break;
+            case IROp::Mul: arithmetic = "imulq"; break;
+            case IROp::BitAnd: case IROp::And: arithmetic = "andq"; break;
+            case IROp::BitOr: case IROp::Or: arithmetic = "orq"; break;
+            case IROp::BitXor: arithmetic = "xorq"; break;
+            default: break;
+        }
+        if (arithmetic) {
+            // Computed in place when dst has a register b is not in.
+            int d = regOf(ins.dst);
+            bool direct = d != RegisterAllocation::memory && !isFloatRegister(d) && regOf(ins.b) != d;
+            const char* acc = direct ? registerName(d) : "%rax";
+            load(ins.a, acc);
+            string b = source(ins.b);
+            os << "    " << arithmetic << " " << b << ", " << acc << "\n";
+            store(ins.dst, acc);
+            return;
+        }
+        load(ins.a, "%rax");
+        switch (ins.op) {
+            case IROp::Div:
+            case IROp::Mod:
+                load(ins.b, "%rcx");
+                // idiv faults on INT64_MIN / -1, which wraps here.
+                os << "    testq %rcx, %rcx\n"
+                   << "    jz " << local("divzero") << "\n"
+                   << "    cmpq $-1, %rcx\n"
+                   << "    jne 1f\n"
+                   << (ins.op == IROp::Div ? "    negq %rax\n" : "    xorl %eax, %eax\n")
+                   << "    jmp 2f\n"
+                   << "1:  cqto\n"
+                   << "    idivq %rcx\n"
+                   << (ins.op == IROp::Mod ? "    movq %rdx, %rax\n" : "")
+                   << "2:\n";
+                break;
+            case IROp::Shl:
+            case IROp::Shr:
+                load(ins.b, "%rcx");
+                os << (ins.op == IROp::Shl ? "    shlq %cl, %rax\n" : "    sarq %cl, %rax\n");
+                break;
+            default: {
+                string b = source(ins.b);
+                os << "    cmpq " << b << ", %rax\n"
+                   << "    " << setcc[(size_t)ins.op - (size_t)IROp::Eq] << " %al\n"
+                   << "    movzbl %al, %eax\n";
+                break;
+            }
+        }
+        store(ins.dst, "%rax");
+    }
+
+    void copy(const IRInstr& ins) {
+        int d = regOf(ins.dst), a = regOf(ins.a);
+        if (d != RegisterAllocation::memory && isFloatRegister(d)) {
+            loadFloat(ins.a, registerName(d));
+        } else if (d != RegisterAllocation::memory) {
+            load(ins.a, registerName(d));
+        } else if (a != RegisterAllocation::memory && isFloatRegister(a)) {
+            storeFloat(ins.dst, registerName(a));
+        } else {
+            load(ins.a, "%rax");
+            store(ins.dst, "%rax");
+        }
+    }
+
+    void instruction(const IRInstr& ins) {
+        switch (ins.op) {
+            case IROp::Label:
+                os << label(ins.a) << ":\n";
+                return;
+            case IROp::Goto:
+                if (alloc) resolve(block(), alloc->cfg.blockOfLabel(ins.a));
+                os << "    jmp " << label(ins.a) << "\n";
+                return;
+            case IROp::IfGoto: {
+                int r = regOf(ins.a);
+                if (r != RegisterAllocation::memory) {
+                    os << "    testq " << registerName(r) << ", " << registerName(r) << "\n";
+                } else if (ins.a.kind() == OperandKind::Const) {
+                    load(ins.a, "%rax");
+                    os << "    testq %rax, %rax\n";
+                } else {
+                    os << "    cmpq $0, " << home(ins.a) << "\n";
+                }
+                os << "    jnz " << jumpTarget(ins.b) << "\n";
+                uint32_t b = alloc ? block() : 0;
+                if (alloc && b + 1 < alloc->cfg.blockCount()) resolve(b, b + 1);
+                return;
+            }
+            case IROp::Copy:
+            case IROp::Pos:
+                copy(ins);
+                return;
+            case IROp::Neg:
+                load(ins.a, "%rax");
+                os << (isFloat(ins.opType) ? "    btcq $63, %rax\n" : "    negq %rax\n");
+                store(ins.dst, "%rax");
+                return;
+            case IROp::Not:
+                load(ins.a, "%rax");
+                os << "    testq %rax, %rax\n    sete %al\n    movzbl %al, %eax\n";
+                store(ins.dst, "%rax");
+                return;
+            case IROp::BitNot:
+                load(ins.a, "%rax");
+                os << "    notq %rax\n";
+                store(ins.dst, "%rax");
+                return;
+            case IROp::IntToFloat:
+                load(ins.a, "%rax");
+                os << "    cvtsi2sdq %rax, %xmm0\n";
+                storeFloat(ins.dst, "%xmm0");
+                return;
+            case IROp::Param: {
+                int r = regOf(ins.a);
+                if (r == RegisterAllocation::memory) {
+                    load(ins.a, "%rax");
+                    os << "    movq %rax, " << slot(argBase + pending++) << "\n";
+                } else {
+                    os << (isFloatRegister(r) ? "    movsd " : "    movq ") << registerName(r) << ", " << slot(argBase + pending++) << "\n";
+                }
+                return;
+            }
+            case IROp::Call:
+                call(ins);
+                return;
+            case IROp::Return:
+                load(ins.a, "%rax");
+                os << "    jmp " << local("ret") << "\n";
+                return;
+            case IROp::ReturnVoid:
+                os << "    xorl %eax, %eax\n"
+                   << "    jmp " << local("ret") << "\n";
+                return;
+            case IROp::IndexLoad: {
+                element(ins.a, ins.b);
+                int d = regOf(ins.dst);
+                if (d == RegisterAllocation::memory) {
+                    os << "    movq (%rax), %rax\n";
+                    store(ins.dst, "%rax");
+                } else {
+                    os << (isFloatRegister(d) ? "    movsd" : "    movq") << " (%rax), " << registerName(d) << "\n";
+                }
+                return;
+            }
+            case IROp::IndexStore: {
+                element(ins.dst, ins.a);
+                int r = regOf(ins.b);
+                if (r != RegisterAllocation::memory && !isFloatRegister(r)) {
+                    os << "    movq " << registerName(r) << ", (%rax)\n";
+                } else {
+                    load(ins.b, "%rcx");
+                    os << "    movq %rcx, (%rax)\n";
+                }
+                return;
+            }
+            case IROp::Phi:
+                throw runtime_error("phi outside SSA form in " + fn.name);
+            default:
+                break;
+        }
+        if (!isBinaryOp(ins.op)) throw runtime_error(string("cannot emit ") + irOpName(ins.op));
+        if (ins.opType.kind == TypeKind::String) {
+            load(ins.a, "%rdi");
+            load(ins.b, "%rsi");
+            os << "    call __rt_streq\n";
+            if (ins.op == IROp::Neq) os << "    xorl $1, %eax\n";
+            store(ins.dst, "%rax");
+        } else if (isFloat(ins.opType)) {
+            floatBinary(ins);
+        } else {
+            intBinary(ins);
+        }
+    }
+};
+
+}  // namespace
+
+static void emitMain(const IRProgram& ir, ostream& os) {
+    const uint64_t stackBytes = uint64_t(1) << 30;
+    os << "    .globl main\n"
+       << "main:\n"
+       << "    pushq %rbp\n"
+       << "    movq %rsp, %rbp\n"
+       << "    pushq %rbx\n"
+       << "    subq $8, %rsp\n"
+       << "    movq %rsp, %rbx\n";
+    for (const auto& fn : ir.functions) {
+        if (fn.name != "main") continue;
+        // mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+        os << "    xorl %edi, %edi\n"
+           << "    movabsq $" << stackBytes << ", %rsi\n"
+           << "    movl $3, %edx\n"
+           << "    movl $0x4022, %ecx\n"
+           << "    movl $-1, %r8d\n"
+           << "    xorl %r9d, %r9d\n"
+           << "    call mmap@PLT\n"
+           << "    cmpq $-1, %rax\n"
+           << "    je 1f\n"
+           << "    movabsq $" << stackBytes << ", %rcx\n"
+           << "    leaq (%rax,%rcx), %rsp\n"
+           << "1:\n";
+        // Incoming slots for main too, which a tail call from main may fill.
+        if (uint32_t words = stackArgumentWords(ir)) os << "    subq $" << 8 * words << ", %rsp\n";
+        os << "    call fn_main\n"
+           << "    movq %rbx, %rsp\n";
+        break;
+    }
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        const IRGlobal& global = ir.globals[g];
+        string value = "g_" + global.name + "(%rip)";
+        os << "    leaq .Lfmt" << g << "(%rip), %rdi\n";
+        switch (global.type.kind) {
+            case TypeKind::Float:
+                os << "    movq " << value << ", %xmm0\n"
+                   << "    movl $1, %eax\n";
+                break;
+            case TypeKind::Bool:
+                os << "    leaq .Lrt_true(%rip), %rsi\n"
+                   << "    leaq .Lrt_false(%rip), %rcx\n"
+                   << "    cmpq $0, " << value << "\n"
+                   << "    cmovzq %rcx, %rsi\n"
+                   << "    xorl %eax, %eax\n";
+                break;
+            case TypeKind::String:
+                os << "    movq " << value << ", %rsi\n"
+                   << "    leaq .Lrt_empty(%rip), %rcx\n"
+                   << "    testq %rsi, %rsi\n"
+                   << "    cmovzq %rcx, %rsi\n"
+                   << "    xorl %eax, %eax\n";
+                break;
+            default:
+                os << "    movq " << value << ", %rsi\n"
+                   << "    xorl %eax, %eax\n";
+                break;
+        }
+        os << "    call printf@PLT\n";
+    }
+    os << "    xorl %eax, %eax\n"
+       << "    addq $8, %rsp\n"
+       << "    popq %rbx\n"
+       << "    popq %rbp\n"
+       << "    ret\n";
+}
+
+void emitX86(const IRProgram& ir, ostream& os, X86Registers registers) {
+    os << "    .text\n";
+    uint32_t argumentWords = stackArgumentWords(ir);
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) FunctionEmitter(ir, f, argumentWords, os).emit(registers);
+    emitMain(ir, os);
+
+    os << "    .data\n"
+       << "    .p2align 3\n";
+    for (const auto& g : ir.globals) {
+        os << "g_" << g.name << ": ";
+        if (g.init.isNone()) {
+            os << ".quad 0\n";
+            continue;
+        }
+        const IRConst& c = ir.constants[g.init.index()];
+        if (c.type.kind == TypeKind::String) os << ".quad .Lstr" << g.init.index() << "\n";
+        else os << ".quad " << (isFloat(c.type) ? floatBits(c.floatValue) : c.intValue) << "\n";
+    }
+
+    os << "    .section .rodata\n";
+    for (uint32_t k = 0; k < ir.constants.size(); ++k) {
+        if (ir.constants[k].type.kind == TypeKind::String) os << ".Lstr" << k << ": .asciz " << quoted(ir.constants[k].text) << "\n";
+    }
+    os << "    .p2align 3\n";
+    for (uint32_t k = 0; k < ir.constants.size(); ++k) {
+        if (isFloat(ir.constants[k].type)) os << ".Lflt" << k << ": .quad " << floatBits(ir.constants[k].floatValue) << "\n";
+    }
+    for (uint32_t f = 0; f < ir.functions.size(); ++f) os << ".Lname" << f << ": .asciz " << quoted(ir.functions[f].name) << "\n";
+    for (uint32_t g = 0; g < ir.globals.size(); ++g) {
+        const IRGlobal& global = ir.globals[g];
+        const char* conversion = "%ld";
+        switch (global.type.kind) {
+            case TypeKind::Float: conversion = "%g"; break;
+            case TypeKind::Bool: case TypeKind::String: conversion = "%s"; break;
+            case TypeKind::Char: conversion = "'%c'"; break;
+            default: break;
+        }
+        os << ".Lfmt" << g << ": .asciz " << quoted(global.name + " = " + conversion + "\n") << "\n";
+    }
+
+    string runtime = runtimeText;
+    for (size_t at; (at = runtime.find("MAX_LENGTH")) != string::npos;) runtime.replace(at, 10, to_string(maxArrayLength));
+    runtime.replace(runtime.find("@OVERFLOW@"), 10, callStackOverflow);
+    os << runtime
+       << "    .section .note.GNU-stack,\"\",@progbits\n";
+}
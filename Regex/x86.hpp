@@ -0,0 +1,40 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "ir.hpp"
+
+using namespace std;
+
+// How locals and temporaries are kept: all in stack slots, or in registers
+// chosen by allocateRegisters (regalloc.hpp) with the rest in their slots.
+enum class X86Registers { AllSpill, LinearScan };
+
+// x86-64 System V assembly (AT&T syntax, for the GNU assembler) for an
+// IRProgram that is not in SSA form. Every local and temporary has a stack
+// slot; int, bool, char and string values pass through general registers and
+// floats through SSE. Calls follow the System V convention:
+// six integer and eight float argument registers, the rest on the stack,
+// results in rax or xmm0. Every call reserves stackArgumentWords words for
+// stacked arguments, so a tail call (see isTailCall) can always free the
+// caller's arrays, put its arguments in the caller's incoming slots, unwind
+// and jump: tail calls run in constant stack, as in the VM.
+//
+// The output defines `main`, which runs the program's main on a private
+// 1 GiB stack and then prints the globals the way VM::printGlobals does.
+// Run-time errors print "Runtime error: ... in <function>" to stderr and exit
+// with 7, as the driver's --run does; after inlining, the function is the
+// one the failing code was inlined into. Build it with the C library and libm:
+//     cc out.s -o prog -lm
+// Throws runtime_error on IR it cannot express.
+void emitX86(const IRProgram& ir, ostream& os, X86Registers registers = X86Registers::LinearScan);
+
+// The words below the return address every call in ir reserves for
+// arguments passed on the stack: the most any function takes, rounded up to
+// keep rsp 16-byte aligned. Shared with the JIT, which uses the same frames.
+uint32_t stackArgumentWords(const IRProgram& ir);
+
+// text as a double-quoted string literal that both the GNU assembler and a C
+// compiler read back unchanged: quotes and backslashes escaped, anything
+// unprintable (and '?', so no trigraphs) as a three-digit octal escape.
+// Shared with the C backend.
+string quoted(const string& text);